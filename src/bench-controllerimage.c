@@ -0,0 +1,680 @@
+/*
+ * ControllerImage; A simple way to obtain game controller images.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ *  This file written by Ryan C. Gordon.
+ */
+
+// This runs the library through its paces and reports how long things take
+//  (median and 99th percentile per operation) and how many allocations each
+//  operation makes, optionally as JSON so CI can track it across versions.
+//
+// Run it from a directory with controllerimage-standard.bin and
+//  controllerimage-kenney.bin in it (what make-controllerimage-data produces),
+//  and point it at the art directory so it knows what device types to try.
+//  It also rasterizes the gradient-heavy test art in test/art/gradients, since
+//  the shipping art doesn't lean on gradients enough to measure them, and
+//  prints a checksum of the results, so you can tell if the output changed.
+//  It also parses every raw SVG in the art directory on its own, which is the
+//  number to watch when working on the parser.
+//  And it times flushing a batch full of redundant requests, the way a HUD
+//  would, once when nothing is rendered yet and once when everything is.
+
+#include <stdio.h>
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h>
+#include "controllerimage.h"
+
+// we call into the library's copy of nanosvg directly to time parsing on its own.
+#define NANOSVG_SKIP_STDC_HEADERS 1
+#define NANOSVG_SKIP_STDIO 1
+#include "nanosvg.h"
+#include "nanosvgrast.h"
+
+typedef struct Stage
+{
+    char name[64];
+    int num_samples;
+    int allocated_samples;
+    Uint64 *samples;  // nanoseconds per operation.
+    Uint64 allocations;  // total over all samples.
+    Uint64 allocated_bytes;
+    double median_ns;
+    double p99_ns;
+    double mean_ns;
+    double min_ns;
+    double max_ns;
+} Stage;
+
+static SDL_malloc_func original_malloc = NULL;
+static SDL_calloc_func original_calloc = NULL;
+static SDL_realloc_func original_realloc = NULL;
+static SDL_free_func original_free = NULL;
+static SDL_AtomicInt num_allocations;
+static SDL_AtomicInt num_allocated_bytes;
+
+static Stage stages[16];
+static int num_stages = 0;
+static char **device_types = NULL;
+static int num_device_types = 0;
+static int iterations = 5;
+static const int sizes[] = { 16, 32, 64, 128, 256, 512 };
+static const int gradient_sizes[] = { 64, 256 };
+static int num_gradient_images = 0;
+static Uint64 gradient_checksum = 0;
+static int num_art_svgs = 0;
+static Uint64 art_svg_bytes = 0;
+
+static void * SDLCALL counting_malloc(size_t size)
+{
+    SDL_AddAtomicInt(&num_allocations, 1);
+    SDL_AddAtomicInt(&num_allocated_bytes, (int) size);
+    return original_malloc(size);
+}
+
+static void * SDLCALL counting_calloc(size_t nmemb, size_t size)
+{
+    SDL_AddAtomicInt(&num_allocations, 1);
+    SDL_AddAtomicInt(&num_allocated_bytes, (int) (nmemb * size));
+    return original_calloc(nmemb, size);
+}
+
+static void * SDLCALL counting_realloc(void *mem, size_t size)
+{
+    SDL_AddAtomicInt(&num_allocations, 1);
+    SDL_AddAtomicInt(&num_allocated_bytes, (int) size);
+    return original_realloc(mem, size);
+}
+
+static void SDLCALL counting_free(void *mem)
+{
+    original_free(mem);
+}
+
+static Stage *get_stage(const char *name)
+{
+    for (int i = 0; i < num_stages; i++) {
+        if (SDL_strcmp(stages[i].name, name) == 0) {
+            return &stages[i];
+        }
+    }
+
+    if (num_stages >= (int) SDL_arraysize(stages)) {
+        return NULL;  // end_sample() will ignore this stage.
+    }
+
+    Stage *stage = &stages[num_stages++];
+    SDL_zerop(stage);
+    SDL_strlcpy(stage->name, name, sizeof (stage->name));
+    return stage;
+}
+
+// call this right before the thing being timed; pass the result to end_sample() right after it.
+static Uint64 begin_sample(void)
+{
+    SDL_SetAtomicInt(&num_allocations, 0);
+    SDL_SetAtomicInt(&num_allocated_bytes, 0);
+    return SDL_GetPerformanceCounter();
+}
+
+static void end_sample(Stage *stage, Uint64 start)
+{
+    const Uint64 now = SDL_GetPerformanceCounter();
+    const int allocations = SDL_GetAtomicInt(&num_allocations);
+    const int allocated_bytes = SDL_GetAtomicInt(&num_allocated_bytes);
+
+    if (!stage) {
+        return;
+    }
+
+    if (stage->num_samples >= stage->allocated_samples) {
+        const int newlen = stage->allocated_samples ? (stage->allocated_samples * 2) : 256;
+        void *ptr = SDL_realloc(stage->samples, newlen * sizeof (Uint64));
+        if (!ptr) {
+            return;
+        }
+        stage->samples = (Uint64 *) ptr;
+        stage->allocated_samples = newlen;
+    }
+
+    stage->samples[stage->num_samples++] = ((now - start) * SDL_NS_PER_SECOND) / SDL_GetPerformanceFrequency();
+    stage->allocations += (Uint64) allocations;
+    stage->allocated_bytes += (Uint64) allocated_bytes;
+}
+
+static int SDLCALL compare_samples(const void *a, const void *b)
+{
+    const Uint64 x = *((const Uint64 *) a);
+    const Uint64 y = *((const Uint64 *) b);
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+static void finish_stage(Stage *stage)
+{
+    const int total = stage->num_samples;
+    if (total == 0) {
+        return;
+    }
+
+    SDL_qsort(stage->samples, total, sizeof (Uint64), compare_samples);
+
+    double sum = 0.0;
+    for (int i = 0; i < total; i++) {
+        sum += (double) stage->samples[i];
+    }
+
+    stage->mean_ns = sum / total;
+    stage->min_ns = (double) stage->samples[0];
+    stage->max_ns = (double) stage->samples[total - 1];
+    stage->median_ns = (total & 1) ? (double) stage->samples[total / 2] : (((double) stage->samples[(total / 2) - 1]) + ((double) stage->samples[total / 2])) / 2.0;
+    stage->p99_ns = (double) stage->samples[SDL_min(total - 1, (int) ((total * 99) / 100))];
+}
+
+static SDL_EnumerationResult SDLCALL collect_device_type(void *userdata, const char *dirname, const char *fname)
+{
+    for (int i = 0; i < num_device_types; i++) {
+        if (SDL_strcmp(device_types[i], fname) == 0) {
+            return SDL_ENUM_CONTINUE;  // already have it from another theme.
+        }
+    }
+
+    void *ptr = SDL_realloc(device_types, (num_device_types + 1) * sizeof (char *));
+    if (!ptr) {
+        return SDL_ENUM_FAILURE;
+    }
+    device_types = (char **) ptr;
+    device_types[num_device_types] = SDL_strdup(fname);
+    if (!device_types[num_device_types]) {
+        return SDL_ENUM_FAILURE;
+    }
+    num_device_types++;
+    return SDL_ENUM_CONTINUE;
+}
+
+static SDL_EnumerationResult SDLCALL collect_theme(void *userdata, const char *dirname, const char *fname)
+{
+    char *path = NULL;
+    if (SDL_asprintf(&path, "%s%s/gamepad", dirname, fname) < 0) {
+        return SDL_ENUM_FAILURE;
+    }
+
+    SDL_PathInfo info;
+    if (SDL_GetPathInfo(path, &info) && (info.type == SDL_PATHTYPE_DIRECTORY)) {
+        SDL_EnumerateDirectory(path, collect_device_type, NULL);
+    }
+    SDL_free(path);
+    return SDL_ENUM_CONTINUE;
+}
+
+static bool load_databases(Stage *stage_standard, Stage *stage_kenney, const void *standard, size_t standardlen, const void *kenney, size_t kenneylen)
+{
+    Uint64 start;
+    bool rc;
+
+    ControllerImage_Quit();
+    if (!ControllerImage_Init()) {
+        SDL_Log("ControllerImage_Init failed: %s", SDL_GetError());
+        return false;
+    }
+
+    start = begin_sample();
+    rc = ControllerImage_AddData(standard, standardlen);
+    end_sample(stage_standard, start);
+    if (!rc) {
+        SDL_Log("ControllerImage_AddData failed for the standard theme: %s", SDL_GetError());
+        return false;
+    }
+
+    if (kenney) {
+        start = begin_sample();
+        rc = ControllerImage_AddData(kenney, kenneylen);
+        end_sample(stage_kenney, start);
+        if (!rc) {
+            SDL_Log("ControllerImage_AddData failed for the kenney theme: %s", SDL_GetError());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void bench_parse(Stage *stage, const char *svg)
+{
+    if (svg) {
+        // this is what the library does: parse the string where it is, no copy.
+        const size_t svglen = SDL_strlen(svg);
+        const Uint64 start = begin_sample();
+        NSVGimage *image = nsvgParseConst(svg, svglen, "px", 96.0f);
+        end_sample(stage, start);
+        nsvgDelete(image);
+    }
+}
+
+static void bench_device(ControllerImage_Device *device)
+{
+    Stage *parse_stage = get_stage("nsvgParse");
+
+    for (int i = 0; i < SDL_GAMEPAD_BUTTON_COUNT; i++) {
+        bench_parse(parse_stage, ControllerImage_GetSVGForButton(device, (SDL_GamepadButton) i));
+    }
+    for (int i = 0; i < SDL_GAMEPAD_AXIS_COUNT; i++) {
+        bench_parse(parse_stage, ControllerImage_GetSVGForAxis(device, (SDL_GamepadAxis) i));
+    }
+
+    for (int i = 0; i < (int) SDL_arraysize(sizes); i++) {
+        char name[64];
+        SDL_snprintf(name, sizeof (name), "CreateSurface_%d", sizes[i]);
+        Stage *stage = get_stage(name);
+
+        for (int j = 0; j < SDL_GAMEPAD_BUTTON_COUNT; j++) {
+            if (ControllerImage_DeviceHasArtworkForButton(device, (SDL_GamepadButton) j)) {
+                const Uint64 start = begin_sample();
+                SDL_Surface *surface = ControllerImage_CreateSurfaceForButton(device, (SDL_GamepadButton) j, sizes[i]);
+                end_sample(stage, start);
+                SDL_DestroySurface(surface);
+            }
+        }
+
+        for (int j = 0; j < SDL_GAMEPAD_AXIS_COUNT; j++) {
+            if (ControllerImage_DeviceHasArtworkForAxis(device, (SDL_GamepadAxis) j)) {
+                const Uint64 start = begin_sample();
+                SDL_Surface *surface = ControllerImage_CreateSurfaceForAxis(device, (SDL_GamepadAxis) j, sizes[i]);
+                end_sample(stage, start);
+                SDL_DestroySurface(surface);
+            }
+        }
+    }
+}
+
+static void queue_everything(ControllerImage_Batch *batch, ControllerImage_Device **devices)
+{
+    for (int i = 0; i < num_device_types; i++) {
+        if (!devices[i]) {
+            continue;
+        }
+        for (int j = 0; j < (int) SDL_arraysize(sizes); j++) {
+            for (int k = 0; k < SDL_GAMEPAD_BUTTON_COUNT; k++) {
+                ControllerImage_QueueButton(batch, devices[i], (SDL_GamepadButton) k, sizes[j]);
+            }
+            for (int k = 0; k < SDL_GAMEPAD_AXIS_COUNT; k++) {
+                ControllerImage_QueueAxis(batch, devices[i], (SDL_GamepadAxis) k, sizes[j]);
+            }
+        }
+    }
+}
+
+// a HUD's worth of requests: every image of every device at every size, each
+//  asked for twice, like separate widgets would. The cold flush renders each
+//  distinct image once; the warm one asks for the same frame again, so it
+//  shouldn't have to render anything.
+static void bench_batch(void)
+{
+    ControllerImage_Device **devices = (ControllerImage_Device **) SDL_calloc(num_device_types, sizeof (ControllerImage_Device *));
+    if (!devices) {
+        return;
+    }
+
+    for (int i = 0; i < num_device_types; i++) {
+        devices[i] = ControllerImage_CreateGamepadDeviceByIdString(device_types[i]);
+    }
+
+    Stage *stage_cold = get_stage("FlushBatch_cold");
+    Stage *stage_warm = get_stage("FlushBatch_warm");
+    for (int i = 0; i < iterations; i++) {
+        ControllerImage_Batch *batch = ControllerImage_CreateBatch(0);
+        if (!batch) {
+            SDL_Log("Couldn't create batch: %s", SDL_GetError());
+            break;
+        }
+
+        for (int j = 0; j < 2; j++) {
+            queue_everything(batch, devices);
+            queue_everything(batch, devices);
+            const Uint64 start = begin_sample();
+            if (!ControllerImage_FlushBatch(batch)) {
+                SDL_Log("Couldn't flush batch: %s", SDL_GetError());
+            }
+            end_sample(j ? stage_warm : stage_cold, start);
+        }
+
+        ControllerImage_DestroyBatch(batch);
+    }
+
+    for (int i = 0; i < num_device_types; i++) {
+        ControllerImage_DestroyDevice(devices[i]);
+    }
+    SDL_free(devices);
+}
+
+// these are summed, so the order SDL_EnumerateDirectory() gives us files in doesn't matter.
+static Uint64 hash_pixels(const Uint8 *pixels, size_t len)
+{
+    Uint64 hash = 0xcbf29ce484222325ull;  // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ pixels[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static SDL_EnumerationResult SDLCALL bench_gradient_file(void *userdata, const char *dirname, const char *fname)
+{
+    NSVGrasterizer *rasterizer = (NSVGrasterizer *) userdata;
+    const size_t fnamelen = SDL_strlen(fname);
+    if ((fnamelen < 4) || (SDL_strcasecmp(fname + (fnamelen - 4), ".svg") != 0)) {
+        return SDL_ENUM_CONTINUE;
+    }
+
+    char *path = NULL;
+    if (SDL_asprintf(&path, "%s%s", dirname, fname) < 0) {
+        return SDL_ENUM_FAILURE;
+    }
+
+    size_t svglen = 0;
+    char *svg = (char *) SDL_LoadFile(path, &svglen);
+    if (!svg) {
+        SDL_Log("Couldn't load '%s': %s", path, SDL_GetError());
+        SDL_free(path);
+        return SDL_ENUM_CONTINUE;
+    }
+
+    NSVGimage *image = nsvgParseConst(svg, svglen, "px", 96.0f);
+    if (!image || (image->width <= 0.0f)) {
+        SDL_Log("Couldn't parse '%s'", path);
+    } else {
+        for (int i = 0; i < (int) SDL_arraysize(gradient_sizes); i++) {
+            const int size = gradient_sizes[i];
+            Uint8 *pixels = (Uint8 *) SDL_malloc(size * size * 4);
+            if (!pixels) {
+                break;
+            }
+
+            char name[64];
+            SDL_snprintf(name, sizeof (name), "Gradients_%d", size);
+            Stage *stage = get_stage(name);
+            for (int j = 0; j < iterations; j++) {
+                const Uint64 start = begin_sample();
+                nsvgRasterize(rasterizer, image, 0.0f, 0.0f, ((float) size) / image->width, pixels, size, size, size * 4);
+                end_sample(stage, start);
+            }
+
+            gradient_checksum += hash_pixels(pixels, size * size * 4);
+            num_gradient_images++;
+            SDL_free(pixels);
+        }
+    }
+
+    nsvgDelete(image);
+    SDL_free(svg);
+    SDL_free(path);
+    return SDL_ENUM_CONTINUE;
+}
+
+static void bench_gradients(const char *dir)
+{
+    char *path = NULL;
+    if (SDL_asprintf(&path, "%s/", dir) < 0) {
+        return;
+    }
+
+    NSVGrasterizer *rasterizer = nsvgCreateRasterizer();
+    if (rasterizer) {
+        SDL_EnumerateDirectory(path, bench_gradient_file, rasterizer);
+        nsvgDeleteRasterizer(rasterizer);
+    }
+
+    if (num_gradient_images == 0) {
+        SDL_Log("Didn't find any gradient test art in '%s'; use --gradients to point at it.", dir);
+    }
+
+    SDL_free(path);
+}
+
+// the raw art is what the parser sees when the data tool runs, before any optimizing, so it has all the
+//  editor cruft (metadata, unknown attributes, style strings) that parsing has to get through.
+static SDL_EnumerationResult SDLCALL bench_parse_art_file(void *userdata, const char *dirname, const char *fname)
+{
+    Stage *stage = (Stage *) userdata;
+    char *path = NULL;
+    if (SDL_asprintf(&path, "%s%s", dirname, fname) < 0) {
+        return SDL_ENUM_FAILURE;
+    }
+
+    SDL_PathInfo info;
+    const size_t fnamelen = SDL_strlen(fname);
+    if (SDL_GetPathInfo(path, &info) && (info.type == SDL_PATHTYPE_DIRECTORY)) {
+        char *subdir = NULL;
+        if (SDL_asprintf(&subdir, "%s/", path) >= 0) {
+            SDL_EnumerateDirectory(subdir, bench_parse_art_file, stage);
+            SDL_free(subdir);
+        }
+    } else if ((fnamelen >= 4) && (SDL_strcasecmp(fname + (fnamelen - 4), ".svg") == 0)) {
+        size_t svglen = 0;
+        char *svg = (char *) SDL_LoadFile(path, &svglen);
+        if (!svg) {
+            SDL_Log("Couldn't load '%s': %s", path, SDL_GetError());
+        } else {
+            for (int i = 0; i < iterations; i++) {
+                const Uint64 start = begin_sample();
+                NSVGimage *image = nsvgParseConst(svg, svglen, "px", 96.0f);
+                end_sample(stage, start);
+                nsvgDelete(image);
+            }
+            num_art_svgs++;
+            art_svg_bytes += svglen;
+            SDL_free(svg);
+        }
+    }
+
+    SDL_free(path);
+    return SDL_ENUM_CONTINUE;
+}
+
+static void bench_parse_art(const char *dir)
+{
+    char *path = NULL;
+    if (SDL_asprintf(&path, "%s/", dir) >= 0) {
+        SDL_EnumerateDirectory(path, bench_parse_art_file, get_stage("nsvgParse_art"));
+        SDL_free(path);
+    }
+}
+
+static void print_report(void)
+{
+    printf("%-24s %8s %12s %12s %12s %12s\n", "stage", "samples", "median(us)", "p99(us)", "mean(us)", "allocs/op");
+    for (int i = 0; i < num_stages; i++) {
+        const Stage *stage = &stages[i];
+        const double allocs = stage->num_samples ? (((double) stage->allocations) / stage->num_samples) : 0.0;
+        printf("%-24s %8d %12.2f %12.2f %12.2f %12.1f\n", stage->name, stage->num_samples, stage->median_ns / 1000.0, stage->p99_ns / 1000.0, stage->mean_ns / 1000.0, allocs);
+    }
+
+    if (num_art_svgs > 0) {
+        printf("\nraw art: %d SVG files, %" SDL_PRIu64 " bytes\n", num_art_svgs, art_svg_bytes);
+    }
+
+    if (num_gradient_images > 0) {
+        printf("\ngradient test art: %d images, checksum %016" SDL_PRIx64 "\n", num_gradient_images, gradient_checksum);
+    }
+
+    // these cover the last time the data was loaded, and every device created after that.
+    ControllerImage_Stats stats;
+    if (ControllerImage_GetStats(&stats)) {
+        const Uint64 string_bytes = stats.string_cache_bytes + stats.string_bytes_saved;
+        const Uint64 images = stats.images_parsed + stats.images_shared;
+        printf("\ndeduplication: %" SDL_PRIu64 " of %" SDL_PRIu64 " string bytes were already loaded (%.1f%%), %" SDL_PRIu64 " of %" SDL_PRIu64 " images shared instead of parsed (%.1f%%)\n",
+               stats.string_bytes_saved, string_bytes, string_bytes ? ((((double) stats.string_bytes_saved) / ((double) string_bytes)) * 100.0) : 0.0,
+               stats.images_shared, images, images ? ((((double) stats.images_shared) / ((double) images)) * 100.0) : 0.0);
+    }
+}
+
+static bool write_json(const char *fname)
+{
+    SDL_IOStream *io = SDL_IOFromFile(fname, "w");
+    if (!io) {
+        return false;
+    }
+
+    const int version = ControllerImage_Version();
+    const int sdlversion = SDL_GetVersion();
+    SDL_IOprintf(io, "{\n");
+    SDL_IOprintf(io, "  \"controllerimage_version\": \"%d.%d.%d\",\n", SDL_VERSIONNUM_MAJOR(version), SDL_VERSIONNUM_MINOR(version), SDL_VERSIONNUM_MICRO(version));
+    SDL_IOprintf(io, "  \"sdl_version\": \"%d.%d.%d\",\n", SDL_VERSIONNUM_MAJOR(sdlversion), SDL_VERSIONNUM_MINOR(sdlversion), SDL_VERSIONNUM_MICRO(sdlversion));
+    SDL_IOprintf(io, "  \"iterations\": %d,\n", iterations);
+    SDL_IOprintf(io, "  \"device_types\": %d,\n", num_device_types);
+    SDL_IOprintf(io, "  \"art_svgs\": %d,\n", num_art_svgs);
+    SDL_IOprintf(io, "  \"art_svg_bytes\": %" SDL_PRIu64 ",\n", art_svg_bytes);
+    SDL_IOprintf(io, "  \"gradient_images\": %d,\n", num_gradient_images);
+    SDL_IOprintf(io, "  \"gradient_checksum\": \"%016" SDL_PRIx64 "\",\n", gradient_checksum);
+    SDL_IOprintf(io, "  \"stages\": [\n");
+    for (int i = 0; i < num_stages; i++) {
+        const Stage *stage = &stages[i];
+        SDL_IOprintf(io, "    {\n");
+        SDL_IOprintf(io, "      \"name\": \"%s\",\n", stage->name);
+        SDL_IOprintf(io, "      \"samples\": %d,\n", stage->num_samples);
+        SDL_IOprintf(io, "      \"median_ns\": %.0f,\n", stage->median_ns);
+        SDL_IOprintf(io, "      \"p99_ns\": %.0f,\n", stage->p99_ns);
+        SDL_IOprintf(io, "      \"mean_ns\": %.0f,\n", stage->mean_ns);
+        SDL_IOprintf(io, "      \"min_ns\": %.0f,\n", stage->min_ns);
+        SDL_IOprintf(io, "      \"max_ns\": %.0f,\n", stage->max_ns);
+        SDL_IOprintf(io, "      \"allocations\": %" SDL_PRIu64 ",\n", stage->allocations);
+        SDL_IOprintf(io, "      \"allocated_bytes\": %" SDL_PRIu64 "\n", stage->allocated_bytes);
+        SDL_IOprintf(io, "    }%s\n", (i < (num_stages - 1)) ? "," : "");
+    }
+    SDL_IOprintf(io, "  ]\n");
+    SDL_IOprintf(io, "}\n");
+
+    return SDL_CloseIO(io);
+}
+
+static int usage(const char *argv0)
+{
+    SDL_Log("USAGE: %s [--art dir] [--gradients dir] [--standard fname] [--kenney fname] [--iterations N] [--json fname]", argv0);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *artdir = "art";
+    const char *gradientdir = "test/art/gradients";
+    const char *standard_fname = "controllerimage-standard.bin";
+    const char *kenney_fname = "controllerimage-kenney.bin";
+    const char *json_fname = NULL;
+    void *standard = NULL;
+    void *kenney = NULL;
+    size_t standardlen = 0;
+    size_t kenneylen = 0;
+    int retval = 1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        while (*arg == '-') { arg++; }
+        if (argv[i + 1] == NULL) {
+            return usage(argv[0]);
+        } else if (SDL_strcmp(arg, "art") == 0) {
+            artdir = argv[++i];
+        } else if (SDL_strcmp(arg, "gradients") == 0) {
+            gradientdir = argv[++i];
+        } else if (SDL_strcmp(arg, "standard") == 0) {
+            standard_fname = argv[++i];
+        } else if (SDL_strcmp(arg, "kenney") == 0) {
+            kenney_fname = argv[++i];
+        } else if (SDL_strcmp(arg, "json") == 0) {
+            json_fname = argv[++i];
+        } else if (SDL_strcmp(arg, "iterations") == 0) {
+            iterations = (int) SDL_strtol(argv[++i], NULL, 10);
+            if (iterations <= 0) {
+                return usage(argv[0]);
+            }
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    // count allocations everywhere, the library goes through SDL_malloc for everything.
+    SDL_GetOriginalMemoryFunctions(&original_malloc, &original_calloc, &original_realloc, &original_free);
+    if (!SDL_SetMemoryFunctions(counting_malloc, counting_calloc, counting_realloc, counting_free)) {
+        SDL_Log("SDL_SetMemoryFunctions failed: %s", SDL_GetError());
+        return 1;
+    }
+
+    if (!SDL_Init(0)) {
+        SDL_Log("SDL_Init failed: %s", SDL_GetError());
+        return 1;
+    }
+
+    char *artpath = NULL;
+    if (SDL_asprintf(&artpath, "%s/", artdir) < 0) {
+        goto done;
+    }
+    SDL_EnumerateDirectory(artpath, collect_theme, NULL);
+    SDL_free(artpath);
+
+    if (num_device_types == 0) {
+        SDL_Log("Didn't find any device types in '%s'; use --art to point at the art directory.", artdir);
+        goto done;
+    }
+
+    // load the files up front, we don't care about disk i/o here.
+    if ((standard = SDL_LoadFile(standard_fname, &standardlen)) == NULL) {
+        SDL_Log("Couldn't load '%s': %s", standard_fname, SDL_GetError());
+        goto done;
+    } else if ((kenney = SDL_LoadFile(kenney_fname, &kenneylen)) == NULL) {
+        SDL_Log("Couldn't load '%s' (%s); skipping that theme.", kenney_fname, SDL_GetError());
+    }
+
+    Stage *stage_standard = get_stage("AddData_standard");
+    Stage *stage_kenney = kenney ? get_stage("AddData_kenney") : NULL;
+    for (int i = 0; i < iterations; i++) {
+        if (!load_databases(stage_standard, stage_kenney, standard, standardlen, kenney, kenneylen)) {
+            goto done;
+        }
+    }
+
+    // the last iteration left both themes loaded, so now work with those.
+    Stage *stage_create = get_stage("CreateGamepadDevice");
+    for (int i = 0; i < iterations; i++) {
+        for (int j = 0; j < num_device_types; j++) {
+            const Uint64 start = begin_sample();
+            ControllerImage_Device *device = ControllerImage_CreateGamepadDeviceByIdString(device_types[j]);
+            end_sample(stage_create, start);
+            if (!device) {
+                SDL_Log("Couldn't create device '%s': %s", device_types[j], SDL_GetError());
+                continue;
+            }
+            bench_device(device);
+            ControllerImage_DestroyDevice(device);
+        }
+    }
+
+    bench_batch();
+    bench_parse_art(artdir);
+    bench_gradients(gradientdir);
+
+    for (int i = 0; i < num_stages; i++) {
+        finish_stage(&stages[i]);
+    }
+
+    print_report();
+
+    if (json_fname && !write_json(json_fname)) {
+        SDL_Log("Couldn't write '%s': %s", json_fname, SDL_GetError());
+        goto done;
+    }
+
+    retval = 0;
+
+done:
+    ControllerImage_Quit();
+    for (int i = 0; i < num_stages; i++) {
+        SDL_free(stages[i].samples);
+    }
+    for (int i = 0; i < num_device_types; i++) {
+        SDL_free(device_types[i]);
+    }
+    SDL_free(device_types);
+    SDL_free(standard);
+    SDL_free(kenney);
+    SDL_Quit();
+    return retval;
+}
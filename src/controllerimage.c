@@ -8,6 +8,14 @@
 
 #include "controllerimage.h"
 
+// All of the library's allocations go through these, including nanosvg's,
+// so apps can supply their own allocator and we can track memory usage.
+static void *CI_malloc(size_t len);
+static void *CI_calloc(size_t nmemb, size_t len);
+static void *CI_realloc(void *ptr, size_t len);
+static void CI_free(void *ptr);
+static char *CI_strdup(const char *str);
+
 // nanosvg uses a bunch of C runtime stuff we can push through SDL to
 // avoid the C runtime dependency...
 
@@ -19,14 +27,15 @@
 #define cosf SDL_cosf
 #define floorf SDL_floorf
 #define fmodf SDL_fmodf
-#define free SDL_free
+#define free CI_free
 #define sscanf SDL_sscanf
-#define malloc SDL_malloc
+#define malloc CI_malloc
+#define memcmp SDL_memcmp
 #define memcpy SDL_memcpy
 #define memset SDL_memset
 #define pow SDL_pow
 #define qsort SDL_qsort
-#define realloc SDL_realloc
+#define realloc CI_realloc
 #define roundf SDL_roundf
 #define sinf SDL_sinf
 #define sqrt SDL_sqrt
@@ -47,26 +56,82 @@
 #define NANOSVGRAST_IMPLEMENTATION
 #include "nanosvgrast.h"
 
-#define CONTROLLERIMAGE_CURRENT_DATAVER 2
+#define CONTROLLERIMAGE_CURRENT_DATAVER 3
+#define CONTROLLERIMAGE_CURRENT_STATIC_DATAVER 2
+
+// optional sections that can follow the devices in a data file.
+#define SECTION_IMAGE_INFO 1
+
+// a ControllerImage_ImageInfo, as make-controllerimage-data stores it.
+#define IMAGEINFO_RECORD_SIZE 30
+#define IMAGEINFO_FLAG_GRADIENTS (1 << 0)
+#define IMAGEINFO_FLAG_STROKES (1 << 1)
 
 static const char magic[8] = { 'C', 'T', 'I', 'M', 'G', '\r', '\n', '\0' };
+static const char static_magic[8] = { 'C', 'T', 'I', 'M', 'G', 'S', 'T', '\0' };
 static const SDL_GUID zeroguid;
 
+#define MAX_EDGE_CACHE_SIZES 4  // per image; past this, the least-recently-used size is dropped.
+
+// where an image goes on a surface, and at what scale.
+typedef struct RasterLayout
+{
+    int surface_w;
+    int surface_h;
+    SDL_Rect rect;  // the part of the surface the image covers; only this much gets rasterized.
+    float sx, sy;  // scale.
+    float tx, ty;  // offset within `rect`, after scaling.
+} RasterLayout;
+
+// flattened, sorted edges for one image at one scale, so drawing it that way again skips straight to filling scanlines.
+typedef struct EdgeCacheEntry
+{
+    float sx, sy;
+    float tx, ty;
+    NSVGedgeCache *edges;  // NULL until the image is rasterized at this scale a second time, so one-off sizes don't cost memory.
+    struct EdgeCacheEntry *next;  // most-recently-used first.
+} EdgeCacheEntry;
+
+// Parsed images are shared by everything that uses the same SVG: buttons on
+//  the same device, different devices, and identical art from different data
+//  files. They're found by a hash of the SVG's contents, since static data
+//  isn't interned with everything else.
+typedef struct SharedImage
+{
+    Uint64 hash;
+    const char *svg;  // NULL after ControllerImage_Quit(), so nothing new matches it.
+    NSVGimage *image;
+    int refcount;
+    EdgeCacheEntry *edges;  // shared too, so every device drawing this image at a size benefits from one cache.
+    Uint64 memory_used;  // the parsed image and its edge caches; they aren't charged to any one device.
+    struct SharedImage *next;  // next in the same hash bucket.
+} SharedImage;
+
 typedef struct ControllerImage_Device
 {
     // any of these might be NULL!
-    NSVGimage *axes[SDL_GAMEPAD_AXIS_COUNT];
-    NSVGimage *buttons[SDL_GAMEPAD_BUTTON_COUNT];
+    SharedImage *axes[SDL_GAMEPAD_AXIS_COUNT];
+    SharedImage *buttons[SDL_GAMEPAD_BUTTON_COUNT];
     const char *device_type;
-    char *axes_svg[SDL_GAMEPAD_AXIS_COUNT];
-    char *buttons_svg[SDL_GAMEPAD_BUTTON_COUNT];
-    NSVGrasterizer *rasterizer;
+    const char *axes_svg[SDL_GAMEPAD_AXIS_COUNT];  // these point into StringCache, so they go away at ControllerImage_Quit().
+    const char *buttons_svg[SDL_GAMEPAD_BUTTON_COUNT];
+    bool axes_purged[SDL_GAMEPAD_AXIS_COUNT];  // image was dropped to stay under the memory budget, reparse it when needed.
+    bool buttons_purged[SDL_GAMEPAD_BUTTON_COUNT];
+    ControllerImage_ImageInfo axes_info[SDL_GAMEPAD_AXIS_COUNT];  // copies, so these survive new data replacing the items they came from.
+    ControllerImage_ImageInfo buttons_info[SDL_GAMEPAD_BUTTON_COUNT];
+    bool axes_has_info[SDL_GAMEPAD_AXIS_COUNT];
+    bool buttons_has_info[SDL_GAMEPAD_BUTTON_COUNT];
+    Uint64 memory_used;  // everything allocated on this device's behalf, except the device object itself and shared images.
+    struct ControllerImage_Device *prev;  // live devices, most-recently-used first.
+    struct ControllerImage_Device *next;
 } ControllerImage_Device;
 
 typedef struct ControllerImage_Item
 {
     const char *type;
     const char *svg;
+    bool has_info;  // false if the data was built before make-controllerimage-data recorded this.
+    ControllerImage_ImageInfo info;
 } ControllerImage_Item;
 
 typedef struct ControllerImage_DeviceInfo
@@ -82,7 +147,181 @@ static int controllerimage_initialized = 0;
 static SDL_PropertiesID DeviceInfoMap = 0;
 static SDL_PropertiesID GuidToDeviceTypeMap = 0;
 static char **StringCache = NULL;
+static Uint64 *StringCacheHashes = NULL;  // parallel to StringCache.
 static int NumCachedStrings = 0;
+static int *StringCacheTable = NULL;  // open-addressed hash table of StringCache indices, -1 for empty slots.
+static int StringCacheTableSize = 0;  // always a power of two.
+static SharedImage **SharedImages = NULL;  // hash buckets.
+static int SharedImageBuckets = 0;  // always a power of two.
+static int NumSharedImages = 0;
+static ControllerImage_Stats Stats;
+static ControllerImage_ProfileCallback ProfileBeginCallback = NULL;
+static ControllerImage_ProfileCallback ProfileEndCallback = NULL;
+static void *ProfileUserdata = NULL;
+static ControllerImage_Device *LiveDevices = NULL;
+static struct TextureCache *TextureCaches = NULL;
+static struct ControllerImage_Batch *LiveBatches = NULL;
+static NSVGrasterizer **RasterizerPool = NULL;  // idle rasterizers, shared by all devices.
+static int NumPooledRasterizers = 0;
+static int RasterizerPoolCapacity = 0;
+
+
+// every allocation gets one of these in front of it, so we know how much to
+// subtract from the totals when it's freed, and from which device.
+typedef struct AllocHeader
+{
+    size_t len;
+    Uint64 *counter;  // points into the device this allocation was made for, or NULL.
+} AllocHeader;
+
+#define ALLOC_HEADER_SIZE 16  // keep what follows the header as aligned as malloc would.
+SDL_COMPILE_TIME_ASSERT(alloc_header_size, sizeof (AllocHeader) <= ALLOC_HEADER_SIZE);
+
+static SDL_malloc_func AppMalloc = NULL;  // NULL means use SDL_malloc, etc.
+static SDL_calloc_func AppCalloc = NULL;
+static SDL_realloc_func AppRealloc = NULL;
+static SDL_free_func AppFree = NULL;
+static Uint64 MemoryUsed = 0;
+static Uint64 MemoryBudget = 0;  // zero means no limit.
+static Uint64 *MemoryCounter = NULL;  // new allocations are charged to this device, too.
+static SDL_SpinLock MemoryLock = 0;
+static bool MemoryLockNeeded = false;  // the library isn't thread safe; only a batch's worker threads allocate while something else might, so only they need the lock.
+
+static void LockMemory(void)
+{
+    if (MemoryLockNeeded) {
+        SDL_LockSpinlock(&MemoryLock);
+    }
+}
+
+static void UnlockMemory(void)
+{
+    if (MemoryLockNeeded) {
+        SDL_UnlockSpinlock(&MemoryLock);
+    }
+}
+
+static void *TrackAllocation(Uint8 *ptr, size_t len)
+{
+    if (!ptr) {
+        SDL_OutOfMemory();
+        return NULL;
+    }
+
+    AllocHeader *header = (AllocHeader *) ptr;
+    header->len = len;
+    LockMemory();
+    header->counter = MemoryCounter;
+    MemoryUsed += len;
+    if (MemoryCounter) {
+        *MemoryCounter += len;
+    }
+    UnlockMemory();
+    return ptr + ALLOC_HEADER_SIZE;
+}
+
+static void *CI_malloc(size_t len)
+{
+    if (len > (SDL_SIZE_MAX - ALLOC_HEADER_SIZE)) {
+        SDL_OutOfMemory();
+        return NULL;
+    }
+    len += ALLOC_HEADER_SIZE;
+    return TrackAllocation((Uint8 *) (AppMalloc ? AppMalloc(len) : SDL_malloc(len)), len - ALLOC_HEADER_SIZE);
+}
+
+static void *CI_calloc(size_t nmemb, size_t len)
+{
+    size_t total = 0;
+    if (!SDL_size_mul_check_overflow(nmemb, len, &total) || (total > (SDL_SIZE_MAX - ALLOC_HEADER_SIZE))) {
+        SDL_OutOfMemory();
+        return NULL;
+    }
+    total += ALLOC_HEADER_SIZE;
+    return TrackAllocation((Uint8 *) (AppCalloc ? AppCalloc(1, total) : SDL_calloc(1, total)), total - ALLOC_HEADER_SIZE);
+}
+
+static void *CI_realloc(void *ptr, size_t len)
+{
+    if (!ptr) {
+        return CI_malloc(len);
+    } else if (len > (SDL_SIZE_MAX - ALLOC_HEADER_SIZE)) {
+        SDL_OutOfMemory();
+        return NULL;
+    }
+
+    Uint8 *block = ((Uint8 *) ptr) - ALLOC_HEADER_SIZE;
+    const size_t oldlen = ((AllocHeader *) block)->len;
+    block = (Uint8 *) (AppRealloc ? AppRealloc(block, len + ALLOC_HEADER_SIZE) : SDL_realloc(block, len + ALLOC_HEADER_SIZE));
+    if (!block) {
+        SDL_OutOfMemory();
+        return NULL;
+    }
+
+    AllocHeader *header = (AllocHeader *) block;  // the allocation stays charged to whatever it was charged to before.
+    header->len = len;
+    LockMemory();
+    MemoryUsed = (MemoryUsed - oldlen) + len;
+    if (header->counter) {
+        *header->counter = (*header->counter - oldlen) + len;
+    }
+    UnlockMemory();
+    return block + ALLOC_HEADER_SIZE;
+}
+
+static void CI_free(void *ptr)
+{
+    if (ptr) {
+        Uint8 *block = ((Uint8 *) ptr) - ALLOC_HEADER_SIZE;
+        const AllocHeader *header = (const AllocHeader *) block;
+        LockMemory();
+        MemoryUsed -= header->len;
+        if (header->counter) {
+            *header->counter -= header->len;
+        }
+        UnlockMemory();
+        if (AppFree) {
+            AppFree(block);
+        } else {
+            SDL_free(block);
+        }
+    }
+}
+
+static char *CI_strdup(const char *str)
+{
+    const size_t len = SDL_strlen(str) + 1;
+    char *retval = (char *) CI_malloc(len);
+    if (retval) {
+        SDL_memcpy(retval, str, len);
+    }
+    return retval;
+}
+
+// move an existing allocation's charge to a different device (or NULL for none).
+static void ChargeAllocation(void *ptr, Uint64 *counter)
+{
+    if (ptr) {
+        AllocHeader *header = (AllocHeader *) (((Uint8 *) ptr) - ALLOC_HEADER_SIZE);
+        LockMemory();
+        if (header->counter) {
+            *header->counter -= header->len;
+        }
+        header->counter = counter;
+        if (counter) {
+            *counter += header->len;
+        }
+        UnlockMemory();
+    }
+}
+
+// returns the previous counter, so you can put it back when done.
+static Uint64 *SetMemoryCounter(Uint64 *counter)
+{
+    Uint64 *retval = MemoryCounter;
+    MemoryCounter = counter;
+    return retval;
+}
 
 int ControllerImage_MaxDatafileVersion(void)
 {
@@ -94,9 +333,109 @@ int ControllerImage_Version(void)
     return CONTROLLERIMAGE_VERSION;
 }
 
+bool ControllerImage_GetStats(ControllerImage_Stats *stats)
+{
+    if (!stats) {
+        return SDL_InvalidParamError("stats");
+    }
+    SDL_copyp(stats, &Stats);
+    return true;
+}
+
+void ControllerImage_SetProfilerCallbacks(ControllerImage_ProfileCallback begin, ControllerImage_ProfileCallback end, void *userdata)
+{
+    ProfileBeginCallback = begin;
+    ProfileEndCallback = end;
+    ProfileUserdata = userdata;
+}
+
+bool ControllerImage_SetMemoryFunctions(SDL_malloc_func malloc_func, SDL_calloc_func calloc_func, SDL_realloc_func realloc_func, SDL_free_func free_func)
+{
+    const bool all_null = !malloc_func && !calloc_func && !realloc_func && !free_func;
+    if (!all_null) {
+        if (!malloc_func) {
+            return SDL_InvalidParamError("malloc_func");
+        } else if (!calloc_func) {
+            return SDL_InvalidParamError("calloc_func");
+        } else if (!realloc_func) {
+            return SDL_InvalidParamError("realloc_func");
+        } else if (!free_func) {
+            return SDL_InvalidParamError("free_func");
+        }
+    }
+
+    if (MemoryUsed > 0) {
+        return SDL_SetError("Can't change memory functions while ControllerImage has memory allocated");
+    }
+
+    AppMalloc = malloc_func;
+    AppCalloc = calloc_func;
+    AppRealloc = realloc_func;
+    AppFree = free_func;
+    return true;
+}
+
+Uint64 ControllerImage_GetMemoryUsage(ControllerImage_Device *device)
+{
+    if (!device) {
+        return MemoryUsed;
+    }
+
+    // parsed images might be shared with other devices, but they count for each one, once each.
+    const SharedImage *counted[SDL_GAMEPAD_AXIS_COUNT + SDL_GAMEPAD_BUTTON_COUNT];
+    int num_counted = 0;
+    Uint64 retval = device->memory_used + sizeof (*device);
+    for (int i = 0; i < (SDL_GAMEPAD_AXIS_COUNT + SDL_GAMEPAD_BUTTON_COUNT); i++) {
+        const SharedImage *shared = (i < SDL_GAMEPAD_AXIS_COUNT) ? device->axes[i] : device->buttons[i - SDL_GAMEPAD_AXIS_COUNT];
+        bool seen = (shared == NULL);
+        for (int j = 0; !seen && (j < num_counted); j++) {
+            seen = (counted[j] == shared);
+        }
+        if (!seen) {
+            counted[num_counted++] = shared;
+            retval += shared->memory_used;
+        }
+    }
+    return retval;
+}
+
+static void EnforceMemoryBudget(void);
+
+void ControllerImage_SetMemoryBudget(Uint64 bytes)
+{
+    MemoryBudget = bytes;
+    EnforceMemoryBudget();
+}
+
+static bool SDLCALL TextureCacheEventWatch(void *userdata, SDL_Event *event);
+static void ForgetBatchResults(void);
+static void ForgetBatchDevice(ControllerImage_Device *device);
+
+static Uint64 BeginProfile(ControllerImage_ProfileEvent event)
+{
+    if (ProfileBeginCallback) {
+        ProfileBeginCallback(ProfileUserdata, event);
+    }
+    return SDL_GetTicksNS();
+}
+
+// returns nanoseconds since `start`.
+static Uint64 EndProfile(ControllerImage_ProfileEvent event, Uint64 start)
+{
+    const Uint64 elapsed = SDL_GetTicksNS() - start;
+    if (ProfileEndCallback) {
+        ProfileEndCallback(ProfileUserdata, event);
+    }
+    return elapsed;
+}
+
 bool ControllerImage_Init(void)
 {
     if (!controllerimage_initialized) {
+        const Uint64 devices_live = Stats.devices_live;  // devices can outlive the library, so keep counting those.
+        SDL_zero(Stats);
+        Stats.devices_live = devices_live;
+
         DeviceInfoMap = SDL_CreateProperties();
         if (!DeviceInfoMap) {
             return false;
@@ -107,6 +446,12 @@ bool ControllerImage_Init(void)
             DeviceInfoMap = 0;
             return false;
         }
+        if (!SDL_AddEventWatch(TextureCacheEventWatch, NULL)) {
+            SDL_DestroyProperties(GuidToDeviceTypeMap);
+            SDL_DestroyProperties(DeviceInfoMap);
+            DeviceInfoMap = GuidToDeviceTypeMap = 0;
+            return false;
+        }
     }
     controllerimage_initialized++;
     return true;
@@ -125,15 +470,86 @@ void ControllerImage_Quit(void)
 
     // actually shutting down now.
 
+    SDL_RemoveEventWatch(TextureCacheEventWatch, NULL);
+    ControllerImage_FlushTextureCache(NULL);  // the cache is keyed on SVG strings, which are about to go away.
+    ForgetBatchResults();  // so are these.
+    ControllerImage_TrimRasterizerPool();
+
+    // Devices can outlive the library, but the SVG strings they point to are
+    // about to go away. They keep whatever images are already parsed, but
+    // can't reparse anything after this.
+    for (ControllerImage_Device *device = LiveDevices; device; device = device->next) {
+        SDL_zeroa(device->axes_svg);
+        SDL_zeroa(device->buttons_svg);
+        SDL_zeroa(device->axes_purged);
+        SDL_zeroa(device->buttons_purged);
+    }
+    for (int i = 0; i < SharedImageBuckets; i++) {
+        for (SharedImage *shared = SharedImages[i]; shared; shared = shared->next) {
+            shared->svg = NULL;
+        }
+    }
+
     SDL_DestroyProperties(DeviceInfoMap);
     SDL_DestroyProperties(GuidToDeviceTypeMap);
     DeviceInfoMap = GuidToDeviceTypeMap = 0;
     for (int i = 0; i < NumCachedStrings; i++) {
-        SDL_free(StringCache[i]);
+        CI_free(StringCache[i]);
     }
-    SDL_free(StringCache);
+    CI_free(StringCache);
+    CI_free(StringCacheHashes);
+    CI_free(StringCacheTable);
     StringCache = NULL;
+    StringCacheHashes = NULL;
+    StringCacheTable = NULL;
     NumCachedStrings = 0;
+    StringCacheTableSize = 0;
+    Stats.strings_interned = 0;
+    Stats.string_cache_bytes = 0;
+    controllerimage_initialized = 0;
+}
+
+// FNV-1a over the length and a sample of the bytes. Most of our strings are
+//  big SVGs, and this only has to narrow things down to a few candidates for
+//  SDL_strcmp(), not hash every byte of them.
+static Uint64 HashString(const char *str, size_t len)
+{
+    const size_t step = (len > 64) ? (len / 64) : 1;
+    Uint64 hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < sizeof (len); i++) {
+        hash ^= (Uint64) ((len >> (i * 8)) & 0xFF);
+        hash *= 0x100000001B3ULL;
+    }
+    for (size_t i = 0; i < len; i += step) {
+        hash ^= (Uint64) (Uint8) str[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static bool GrowStringCacheTable(void)
+{
+    const int newsize = StringCacheTableSize ? (StringCacheTableSize * 2) : 1024;
+    int *table = (int *) CI_malloc(newsize * sizeof (int));
+    if (!table) {
+        return false;
+    }
+
+    SDL_memset(table, 0xFF, newsize * sizeof (int));  // -1 everywhere.
+
+    const int mask = newsize - 1;
+    for (int i = 0; i < NumCachedStrings; i++) {
+        int slot = (int) (StringCacheHashes[i] & mask);
+        while (table[slot] != -1) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = i;
+    }
+
+    CI_free(StringCacheTable);
+    StringCacheTable = table;
+    StringCacheTableSize = newsize;
+    return true;
 }
 
 static bool readstr(const Uint8 **_ptr, size_t *_buflen, char **_str)
@@ -144,26 +560,51 @@ static bool readstr(const Uint8 **_ptr, size_t *_buflen, char **_str)
         if (ptr[i] == '\0') {   // found end of string?
             i++;
 
+            if (((NumCachedStrings * 2) >= StringCacheTableSize) && !GrowStringCacheTable()) {
+                return false;
+            }
+
+            // identical strings from every data file end up as the same pointer, so
+            //  everything downstream can tell they're the same without comparing them.
+            const Uint64 hash = HashString((const char *) ptr, i - 1);
+            const int mask = StringCacheTableSize - 1;
+            int slot = (int) (hash & mask);
             char *finalstr = NULL;
-            for (int j = 0; j < NumCachedStrings; j++) {
-                if (SDL_strcmp(StringCache[j], (const char *) ptr) == 0) {
-                    finalstr = StringCache[j];
+            while (StringCacheTable[slot] != -1) {
+                const int idx = StringCacheTable[slot];
+                if ((StringCacheHashes[idx] == hash) && (SDL_strcmp(StringCache[idx], (const char *) ptr) == 0)) {
+                    finalstr = StringCache[idx];
                     break;
                 }
+                slot = (slot + 1) & mask;
             }
 
-            if (!finalstr) {
-                void *expanded = SDL_realloc(StringCache, (NumCachedStrings + 1) * sizeof (char *));
+            if (finalstr) {
+                Stats.string_cache_hits++;
+                Stats.string_bytes_saved += i;
+            } else {
+                void *expanded = CI_realloc(StringCache, (NumCachedStrings + 1) * sizeof (char *));
                 if (!expanded) {
                     return false;
                 }
                 StringCache = (char **) expanded;
-                finalstr = SDL_strdup((const char *) ptr);
+                expanded = CI_realloc(StringCacheHashes, (NumCachedStrings + 1) * sizeof (Uint64));
+                if (!expanded) {
+                    return false;
+                }
+                StringCacheHashes = (Uint64 *) expanded;
+                finalstr = CI_strdup((const char *) ptr);
                 if (!finalstr) {
                     return false;
                 }
 
-                StringCache[NumCachedStrings++] = finalstr;
+                StringCache[NumCachedStrings] = finalstr;
+                StringCacheHashes[NumCachedStrings] = hash;
+                StringCacheTable[slot] = NumCachedStrings;  // the empty slot the search stopped at.
+                NumCachedStrings++;
+                Stats.string_cache_misses++;
+                Stats.strings_interned++;
+                Stats.string_cache_bytes += i;  // `i` is the string length, including the null terminator, right now.
             }
 
             *_str = finalstr;
@@ -189,15 +630,175 @@ static bool readui16(const Uint8 **_ptr, size_t *_buflen, Uint16 *_ui16)
     return true;
 }
 
+static bool readui32(const Uint8 **_ptr, size_t *_buflen, Uint32 *_ui32)
+{
+    if (*_buflen < 4) {
+        return SDL_SetError("Unexpected end of data");
+    }
+
+    const Uint8 *ptr = *_ptr;
+    *_ui32 = (((Uint32) ptr[0]) << 24) | (((Uint32) ptr[1]) << 16) | (((Uint32) ptr[2]) << 8) | ((Uint32) ptr[3]);
+    *_ptr += 4;
+    *_buflen -= 4;
+    return true;
+}
+
+static bool readimageinfo(const Uint8 **_ptr, size_t *_buflen, ControllerImage_ImageInfo *info)
+{
+    if (*_buflen < IMAGEINFO_RECORD_SIZE) {
+        return SDL_SetError("Unexpected end of data");
+    }
+
+    Uint16 num_shapes = 0;
+    Uint16 num_paths = 0;
+    Uint32 num_points = 0;
+    Uint16 flags = 0;
+    readui16(_ptr, _buflen, &num_shapes);  // we already checked there's enough data for all of these.
+    readui16(_ptr, _buflen, &num_paths);
+    readui32(_ptr, _buflen, &num_points);
+    for (int i = 0; i < 4; i++) {
+        Uint32 bits = 0;
+        readui32(_ptr, _buflen, &bits);
+        SDL_memcpy(&info->bounds[i], &bits, sizeof (bits));  // stored as the float's bits.
+    }
+    readui16(_ptr, _buflen, &flags);
+    readui32(_ptr, _buflen, &info->raster_cost);
+
+    info->num_shapes = (int) num_shapes;
+    info->num_paths = (int) num_paths;
+    info->num_points = (int) SDL_min(num_points, (Uint32) SDL_MAX_SINT32);
+    info->has_gradients = ((flags & IMAGEINFO_FLAG_GRADIENTS) != 0);
+    info->has_strokes = ((flags & IMAGEINFO_FLAG_STROKES) != 0);
+    return true;
+}
+
+static bool readlz4length(const Uint8 **_src, const Uint8 *srcend, size_t *_len)
+{
+    const Uint8 *src = *_src;
+    size_t len = *_len;
+    Uint8 b;
+    do {
+        if (src >= srcend) {
+            return false;
+        }
+        b = *(src++);
+        len += b;
+    } while (b == 255);
+    *_src = src;
+    *_len = len;
+    return true;
+}
+
+// Decompresses an LZ4 block (just the block format, no frame header). This
+//  is what make-controllerimage-data uses when asked to compress the strings.
+//  Returns false if the data is corrupt or doesn't decompress to exactly
+//  `dstlen` bytes.
+static bool DecompressBlock(const Uint8 *src, size_t srclen, Uint8 *dst, size_t dstlen)
+{
+    const Uint8 *srcend = src + srclen;
+    Uint8 *op = dst;
+    Uint8 *dstend = dst + dstlen;
+
+    while (src < srcend) {
+        const Uint8 token = *(src++);
+
+        size_t len = (size_t) (token >> 4);
+        if ((len == 15) && !readlz4length(&src, srcend, &len)) {
+            return false;
+        } else if ((len > (size_t) (srcend - src)) || (len > (size_t) (dstend - op))) {
+            return false;
+        }
+
+        SDL_memcpy(op, src, len);
+        op += len;
+        src += len;
+
+        if (src == srcend) {
+            break;  // the last sequence is only literals.
+        } else if ((srcend - src) < 2) {
+            return false;
+        }
+
+        const size_t offset = ((size_t) src[0]) | (((size_t) src[1]) << 8);
+        src += 2;
+        if ((offset == 0) || (offset > (size_t) (op - dst))) {
+            return false;
+        }
+
+        len = (size_t) (token & 0xF);
+        if ((len == 15) && !readlz4length(&src, srcend, &len)) {
+            return false;
+        }
+        len += 4;
+        if (len > (size_t) (dstend - op)) {
+            return false;
+        }
+
+        const Uint8 *match = op - offset;
+        if (offset >= len) {
+            SDL_memcpy(op, match, len);
+            op += len;
+        } else {  // overlapping copy, this is how runs get encoded, so it has to go a byte at a time.
+            for (size_t i = 0; i < len; i++) {
+                *(op++) = *(match++);
+            }
+        }
+    }
+
+    return (op == dstend);
+}
+
 static void SDLCALL CleanupDeviceInfo(void *userdata, void *value)
 {
-    SDL_free(value);
+    CI_free(value);
 }
 
-bool ControllerImage_AddData(const void *buf, size_t buflen)
+// `devtype` isn't copied, so it has to be in the StringCache or static data.
+static void MapGuidToDeviceType(SDL_GUID guid, const char *devtype)
+{
+    char guidstr[33];
+    SDL_GUIDToString(guid, guidstr, sizeof (guidstr));
+
+    // If this fails for some reason, go on without this guid.
+
+    // No cleanup function; the string outlives the map.
+    SDL_SetPointerProperty(GuidToDeviceTypeMap, guidstr, (void *) devtype);
+
+    // stick a GUID in there that's just the USB VID/PID values, which
+    // might catch some variations on the same device.
+    char vidpid[33];
+    SDL_memset(vidpid, '0', sizeof (vidpid) - 1);  // blank it out.
+    SDL_memcpy(&vidpid[8], &guidstr[8], 4);         // copy in VID
+    SDL_memcpy(&vidpid[16], &guidstr[16], 4);       // copy in PID
+    vidpid[32] = '\0';   // null-terminate it.
+
+    // No cleanup function; the string outlives the map.
+    SDL_SetPointerProperty(GuidToDeviceTypeMap, vidpid, (void *) devtype);
+}
+
+typedef struct PendingGuids
+{
+    const Uint8 *data;
+    Uint16 count;
+} PendingGuids;
+
+static void MapPendingGuids(const PendingGuids *guids, const char *devtype)
+{
+    for (Uint16 i = 0; i < guids->count; i++) {
+        SDL_GUID guid;
+        SDL_memcpy(guid.data, guids->data + (((size_t) i) * sizeof (SDL_GUID)), sizeof (guid.data));
+        MapGuidToDeviceType(guid, devtype);
+    }
+}
+
+static bool AddData(const void *buf, size_t buflen)
 {
     const Uint8 *ptr = ((const Uint8 *) buf) + sizeof (magic);
     char **strings = NULL;
+    Uint8 *decompressed = NULL;
+    ControllerImage_DeviceInfo **added = NULL;
+    PendingGuids *guids = NULL;
+    size_t total_items = 0;
     Uint16 num_devices = 0;
     Uint16 num_strings = 0;
     Uint16 version = 0;
@@ -208,26 +809,78 @@ bool ControllerImage_AddData(const void *buf, size_t buflen)
         goto bogus_data;
     } else if (SDL_memcmp(magic, buf, sizeof (magic)) != 0) {
         goto bogus_data;
-    } else if (!readui16(&ptr, &buflen, &version)) {
+    }
+
+    buflen -= sizeof (magic);
+    if (!readui16(&ptr, &buflen, &version)) {
         return false;
     } else if (version > CONTROLLERIMAGE_CURRENT_DATAVER) {
         return SDL_SetError("Unsupported data version; upgrade your copy of ControllerImage?");
     } else if (!readui16(&ptr, &buflen, &num_strings)) {
         return false;
-    } else if ((strings = (char **) SDL_calloc(num_strings, sizeof (char *))) == NULL) {
+    } else if ((strings = (char **) CI_calloc(num_strings, sizeof (char *))) == NULL) {
         return false;
     }
 
+    // the string table might be compressed, starting with version 3 of the file format.
+    const Uint8 *strptr = ptr;
+    size_t strbuflen = buflen;
+    if (version >= 3) {
+        Uint16 compression = 0;
+        if (!readui16(&ptr, &buflen, &compression)) {
+            goto failed;
+        } else if (compression == 1) {  // LZ4 block.
+            Uint32 uncompressed_len = 0;
+            Uint32 compressed_len = 0;
+            if (!readui32(&ptr, &buflen, &uncompressed_len) || !readui32(&ptr, &buflen, &compressed_len)) {
+                goto failed;
+            } else if (compressed_len > buflen) {
+                SDL_SetError("Unexpected end of data");
+                goto failed;
+            } else if ((decompressed = (Uint8 *) CI_malloc(uncompressed_len ? uncompressed_len : 1)) == NULL) {
+                goto failed;
+            } else if (!DecompressBlock(ptr, compressed_len, decompressed, uncompressed_len)) {
+                goto bogus_data;
+            }
+            ptr += compressed_len;
+            buflen -= compressed_len;
+            strptr = decompressed;
+            strbuflen = uncompressed_len;
+        } else if (compression != 0) {
+            SDL_SetError("Unsupported data compression; upgrade your copy of ControllerImage?");
+            goto failed;
+        } else {
+            strptr = ptr;
+            strbuflen = buflen;
+        }
+    }
+
     for (Uint16 i = 0; i < num_strings; i++) {
-        if (!readstr(&ptr, &buflen, &strings[i])) {
+        if (!readstr(&strptr, &strbuflen, &strings[i])) {
             goto failed;
         }
     }
 
+    if (decompressed) {
+        CI_free(decompressed);  // everything we need got copied into the StringCache.
+        decompressed = NULL;
+    } else {
+        ptr = strptr;  // the strings weren't compressed, so move past them in the original buffer.
+        buflen = strbuflen;
+    }
+
     if (!readui16(&ptr, &buflen, &num_devices)) {
         goto failed;
+    } else if ((added = (ControllerImage_DeviceInfo **) CI_calloc(num_devices ? num_devices : 1, sizeof (ControllerImage_DeviceInfo *))) == NULL) {
+        goto failed;
+    } else if ((guids = (PendingGuids *) CI_calloc(num_devices ? num_devices : 1, sizeof (PendingGuids))) == NULL) {
+        goto failed;
     }
 
+    // devices (and their GUIDs) don't get registered until we've read
+    // everything, since the sections after them can still fill in their
+    // items, or turn out to be bogus.
+
     for (Uint16 i = 0; i < num_devices; i++) {
         Uint16 num_items = 0;
         Uint16 num_guids = 0;
@@ -251,30 +904,28 @@ bool ControllerImage_AddData(const void *buf, size_t buflen)
             goto bogus_data;  // can't have an empty string for inherits.
         }
 
-        ControllerImage_DeviceInfo *info = (ControllerImage_DeviceInfo *) SDL_calloc(1, sizeof (ControllerImage_DeviceInfo) + (sizeof (ControllerImage_Item) * num_items));
+        ControllerImage_DeviceInfo *info = (ControllerImage_DeviceInfo *) CI_calloc(1, sizeof (ControllerImage_DeviceInfo) + (sizeof (ControllerImage_Item) * num_items));
         if (!info) {
             goto failed;
         }
 
+        added[i] = info;
         info->type = strings[devid];
         info->inherits = inherits ? strings[inherits] : NULL;
         info->num_items = num_items;
         info->items = (ControllerImage_Item *) (info + 1);
+        total_items += num_items;
 
         for (Uint16 j = 0; j < num_items; j++) {
             Uint16 itemtype = 0;
             Uint16 itemimage = 0;
             if (!readui16(&ptr, &buflen, &itemtype)) {
-                SDL_free(info);
                 goto failed;
             } else if (itemtype >= num_strings) {
-                SDL_free(info);
                 goto bogus_data;
             } else if (!readui16(&ptr, &buflen, &itemimage)) {
-                SDL_free(info);
                 goto failed;
             } else if (itemimage >= num_strings) {
-                SDL_free(info);
                 goto bogus_data;
             }
 
@@ -282,76 +933,251 @@ bool ControllerImage_AddData(const void *buf, size_t buflen)
             info->items[j].svg = strings[itemimage];
         }
 
-        if (!SDL_SetPointerPropertyWithCleanup(DeviceInfoMap, strings[devid], info, CleanupDeviceInfo, NULL)) {
+        // the GUIDs get mapped to device types at the end, with everything else.
+        const size_t guidslen = ((size_t) num_guids) * sizeof (SDL_GUID);
+        if (buflen < guidslen) {
+            SDL_SetError("Unexpected end of data");
             goto failed;
         }
+        guids[i].data = ptr;
+        guids[i].count = num_guids;
+        ptr += guidslen;
+        buflen -= guidslen;
+    }
 
-        // now map out GUIDs to device types, so we can get to the device info of whatever
-        // the latest loaded theme is, even though the GUIDs are probably only shipped
-        // with the "standard" database.
-        for (Uint16 j = 0; j < num_guids; j++) {
-            SDL_GUID guid;
-            if (buflen < sizeof (guid.data)) {
-                SDL_SetError("Unexpected end of data");
-                goto failed;
-            }
-
-            SDL_memcpy(guid.data, ptr, sizeof (guid.data));
-            ptr += sizeof (guid.data);
-            buflen -= sizeof (guid.data);
-
-            char guidstr[33];
-            SDL_GUIDToString(guid, guidstr, sizeof (guidstr));
-
-            // If this fails for some reason, go on without this guid.
-
-            // No cleanup function; this is using a string in the StringCache.
-            SDL_SetPointerProperty(GuidToDeviceTypeMap, guidstr, strings[devid]);
+    // Newer files have optional sections after the devices: a ui16 type,
+    //  a ui32 length, then that many bytes. Older versions of this library
+    //  stop reading before them, and we skip any types we don't know.
+    while (buflen >= 6) {
+        Uint16 section = 0;
+        Uint32 section_len = 0;
+        readui16(&ptr, &buflen, &section);
+        readui32(&ptr, &buflen, &section_len);
+        if (section_len > buflen) {
+            goto bogus_data;
+        } else if (section != SECTION_IMAGE_INFO) {
+            ptr += section_len;
+            buflen -= section_len;
+            continue;
+        } else if (section_len != (total_items * IMAGEINFO_RECORD_SIZE)) {
+            goto bogus_data;
+        }
 
-            // stick a GUID in there that's just the USB VID/PID values, which
-            // might catch some variations on the same device.
-            char vidpid[33];
-            SDL_memset(vidpid, '0', sizeof (vidpid) - 1);  // blank it out.
-            SDL_memcpy(&vidpid[8], &guidstr[8], 4);         // copy in VID
-            SDL_memcpy(&vidpid[16], &guidstr[16], 4);       // copy in PID
-            vidpid[32] = '\0';   // null-terminate it.
+        // one record per item, in the same order as the devices listed them.
+        for (Uint16 i = 0; i < num_devices; i++) {
+            ControllerImage_DeviceInfo *info = added[i];
+            for (int j = 0; j < info->num_items; j++) {
+                readimageinfo(&ptr, &buflen, &info->items[j].info);  // we already checked the section's length.
+                info->items[j].has_info = true;
+            }
+        }
+    }
 
-            // No cleanup function; this is using a string in the StringCache.
-            SDL_SetPointerProperty(GuidToDeviceTypeMap, vidpid, strings[devid]);
+    for (Uint16 i = 0; i < num_devices; i++) {
+        ControllerImage_DeviceInfo *info = added[i];
+        added[i] = NULL;  // the map owns it now, even if this fails.
+        if (!SDL_SetPointerPropertyWithCleanup(DeviceInfoMap, info->type, info, CleanupDeviceInfo, NULL)) {
+            goto failed;
         }
+
+        // now map out GUIDs to device types, so we can get to the device info of whatever
+        // the latest loaded theme is, even though the GUIDs are probably only shipped
+        // with the "standard" database.
+        MapPendingGuids(&guids[i], info->type);
     }
 
-    SDL_free(strings);  // the array! the actual strings are stored in StringCache!
+    CI_free(guids);
+    CI_free(added);
+    CI_free(strings);  // the array! the actual strings are stored in StringCache!
     return true;
 
 bogus_data:
     SDL_SetError("Bogus data");
 
 failed:
-    SDL_free(strings);
+    if (added) {
+        for (Uint16 i = 0; i < num_devices; i++) {
+            CI_free(added[i]);
+        }
+        CI_free(added);
+    }
+    CI_free(guids);
+    CI_free(decompressed);
+    CI_free(strings);
     return false;
 }
 
-bool ControllerImage_AddDataFromIOStream(SDL_IOStream *io, bool closeio)
+bool ControllerImage_AddData(const void *buf, size_t buflen)
 {
-    if (!io) {
-        return SDL_InvalidParamError("io");
-    }
-
-    size_t buflen = 0;
-    Uint8 *buf = (Uint8 *) SDL_LoadFile_IO(io, &buflen, closeio);
-    const bool retval = buf ? ControllerImage_AddData(buf, buflen) : false;
-    SDL_free(buf);
+    const Uint64 start = BeginProfile(CONTROLLERIMAGE_PROFILE_ADD_DATA);
+    const bool retval = AddData(buf, buflen);
+    EndProfile(CONTROLLERIMAGE_PROFILE_ADD_DATA, start);
+    EnforceMemoryBudget();
     return retval;
 }
 
-bool ControllerImage_AddDataFromFile(const char *fname)
+// Static data (what make-controllerimage-data --c-source writes) is laid out
+//  so we can use it right where it is: an index of devices that refers to
+//  strings by their offset in the buffer, followed by the strings themselves,
+//  each one only once. Nothing gets copied into the StringCache, and since the
+//  buffer has to end with a null terminator, every offset inside the string
+//  area is a valid string without having to scan any of them.
+static const char *GetStaticString(const Uint8 *buf, size_t buflen, Uint32 strings_offset, Uint32 offset)
 {
-    SDL_IOStream *io = SDL_IOFromFile(fname, "rb");
+    return ((offset >= strings_offset) && (offset < buflen)) ? (const char *) (buf + offset) : NULL;
+}
+
+static bool AddStaticData(const void *buf, size_t buflen)
+{
+    const Uint8 *data = (const Uint8 *) buf;
+    const Uint8 *ptr = data + sizeof (static_magic);
+    size_t remaining = buflen;
+    ControllerImage_DeviceInfo **added = NULL;
+    PendingGuids *guids = NULL;
+    Uint16 version = 0;
+    Uint16 num_devices = 0;
+    Uint32 strings_offset = 0;
+
+    if (!DeviceInfoMap) {
+        return SDL_SetError("Not initialized");
+    } else if (!buf) {
+        return SDL_InvalidParamError("buf");
+    } else if (buflen < 16) {
+        return SDL_SetError("Bogus data");
+    } else if (SDL_memcmp(static_magic, buf, sizeof (static_magic)) != 0) {
+        return SDL_SetError("Bogus data");
+    }
+
+    remaining -= sizeof (static_magic);
+    if (!readui16(&ptr, &remaining, &version)) {
+        return false;
+    } else if (version > CONTROLLERIMAGE_CURRENT_STATIC_DATAVER) {
+        return SDL_SetError("Unsupported static data version; upgrade your copy of ControllerImage?");
+    } else if (!readui16(&ptr, &remaining, &num_devices) || !readui32(&ptr, &remaining, &strings_offset)) {
+        return false;
+    } else if ((strings_offset < (Uint32) (ptr - data)) || (strings_offset >= buflen) || (data[buflen - 1] != '\0')) {
+        return SDL_SetError("Bogus data");
+    } else if ((added = (ControllerImage_DeviceInfo **) CI_calloc(num_devices ? num_devices : 1, sizeof (ControllerImage_DeviceInfo *))) == NULL) {
+        return false;
+    } else if ((guids = (PendingGuids *) CI_calloc(num_devices ? num_devices : 1, sizeof (PendingGuids))) == NULL) {
+        CI_free(added);
+        return false;
+    }
+
+    remaining = strings_offset - (size_t) (ptr - data);  // the index stops where the strings start.
+
+    // version 2 added a ControllerImage_ImageInfo record after each item.
+    const size_t itemlen = 8 + ((version >= 2) ? IMAGEINFO_RECORD_SIZE : 0);
+
+    // like AddData, nothing gets registered until the whole index checked out.
+    for (Uint16 i = 0; i < num_devices; i++) {
+        Uint32 devid = 0;
+        Uint32 inherits = 0;
+        Uint16 num_items = 0;
+        Uint16 num_guids = 0;
+        if (!readui32(&ptr, &remaining, &devid) || !readui32(&ptr, &remaining, &inherits)) {
+            goto failed;
+        } else if (!readui16(&ptr, &remaining, &num_items) || !readui16(&ptr, &remaining, &num_guids)) {
+            goto failed;
+        } else if (remaining < ((((size_t) num_items) * itemlen) + (((size_t) num_guids) * sizeof (SDL_GUID)))) {
+            SDL_SetError("Unexpected end of data");
+            goto failed;
+        }
+
+        const char *devtype = GetStaticString(data, buflen, strings_offset, devid);
+        const char *inheritstr = inherits ? GetStaticString(data, buflen, strings_offset, inherits) : NULL;
+        if (!devtype || (*devtype == '\0')) {
+            goto bogus_data;  // can't have an empty string for the device ID.
+        } else if (inherits && (!inheritstr || (*inheritstr == '\0'))) {
+            goto bogus_data;  // can't have an empty string for inherits.
+        }
+
+        ControllerImage_DeviceInfo *info = (ControllerImage_DeviceInfo *) CI_calloc(1, sizeof (ControllerImage_DeviceInfo) + (sizeof (ControllerImage_Item) * num_items));
+        if (!info) {
+            goto failed;
+        }
+
+        added[i] = info;
+        info->type = devtype;
+        info->inherits = inheritstr;
+        info->num_items = num_items;
+        info->items = (ControllerImage_Item *) (info + 1);
+
+        for (Uint16 j = 0; j < num_items; j++) {
+            Uint32 itemtype = 0;
+            Uint32 itemimage = 0;
+            readui32(&ptr, &remaining, &itemtype);  // we already checked there's enough data for these.
+            readui32(&ptr, &remaining, &itemimage);
+            info->items[j].type = GetStaticString(data, buflen, strings_offset, itemtype);
+            info->items[j].svg = GetStaticString(data, buflen, strings_offset, itemimage);
+            if (!info->items[j].type || !info->items[j].svg) {
+                goto bogus_data;
+            } else if (version >= 2) {
+                readimageinfo(&ptr, &remaining, &info->items[j].info);
+                info->items[j].has_info = true;
+            }
+        }
+
+        guids[i].data = ptr;
+        guids[i].count = num_guids;
+        ptr += ((size_t) num_guids) * sizeof (SDL_GUID);
+        remaining -= ((size_t) num_guids) * sizeof (SDL_GUID);
+    }
+
+    for (Uint16 i = 0; i < num_devices; i++) {
+        ControllerImage_DeviceInfo *info = added[i];
+        added[i] = NULL;  // the map owns it now, even if this fails.
+        if (!SDL_SetPointerPropertyWithCleanup(DeviceInfoMap, info->type, info, CleanupDeviceInfo, NULL)) {
+            goto failed;
+        }
+        MapPendingGuids(&guids[i], info->type);
+    }
+
+    CI_free(guids);
+    CI_free(added);
+    return true;
+
+bogus_data:
+    SDL_SetError("Bogus data");
+
+failed:
+    for (Uint16 i = 0; i < num_devices; i++) {
+        CI_free(added[i]);
+    }
+    CI_free(added);
+    CI_free(guids);
+    return false;
+}
+
+bool ControllerImage_AddStaticData(const void *buf, size_t buflen)
+{
+    const Uint64 start = BeginProfile(CONTROLLERIMAGE_PROFILE_ADD_DATA);
+    const bool retval = AddStaticData(buf, buflen);
+    EndProfile(CONTROLLERIMAGE_PROFILE_ADD_DATA, start);
+    EnforceMemoryBudget();
+    return retval;
+}
+
+bool ControllerImage_AddDataFromIOStream(SDL_IOStream *io, bool closeio)
+{
+    if (!io) {
+        return SDL_InvalidParamError("io");
+    }
+
+    size_t buflen = 0;
+    Uint8 *buf = (Uint8 *) SDL_LoadFile_IO(io, &buflen, closeio);
+    const bool retval = buf ? ControllerImage_AddData(buf, buflen) : false;
+    SDL_free(buf);
+    return retval;
+}
+
+bool ControllerImage_AddDataFromFile(const char *fname)
+{
+    SDL_IOStream *io = SDL_IOFromFile(fname, "rb");
     return io ? ControllerImage_AddDataFromIOStream(io, true) : false;
 }
 
-static void CollectGamepadImages(ControllerImage_DeviceInfo *info, char **axes, char **buttons)
+static void CollectGamepadImages(ControllerImage_DeviceInfo *info, const ControllerImage_Item **axes, const ControllerImage_Item **buttons)
 {
     if (!info) {
         return;
@@ -393,8 +1219,7 @@ static void CollectGamepadImages(ControllerImage_DeviceInfo *info, char **axes,
         if (axis != SDL_GAMEPAD_AXIS_INVALID) {
             SDL_assert(axis >= 0);
             if (axis < SDL_GAMEPAD_AXIS_COUNT) {
-                SDL_free(axes[axis]);  // in case we're overriding an earlier image.
-                axes[axis] = SDL_strdup(item->svg);
+                axes[axis] = item;  // might override an earlier image, that's okay.
                 axes_present[axis] = true;
             }
         } else {
@@ -402,8 +1227,7 @@ static void CollectGamepadImages(ControllerImage_DeviceInfo *info, char **axes,
             if (button != SDL_GAMEPAD_BUTTON_INVALID) {
                 SDL_assert(button >= 0);
                 if (button < SDL_GAMEPAD_BUTTON_COUNT) {
-                    SDL_free(buttons[button]);  // in case we're overriding an earlier image.
-                    buttons[button] = SDL_strdup(item->svg);
+                    buttons[button] = item;  // might override an earlier image, that's okay.
                 }
             }
         }
@@ -412,73 +1236,333 @@ static void CollectGamepadImages(ControllerImage_DeviceInfo *info, char **axes,
     // If there isn't a separate image for [left|right][x|y], see if there's a [left|right]xy fallback...
     if (leftxy) {
         if (!axes_present[SDL_GAMEPAD_AXIS_LEFTX]) {
-            SDL_free(axes[SDL_GAMEPAD_AXIS_LEFTX]);
-            axes[SDL_GAMEPAD_AXIS_LEFTX] = SDL_strdup(leftxy->svg);
+            axes[SDL_GAMEPAD_AXIS_LEFTX] = leftxy;
         }
         if (!axes_present[SDL_GAMEPAD_AXIS_LEFTY]) {
-            SDL_free(axes[SDL_GAMEPAD_AXIS_LEFTY]);
-            axes[SDL_GAMEPAD_AXIS_LEFTY] = SDL_strdup(leftxy->svg);
+            axes[SDL_GAMEPAD_AXIS_LEFTY] = leftxy;
         }
     }
 
     if (rightxy) {
         if (!axes_present[SDL_GAMEPAD_AXIS_RIGHTX]) {
-            SDL_free(axes[SDL_GAMEPAD_AXIS_RIGHTX]);
-            axes[SDL_GAMEPAD_AXIS_RIGHTX] = SDL_strdup(rightxy->svg);
+            axes[SDL_GAMEPAD_AXIS_RIGHTX] = rightxy;
         }
         if (!axes_present[SDL_GAMEPAD_AXIS_RIGHTY]) {
-            SDL_free(axes[SDL_GAMEPAD_AXIS_RIGHTY]);
-            axes[SDL_GAMEPAD_AXIS_RIGHTY] = SDL_strdup(rightxy->svg);
+            axes[SDL_GAMEPAD_AXIS_RIGHTY] = rightxy;
         }
     }
 }
 
-static ControllerImage_Device *CreateGamepadDeviceFromInfo(ControllerImage_DeviceInfo *info)
+static NSVGimage *ParseSVG(const char *svg)
 {
-    if (!info) {
-        SDL_SetError("Couldn't find any usable images for this device! Maybe you didn't load anything?");
+    // nsvgParseConst doesn't touch the string, so we can parse the interned copy directly.
+    const Uint64 start = BeginProfile(CONTROLLERIMAGE_PROFILE_PARSE_SVG);
+    NSVGimage *image = nsvgParseConst(svg, SDL_strlen(svg), "px", 96.0f);
+    Stats.parse_time_ns += EndProfile(CONTROLLERIMAGE_PROFILE_PARSE_SVG, start);
+    Stats.images_parsed++;
+    return image;
+}
+
+static bool GrowSharedImages(void)
+{
+    const int newsize = SharedImageBuckets ? (SharedImageBuckets * 2) : 64;
+    Uint64 *prevcounter = SetMemoryCounter(NULL);  // shared, so don't charge it to any device.
+    SharedImage **buckets = (SharedImage **) CI_calloc(newsize, sizeof (SharedImage *));
+    SetMemoryCounter(prevcounter);
+    if (!buckets) {
+        return false;
+    }
+
+    for (int i = 0; i < SharedImageBuckets; i++) {
+        SharedImage *next = NULL;
+        for (SharedImage *shared = SharedImages[i]; shared; shared = next) {
+            const int bucket = (int) (shared->hash & (newsize - 1));
+            next = shared->next;
+            shared->next = buckets[bucket];
+            buckets[bucket] = shared;
+        }
+    }
+
+    CI_free(SharedImages);
+    SharedImages = buckets;
+    SharedImageBuckets = newsize;
+    return true;
+}
+
+// Get a reference to the parsed image for this SVG, parsing it only if nothing else has it already.
+static SharedImage *AcquireImage(const char *svg)
+{
+    const Uint64 hash = HashString(svg, SDL_strlen(svg));
+
+    if (SharedImageBuckets) {
+        for (SharedImage *shared = SharedImages[hash & (SharedImageBuckets - 1)]; shared; shared = shared->next) {
+            if ((shared->hash == hash) && shared->svg && ((shared->svg == svg) || (SDL_strcmp(shared->svg, svg) == 0))) {
+                shared->refcount++;
+                Stats.images_shared++;
+                return shared;
+            }
+        }
+    }
+
+    if ((NumSharedImages >= SharedImageBuckets) && !GrowSharedImages()) {
         return NULL;
     }
 
-    ControllerImage_Device *device = SDL_calloc(1, sizeof (ControllerImage_Device));
-    if (!device) {
+    Uint64 *prevcounter = SetMemoryCounter(NULL);
+    SharedImage *shared = (SharedImage *) CI_calloc(1, sizeof (SharedImage));
+    if (shared) {
+        SetMemoryCounter(&shared->memory_used);
+        shared->image = ParseSVG(svg);
+    }
+    SetMemoryCounter(prevcounter);
+
+    if (!shared) {
+        return NULL;
+    } else if (!shared->image) {
+        CI_free(shared);
         return NULL;
     }
 
-    device->device_type = info->type;
+    const int bucket = (int) (hash & (SharedImageBuckets - 1));
+    shared->hash = hash;
+    shared->svg = svg;
+    shared->refcount = 1;
+    shared->next = SharedImages[bucket];
+    SharedImages[bucket] = shared;
+    NumSharedImages++;
+    return shared;
+}
+
+static void FreeEdgeCache(EdgeCacheEntry **_list)
+{
+    EdgeCacheEntry *next = NULL;
+    for (EdgeCacheEntry *entry = *_list; entry; entry = next) {
+        next = entry->next;
+        nsvgDeleteEdgeCache(entry->edges);
+        CI_free(entry);
+    }
+    *_list = NULL;
+}
+
+static void ReleaseImage(SharedImage *shared)
+{
+    if (shared && (--shared->refcount == 0)) {
+        SharedImage **link = &SharedImages[shared->hash & (SharedImageBuckets - 1)];
+        while (*link != shared) {
+            link = &(*link)->next;
+        }
+        *link = shared->next;
+
+        FreeEdgeCache(&shared->edges);
+        nsvgDelete(shared->image);
+        SDL_assert(shared->memory_used == 0);
+        CI_free(shared);
+
+        if (--NumSharedImages == 0) {  // don't leave anything allocated if devices outlived ControllerImage_Quit().
+            CI_free(SharedImages);
+            SharedImages = NULL;
+            SharedImageBuckets = 0;
+        }
+    }
+}
+
+// drops the edge caches of every image this device uses, even if other devices use them too; they get rebuilt as needed.
+static void PurgeDeviceEdgeCaches(ControllerImage_Device *device)
+{
+    for (int i = 0; i < SDL_GAMEPAD_AXIS_COUNT; i++) {
+        if (device->axes[i]) {
+            FreeEdgeCache(&device->axes[i]->edges);
+        }
+    }
+    for (int i = 0; i < SDL_GAMEPAD_BUTTON_COUNT; i++) {
+        if (device->buttons[i]) {
+            FreeEdgeCache(&device->buttons[i]->edges);
+        }
+    }
+}
+
+static void FreeDeviceImages(ControllerImage_Device *device)
+{
+    for (int i = 0; i < SDL_GAMEPAD_AXIS_COUNT; i++) {
+        ReleaseImage(device->axes[i]);
+    }
+    for (int i = 0; i < SDL_GAMEPAD_BUTTON_COUNT; i++) {
+        ReleaseImage(device->buttons[i]);
+    }
+}
+
+// move a device to the front of the live list, so it's the last to lose memory to the budget.
+static void TouchDevice(ControllerImage_Device *device)
+{
+    if (LiveDevices != device) {
+        if (device->prev) {
+            device->prev->next = device->next;
+        }
+        if (device->next) {
+            device->next->prev = device->prev;
+        }
+        device->prev = NULL;
+        device->next = LiveDevices;
+        if (LiveDevices) {
+            LiveDevices->prev = device;
+        }
+        LiveDevices = device;
+    }
+}
 
-    CollectGamepadImages(info, device->axes_svg, device->buttons_svg);
+// Rasterizers are only needed while an image is being rasterized, so instead of each device keeping
+//  one (and its scratch buffers, which grow to fit the biggest thing it ever drew), they borrow one
+//  from a library-wide pool for each call. The pool only grows as large as the number of
+//  rasterizations in progress at once, no matter how many devices are live.
+static NSVGrasterizer *BorrowRasterizer(void)
+{
+    if (NumPooledRasterizers > 0) {
+        return RasterizerPool[--NumPooledRasterizers];
+    }
 
-    device->rasterizer = nsvgCreateRasterizer();
-    if (!device->rasterizer) {
-        SDL_free(device);
+    Uint64 *prevcounter = SetMemoryCounter(NULL);  // shared, so don't charge it to any device.
+    NSVGrasterizer *rasterizer = nsvgCreateRasterizer();
+    SetMemoryCounter(prevcounter);
+    if (!rasterizer) {
         SDL_SetError("Failed to create SVG rasterizer");
+    }
+    return rasterizer;
+}
+
+static void ReturnRasterizer(NSVGrasterizer *rasterizer)
+{
+    Uint64 *prevcounter = SetMemoryCounter(NULL);
+    if (!controllerimage_initialized) {
+        nsvgDeleteRasterizer(rasterizer);  // a device outlived the library; don't leave anything allocated after ControllerImage_Quit().
+    } else if (NumPooledRasterizers < RasterizerPoolCapacity) {
+        RasterizerPool[NumPooledRasterizers++] = rasterizer;
+    } else {
+        const int newcapacity = RasterizerPoolCapacity ? (RasterizerPoolCapacity * 2) : 4;
+        void *ptr = CI_realloc(RasterizerPool, sizeof (NSVGrasterizer *) * newcapacity);
+        if (!ptr) {
+            nsvgDeleteRasterizer(rasterizer);  // oh well, we'll make another later.
+        } else {
+            RasterizerPool = (NSVGrasterizer **) ptr;
+            RasterizerPoolCapacity = newcapacity;
+            RasterizerPool[NumPooledRasterizers++] = rasterizer;
+        }
+    }
+    SetMemoryCounter(prevcounter);
+}
+
+void ControllerImage_TrimRasterizerPool(void)
+{
+    for (int i = 0; i < NumPooledRasterizers; i++) {
+        nsvgDeleteRasterizer(RasterizerPool[i]);
+    }
+    CI_free(RasterizerPool);
+    RasterizerPool = NULL;
+    NumPooledRasterizers = 0;
+    RasterizerPoolCapacity = 0;
+}
+
+static void PurgeDeviceImages(ControllerImage_Device *device)
+{
+    for (int i = 0; i < SDL_GAMEPAD_AXIS_COUNT; i++) {
+        if (device->axes[i]) {
+            ReleaseImage(device->axes[i]);  // if another device is still using it, it stays parsed for them.
+            device->axes[i] = NULL;
+            device->axes_purged[i] = true;
+        }
+    }
+    for (int i = 0; i < SDL_GAMEPAD_BUTTON_COUNT; i++) {
+        if (device->buttons[i]) {
+            ReleaseImage(device->buttons[i]);
+            device->buttons[i] = NULL;
+            device->buttons_purged[i] = true;
+        }
+    }
+}
+
+// If we're over budget, throw away things we can rebuild later.
+//  Pooled rasterizer scratch buffers are cheap to rebuild, so those go first, then cached edge lists,
+//  and then parsed images, least-recently-used devices first.
+//  This can't go below what the database and the devices' SVG strings need, so the budget is a soft limit.
+static void EnforceMemoryBudget(void)
+{
+    if (!MemoryBudget || (MemoryUsed <= MemoryBudget)) {
+        return;
+    }
+
+    ControllerImage_TrimRasterizerPool();
+
+    if (!LiveDevices || (MemoryUsed <= MemoryBudget)) {
+        return;
+    }
+
+    ControllerImage_Device *oldest = LiveDevices;
+    while (oldest->next) {
+        oldest = oldest->next;
+    }
+
+    for (ControllerImage_Device *device = oldest; device && (MemoryUsed > MemoryBudget); device = device->prev) {
+        PurgeDeviceEdgeCaches(device);
+    }
+
+    for (ControllerImage_Device *device = oldest; device && (MemoryUsed > MemoryBudget); device = device->prev) {
+        PurgeDeviceImages(device);
+    }
+}
+
+static ControllerImage_Device *CreateGamepadDeviceFromInfoInternal(ControllerImage_DeviceInfo *info)
+{
+    if (!info) {
+        SDL_SetError("Couldn't find any usable images for this device! Maybe you didn't load anything?");
         return NULL;
     }
 
+    ControllerImage_Device *device = CI_calloc(1, sizeof (ControllerImage_Device));
+    if (!device) {
+        return NULL;
+    }
+
+    device->device_type = info->type;
+
+    const ControllerImage_Item *axes[SDL_GAMEPAD_AXIS_COUNT];
+    const ControllerImage_Item *buttons[SDL_GAMEPAD_BUTTON_COUNT];
+    SDL_zeroa(axes);
+    SDL_zeroa(buttons);
+    CollectGamepadImages(info, axes, buttons);
+
     for (int i = 0; i < SDL_GAMEPAD_AXIS_COUNT; i++) {
-        if (device->axes_svg[i]) {
-            char *cpy = SDL_strdup(device->axes_svg[i]);  // nsvgParse mangles the string!
-            if (cpy) {
-                device->axes[i] = nsvgParse(cpy, "px", 96.0f);
-                SDL_free(cpy);
-            }
+        if (axes[i]) {
+            device->axes[i] = AcquireImage(axes[i]->svg);
+            device->axes_svg[i] = device->axes[i] ? device->axes[i]->svg : axes[i]->svg;  // use the shared copy, so the texture cache sees them as the same image.
+            device->axes_info[i] = axes[i]->info;
+            device->axes_has_info[i] = axes[i]->has_info;
         }
     }
 
     for (int i = 0; i < SDL_GAMEPAD_BUTTON_COUNT; i++) {
-        if (device->buttons_svg[i]) {
-            char *cpy = SDL_strdup(device->buttons_svg[i]);  // nsvgParse mangles the string!
-            if (cpy) {
-                device->buttons[i] = nsvgParse(cpy, "px", 96.0f);
-                SDL_free(cpy);
-            }
+        if (buttons[i]) {
+            device->buttons[i] = AcquireImage(buttons[i]->svg);
+            device->buttons_svg[i] = device->buttons[i] ? device->buttons[i]->svg : buttons[i]->svg;
+            device->buttons_info[i] = buttons[i]->info;
+            device->buttons_has_info[i] = buttons[i]->has_info;
         }
     }
 
+    Stats.devices_live++;
+
+    TouchDevice(device);
+    EnforceMemoryBudget();
+
     return device;
 }
 
+static ControllerImage_Device *CreateGamepadDeviceFromInfo(ControllerImage_DeviceInfo *info)
+{
+    const Uint64 start = BeginProfile(CONTROLLERIMAGE_PROFILE_CREATE_DEVICE);
+    ControllerImage_Device *retval = CreateGamepadDeviceFromInfoInternal(info);
+    EndProfile(CONTROLLERIMAGE_PROFILE_CREATE_DEVICE, start);
+    return retval;
+}
+
 ControllerImage_Device *ControllerImage_CreateGamepadDeviceByIdString(const char *str)
 {
     const char *devtype = SDL_GetPointerProperty(GuidToDeviceTypeMap, str, NULL);  // in case it's a GUID.
@@ -557,104 +1641,1138 @@ ControllerImage_Device *ControllerImage_CreateGamepadDevice(SDL_Gamepad *gamepad
 void ControllerImage_DestroyDevice(ControllerImage_Device *device)
 {
     if (device) {
-        nsvgDeleteRasterizer(device->rasterizer);
-        for (int i = 0; i < SDL_GAMEPAD_AXIS_COUNT; i++) {
-            nsvgDelete(device->axes[i]);
-            SDL_free(device->axes_svg[i]);
+        SDL_assert(Stats.devices_live > 0);
+        Stats.devices_live--;
+
+        if (device->prev) {
+            device->prev->next = device->next;
+        } else {
+            SDL_assert(LiveDevices == device);
+            LiveDevices = device->next;
         }
-        for (int i = 0; i < SDL_GAMEPAD_BUTTON_COUNT; i++) {
-            nsvgDelete(device->buttons[i]);
-            SDL_free(device->buttons_svg[i]);
+        if (device->next) {
+            device->next->prev = device->prev;
         }
+
+        ForgetBatchDevice(device);
+        FreeDeviceImages(device);
+        SDL_assert(device->memory_used == 0);
+        CI_free(device);
     }
 }
 
 bool ControllerImage_DeviceHasArtworkForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis)
 {
     if (!device) {
-        return NULL;
+        return false;
     }
     const int iaxis = (int) axis;
     if ((iaxis < 0) || (iaxis >= SDL_GAMEPAD_AXIS_COUNT)) {
-        return NULL;
+        return false;
     }
-    return device->axes[iaxis] != NULL;
+    return (device->axes[iaxis] != NULL) || device->axes_purged[iaxis];
 }
 
 bool ControllerImage_DeviceHasArtworkForButton(ControllerImage_Device *device, SDL_GamepadButton button)
 {
     if (!device) {
-        return NULL;
+        return false;
     }
     const int ibutton = (int) button;
     if ((ibutton < 0) || (ibutton >= SDL_GAMEPAD_BUTTON_COUNT)) {
-        return NULL;
+        return false;
     }
-    return device->buttons[ibutton] != NULL;
+    return (device->buttons[ibutton] != NULL) || device->buttons_purged[ibutton];
 }
 
-static SDL_Surface *RasterizeImage(NSVGrasterizer *rasterizer, NSVGimage *image, int size)
+// reparses the image if it was dropped to stay under the memory budget (unless another device still has it).
+static SharedImage *GetDeviceImage(SharedImage **image, const char *svg, bool *purged)
 {
-    SDL_assert(image != NULL);
+    if (*purged) {
+        *image = AcquireImage(svg);
+        if (*image) {
+            *purged = false;
+        }
+    }
 
-    SDL_Surface *surface = SDL_CreateSurface(size, size, SDL_PIXELFORMAT_ABGR8888);
-    if (!surface) {
+    if (!*image) {
+        SDL_SetError("No image available");
         return NULL;
     }
-
-    const float scale = (float)size / image->width;
-
-    SDL_assert(rasterizer != NULL);
-    nsvgRasterize(rasterizer, image, 0.0f, 0.0f, scale, (unsigned char *) surface->pixels, size, size, size * 4);
-    return surface;
+    return *image;
 }
 
-SDL_Surface *ControllerImage_CreateSurfaceForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis, int size)
+// finds (or adds) this scale in an image's edge cache and makes it the most-recently-used one.
+//  Returns NULL if out of memory, which just means we rasterize without the cache.
+static EdgeCacheEntry *FindEdgeCacheEntry(SharedImage *shared, const RasterLayout *layout, bool *_added)
 {
-    if (!device) {
-        SDL_InvalidParamError("device");
-        return NULL;
-    }
-    const int iaxis = (int) axis;
-    if ((iaxis < 0) || (iaxis >= SDL_GAMEPAD_AXIS_COUNT)) {
-        SDL_InvalidParamError("axis");
-        return NULL;
+    *_added = false;
+
+    EdgeCacheEntry **_list = &shared->edges;
+    EdgeCacheEntry *prev = NULL;
+    int count = 0;
+    for (EdgeCacheEntry *entry = *_list; entry; entry = entry->next) {
+        if ((entry->sx == layout->sx) && (entry->sy == layout->sy) && (entry->tx == layout->tx) && (entry->ty == layout->ty)) {
+            if (prev) {
+                prev->next = entry->next;
+                entry->next = *_list;
+                *_list = entry;
+            }
+            return entry;
+        } else if (++count == MAX_EDGE_CACHE_SIZES) {
+            SDL_assert(prev != NULL);  // MAX_EDGE_CACHE_SIZES is > 1, right?
+            prev->next = NULL;  // drop the least-recently-used size to make room.
+            FreeEdgeCache(&entry);
+            break;
+        }
+        prev = entry;
     }
-    NSVGimage *img = device->axes[iaxis];
-    if (!img) {
-        SDL_SetError("No image available");
-        return NULL;
+
+    Uint64 *prevcounter = SetMemoryCounter(&shared->memory_used);
+    EdgeCacheEntry *entry = (EdgeCacheEntry *) CI_calloc(1, sizeof (EdgeCacheEntry));
+    SetMemoryCounter(prevcounter);
+    if (entry) {
+        entry->sx = layout->sx;
+        entry->sy = layout->sy;
+        entry->tx = layout->tx;
+        entry->ty = layout->ty;
+        entry->next = *_list;
+        *_list = entry;
+        *_added = true;
     }
-    return RasterizeImage(device->rasterizer, img, size);
+    return entry;
 }
 
-SDL_Surface *ControllerImage_CreateSurfaceForButton(ControllerImage_Device *device, SDL_GamepadButton button, int size)
+// Figures out how to have the rasterizer write `format` directly. The rasterizer natively writes RGBA bytes
+//  (SDL_PIXELFORMAT_RGBA32), and anything else is packed as it unpremultiplies, so there's no separate conversion pass.
+//  Sets `*nsvgfmt` to NULL if no conversion is needed.
+static bool GetRasterPixelFormat(SDL_PixelFormat format, NSVGpixelFormat *nsvgfmtdata, const NSVGpixelFormat **nsvgfmt, int *bpp)
 {
-    if (!device) {
-        SDL_InvalidParamError("device");
-        return NULL;
+    *nsvgfmt = NULL;
+    *bpp = 4;
+
+    if (format == SDL_PIXELFORMAT_RGBA32) {
+        return true;
+    } else if (SDL_ISPIXELFORMAT_FOURCC(format) || SDL_ISPIXELFORMAT_INDEXED(format) || SDL_ISPIXELFORMAT_FLOAT(format)) {
+        return SDL_SetError("Unsupported pixel format %s", SDL_GetPixelFormatName(format));
     }
-    const int ibutton = (int) button;
-    if ((ibutton < 0) || (ibutton >= SDL_GAMEPAD_BUTTON_COUNT)) {
-        SDL_InvalidParamError("button");
-        return NULL;
+
+    const SDL_PixelFormatDetails *details = SDL_GetPixelFormatDetails(format);
+    if (!details) {
+        return false;
+    } else if (((details->bytes_per_pixel != 2) && (details->bytes_per_pixel != 4)) ||
+               !details->Rbits || !details->Gbits || !details->Bbits ||
+               (details->Rbits > 8) || (details->Gbits > 8) || (details->Bbits > 8) || (details->Abits > 8)) {
+        return SDL_SetError("Unsupported pixel format %s", SDL_GetPixelFormatName(format));
     }
-    NSVGimage *img = device->buttons[ibutton];
-    if (!img) {
-        SDL_SetError("No image available");
-        return NULL;
+
+    SDL_zerop(nsvgfmtdata);
+    nsvgfmtdata->bytesPerPixel = details->bytes_per_pixel;
+    nsvgfmtdata->rbits = details->Rbits;
+    nsvgfmtdata->gbits = details->Gbits;
+    nsvgfmtdata->bbits = details->Bbits;
+    nsvgfmtdata->abits = details->Abits;
+    nsvgfmtdata->rshift = details->Rshift;
+    nsvgfmtdata->gshift = details->Gshift;
+    nsvgfmtdata->bshift = details->Bshift;
+    nsvgfmtdata->ashift = details->Ashift;
+    if (!details->Abits) {  // no alpha channel? Use a color key for transparency.
+        nsvgfmtdata->useColorKey = 1;
+        nsvgfmtdata->colorKey = SDL_MapRGB(details, NULL, 255, 0, 255);
     }
-    return RasterizeImage(device->rasterizer, img, size);
+
+    *nsvgfmt = nsvgfmtdata;
+    *bpp = details->bytes_per_pixel;
+    return true;
 }
 
-const char *ControllerImage_GetSVGForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis)
+// rasterizes into `pixels`, in the format GetRasterPixelFormat() figured out. Only `layout->rect` is touched, so the caller
+//  has to clear the rest, if there is any.
+static bool RasterizeToPixels(ControllerImage_Device *device, SharedImage *shared, const RasterLayout *layout, const NSVGpixelFormat *nsvgfmt, int bpp, void *pixels, int pitch)
 {
-    if (!device) {
-        SDL_InvalidParamError("device");
-        return NULL;
+    SDL_assert(shared != NULL);
+    NSVGimage *image = shared->image;
+
+    NSVGrasterizer *rasterizer = BorrowRasterizer();
+    if (!rasterizer) {
+        return false;
     }
-    const int iaxis = (int) axis;
-    if ((iaxis < 0) || (iaxis >= SDL_GAMEPAD_AXIS_COUNT)) {
+
+    bool added = false;
+    EdgeCacheEntry *entry = FindEdgeCacheEntry(shared, layout, &added);
+
+    const SDL_Rect *rect = &layout->rect;
+    unsigned char *dst = ((unsigned char *) pixels) + (rect->y * pitch) + (rect->x * bpp);
+
+    // the rasterizer's scratch buffers grow as needed; they belong to the pool, so don't charge them to this device.
+    Uint64 *prevcounter = SetMemoryCounter(NULL);
+    const Uint64 start = BeginProfile(CONTROLLERIMAGE_PROFILE_RASTERIZE);
+
+    if (entry && entry->edges) {
+        Stats.edge_cache_hits++;
+    } else {
+        Stats.edge_cache_misses++;
+        if (entry && !added) {  // second time at this scale, so it's probably going to keep happening. Cache the edges.
+            entry->edges = nsvgCreateEdgeCache(rasterizer, image, layout->tx, layout->ty, layout->sx, layout->sy);
+            ChargeAllocation(entry->edges, &shared->memory_used);
+        }
+    }
+
+    nsvgSetPixelFormat(rasterizer, nsvgfmt);
+    if (entry && entry->edges) {
+        nsvgRasterizeEdgeCache(rasterizer, image, entry->edges, dst, rect->w, rect->h, pitch);
+    } else {
+        nsvgRasterizeXY(rasterizer, image, layout->tx, layout->ty, layout->sx, layout->sy, dst, rect->w, rect->h, pitch);
+    }
+    nsvgSetPixelFormat(rasterizer, NULL);  // it's going back to the pool.
+
+    Stats.raster_time_ns += EndProfile(CONTROLLERIMAGE_PROFILE_RASTERIZE, start);
+    Stats.rasterizations++;
+    Stats.pixels_produced += (Uint64) rect->w * (Uint64) rect->h;
+    SetMemoryCounter(prevcounter);
+
+    ReturnRasterizer(rasterizer);
+
+    TouchDevice(device);
+    EnforceMemoryBudget();
+
+    return true;
+}
+
+static SDL_Surface *RasterizeImage(ControllerImage_Device *device, SharedImage *shared, const RasterLayout *layout, SDL_PixelFormat format)
+{
+    NSVGpixelFormat nsvgfmtdata;
+    const NSVGpixelFormat *nsvgfmt = NULL;
+    int bpp = 0;
+    if (!GetRasterPixelFormat(format, &nsvgfmtdata, &nsvgfmt, &bpp)) {
+        return NULL;
+    }
+
+    // SDL_CreateSurface() clears the pixels, so we only have to rasterize the part the image covers.
+    SDL_Surface *surface = SDL_CreateSurface(layout->surface_w, layout->surface_h, format);
+    if (!surface) {
+        return NULL;
+    }
+
+    // no alpha channel? Transparent pixels get the same color key the rasterizer uses, borders included.
+    if (!SDL_ISPIXELFORMAT_ALPHA(format)) {
+        const Uint32 colorkey = SDL_MapSurfaceRGB(surface, 255, 0, 255);
+        if (!SDL_SetSurfaceColorKey(surface, true, colorkey) || !SDL_FillSurfaceRect(surface, NULL, colorkey)) {
+            SDL_DestroySurface(surface);
+            return NULL;
+        }
+    }
+
+    if (!RasterizeToPixels(device, shared, layout, nsvgfmt, bpp, surface->pixels, surface->pitch)) {
+        SDL_DestroySurface(surface);
+        return NULL;
+    }
+    return surface;
+}
+
+// the original behavior: a square, with the image's width scaled to fit it.
+static void CalculateSquareLayout(const NSVGimage *image, int size, RasterLayout *layout)
+{
+    SDL_zerop(layout);
+    layout->surface_w = layout->surface_h = layout->rect.w = layout->rect.h = size;
+    layout->sx = layout->sy = (float)size / image->width;
+}
+
+static SDL_Surface *RasterizeSquare(ControllerImage_Device *device, SharedImage *shared, int size)
+{
+    RasterLayout layout;
+    CalculateSquareLayout(shared->image, size, &layout);
+    return RasterizeImage(device, shared, &layout, SDL_PIXELFORMAT_RGBA32);
+}
+
+static SDL_Surface *RasterizeFitted(ControllerImage_Device *device, SharedImage *shared, int width, int height, ControllerImage_FitMode fit, SDL_PixelFormat format)
+{
+    const NSVGimage *image = shared->image;
+    if (width <= 0) {
+        SDL_InvalidParamError("width");
+        return NULL;
+    } else if (height <= 0) {
+        SDL_InvalidParamError("height");
+        return NULL;
+    } else if ((image->width <= 0.0f) || (image->height <= 0.0f)) {
+        SDL_SetError("Image has no size");
+        return NULL;
+    }
+
+    const float w = (float) width;
+    const float h = (float) height;
+    const float iw = image->width;
+    const float ih = image->height;
+
+    RasterLayout layout;
+    SDL_zero(layout);
+    layout.surface_w = layout.rect.w = width;
+    layout.surface_h = layout.rect.h = height;
+
+    switch (fit) {
+        case CONTROLLERIMAGE_FIT_CONTAIN:  // center it, and only rasterize the rows and columns it covers; the borders stay clear.
+            layout.sx = layout.sy = SDL_min(w / iw, h / ih);
+            layout.rect.w = SDL_min(width, (int) SDL_ceilf(iw * layout.sx));
+            layout.rect.h = SDL_min(height, (int) SDL_ceilf(ih * layout.sy));
+            layout.rect.x = (width - layout.rect.w) / 2;
+            layout.rect.y = (height - layout.rect.h) / 2;
+            break;
+
+        case CONTROLLERIMAGE_FIT_COVER:  // center it, the rasterizer clips whatever hangs off the edges.
+            layout.sx = layout.sy = SDL_max(w / iw, h / ih);
+            layout.tx = SDL_roundf((w - (iw * layout.sx)) / 2.0f);
+            layout.ty = SDL_roundf((h - (ih * layout.sy)) / 2.0f);
+            break;
+
+        case CONTROLLERIMAGE_FIT_STRETCH:
+            layout.sx = w / iw;
+            layout.sy = h / ih;
+            break;
+
+        case CONTROLLERIMAGE_FIT_INTRINSIC:  // like CONTAIN, but shrink the surface to match instead of leaving borders.
+            layout.sx = layout.sy = SDL_min(w / iw, h / ih);
+            layout.surface_w = layout.rect.w = SDL_clamp((int) SDL_roundf(iw * layout.sx), 1, width);
+            layout.surface_h = layout.rect.h = SDL_clamp((int) SDL_roundf(ih * layout.sy), 1, height);
+            break;
+
+        default:
+            SDL_InvalidParamError("fit");
+            return NULL;
+    }
+
+    return RasterizeImage(device, shared, &layout, format);
+}
+
+SDL_Surface *ControllerImage_CreateSurfaceForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis, int size)
+{
+    if (!device) {
+        SDL_InvalidParamError("device");
+        return NULL;
+    }
+    const int iaxis = (int) axis;
+    if ((iaxis < 0) || (iaxis >= SDL_GAMEPAD_AXIS_COUNT)) {
+        SDL_InvalidParamError("axis");
+        return NULL;
+    }
+    SharedImage *shared = GetDeviceImage(&device->axes[iaxis], device->axes_svg[iaxis], &device->axes_purged[iaxis]);
+    return shared ? RasterizeSquare(device, shared, size) : NULL;
+}
+
+SDL_Surface *ControllerImage_CreateFittedSurfaceForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis, int width, int height, ControllerImage_FitMode fit, SDL_PixelFormat format)
+{
+    if (!device) {
+        SDL_InvalidParamError("device");
+        return NULL;
+    }
+    const int iaxis = (int) axis;
+    if ((iaxis < 0) || (iaxis >= SDL_GAMEPAD_AXIS_COUNT)) {
+        SDL_InvalidParamError("axis");
+        return NULL;
+    }
+    SharedImage *shared = GetDeviceImage(&device->axes[iaxis], device->axes_svg[iaxis], &device->axes_purged[iaxis]);
+    return shared ? RasterizeFitted(device, shared, width, height, fit, format) : NULL;
+}
+
+SDL_Surface *ControllerImage_CreateSurfaceForButton(ControllerImage_Device *device, SDL_GamepadButton button, int size)
+{
+    if (!device) {
+        SDL_InvalidParamError("device");
+        return NULL;
+    }
+    const int ibutton = (int) button;
+    if ((ibutton < 0) || (ibutton >= SDL_GAMEPAD_BUTTON_COUNT)) {
+        SDL_InvalidParamError("button");
+        return NULL;
+    }
+    SharedImage *shared = GetDeviceImage(&device->buttons[ibutton], device->buttons_svg[ibutton], &device->buttons_purged[ibutton]);
+    return shared ? RasterizeSquare(device, shared, size) : NULL;
+}
+
+SDL_Surface *ControllerImage_CreateFittedSurfaceForButton(ControllerImage_Device *device, SDL_GamepadButton button, int width, int height, ControllerImage_FitMode fit, SDL_PixelFormat format)
+{
+    if (!device) {
+        SDL_InvalidParamError("device");
+        return NULL;
+    }
+    const int ibutton = (int) button;
+    if ((ibutton < 0) || (ibutton >= SDL_GAMEPAD_BUTTON_COUNT)) {
+        SDL_InvalidParamError("button");
+        return NULL;
+    }
+    SharedImage *shared = GetDeviceImage(&device->buttons[ibutton], device->buttons_svg[ibutton], &device->buttons_purged[ibutton]);
+    return shared ? RasterizeFitted(device, shared, width, height, fit, format) : NULL;
+}
+
+// Textures are cached per renderer, keyed on the SVG string and size, so
+//  devices of the same type (or any that inherit the same art) share them.
+//  The cache lives in the renderer's properties, so it goes away with the
+//  renderer, and it holds a reference to each texture it has handed out.
+#define TEXTURE_CACHE_PROPERTY "ControllerImage.texture_cache"
+
+typedef struct TextureCache
+{
+    SDL_Renderer *renderer;
+    SDL_PropertiesID textures;  // "svgptr/size" -> SDL_Texture *
+    bool renderer_gone;  // the renderer destroyed our textures itself, don't touch them.
+    struct TextureCache *prev;
+    struct TextureCache *next;
+} TextureCache;
+
+static void SDLCALL CleanupCachedTexture(void *userdata, void *value)
+{
+    const TextureCache *cache = (const TextureCache *) userdata;
+    if (!cache->renderer_gone) {
+        SDL_DestroyTexture((SDL_Texture *) value);  // just drops our reference if the app still has one.
+    }
+}
+
+// this runs when we remove the cache, or when the renderer (and its properties) are destroyed.
+static void SDLCALL CleanupTextureCache(void *userdata, void *value)
+{
+    TextureCache *cache = (TextureCache *) value;
+    if (cache->textures) {  // still have textures? The renderer is being destroyed, and has already destroyed them.
+        cache->renderer_gone = true;
+        SDL_DestroyProperties(cache->textures);
+    }
+
+    if (cache->prev) {
+        cache->prev->next = cache->next;
+    } else {
+        SDL_assert(TextureCaches == cache);
+        TextureCaches = cache->next;
+    }
+    if (cache->next) {
+        cache->next->prev = cache->prev;
+    }
+    CI_free(cache);
+}
+
+static TextureCache *GetTextureCache(SDL_Renderer *renderer)
+{
+    const SDL_PropertiesID props = SDL_GetRendererProperties(renderer);
+    if (!props) {
+        return NULL;
+    }
+
+    TextureCache *cache = (TextureCache *) SDL_GetPointerProperty(props, TEXTURE_CACHE_PROPERTY, NULL);
+    if (cache) {
+        return cache;
+    }
+
+    Uint64 *prevcounter = SetMemoryCounter(NULL);
+    cache = (TextureCache *) CI_calloc(1, sizeof (TextureCache));
+    SetMemoryCounter(prevcounter);
+    if (!cache) {
+        return NULL;
+    }
+
+    cache->textures = SDL_CreateProperties();
+    if (!cache->textures) {
+        CI_free(cache);
+        return NULL;
+    }
+
+    cache->renderer = renderer;
+    cache->next = TextureCaches;
+    if (TextureCaches) {
+        TextureCaches->prev = cache;
+    }
+    TextureCaches = cache;
+
+    if (!SDL_SetPointerPropertyWithCleanup(props, TEXTURE_CACHE_PROPERTY, cache, CleanupTextureCache, NULL)) {
+        return NULL;  // the cleanup callback already freed it.
+    }
+
+    return cache;
+}
+
+static void FlushTextureCache(TextureCache *cache)
+{
+    SDL_DestroyProperties(cache->textures);  // releases our references.
+    cache->textures = 0;
+    SDL_ClearProperty(SDL_GetRendererProperties(cache->renderer), TEXTURE_CACHE_PROPERTY);  // this frees `cache`.
+}
+
+void ControllerImage_FlushTextureCache(SDL_Renderer *renderer)
+{
+    TextureCache *next = NULL;
+    for (TextureCache *cache = TextureCaches; cache; cache = next) {
+        next = cache->next;
+        if (!renderer || (cache->renderer == renderer)) {
+            FlushTextureCache(cache);
+        }
+    }
+}
+
+// after a device reset, the contents of every texture on that renderer are gone, so don't hand them out again.
+static bool SDLCALL TextureCacheEventWatch(void *userdata, SDL_Event *event)
+{
+    if (event->type == SDL_EVENT_RENDER_DEVICE_RESET) {
+        SDL_Window *window = SDL_GetWindowFromID(event->render.windowID);
+        ControllerImage_FlushTextureCache(window ? SDL_GetRenderer(window) : NULL);  // flush everything if we can't tell which renderer it was.
+    }
+    return true;
+}
+
+// use the first format the renderer lists (its favorite) that we can write directly and that has alpha, so SDL doesn't have to convert it.
+static SDL_PixelFormat ChooseTextureFormat(SDL_Renderer *renderer, NSVGpixelFormat *nsvgfmtdata, const NSVGpixelFormat **nsvgfmt, int *bpp)
+{
+    const SDL_PixelFormat *formats = (const SDL_PixelFormat *) SDL_GetPointerProperty(SDL_GetRendererProperties(renderer), SDL_PROP_RENDERER_TEXTURE_FORMATS_POINTER, NULL);
+    if (formats) {
+        for (int i = 0; formats[i] != SDL_PIXELFORMAT_UNKNOWN; i++) {
+            if (SDL_ISPIXELFORMAT_ALPHA(formats[i]) && GetRasterPixelFormat(formats[i], nsvgfmtdata, nsvgfmt, bpp)) {
+                return formats[i];
+            }
+        }
+    }
+
+    GetRasterPixelFormat(SDL_PIXELFORMAT_RGBA32, nsvgfmtdata, nsvgfmt, bpp);  // can't fail; SDL will convert it if it has to.
+    return SDL_PIXELFORMAT_RGBA32;
+}
+
+static SDL_Texture *CreateTexture(SDL_Renderer *renderer, ControllerImage_Device *device, SharedImage *shared, const char *svg, int size)
+{
+    // devices that outlived ControllerImage_Quit() have no SVG string to key on, so they skip the cache.
+    TextureCache *cache = svg ? GetTextureCache(renderer) : NULL;
+    char key[64];
+
+    if (cache) {
+        SDL_snprintf(key, sizeof (key), "%p/%d", (const void *) svg, size);
+        SDL_Texture *texture = (SDL_Texture *) SDL_GetPointerProperty(cache->textures, key, NULL);
+        if (texture) {
+            Stats.texture_cache_hits++;
+            texture->refcount++;  // the caller gets their own reference, which SDL_DestroyTexture() releases.
+            return texture;
+        }
+        Stats.texture_cache_misses++;
+    }
+
+    RasterLayout layout;
+    CalculateSquareLayout(shared->image, size, &layout);
+
+    NSVGpixelFormat nsvgfmtdata;
+    const NSVGpixelFormat *nsvgfmt = NULL;
+    int bpp = 0;
+    const SDL_PixelFormat format = ChooseTextureFormat(renderer, &nsvgfmtdata, &nsvgfmt, &bpp);
+    SDL_Texture *texture = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_STREAMING, layout.surface_w, layout.surface_h);
+    if (!texture) {
+        return NULL;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+    // rasterize straight into the texture, no staging surface. The layout covers the whole texture, so nothing else needs clearing.
+    void *pixels = NULL;
+    int pitch = 0;
+    if (!SDL_LockTexture(texture, NULL, &pixels, &pitch)) {
+        SDL_DestroyTexture(texture);
+        return NULL;
+    }
+    const bool rc = RasterizeToPixels(device, shared, &layout, nsvgfmt, bpp, pixels, pitch);
+    SDL_UnlockTexture(texture);
+    if (!rc) {
+        SDL_DestroyTexture(texture);
+        return NULL;
+    }
+
+    if (cache) {
+        texture->refcount++;  // the cache's reference.
+        SDL_SetPointerPropertyWithCleanup(cache->textures, key, texture, CleanupCachedTexture, cache);  // if this fails, the cleanup drops the cache's reference.
+    }
+
+    return texture;
+}
+
+SDL_Texture *ControllerImage_CreateTextureForAxis(SDL_Renderer *renderer, ControllerImage_Device *device, SDL_GamepadAxis axis, int size)
+{
+    if (!renderer) {
+        SDL_InvalidParamError("renderer");
+        return NULL;
+    } else if (!device) {
+        SDL_InvalidParamError("device");
+        return NULL;
+    }
+    const int iaxis = (int) axis;
+    if ((iaxis < 0) || (iaxis >= SDL_GAMEPAD_AXIS_COUNT)) {
+        SDL_InvalidParamError("axis");
+        return NULL;
+    }
+    SharedImage *shared = GetDeviceImage(&device->axes[iaxis], device->axes_svg[iaxis], &device->axes_purged[iaxis]);
+    return shared ? CreateTexture(renderer, device, shared, device->axes_svg[iaxis], size) : NULL;
+}
+
+SDL_Texture *ControllerImage_CreateTextureForButton(SDL_Renderer *renderer, ControllerImage_Device *device, SDL_GamepadButton button, int size)
+{
+    if (!renderer) {
+        SDL_InvalidParamError("renderer");
+        return NULL;
+    } else if (!device) {
+        SDL_InvalidParamError("device");
+        return NULL;
+    }
+    const int ibutton = (int) button;
+    if ((ibutton < 0) || (ibutton >= SDL_GAMEPAD_BUTTON_COUNT)) {
+        SDL_InvalidParamError("button");
+        return NULL;
+    }
+    SharedImage *shared = GetDeviceImage(&device->buttons[ibutton], device->buttons_svg[ibutton], &device->buttons_purged[ibutton]);
+    return shared ? CreateTexture(renderer, device, shared, device->buttons_svg[ibutton], size) : NULL;
+}
+
+// Batches remember what they rendered, keyed on the SVG string and size like
+//  the texture cache, so each distinct image is rendered once per flush, and
+//  the next flush reuses it if it's asked for again. The rendering is split
+//  across threads, but everything that touches the library's state (parsing,
+//  devices, stats, the memory budget) stays on the calling thread; the
+//  workers only run rasterizers on images that are already parsed.
+typedef struct BatchRequest
+{
+    ControllerImage_Device *device;  // NULL if the device was destroyed before the flush.
+    bool is_axis;
+    int index;
+    int size;
+    int result;  // index into the batch's results after a flush, -1 if it failed.
+} BatchRequest;
+
+typedef struct BatchResult
+{
+    const char *svg;
+    int size;
+    SDL_Surface *surface;
+    NSVGimage *image;  // only set while a flush is rendering it.
+    Uint64 cost;  // only set while a flush is rendering it.
+    bool used;  // something in the current flush asked for it.
+} BatchResult;
+
+typedef struct ControllerImage_Batch
+{
+    int num_threads;
+    BatchRequest *requests;
+    int num_requests;
+    int requests_capacity;
+    bool flushed;  // the next request starts a new batch.
+    BatchResult *results;
+    int num_results;
+    int results_capacity;
+    int *result_table;  // open-addressed hash table of `results` indices, -1 for empty slots.
+    int result_table_size;  // always a power of two, at least twice the number of results.
+    int *jobs;  // indices into `results` that this flush has to render, most expensive first.
+    int num_jobs;
+    SDL_AtomicInt next_job;
+    struct ControllerImage_Batch *prev;  // live batches, so ControllerImage_Quit() and ControllerImage_DestroyDevice() can find them.
+    struct ControllerImage_Batch *next;
+} ControllerImage_Batch;
+
+typedef struct BatchWorker
+{
+    ControllerImage_Batch *batch;
+    NSVGrasterizer *rasterizer;
+    SDL_Thread *thread;
+} BatchWorker;
+
+static void FreeBatchResults(ControllerImage_Batch *batch)
+{
+    for (int i = 0; i < batch->num_results; i++) {
+        SDL_DestroySurface(batch->results[i].surface);
+    }
+    batch->num_results = 0;
+    if (batch->result_table) {
+        SDL_memset(batch->result_table, 0xFF, batch->result_table_size * sizeof (int));  // -1 everywhere.
+    }
+}
+
+// the results are keyed on SVG strings, which are about to go away, and the requests point to devices that might be.
+static void ForgetBatchResults(void)
+{
+    for (ControllerImage_Batch *batch = LiveBatches; batch; batch = batch->next) {
+        FreeBatchResults(batch);
+        batch->num_requests = 0;
+    }
+}
+
+static void ForgetBatchDevice(ControllerImage_Device *device)
+{
+    for (ControllerImage_Batch *batch = LiveBatches; batch; batch = batch->next) {
+        if (!batch->flushed) {
+            for (int i = 0; i < batch->num_requests; i++) {
+                if (batch->requests[i].device == device) {
+                    batch->requests[i].device = NULL;
+                }
+            }
+        }
+    }
+}
+
+ControllerImage_Batch *ControllerImage_CreateBatch(int num_threads)
+{
+    if (num_threads < 0) {
+        SDL_InvalidParamError("num_threads");
+        return NULL;
+    }
+
+    Uint64 *prevcounter = SetMemoryCounter(NULL);  // batches aren't any one device's.
+    ControllerImage_Batch *batch = (ControllerImage_Batch *) CI_calloc(1, sizeof (ControllerImage_Batch));
+    SetMemoryCounter(prevcounter);
+    if (!batch) {
+        return NULL;
+    }
+
+    batch->num_threads = num_threads ? num_threads : SDL_max(SDL_GetNumLogicalCPUCores(), 1);
+    batch->next = LiveBatches;
+    if (LiveBatches) {
+        LiveBatches->prev = batch;
+    }
+    LiveBatches = batch;
+    return batch;
+}
+
+static int QueueRequest(ControllerImage_Batch *batch, ControllerImage_Device *device, bool is_axis, int index, int size)
+{
+    if (!batch) {
+        SDL_InvalidParamError("batch");
+        return -1;
+    } else if (!device) {
+        SDL_InvalidParamError("device");
+        return -1;
+    } else if (size <= 0) {
+        SDL_InvalidParamError("size");
+        return -1;
+    }
+
+    if (batch->flushed) {
+        batch->flushed = false;
+        batch->num_requests = 0;
+    }
+
+    if (batch->num_requests >= batch->requests_capacity) {
+        const int newcapacity = batch->requests_capacity ? (batch->requests_capacity * 2) : 32;
+        Uint64 *prevcounter = SetMemoryCounter(NULL);
+        void *ptr = CI_realloc(batch->requests, sizeof (BatchRequest) * newcapacity);
+        SetMemoryCounter(prevcounter);
+        if (!ptr) {
+            return -1;
+        }
+        batch->requests = (BatchRequest *) ptr;
+        batch->requests_capacity = newcapacity;
+    }
+
+    BatchRequest *request = &batch->requests[batch->num_requests];
+    SDL_zerop(request);
+    request->device = device;
+    request->is_axis = is_axis;
+    request->index = index;
+    request->size = size;
+    request->result = -1;
+    return batch->num_requests++;
+}
+
+int ControllerImage_QueueAxis(ControllerImage_Batch *batch, ControllerImage_Device *device, SDL_GamepadAxis axis, int size)
+{
+    const int iaxis = (int) axis;
+    if ((iaxis < 0) || (iaxis >= SDL_GAMEPAD_AXIS_COUNT)) {
+        SDL_InvalidParamError("axis");
+        return -1;
+    }
+    return QueueRequest(batch, device, true, iaxis, size);
+}
+
+int ControllerImage_QueueButton(ControllerImage_Batch *batch, ControllerImage_Device *device, SDL_GamepadButton button, int size)
+{
+    const int ibutton = (int) button;
+    if ((ibutton < 0) || (ibutton >= SDL_GAMEPAD_BUTTON_COUNT)) {
+        SDL_InvalidParamError("button");
+        return -1;
+    }
+    return QueueRequest(batch, device, false, ibutton, size);
+}
+
+static int HashBatchResult(const char *svg, int size, int mask)
+{
+    Uint64 hash = ((Uint64) (uintptr_t) svg) ^ (((Uint64) size) * 0x9E3779B97F4A7C15ULL);
+    hash ^= hash >> 29;
+    hash *= 0xBF58476D1CE4E5B9ULL;
+    hash ^= hash >> 32;
+    return (int) (hash & mask);
+}
+
+static void FillBatchResultTable(ControllerImage_Batch *batch)
+{
+    const int mask = batch->result_table_size - 1;
+    SDL_memset(batch->result_table, 0xFF, batch->result_table_size * sizeof (int));  // -1 everywhere.
+    for (int i = 0; i < batch->num_results; i++) {
+        int slot = HashBatchResult(batch->results[i].svg, batch->results[i].size, mask);
+        while (batch->result_table[slot] != -1) {
+            slot = (slot + 1) & mask;
+        }
+        batch->result_table[slot] = i;
+    }
+}
+
+// finds (or adds) the result for this image at this size. Returns -1 if out of memory.
+static int FindBatchResult(ControllerImage_Batch *batch, const char *svg, int size, bool *_added)
+{
+    *_added = false;
+
+    if (batch->result_table) {
+        const int mask = batch->result_table_size - 1;
+        for (int slot = HashBatchResult(svg, size, mask); batch->result_table[slot] != -1; slot = (slot + 1) & mask) {
+            const BatchResult *result = &batch->results[batch->result_table[slot]];
+            if ((result->svg == svg) && (result->size == size)) {
+                return batch->result_table[slot];
+            }
+        }
+    }
+
+    if (batch->num_results >= batch->results_capacity) {
+        const int newcapacity = batch->results_capacity ? (batch->results_capacity * 2) : 32;
+        Uint64 *prevcounter = SetMemoryCounter(NULL);
+        void *ptr = CI_realloc(batch->results, sizeof (BatchResult) * newcapacity);
+        int *table = (int *) CI_malloc(sizeof (int) * newcapacity * 2);
+        SetMemoryCounter(prevcounter);
+        if (ptr) {
+            batch->results = (BatchResult *) ptr;
+        }
+        if (!ptr || !table) {
+            CI_free(table);
+            return -1;
+        }
+        batch->results_capacity = newcapacity;
+        CI_free(batch->result_table);
+        batch->result_table = table;
+        batch->result_table_size = newcapacity * 2;
+        FillBatchResultTable(batch);
+    }
+
+    const int mask = batch->result_table_size - 1;
+    int slot = HashBatchResult(svg, size, mask);
+    while (batch->result_table[slot] != -1) {
+        slot = (slot + 1) & mask;
+    }
+    batch->result_table[slot] = batch->num_results;
+
+    BatchResult *result = &batch->results[batch->num_results];
+    SDL_zerop(result);
+    result->svg = svg;
+    result->size = size;
+    *_added = true;
+    return batch->num_results++;
+}
+
+static int SDLCALL CompareBatchJobs(void *userdata, const void *a, const void *b)
+{
+    const ControllerImage_Batch *batch = (const ControllerImage_Batch *) userdata;
+    const Uint64 cost_a = batch->results[*(const int *) a].cost;
+    const Uint64 cost_b = batch->results[*(const int *) b].cost;
+    if (cost_a != cost_b) {
+        return (cost_a > cost_b) ? -1 : 1;  // most expensive first, so nobody's left with a big one at the end.
+    }
+    return *(const int *) a - *(const int *) b;
+}
+
+// finds the image, and a surface for it, for each request that isn't already rendered. The requests that
+//  need rendering become jobs.
+static bool PrepareBatchJobs(ControllerImage_Batch *batch)
+{
+    for (int i = 0; i < batch->num_requests; i++) {
+        BatchRequest *request = &batch->requests[i];
+        ControllerImage_Device *device = request->device;
+        request->result = -1;
+        if (!device) {
+            continue;
+        }
+
+        const int idx = request->index;
+        const char *svg = request->is_axis ? device->axes_svg[idx] : device->buttons_svg[idx];
+        if (!svg) {
+            continue;  // no artwork, or the device outlived the library and can't reparse anything.
+        }
+
+        bool added = false;
+        const int found = FindBatchResult(batch, svg, request->size, &added);
+        if (found < 0) {
+            return false;
+        }
+
+        BatchResult *result = &batch->results[found];
+        result->used = true;
+        if (!added) {
+            if (result->surface || result->image) {
+                Stats.batch_hits++;
+                request->result = found;
+            }
+            continue;  // either it's done, or it's already a job, or it already failed this time.
+        }
+
+        Stats.batch_misses++;
+        SharedImage *shared = request->is_axis ? GetDeviceImage(&device->axes[idx], svg, &device->axes_purged[idx]) : GetDeviceImage(&device->buttons[idx], svg, &device->buttons_purged[idx]);
+        if (!shared) {
+            continue;
+        }
+
+        // SDL_CreateSurface() clears the pixels, and the layout covers the whole surface, so the workers only have to rasterize.
+        result->surface = SDL_CreateSurface(request->size, request->size, SDL_PIXELFORMAT_RGBA32);
+        if (!result->surface) {
+            continue;
+        }
+
+        const bool has_info = request->is_axis ? device->axes_has_info[idx] : device->buttons_has_info[idx];
+        const Uint32 raster_cost = request->is_axis ? device->axes_info[idx].raster_cost : device->buttons_info[idx].raster_cost;
+        result->image = shared->image;
+        result->cost = ((Uint64) request->size * (Uint64) request->size) * (has_info ? ((Uint64) raster_cost + 1) : 1);
+        batch->jobs[batch->num_jobs++] = found;
+        request->result = found;
+        TouchDevice(device);
+    }
+
+    return true;
+}
+
+static void RasterizeBatchJobs(ControllerImage_Batch *batch, NSVGrasterizer *rasterizer)
+{
+    int i;
+    while ((i = SDL_AddAtomicInt(&batch->next_job, 1)) < batch->num_jobs) {
+        const BatchResult *result = &batch->results[batch->jobs[i]];
+        SDL_Surface *surface = result->surface;
+        RasterLayout layout;
+        CalculateSquareLayout(result->image, result->size, &layout);
+        nsvgRasterizeXY(rasterizer, result->image, layout.tx, layout.ty, layout.sx, layout.sy, (unsigned char *) surface->pixels, layout.rect.w, layout.rect.h, surface->pitch);
+    }
+}
+
+static int SDLCALL BatchWorkerThread(void *data)
+{
+    BatchWorker *worker = (BatchWorker *) data;
+    RasterizeBatchJobs(worker->batch, worker->rasterizer);
+    return 0;
+}
+
+// the images are shared and only read while rasterizing, and each job has its own surface, so the workers only
+//  need their own rasterizers. The edge caches are left alone; building them isn't safe from several threads, and the
+//  batch keeps its results anyhow.
+static bool RunBatchJobs(ControllerImage_Batch *batch)
+{
+    const int num_workers = SDL_min(batch->num_threads, batch->num_jobs);
+    Uint64 *prevcounter = SetMemoryCounter(NULL);  // the rasterizers' scratch buffers belong to the pool, not any device.
+    BatchWorker *workers = (BatchWorker *) CI_calloc(num_workers, sizeof (BatchWorker));
+    SetMemoryCounter(prevcounter);
+    if (!workers) {
+        return false;
+    }
+
+    int num_rasterizers = 0;
+    while (num_rasterizers < num_workers) {
+        workers[num_rasterizers].batch = batch;
+        workers[num_rasterizers].rasterizer = BorrowRasterizer();
+        if (!workers[num_rasterizers].rasterizer) {
+            break;
+        }
+        num_rasterizers++;
+    }
+
+    bool retval = false;
+    if (num_rasterizers > 0) {  // if we couldn't get as many rasterizers as we wanted, the ones we got just do more of the work.
+        prevcounter = SetMemoryCounter(NULL);
+        const Uint64 start = BeginProfile(CONTROLLERIMAGE_PROFILE_RASTERIZE);
+
+        SDL_SetAtomicInt(&batch->next_job, 0);
+        MemoryLockNeeded = (num_rasterizers > 1);  // set before any worker starts and cleared after they all finish, so they agree on it.
+        for (int i = 1; i < num_rasterizers; i++) {
+            workers[i].thread = SDL_CreateThread(BatchWorkerThread, "ControllerImage", &workers[i]);  // if this fails, the other threads just do more of the work.
+        }
+        RasterizeBatchJobs(batch, workers[0].rasterizer);
+        for (int i = 1; i < num_rasterizers; i++) {
+            SDL_WaitThread(workers[i].thread, NULL);  // this is safe with NULL.
+        }
+        MemoryLockNeeded = false;
+
+        Stats.raster_time_ns += EndProfile(CONTROLLERIMAGE_PROFILE_RASTERIZE, start);
+        SetMemoryCounter(prevcounter);
+        retval = true;
+    }
+
+    for (int i = 0; i < num_rasterizers; i++) {
+        ReturnRasterizer(workers[i].rasterizer);
+    }
+    CI_free(workers);
+
+    return retval;
+}
+
+// drops the results nothing asked for this time, and moves the rest down to fill the gaps.
+static void CompactBatchResults(ControllerImage_Batch *batch)
+{
+    int *remap = batch->jobs;  // done with these, and there's one per result.
+    int num_kept = 0;
+    for (int i = 0; i < batch->num_results; i++) {
+        BatchResult *result = &batch->results[i];
+        if (!result->used || !result->surface) {
+            SDL_DestroySurface(result->surface);
+            remap[i] = -1;
+            continue;
+        }
+
+        result->used = false;
+        result->image = NULL;
+        result->cost = 0;
+        remap[i] = num_kept;
+        batch->results[num_kept++] = *result;
+    }
+    batch->num_results = num_kept;
+
+    for (int i = 0; i < batch->num_requests; i++) {
+        BatchRequest *request = &batch->requests[i];
+        if (request->result >= 0) {
+            request->result = remap[request->result];
+        }
+    }
+
+    if (batch->result_table) {
+        FillBatchResultTable(batch);
+    }
+}
+
+bool ControllerImage_FlushBatch(ControllerImage_Batch *batch)
+{
+    if (!batch) {
+        return SDL_InvalidParamError("batch");
+    }
+
+    batch->flushed = true;
+
+    // there can't be more new results than requests, and CompactBatchResults() reuses this to remap every result.
+    const int max_jobs = batch->num_results + batch->num_requests;
+    Uint64 *prevcounter = SetMemoryCounter(NULL);
+    batch->jobs = (int *) CI_malloc(sizeof (int) * SDL_max(max_jobs, 1));
+    SetMemoryCounter(prevcounter);
+    if (!batch->jobs) {
+        return false;
+    }
+
+    batch->num_jobs = 0;
+    bool retval = PrepareBatchJobs(batch);
+
+    if (retval && (batch->num_jobs > 0)) {
+        SDL_qsort_r(batch->jobs, batch->num_jobs, sizeof (int), CompareBatchJobs, batch);
+        retval = RunBatchJobs(batch);
+    }
+
+    if (retval) {
+        Stats.rasterizations += batch->num_jobs;
+        for (int i = 0; i < batch->num_jobs; i++) {
+            const Uint64 size = (Uint64) batch->results[batch->jobs[i]].size;
+            Stats.pixels_produced += size * size;
+        }
+    } else {
+        for (int i = 0; i < batch->num_jobs; i++) {  // nothing was rendered, so don't hand out blank surfaces.
+            BatchResult *result = &batch->results[batch->jobs[i]];
+            SDL_DestroySurface(result->surface);
+            result->surface = NULL;
+        }
+        for (int i = 0; i < batch->num_requests; i++) {
+            const int found = batch->requests[i].result;
+            if ((found >= 0) && !batch->results[found].surface) {
+                batch->requests[i].result = -1;
+            }
+        }
+    }
+
+    CompactBatchResults(batch);
+
+    CI_free(batch->jobs);
+    batch->jobs = NULL;
+    batch->num_jobs = 0;
+
+    EnforceMemoryBudget();
+
+    return retval;
+}
+
+SDL_Surface *ControllerImage_GetBatchSurface(ControllerImage_Batch *batch, int request)
+{
+    if (!batch) {
+        SDL_InvalidParamError("batch");
+        return NULL;
+    } else if ((request < 0) || (request >= batch->num_requests)) {
+        SDL_InvalidParamError("request");
+        return NULL;
+    } else if (!batch->flushed) {
+        SDL_SetError("Batch hasn't been flushed yet");
+        return NULL;
+    }
+
+    const int found = batch->requests[request].result;
+    if (found < 0) {
+        SDL_SetError("No image available");
+        return NULL;
+    }
+    return batch->results[found].surface;
+}
+
+void ControllerImage_DestroyBatch(ControllerImage_Batch *batch)
+{
+    if (batch) {
+        if (batch->prev) {
+            batch->prev->next = batch->next;
+        } else {
+            SDL_assert(LiveBatches == batch);
+            LiveBatches = batch->next;
+        }
+        if (batch->next) {
+            batch->next->prev = batch->prev;
+        }
+
+        FreeBatchResults(batch);
+        CI_free(batch->result_table);
+        CI_free(batch->results);
+        CI_free(batch->requests);
+        CI_free(batch);
+    }
+}
+
+static bool GetImageInfo(const char *svg, bool has_info, const ControllerImage_ImageInfo *src, ControllerImage_ImageInfo *info)
+{
+    if (has_info) {
+        SDL_copyp(info, src);
+        return true;
+    } else if (!svg) {
+        return SDL_SetError("No image available");
+    }
+    return SDL_SetError("No image info available; rebuild the data with a newer make-controllerimage-data");
+}
+
+bool ControllerImage_GetImageInfoForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis, ControllerImage_ImageInfo *info)
+{
+    const int iaxis = (int) axis;
+    if (!device) {
+        return SDL_InvalidParamError("device");
+    } else if ((iaxis < 0) || (iaxis >= SDL_GAMEPAD_AXIS_COUNT)) {
+        return SDL_InvalidParamError("axis");
+    } else if (!info) {
+        return SDL_InvalidParamError("info");
+    }
+    return GetImageInfo(device->axes_svg[iaxis], device->axes_has_info[iaxis], &device->axes_info[iaxis], info);
+}
+
+bool ControllerImage_GetImageInfoForButton(ControllerImage_Device *device, SDL_GamepadButton button, ControllerImage_ImageInfo *info)
+{
+    const int ibutton = (int) button;
+    if (!device) {
+        return SDL_InvalidParamError("device");
+    } else if ((ibutton < 0) || (ibutton >= SDL_GAMEPAD_BUTTON_COUNT)) {
+        return SDL_InvalidParamError("button");
+    } else if (!info) {
+        return SDL_InvalidParamError("info");
+    }
+    return GetImageInfo(device->buttons_svg[ibutton], device->buttons_has_info[ibutton], &device->buttons_info[ibutton], info);
+}
+
+const char *ControllerImage_GetSVGForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis)
+{
+    if (!device) {
+        SDL_InvalidParamError("device");
+        return NULL;
+    }
+    const int iaxis = (int) axis;
+    if ((iaxis < 0) || (iaxis >= SDL_GAMEPAD_AXIS_COUNT)) {
         SDL_InvalidParamError("axis");
         return NULL;
     }
@@ -683,3 +2801,15 @@ const char *ControllerImage_GetSVGForButton(ControllerImage_Device *device, SDL_
     return svg;
 }
 
+char *ControllerImage_CopySVGForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis)
+{
+    const char *svg = ControllerImage_GetSVGForAxis(device, axis);
+    return svg ? SDL_strdup(svg) : NULL;  // the app owns this, so it doesn't come from our allocator.
+}
+
+char *ControllerImage_CopySVGForButton(ControllerImage_Device *device, SDL_GamepadButton button)
+{
+    const char *svg = ControllerImage_GetSVGForButton(device, button);
+    return svg ? SDL_strdup(svg) : NULL;  // the app owns this, so it doesn't come from our allocator.
+}
+
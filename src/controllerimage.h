@@ -32,7 +32,8 @@
  * - In your app near startup (preferably after SDL_Init), call
  *   ControllerImage_Init().
  * - Load in the controller and image data with
- *   ControllerImage_AddDataFromFile().
+ *   ControllerImage_AddDataFromFile(), or ControllerImage_AddStaticData() if
+ *   it's compiled into the app.
  * - Get image information for an SDL_Gamepad, probably once when you open the
  *   gamepad, with ControllerImage_CreateGamepadDevice().
  * - Get image data for specific buttons or axes on the gamepad. They come in
@@ -41,7 +42,10 @@
  *   might want a larger one than a game running at 720p, so it always looks
  *   crisp on the display without scaling. Use
  *   ControllerImage_CreateSurfaceForAxis() and
- *   ControllerImage_CreateSurfaceForButton().
+ *   ControllerImage_CreateSurfaceForButton(). If you're drawing with an
+ *   SDL_Renderer, ControllerImage_CreateTextureForAxis() and
+ *   ControllerImage_CreateTextureForButton() skip the surface and cache the
+ *   textures for you.
  * - Done with a gamepad? Free resources with ControllerImage_DestroyDevice().
  * - Done with the library? Call ControllerImage_Quit() to clean up.
  *
@@ -119,6 +123,124 @@ extern "C" {
  */
 typedef struct ControllerImage_Device ControllerImage_Device;
 
+/**
+ * A queue of image requests that are rasterized together.
+ *
+ * Apps that draw lots of controller images every frame (a HUD with button
+ * prompts all over it, say) can queue them up from wherever they're needed,
+ * and have the library render them all at once.
+ *
+ * \since This datatype is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_CreateBatch
+ * \sa ControllerImage_FlushBatch
+ */
+typedef struct ControllerImage_Batch ControllerImage_Batch;
+
+/**
+ * Counters that describe what the library has been up to.
+ *
+ * Some of these describe the library's current state (like how many devices
+ * exist right now), and the rest count things that have happened since the
+ * library was last initialized.
+ *
+ * \since This struct is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetStats
+ */
+typedef struct ControllerImage_Stats
+{
+    Uint64 strings_interned;        /**< Unique strings (device names, SVG data, etc) currently held by the library. */
+    Uint64 string_cache_bytes;      /**< Bytes used by those strings. */
+    Uint64 string_bytes_saved;      /**< Bytes of strings in loaded data that matched ones already held, so they weren't stored again. */
+    Uint64 devices_live;            /**< ControllerImage_Device objects that haven't been destroyed yet. */
+    Uint64 images_parsed;           /**< SVG images parsed. */
+    Uint64 images_shared;           /**< Images a device got without parsing, because something was already using an identical SVG. */
+    Uint64 parse_time_ns;           /**< Total time spent parsing SVG images, in nanoseconds. */
+    Uint64 rasterizations;          /**< Images rasterized. */
+    Uint64 raster_time_ns;          /**< Total time spent rasterizing images, in nanoseconds. */
+    Uint64 pixels_produced;         /**< Total pixels in all rasterized images. */
+    Uint64 string_cache_hits;       /**< Strings in loaded data that matched one already held. */
+    Uint64 string_cache_misses;     /**< Strings in loaded data that had to be added to the string cache. */
+    Uint64 edge_cache_hits;         /**< Rasterizations that reused an image's cached edges for that size. */
+    Uint64 edge_cache_misses;       /**< Rasterizations that had to flatten the image's paths; the second one at a size caches its edges. */
+    Uint64 texture_cache_hits;      /**< Textures created for an image and size a renderer already had. */
+    Uint64 texture_cache_misses;    /**< Textures that had to be rendered and added to a renderer's cache. */
+    Uint64 batch_hits;              /**< Batch requests that got an image the batch already had. */
+    Uint64 batch_misses;            /**< Batch requests that needed an image the batch didn't have yet. */
+} ControllerImage_Stats;
+
+/**
+ * How to fit an image into a surface that doesn't match its shape.
+ *
+ * \since This enum is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_CreateFittedSurfaceForAxis
+ * \sa ControllerImage_CreateFittedSurfaceForButton
+ */
+typedef enum ControllerImage_FitMode
+{
+    CONTROLLERIMAGE_FIT_CONTAIN,   /**< Scale evenly so the whole image fits, centered, with transparent borders. */
+    CONTROLLERIMAGE_FIT_COVER,     /**< Scale evenly so the image fills the surface, centered, cropping what doesn't fit. */
+    CONTROLLERIMAGE_FIT_STRETCH,   /**< Scale width and height separately so the image fills the surface exactly. */
+    CONTROLLERIMAGE_FIT_INTRINSIC  /**< Like CONTAIN, but the surface shrinks to the image's aspect ratio instead of having borders. */
+} ControllerImage_FitMode;
+
+/**
+ * What's in an image, and roughly how expensive it is to rasterize.
+ *
+ * make-controllerimage-data works this out for every image when it builds a
+ * data file, so apps can decide what to render first (or ahead of time)
+ * without parsing or rendering anything.
+ *
+ * \since This struct is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetImageInfoForAxis
+ * \sa ControllerImage_GetImageInfoForButton
+ */
+typedef struct ControllerImage_ImageInfo
+{
+    int num_shapes;      /**< Shapes that actually get drawn. */
+    int num_paths;       /**< Paths in those shapes. */
+    int num_points;      /**< Bezier points in those paths. */
+    float bounds[4];     /**< What gets drawn, including half the width of any strokes: minx, miny, maxx, maxy, in the SVG's units. Its width scales to the image's size. */
+    bool has_gradients;  /**< true if anything is filled or stroked with a gradient. */
+    bool has_strokes;    /**< true if anything is stroked. */
+    Uint32 raster_cost;  /**< Estimated cost to rasterize, only meaningful compared to other images' costs. Bigger is slower. */
+} ControllerImage_ImageInfo;
+
+/**
+ * Things the library does that can be reported to a profiler.
+ *
+ * \since This enum is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_SetProfilerCallbacks
+ */
+typedef enum ControllerImage_ProfileEvent
+{
+    CONTROLLERIMAGE_PROFILE_ADD_DATA,       /**< Loading a database in ControllerImage_AddData() or ControllerImage_AddStaticData(). */
+    CONTROLLERIMAGE_PROFILE_CREATE_DEVICE,  /**< Creating a ControllerImage_Device. */
+    CONTROLLERIMAGE_PROFILE_PARSE_SVG,      /**< Parsing one SVG image. */
+    CONTROLLERIMAGE_PROFILE_RASTERIZE       /**< Rasterizing one image. */
+} ControllerImage_ProfileEvent;
+
+/**
+ * A callback that fires when the library begins or ends a profiled event.
+ *
+ * Events might nest; for example, creating a device parses several SVGs.
+ *
+ * \param userdata what was passed as `userdata` to
+ *                 ControllerImage_SetProfilerCallbacks().
+ * \param event the event that is beginning or ending.
+ *
+ * \threadsafety This callback runs on whatever thread called into the library.
+ *
+ * \since This datatype is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_SetProfilerCallbacks
+ */
+typedef void (SDLCALL *ControllerImage_ProfileCallback)(void *userdata, ControllerImage_ProfileEvent event);
+
 /**
  * Get the version of ControllerImage that is linked against your program.
  *
@@ -149,6 +271,7 @@ extern SDL_DECLSPEC int SDLCALL ControllerImage_Version(void);
  *
  * - 1: first public version
  * - 2: Added GUIDs lists to devices
+ * - 3: Added optional compression of the string table
  *
  * \since This function is available since ControllerImage 1.0.0.
  */
@@ -188,12 +311,15 @@ extern SDL_DECLSPEC bool SDLCALL ControllerImage_Init(void);
  * ControllerImage_Init() to reinitialize it for further use.
  *
  * Any data added to the library through ControllerImage_AddData() and related
- * functions will be deallocated.
+ * functions will be deallocated. The library stops referencing buffers given
+ * to ControllerImage_AddStaticData(), so the app may free them after this.
  *
  * This function does not automatically destroy any created
  * ControllerImage_Device objects that have been created. Please destroy them
  * before deinitializing the library. SDL_Surface objects generated by the
- * library are _also_ not destroyed here.
+ * library are _also_ not destroyed here. Devices that are still alive after
+ * deinitialization can still create surfaces from images they have already
+ * parsed, but they no longer have any SVG data.
  *
  * Once the library deinitializes, constant strings returned by various
  * functions, like ControllerImage_GetDeviceType(),
@@ -312,6 +438,37 @@ extern SDL_DECLSPEC bool SDLCALL ControllerImage_AddDataFromFile(const char *fna
  */
 extern SDL_DECLSPEC bool SDLCALL ControllerImage_AddDataFromIOStream(SDL_IOStream *io, bool closeio);
 
+/**
+ * Add data that's compiled into the app to the ControllerImage database.
+ *
+ * This works like ControllerImage_AddData(), but the data must be in the
+ * "static" format that `make-controllerimage-data --c-source` writes out as
+ * a C source file, so it can be built right into a program.
+ *
+ * Static data is used where it is: the library doesn't copy the buffer or
+ * any of the strings in it, and doesn't have to scan through them, so this
+ * is nearly free at startup. It only allocates the tables it uses to look up
+ * devices. In exchange, the buffer must stay valid and unchanged until
+ * ControllerImage_Quit() is called, which is easy for a constant array.
+ *
+ * Static data and data added with ControllerImage_AddData() can be mixed
+ * freely; whatever is added later replaces earlier data for the same
+ * gamepad, the same as calling ControllerImage_AddData() multiple times.
+ *
+ * \param buf a pointer to static database data, which must stay valid until
+ *            the library deinitializes.
+ * \param buflen the number of bytes in buffer.
+ * \returns true on success, false on error; call SDL_GetError() for details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_AddData
+ * \sa ControllerImage_Quit
+ */
+extern SDL_DECLSPEC bool SDLCALL ControllerImage_AddStaticData(const void *buf, size_t buflen);
+
 /**
  * Create an device object to obtain image data for a specific gamepad.
  *
@@ -518,10 +675,59 @@ extern SDL_DECLSPEC bool SDLCALL ControllerImage_DeviceHasArtworkForButton(Contr
  *
  * \since This function is available since ControllerImage 1.0.0.
  *
+ * \sa ControllerImage_CreateFittedSurfaceForAxis
  * \sa ControllerImage_GetSVGForAxis
  */
 extern SDL_DECLSPEC SDL_Surface * SDLCALL ControllerImage_CreateSurfaceForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis, int size);
 
+/**
+ * Render one of a controller's axis images to an SDL_Surface of any shape.
+ *
+ * This is like ControllerImage_CreateSurfaceForAxis(), but the surface
+ * doesn't have to be square. Some artwork, like triggers, is taller than it
+ * is wide; rather than rasterizing a larger square and cropping it, ask for
+ * the size you want and say how the image should fit into it.
+ *
+ * For CONTROLLERIMAGE_FIT_CONTAIN, only the part of the surface the image
+ * covers is rasterized, so the borders cost nothing to render. For
+ * CONTROLLERIMAGE_FIT_INTRINSIC, `width` and `height` are a bounding box,
+ * and the returned surface may be smaller in one dimension.
+ *
+ * The surface is rasterized directly in `format`, so there's no extra
+ * conversion pass when it's going to be blitted to, or uploaded as, something
+ * other than SDL_PIXELFORMAT_RGBA32. Any packed 16 or 32-bit format with 8 or
+ * fewer bits per channel works. If `format` has no alpha channel, transparent
+ * pixels are set to a color key, which is set on the returned surface.
+ *
+ * Since this has to allocate and rasterize an image, it's not a fast call,
+ * and should probably be done once, not every frame.
+ *
+ * This returns NULL on error, but also if there is no artwork available. For
+ * a controller missing an axis, this is not necessarily an error. If the
+ * distinction is important, consider calling
+ * ControllerImage_DeviceHasArtworkForAxis().
+ *
+ * The returned SDL_Surface is owned by the caller, who should call
+ * SDL_DestroySurface() to dispose of it when done with it.
+ *
+ * \param device the device object for which to generate an image.
+ * \param axis the axis on the device for which to generate an image.
+ * \param width the width, in pixels, of the generated SDL_Surface.
+ * \param height the height, in pixels, of the generated SDL_Surface.
+ * \param fit how to fit the image into the surface.
+ * \param format the pixel format of the generated SDL_Surface.
+ * \returns a new surface on success, or NULL on error; call SDL_GetError()
+ *          for details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_CreateSurfaceForAxis
+ * \sa ControllerImage_CreateFittedSurfaceForButton
+ */
+extern SDL_DECLSPEC SDL_Surface * SDLCALL ControllerImage_CreateFittedSurfaceForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis, int width, int height, ControllerImage_FitMode fit, SDL_PixelFormat format);
+
 /**
  * Render one of a controller's button images to an SDL_Surface.
  *
@@ -554,10 +760,346 @@ extern SDL_DECLSPEC SDL_Surface * SDLCALL ControllerImage_CreateSurfaceForAxis(C
  *
  * \since This function is available since ControllerImage 1.0.0.
  *
+ * \sa ControllerImage_CreateFittedSurfaceForButton
  * \sa ControllerImage_GetSVGForButton
  */
 extern SDL_DECLSPEC SDL_Surface * SDLCALL ControllerImage_CreateSurfaceForButton(ControllerImage_Device *device, SDL_GamepadButton button, int size);
 
+/**
+ * Render one of a controller's button images to an SDL_Surface of any shape.
+ *
+ * This is like ControllerImage_CreateSurfaceForButton(), but the surface
+ * doesn't have to be square. Rather than rasterizing a larger square and
+ * cropping it, ask for the size you want and say how the image should fit
+ * into it.
+ *
+ * For CONTROLLERIMAGE_FIT_CONTAIN, only the part of the surface the image
+ * covers is rasterized, so the borders cost nothing to render. For
+ * CONTROLLERIMAGE_FIT_INTRINSIC, `width` and `height` are a bounding box,
+ * and the returned surface may be smaller in one dimension.
+ *
+ * The surface is rasterized directly in `format`, so there's no extra
+ * conversion pass when it's going to be blitted to, or uploaded as, something
+ * other than SDL_PIXELFORMAT_RGBA32. Any packed 16 or 32-bit format with 8 or
+ * fewer bits per channel works. If `format` has no alpha channel, transparent
+ * pixels are set to a color key, which is set on the returned surface.
+ *
+ * Since this has to allocate and rasterize an image, it's not a fast call,
+ * and should probably be done once, not every frame.
+ *
+ * This returns NULL on error, but also if there is no artwork available. For
+ * a controller missing a button, this is not necessarily an error. If the
+ * distinction is important, consider calling
+ * ControllerImage_DeviceHasArtworkForButton().
+ *
+ * The returned SDL_Surface is owned by the caller, who should call
+ * SDL_DestroySurface() to dispose of it when done with it.
+ *
+ * \param device the device object for which to generate an image.
+ * \param button the button on the device for which to generate an image.
+ * \param width the width, in pixels, of the generated SDL_Surface.
+ * \param height the height, in pixels, of the generated SDL_Surface.
+ * \param fit how to fit the image into the surface.
+ * \param format the pixel format of the generated SDL_Surface.
+ * \returns a new surface on success, or NULL on error; call SDL_GetError()
+ *          for details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_CreateSurfaceForButton
+ * \sa ControllerImage_CreateFittedSurfaceForAxis
+ */
+extern SDL_DECLSPEC SDL_Surface * SDLCALL ControllerImage_CreateFittedSurfaceForButton(ControllerImage_Device *device, SDL_GamepadButton button, int width, int height, ControllerImage_FitMode fit, SDL_PixelFormat format);
+
+/**
+ * Render one of a controller's axis images to an SDL_Texture.
+ *
+ * This is like ControllerImage_CreateSurfaceForAxis(), but it rasterizes
+ * straight into a texture for `renderer`, without a staging surface. The
+ * texture uses the first format the renderer lists that has an alpha channel
+ * and can be written directly, so nothing needs to be converted on upload.
+ *
+ * Textures are cached per renderer, so asking for the same image at the same
+ * size again (even from a different device of the same type) is very fast,
+ * and returns the same texture. Each call returns a new reference to it, so
+ * treat it like any other texture and call SDL_DestroyTexture() on it when
+ * done. Since cached textures can be shared, don't change their contents; if
+ * you change other state, like the scale mode, that change is shared, too.
+ *
+ * The cache is flushed when the renderer is destroyed, when SDL sends an
+ * SDL_EVENT_RENDER_DEVICE_RESET event, at ControllerImage_Quit(), or
+ * when you call ControllerImage_FlushTextureCache(). Textures you still hold
+ * references to remain valid until the renderer destroys them.
+ *
+ * This returns NULL on error, but also if there is no artwork available. For
+ * a controller missing an axis, this is not necessarily an error. If the
+ * distinction is important, consider calling
+ * ControllerImage_DeviceHasArtworkForAxis().
+ *
+ * \param renderer the renderer that will draw the texture.
+ * \param device the device object for which to generate an image.
+ * \param axis the axis on the device for which to generate an image.
+ * \param size the size, in pixels, that the generated SDL_Texture should be,
+ *             This size is used for both the width and height.
+ * \returns a new reference to a texture on success, or NULL on error; call
+ *          SDL_GetError() for details.
+ *
+ * \threadsafety This function should only be called on the main thread.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_CreateSurfaceForAxis
+ * \sa ControllerImage_CreateTextureForButton
+ * \sa ControllerImage_FlushTextureCache
+ */
+extern SDL_DECLSPEC SDL_Texture * SDLCALL ControllerImage_CreateTextureForAxis(SDL_Renderer *renderer, ControllerImage_Device *device, SDL_GamepadAxis axis, int size);
+
+/**
+ * Render one of a controller's button images to an SDL_Texture.
+ *
+ * This is like ControllerImage_CreateSurfaceForButton(), but it rasterizes
+ * straight into a texture for `renderer`, without a staging surface. The
+ * texture uses the first format the renderer lists that has an alpha channel
+ * and can be written directly, so nothing needs to be converted on upload.
+ *
+ * Textures are cached per renderer, so asking for the same image at the same
+ * size again (even from a different device of the same type) is very fast,
+ * and returns the same texture. Each call returns a new reference to it, so
+ * treat it like any other texture and call SDL_DestroyTexture() on it when
+ * done. Since cached textures can be shared, don't change their contents; if
+ * you change other state, like the scale mode, that change is shared, too.
+ *
+ * The cache is flushed when the renderer is destroyed, when SDL sends an
+ * SDL_EVENT_RENDER_DEVICE_RESET event, at ControllerImage_Quit(), or
+ * when you call ControllerImage_FlushTextureCache(). Textures you still hold
+ * references to remain valid until the renderer destroys them.
+ *
+ * This returns NULL on error, but also if there is no artwork available. For
+ * a controller missing a button, this is not necessarily an error. If the
+ * distinction is important, consider calling
+ * ControllerImage_DeviceHasArtworkForButton().
+ *
+ * \param renderer the renderer that will draw the texture.
+ * \param device the device object for which to generate an image.
+ * \param button the button on the device for which to generate an image.
+ * \param size the size, in pixels, that the generated SDL_Texture should be,
+ *             This size is used for both the width and height.
+ * \returns a new reference to a texture on success, or NULL on error; call
+ *          SDL_GetError() for details.
+ *
+ * \threadsafety This function should only be called on the main thread.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_CreateSurfaceForButton
+ * \sa ControllerImage_CreateTextureForAxis
+ * \sa ControllerImage_FlushTextureCache
+ */
+extern SDL_DECLSPEC SDL_Texture * SDLCALL ControllerImage_CreateTextureForButton(SDL_Renderer *renderer, ControllerImage_Device *device, SDL_GamepadButton button, int size);
+
+/**
+ * Drop the library's cached textures.
+ *
+ * This releases the references ControllerImage_CreateTextureForAxis() and
+ * ControllerImage_CreateTextureForButton() keep for reuse. Textures the app
+ * still holds references to are not destroyed, but won't be handed out
+ * again; the next request creates a new texture.
+ *
+ * The library does this by itself when a renderer is destroyed or reset, so
+ * most apps never need to call this, but it can be useful to free video
+ * memory when the app knows it won't need those images again for a while.
+ *
+ * \param renderer the renderer whose textures should be dropped, or NULL
+ *                 for all renderers.
+ *
+ * \threadsafety This function should only be called on the main thread.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_CreateTextureForAxis
+ * \sa ControllerImage_CreateTextureForButton
+ */
+extern SDL_DECLSPEC void SDLCALL ControllerImage_FlushTextureCache(SDL_Renderer *renderer);
+
+/**
+ * Create a batch, to rasterize many images at once.
+ *
+ * A batch is meant to be used once per frame: queue up every image the frame
+ * needs with ControllerImage_QueueAxis() and ControllerImage_QueueButton(),
+ * wherever in the app they come from, then call ControllerImage_FlushBatch()
+ * once, and then get each image with ControllerImage_GetBatchSurface().
+ *
+ * The flush renders each distinct image (the same art at the same size) only
+ * once, no matter how many times it was queued or by how many devices, and
+ * keeps the results for the next flush, so images that are on screen frame
+ * after frame are only rendered the first time. The ones it does have to
+ * render are split across several threads.
+ *
+ * \param num_threads the most threads to rasterize on at once, including the
+ *                    one that calls ControllerImage_FlushBatch(). Zero uses
+ *                    one per CPU core, and one does everything on the
+ *                    calling thread.
+ * \returns a new batch on success, or NULL on error; call SDL_GetError() for
+ *          details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_DestroyBatch
+ * \sa ControllerImage_FlushBatch
+ * \sa ControllerImage_QueueAxis
+ * \sa ControllerImage_QueueButton
+ */
+extern SDL_DECLSPEC ControllerImage_Batch * SDLCALL ControllerImage_CreateBatch(int num_threads);
+
+/**
+ * Queue up one of a controller's axis images in a batch.
+ *
+ * This doesn't render anything; it returns a handle that can be passed to
+ * ControllerImage_GetBatchSurface() after the next
+ * ControllerImage_FlushBatch().
+ *
+ * The first request queued after a flush starts a new batch, so handles from
+ * before that flush aren't valid anymore.
+ *
+ * If `device` is destroyed before the flush, this request fails, like it
+ * would if the device had no artwork for `axis`.
+ *
+ * \param batch the batch to add the request to.
+ * \param device the device object for which to generate an image.
+ * \param axis the axis on the device for which to generate an image.
+ * \param size the size, in pixels, that the image should be. This size is
+ *             used for both the width and height.
+ * \returns a handle for the request on success, or -1 on error; call
+ *          SDL_GetError() for details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_FlushBatch
+ * \sa ControllerImage_GetBatchSurface
+ * \sa ControllerImage_QueueButton
+ */
+extern SDL_DECLSPEC int SDLCALL ControllerImage_QueueAxis(ControllerImage_Batch *batch, ControllerImage_Device *device, SDL_GamepadAxis axis, int size);
+
+/**
+ * Queue up one of a controller's button images in a batch.
+ *
+ * This doesn't render anything; it returns a handle that can be passed to
+ * ControllerImage_GetBatchSurface() after the next
+ * ControllerImage_FlushBatch().
+ *
+ * The first request queued after a flush starts a new batch, so handles from
+ * before that flush aren't valid anymore.
+ *
+ * If `device` is destroyed before the flush, this request fails, like it
+ * would if the device had no artwork for `button`.
+ *
+ * \param batch the batch to add the request to.
+ * \param device the device object for which to generate an image.
+ * \param button the button on the device for which to generate an image.
+ * \param size the size, in pixels, that the image should be. This size is
+ *             used for both the width and height.
+ * \returns a handle for the request on success, or -1 on error; call
+ *          SDL_GetError() for details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_FlushBatch
+ * \sa ControllerImage_GetBatchSurface
+ * \sa ControllerImage_QueueAxis
+ */
+extern SDL_DECLSPEC int SDLCALL ControllerImage_QueueButton(ControllerImage_Batch *batch, ControllerImage_Device *device, SDL_GamepadButton button, int size);
+
+/**
+ * Render everything queued in a batch.
+ *
+ * Requests for the same image at the same size (even from different devices
+ * of the same type) share one surface. Anything the previous flush already
+ * rendered is reused. The rest are rendered most expensive first, spread
+ * across the batch's threads, and results that nothing asked for this time
+ * are freed.
+ *
+ * Threads are only started when there's more than one image to render, so
+ * once a frame's images stop changing, a flush doesn't render anything or
+ * start any threads.
+ *
+ * A request that can't be rendered (say, the device has no artwork for that
+ * button) doesn't make the flush fail; ControllerImage_GetBatchSurface()
+ * reports it for that request.
+ *
+ * The profiler callbacks see one CONTROLLERIMAGE_PROFILE_RASTERIZE event for
+ * all the images a flush renders.
+ *
+ * \param batch the batch to flush.
+ * \returns true on success or false on failure; call SDL_GetError() for
+ *          details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetBatchSurface
+ * \sa ControllerImage_QueueAxis
+ * \sa ControllerImage_QueueButton
+ */
+extern SDL_DECLSPEC bool SDLCALL ControllerImage_FlushBatch(ControllerImage_Batch *batch);
+
+/**
+ * Get the image for a request, after its batch was flushed.
+ *
+ * The surface is RGBA32, exactly what ControllerImage_CreateSurfaceForAxis()
+ * or ControllerImage_CreateSurfaceForButton() would have made.
+ *
+ * The surface is owned by the batch, not the caller, and should not be
+ * destroyed or changed. Requests for the same image at the same size get the
+ * same surface. It remains valid until a later flush doesn't ask for that
+ * image anymore, the batch is destroyed, or ControllerImage_Quit()
+ * deinitializes the library, whichever comes first. If it's requested again
+ * in the next flush, the next flush returns the same surface, so an app can
+ * keep its own textures keyed on the pointer.
+ *
+ * This returns NULL on error, but also if there is no artwork available. If
+ * the distinction is important, consider calling
+ * ControllerImage_DeviceHasArtworkForAxis() or
+ * ControllerImage_DeviceHasArtworkForButton().
+ *
+ * \param batch the batch that `request` was queued in.
+ * \param request a handle from ControllerImage_QueueAxis() or
+ *                ControllerImage_QueueButton().
+ * \returns the image on success, or NULL on error; call SDL_GetError() for
+ *          details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_FlushBatch
+ */
+extern SDL_DECLSPEC SDL_Surface * SDLCALL ControllerImage_GetBatchSurface(ControllerImage_Batch *batch, int request);
+
+/**
+ * Destroy a batch, and free every surface it rendered.
+ *
+ * This function may be called safely at any time, even after
+ * ControllerImage_Quit().
+ *
+ * \param batch the batch to destroy. NULL is safely ignored.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_CreateBatch
+ */
+extern SDL_DECLSPEC void SDLCALL ControllerImage_DestroyBatch(ControllerImage_Batch *batch);
+
 /**
  * Get the raw SVG data for one axis on a controller.
  *
@@ -571,8 +1113,11 @@ extern SDL_DECLSPEC SDL_Surface * SDLCALL ControllerImage_CreateSurfaceForButton
  * ControllerImage_DeviceHasArtworkForButton().
  *
  * The returned string (SVG files are text-based XML files) is owned by
- * ControllerImage, not the caller, and should not be free'd. The pointer
- * remains valid until `device` is destroyed.
+ * ControllerImage, not the caller, and should not be free'd. It is shared
+ * with the library's database, not copied for each device, so the pointer
+ * remains valid until `device` is destroyed or ControllerImage_Quit()
+ * deinitializes the library, whichever comes first. Use
+ * ControllerImage_CopySVGForAxis() if you need a copy that lasts longer.
  *
  * \param device the device object for which to obtain SVG data.
  * \param axis the axis on the device for which to obtain SVG data.
@@ -583,6 +1128,7 @@ extern SDL_DECLSPEC SDL_Surface * SDLCALL ControllerImage_CreateSurfaceForButton
  *
  * \since This function is available since ControllerImage 1.0.0.
  *
+ * \sa ControllerImage_CopySVGForAxis
  * \sa ControllerImage_CreateSurfaceForAxis
  */
 extern SDL_DECLSPEC const char * SDLCALL ControllerImage_GetSVGForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis);
@@ -601,8 +1147,11 @@ extern SDL_DECLSPEC const char * SDLCALL ControllerImage_GetSVGForAxis(Controlle
  * ControllerImage_DeviceHasArtworkForButton().
  *
  * The returned string (SVG files are text-based XML files) is owned by
- * ControllerImage, not the caller, and should not be free'd. The pointer
- * remains valid until `device` is destroyed.
+ * ControllerImage, not the caller, and should not be free'd. It is shared
+ * with the library's database, not copied for each device, so the pointer
+ * remains valid until `device` is destroyed or ControllerImage_Quit()
+ * deinitializes the library, whichever comes first. Use
+ * ControllerImage_CopySVGForButton() if you need a copy that lasts longer.
  *
  * \param device the device object for which to obtain SVG data.
  * \param button the button on the device for which to obtain SVG data.
@@ -613,10 +1162,268 @@ extern SDL_DECLSPEC const char * SDLCALL ControllerImage_GetSVGForAxis(Controlle
  *
  * \since This function is available since ControllerImage 1.0.0.
  *
+ * \sa ControllerImage_CopySVGForButton
  * \sa ControllerImage_CreateSurfaceForButton
  */
 extern SDL_DECLSPEC const char * SDLCALL ControllerImage_GetSVGForButton(ControllerImage_Device *device, SDL_GamepadButton button);
 
+/**
+ * Get information about one of a controller's axis images.
+ *
+ * This reports what make-controllerimage-data found in the image when it
+ * built the data file: how many shapes, paths and points it has, its bounds,
+ * and an estimate of how expensive it is to rasterize. It doesn't parse or
+ * render anything, so it's cheap to call for every image on a device, to
+ * decide which ones to render first, for example.
+ *
+ * Data files built with older versions of make-controllerimage-data don't
+ * have this information, in which case this returns false.
+ *
+ * \param device the device object to query.
+ * \param axis the axis on the device to query.
+ * \param info a pointer to a struct to be filled in.
+ * \returns true on success, false on error (or if there's no artwork or no
+ *          information for this axis); call SDL_GetError() for details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetImageInfoForButton
+ */
+extern SDL_DECLSPEC bool SDLCALL ControllerImage_GetImageInfoForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis, ControllerImage_ImageInfo *info);
+
+/**
+ * Get information about one of a controller's button images.
+ *
+ * This reports what make-controllerimage-data found in the image when it
+ * built the data file: how many shapes, paths and points it has, its bounds,
+ * and an estimate of how expensive it is to rasterize. It doesn't parse or
+ * render anything, so it's cheap to call for every image on a device, to
+ * decide which ones to render first, for example.
+ *
+ * Data files built with older versions of make-controllerimage-data don't
+ * have this information, in which case this returns false.
+ *
+ * \param device the device object to query.
+ * \param button the button on the device to query.
+ * \param info a pointer to a struct to be filled in.
+ * \returns true on success, false on error (or if there's no artwork or no
+ *          information for this button); call SDL_GetError() for details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetImageInfoForAxis
+ */
+extern SDL_DECLSPEC bool SDLCALL ControllerImage_GetImageInfoForButton(ControllerImage_Device *device, SDL_GamepadButton button, ControllerImage_ImageInfo *info);
+
+/**
+ * Get a copy of the raw SVG data for one axis on a controller.
+ *
+ * This is the same as ControllerImage_GetSVGForAxis(), but the caller gets
+ * their own copy of the string, which stays valid after the device is
+ * destroyed or the library is deinitialized.
+ *
+ * \param device the device object for which to obtain SVG data.
+ * \param axis the axis on the device for which to obtain SVG data.
+ * \returns a copy of the raw SVG data for the image on success, or NULL on
+ *          error; call SDL_GetError() for details. Free the returned string
+ *          with SDL_free() when done with it.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetSVGForAxis
+ */
+extern SDL_DECLSPEC char * SDLCALL ControllerImage_CopySVGForAxis(ControllerImage_Device *device, SDL_GamepadAxis axis);
+
+/**
+ * Get a copy of the raw SVG data for one button on a controller.
+ *
+ * This is the same as ControllerImage_GetSVGForButton(), but the caller gets
+ * their own copy of the string, which stays valid after the device is
+ * destroyed or the library is deinitialized.
+ *
+ * \param device the device object for which to obtain SVG data.
+ * \param button the button on the device for which to obtain SVG data.
+ * \returns a copy of the raw SVG data for the image on success, or NULL on
+ *          error; call SDL_GetError() for details. Free the returned string
+ *          with SDL_free() when done with it.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetSVGForButton
+ */
+extern SDL_DECLSPEC char * SDLCALL ControllerImage_CopySVGForButton(ControllerImage_Device *device, SDL_GamepadButton button);
+
+/**
+ * Get statistics about what the library has done.
+ *
+ * This is meant for apps that want to see how much time and memory the
+ * library costs them, maybe to report it in a debug overlay or telemetry.
+ *
+ * Counts of things that have happened (images parsed, time spent
+ * rasterizing, etc) reset when the library initializes.
+ *
+ * This function may be called safely at any time, even before
+ * ControllerImage_Init().
+ *
+ * \param stats a pointer to a struct to be filled in with statistics.
+ * \returns true on success, false on error; call SDL_GetError() for details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ */
+extern SDL_DECLSPEC bool SDLCALL ControllerImage_GetStats(ControllerImage_Stats *stats);
+
+/**
+ * Set callbacks to be notified when the library begins and ends expensive work.
+ *
+ * This lets apps feed the library's work into their own profiler, so parsing
+ * and rasterizing show up as named zones, etc.
+ *
+ * Either callback can be NULL. Call this with both callbacks set to NULL to
+ * stop receiving notifications.
+ *
+ * This function may be called safely at any time, even before
+ * ControllerImage_Init(). The callbacks are not reset when the library
+ * deinitializes.
+ *
+ * \param begin the function to call when an event begins.
+ * \param end the function to call when an event ends.
+ * \param userdata a pointer that is passed to the callbacks.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetStats
+ */
+extern SDL_DECLSPEC void SDLCALL ControllerImage_SetProfilerCallbacks(ControllerImage_ProfileCallback begin, ControllerImage_ProfileCallback end, void *userdata);
+
+/**
+ * Replace the functions ControllerImage uses to allocate memory.
+ *
+ * By default, the library allocates through SDL_malloc() and friends. This
+ * lets an app give the library its own allocator without changing what the
+ * rest of SDL uses. Everything the library allocates, including parsed SVG
+ * images and rasterizer buffers, goes through these functions.
+ *
+ * This can only be called while the library has no memory allocated, so
+ * call it before ControllerImage_Init(), or after ControllerImage_Quit() and
+ * destroying all devices.
+ *
+ * Set all four functions to NULL to go back to SDL's allocator. Otherwise,
+ * all four must be non-NULL.
+ *
+ * \param malloc_func custom malloc function.
+ * \param calloc_func custom calloc function.
+ * \param realloc_func custom realloc function.
+ * \param free_func custom free function.
+ * \returns true on success, false on error; call SDL_GetError() for details.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetMemoryUsage
+ */
+extern SDL_DECLSPEC bool SDLCALL ControllerImage_SetMemoryFunctions(SDL_malloc_func malloc_func, SDL_calloc_func calloc_func, SDL_realloc_func realloc_func, SDL_free_func free_func);
+
+/**
+ * Get the amount of memory ControllerImage is using.
+ *
+ * If `device` is non-NULL, this reports the memory used by that device: its
+ * parsed images, and the edge lists it caches for images that are drawn
+ * more than once at the same size. Devices that use identical artwork share
+ * one parsed copy of it, which counts toward each of them. Devices share SVG
+ * data with the library's database, and rasterizer buffers with each other,
+ * so those aren't counted per device. If `device` is NULL, this reports
+ * everything the library has allocated, including the database, the
+ * rasterizer pool, and all devices.
+ *
+ * SDL_Surface objects returned by the library belong to the app and are not
+ * counted.
+ *
+ * This function may be called safely at any time, even before
+ * ControllerImage_Init().
+ *
+ * \param device the device to query, or NULL for the whole library.
+ * \returns the number of bytes allocated.
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_SetMemoryBudget
+ */
+extern SDL_DECLSPEC Uint64 SDLCALL ControllerImage_GetMemoryUsage(ControllerImage_Device *device);
+
+/**
+ * Set a limit on how much memory ControllerImage should use.
+ *
+ * When the library goes over this limit, it throws away things it can
+ * rebuild later: first the idle rasterizers in the pool (see
+ * ControllerImage_TrimRasterizerPool()), then cached edge lists, and then
+ * parsed images, starting with the devices that were used least recently.
+ * These are rebuilt automatically the next time they are needed, which costs
+ * some time.
+ *
+ * This is a soft limit. The database (which holds all the SVG data) is never
+ * thrown away, so the library can't go below what it needs, and the work
+ * in progress for a single call can briefly go over the limit.
+ *
+ * This function may be called safely at any time, even before
+ * ControllerImage_Init(). If the library is already over the new limit, it
+ * frees what it can right away.
+ *
+ * \param bytes the memory budget in bytes, or zero for no limit (the
+ *              default).
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetMemoryUsage
+ * \sa ControllerImage_TrimRasterizerPool
+ */
+extern SDL_DECLSPEC void SDLCALL ControllerImage_SetMemoryBudget(Uint64 bytes);
+
+/**
+ * Free the scratch memory held by idle SVG rasterizers.
+ *
+ * Rasterizing an image needs scratch buffers that grow to fit the largest,
+ * most complex image drawn with them. Rather than each device keeping its
+ * own, the library keeps a pool of rasterizers that are borrowed for the
+ * length of each ControllerImage_CreateSurfaceForAxis() or
+ * ControllerImage_CreateSurfaceForButton() call, so this memory scales with
+ * how many images are being rasterized at once, not how many devices exist.
+ *
+ * Pooled rasterizers are kept around to make later calls faster. If an app
+ * just drew a bunch of large images and doesn't expect to draw more for a
+ * while (say, after loading a level), this gives that memory back. New
+ * rasterizers are created as needed later.
+ *
+ * ControllerImage_Quit() and the memory budget also trim the pool.
+ *
+ * This function may be called safely at any time, even before
+ * ControllerImage_Init().
+ *
+ * \threadsafety This function is not thread safe.
+ *
+ * \since This function is available since ControllerImage 1.0.0.
+ *
+ * \sa ControllerImage_GetMemoryUsage
+ * \sa ControllerImage_SetMemoryBudget
+ */
+extern SDL_DECLSPEC void SDLCALL ControllerImage_TrimRasterizerPool(void);
+
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
 }
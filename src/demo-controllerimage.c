@@ -85,11 +85,9 @@ static void LoadControllerImages(ControllerImage_Device *imgdev, SDL_Texture **t
 
         for (int i = 0; i < MAX_FLOOD_TEXTURES; i++) {
             TextureFloodItem *item = &flood[i];
-            SDL_Surface *surf = ControllerImage_CreateSurfaceForButton(imgdev, item->button, item->size);
-            if (surf) {
-                textures[i] = SDL_CreateTextureFromSurface(renderer, surf);
+            textures[i] = ControllerImage_CreateTextureForButton(renderer, imgdev, item->button, item->size);
+            if (textures[i]) {
                 SDL_SetTextureScaleMode(textures[i], SDL_SCALEMODE_LINEAR);
-                SDL_DestroySurface(surf);
             }
         }
         ControllerImage_DestroyDevice(imgdev);
@@ -248,15 +246,10 @@ static void IterateGamepad(void)
         ControllerImage_Device *imgdev_xbox = ControllerImage_CreateGamepadDeviceByIdString("xbox360");
         ControllerImage_Device *imgdev_ps = ControllerImage_CreateGamepadDeviceByIdString("ps3");
         for (int i = 0; i < 4; i++) {
-            SDL_Surface *surf;
             SDL_DestroyTexture(gamepad_xbox_buttons[i]);
-            surf = ControllerImage_CreateSurfaceForButton(imgdev_xbox, i + SDL_GAMEPAD_BUTTON_SOUTH, buttonw);
-            gamepad_xbox_buttons[i] = SDL_CreateTextureFromSurface(renderer, surf);
-            SDL_DestroySurface(surf);
+            gamepad_xbox_buttons[i] = ControllerImage_CreateTextureForButton(renderer, imgdev_xbox, i + SDL_GAMEPAD_BUTTON_SOUTH, buttonw);
             SDL_DestroyTexture(gamepad_ps_buttons[i]);
-            surf = ControllerImage_CreateSurfaceForButton(imgdev_ps, i + SDL_GAMEPAD_BUTTON_SOUTH, buttonw);
-            gamepad_ps_buttons[i] = SDL_CreateTextureFromSurface(renderer, surf);
-            SDL_DestroySurface(surf);
+            gamepad_ps_buttons[i] = ControllerImage_CreateTextureForButton(renderer, imgdev_ps, i + SDL_GAMEPAD_BUTTON_SOUTH, buttonw);
         }
 
         ControllerImage_DestroyDevice(imgdev_ps);
@@ -0,0 +1,630 @@
+/*
+ * ControllerImage; A simple way to obtain game controller images.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ *  This file written by Ryan C. Gordon.
+ */
+
+// This renders every button and axis image for a list of device types, at a
+//  list of sizes, and packs them into one PNG sprite sheet per device type and
+//  size, plus a JSON file and/or C header that says where each image landed.
+//  Platforms that can't (or don't want to) rasterize SVGs at runtime can ship
+//  those instead.
+//
+// Everything is rendered through one ControllerImage_Batch, so inheritance
+//  and fallbacks work exactly like they do at runtime, the pixels match what
+//  ControllerImage_CreateSurfaceForButton() makes, identical art is only
+//  rendered once, and the library spreads the work across threads. Each image
+//  is trimmed to the pixels it actually covers before packing; the metadata
+//  says where the trimmed rect goes in the original size x size square.
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h>
+#include "controllerimage.h"
+
+#define MAX_SPRITES_PER_SHEET (SDL_GAMEPAD_BUTTON_COUNT + SDL_GAMEPAD_AXIS_COUNT)
+
+typedef struct Sprite
+{
+    const char *svg;  // owned by the library. Identical images share a pointer, so they share a sprite, too.
+    int size;
+    int request;  // the batch request that renders it.
+    SDL_Surface *surface;  // the whole size x size image, as the library would render it. Owned by the batch.
+    SDL_Rect trim;  // the part of `surface` that isn't fully transparent.
+    int x;  // where `trim` goes on the sprite sheet.
+    int y;
+} Sprite;
+
+typedef struct SpriteName
+{
+    const char *name;  // what SDL_GetGamepadStringForButton() or SDL_GetGamepadStringForAxis() calls it.
+    const Sprite *sprite;
+} SpriteName;
+
+typedef struct Sheet
+{
+    const char *device_type;
+    int size;
+    char *image_fname;  // without the output directory; this is what the metadata refers to.
+    int width;
+    int height;
+    Sprite sprites[MAX_SPRITES_PER_SHEET];
+    int num_sprites;
+    SpriteName names[MAX_SPRITES_PER_SHEET];
+    int num_names;
+} Sheet;
+
+static const char *output_dir = ".";
+static int padding = 1;
+static int num_threads = 0;  // zero means one per CPU core.
+static ControllerImage_Batch *batch = NULL;
+static Sheet *sheets = NULL;
+static int num_sheets = 0;
+static Sprite **all_sprites = NULL;
+static int num_all_sprites = 0;
+static SDL_AtomicInt next_job;
+static SDL_AtomicInt failures;
+
+// runs `fn` on num_threads threads (this one included) and waits for them all. `fn` pulls work off next_job until it runs out.
+static void run_on_all_threads(SDL_ThreadFunction fn)
+{
+    SDL_Thread **threads = (num_threads > 1) ? (SDL_Thread **) SDL_calloc(num_threads - 1, sizeof (SDL_Thread *)) : NULL;
+
+    SDL_SetAtomicInt(&next_job, 0);
+    for (int i = 0; threads && (i < (num_threads - 1)); i++) {
+        threads[i] = SDL_CreateThread(fn, "export", NULL);  // if this fails, the other threads just do more of the work.
+    }
+
+    fn(NULL);
+
+    for (int i = 0; threads && (i < (num_threads - 1)); i++) {
+        if (threads[i]) {
+            SDL_WaitThread(threads[i], NULL);
+        }
+    }
+    SDL_free(threads);
+}
+
+// finds the part of the image that isn't fully transparent.
+static void trim_sprite(Sprite *sprite)
+{
+    const int size = sprite->size;
+    int minx = size, miny = size, maxx = -1, maxy = -1;
+
+    // RGBA32 is always R, G, B, A in memory order.
+    for (int y = 0; y < size; y++) {
+        const Uint8 *row = ((const Uint8 *) sprite->surface->pixels) + (y * sprite->surface->pitch);
+        for (int x = 0; x < size; x++) {
+            if (row[(x * 4) + 3]) {
+                minx = SDL_min(minx, x);
+                maxx = SDL_max(maxx, x);
+                miny = SDL_min(miny, y);
+                maxy = SDL_max(maxy, y);
+            }
+        }
+    }
+
+    if (maxx < 0) {  // nothing visible at all? It takes no space on the sheet.
+        SDL_zero(sprite->trim);
+    } else {
+        sprite->trim.x = minx;
+        sprite->trim.y = miny;
+        sprite->trim.w = (maxx - minx) + 1;
+        sprite->trim.h = (maxy - miny) + 1;
+    }
+}
+
+static int SDLCALL trim_worker(void *unused)
+{
+    int i;
+    while ((i = SDL_AddAtomicInt(&next_job, 1)) < num_all_sprites) {
+        trim_sprite(all_sprites[i]);
+    }
+    return 0;
+}
+
+static int SDLCALL compare_sprites(const void *a, const void *b)
+{
+    const Sprite *spritea = *(const Sprite **) a;
+    const Sprite *spriteb = *(const Sprite **) b;
+
+    // tallest first, then widest, then original order, so the output doesn't depend on how SDL_qsort shuffles ties.
+    if (spritea->trim.h != spriteb->trim.h) {
+        return (spritea->trim.h > spriteb->trim.h) ? -1 : 1;
+    } else if (spritea->trim.w != spriteb->trim.w) {
+        return (spritea->trim.w > spriteb->trim.w) ? -1 : 1;
+    }
+    return (spritea < spriteb) ? -1 : (spritea > spriteb) ? 1 : 0;
+}
+
+// simple shelf packing: there are only a few dozen images per sheet, and they're mostly the same size.
+static void pack_sheet(Sheet *sheet)
+{
+    Sprite *order[MAX_SPRITES_PER_SHEET];
+    Uint64 area = 0;
+    int widest = 0;
+
+    for (int i = 0; i < sheet->num_sprites; i++) {
+        Sprite *sprite = &sheet->sprites[i];
+        order[i] = sprite;
+        area += (Uint64) (sprite->trim.w + padding) * (Uint64) (sprite->trim.h + padding);
+        widest = SDL_max(widest, sprite->trim.w);
+    }
+
+    // aim for something roughly square, but every sprite has to fit across.
+    const int maxwidth = SDL_max((int) SDL_ceil(SDL_sqrt((double) area)) + padding, widest + (padding * 2));
+
+    SDL_qsort(order, sheet->num_sprites, sizeof (order[0]), compare_sprites);
+
+    int x = padding;
+    int y = padding;
+    int shelf_height = 0;
+    int width = 1;
+    for (int i = 0; i < sheet->num_sprites; i++) {
+        Sprite *sprite = order[i];
+        if ((sprite->trim.w == 0) || (sprite->trim.h == 0)) {
+            sprite->x = sprite->y = 0;
+            continue;
+        } else if ((x + sprite->trim.w + padding) > maxwidth) {  // start a new shelf.
+            y += shelf_height + padding;
+            x = padding;
+            shelf_height = 0;
+        }
+        sprite->x = x;
+        sprite->y = y;
+        x += sprite->trim.w + padding;
+        shelf_height = SDL_max(shelf_height, sprite->trim.h);
+        width = SDL_max(width, x);
+    }
+
+    sheet->width = width;
+    sheet->height = SDL_max(1, y + shelf_height + padding);
+}
+
+static bool save_sheet(const Sheet *sheet)
+{
+    SDL_Surface *surface = SDL_CreateSurface(sheet->width, sheet->height, SDL_PIXELFORMAT_RGBA32);  // starts out transparent.
+    if (!surface) {
+        SDL_Log("SDL_CreateSurface failed: %s", SDL_GetError());
+        return false;
+    }
+
+    for (int i = 0; i < sheet->num_sprites; i++) {
+        const Sprite *sprite = &sheet->sprites[i];
+        const Uint8 *src = ((const Uint8 *) sprite->surface->pixels) + (sprite->trim.y * sprite->surface->pitch) + (sprite->trim.x * 4);
+        Uint8 *dst = ((Uint8 *) surface->pixels) + (sprite->y * surface->pitch) + (sprite->x * 4);
+        for (int row = 0; row < sprite->trim.h; row++) {
+            SDL_memcpy(dst, src, sprite->trim.w * 4);
+            src += sprite->surface->pitch;
+            dst += surface->pitch;
+        }
+    }
+
+    char *path = NULL;
+    bool retval = false;
+    if (SDL_asprintf(&path, "%s/%s", output_dir, sheet->image_fname) < 0) {
+        SDL_Log("Out of memory!");
+    } else if (!SDL_SavePNG(surface, path)) {
+        SDL_Log("Couldn't write '%s': %s", path, SDL_GetError());
+    } else {
+        retval = true;
+    }
+
+    SDL_free(path);
+    SDL_DestroySurface(surface);
+    return retval;
+}
+
+static int SDLCALL save_worker(void *unused)
+{
+    int i;
+    while ((i = SDL_AddAtomicInt(&next_job, 1)) < num_sheets) {
+        if (!save_sheet(&sheets[i])) {
+            SDL_AddAtomicInt(&failures, 1);
+        }
+    }
+    return 0;
+}
+
+static bool add_sprite(Sheet *sheet, ControllerImage_Device *device, const char *name, const char *svg, bool is_axis, int index)
+{
+    Sprite *sprite = NULL;
+    for (int i = 0; i < sheet->num_sprites; i++) {
+        if (sheet->sprites[i].svg == svg) {  // leftx and lefty often use the same image, etc.
+            sprite = &sheet->sprites[i];
+            break;
+        }
+    }
+
+    if (!sprite) {
+        SDL_assert(sheet->num_sprites < MAX_SPRITES_PER_SHEET);
+        sprite = &sheet->sprites[sheet->num_sprites++];
+        sprite->svg = svg;
+        sprite->size = sheet->size;
+        sprite->request = is_axis ? ControllerImage_QueueAxis(batch, device, (SDL_GamepadAxis) index, sheet->size) : ControllerImage_QueueButton(batch, device, (SDL_GamepadButton) index, sheet->size);
+        if (sprite->request < 0) {
+            SDL_Log("Couldn't queue '%s' for device '%s': %s", name, sheet->device_type, SDL_GetError());
+            return false;
+        }
+    }
+
+    SDL_assert(sheet->num_names < MAX_SPRITES_PER_SHEET);
+    sheet->names[sheet->num_names].name = name;
+    sheet->names[sheet->num_names].sprite = sprite;
+    sheet->num_names++;
+    return true;
+}
+
+static bool write_json(const char *fname)
+{
+    SDL_IOStream *io = SDL_IOFromFile(fname, "w");
+    if (!io) {
+        return false;
+    }
+
+    SDL_IOprintf(io, "{\n");
+    SDL_IOprintf(io, "  \"sheets\": [\n");
+    for (int i = 0; i < num_sheets; i++) {
+        const Sheet *sheet = &sheets[i];
+        SDL_IOprintf(io, "    {\n");
+        SDL_IOprintf(io, "      \"device_type\": \"%s\",\n", sheet->device_type);
+        SDL_IOprintf(io, "      \"size\": %d,\n", sheet->size);
+        SDL_IOprintf(io, "      \"image\": \"%s\",\n", sheet->image_fname);
+        SDL_IOprintf(io, "      \"width\": %d,\n", sheet->width);
+        SDL_IOprintf(io, "      \"height\": %d,\n", sheet->height);
+        SDL_IOprintf(io, "      \"sprites\": [\n");
+        for (int j = 0; j < sheet->num_names; j++) {
+            const SpriteName *name = &sheet->names[j];
+            const Sprite *sprite = name->sprite;
+            SDL_IOprintf(io, "        { \"name\": \"%s\", \"x\": %d, \"y\": %d, \"w\": %d, \"h\": %d, \"trim_x\": %d, \"trim_y\": %d }%s\n",
+                         name->name, sprite->x, sprite->y, sprite->trim.w, sprite->trim.h, sprite->trim.x, sprite->trim.y,
+                         (j < (sheet->num_names - 1)) ? "," : "");
+        }
+        SDL_IOprintf(io, "      ]\n");
+        SDL_IOprintf(io, "    }%s\n", (i < (num_sheets - 1)) ? "," : "");
+    }
+    SDL_IOprintf(io, "  ]\n");
+    SDL_IOprintf(io, "}\n");
+
+    return SDL_CloseIO(io);
+}
+
+static bool write_header(const char *fname)
+{
+    SDL_IOStream *io = SDL_IOFromFile(fname, "w");
+    if (!io) {
+        return false;
+    }
+
+    SDL_IOprintf(io, "/* This file was generated by export-controllerimage. Don't edit it, regenerate it. */\n\n");
+    SDL_IOprintf(io, "#ifndef CONTROLLERIMAGE_SPRITES_H\n");
+    SDL_IOprintf(io, "#define CONTROLLERIMAGE_SPRITES_H\n\n");
+    SDL_IOprintf(io, "typedef struct ControllerImage_Sprite\n");
+    SDL_IOprintf(io, "{\n");
+    SDL_IOprintf(io, "    const char *device_type;\n");
+    SDL_IOprintf(io, "    int size;  /* the image was rendered at size x size pixels. */\n");
+    SDL_IOprintf(io, "    const char *image;  /* the sprite sheet's filename. */\n");
+    SDL_IOprintf(io, "    const char *name;  /* what SDL_GetGamepadStringForButton() or SDL_GetGamepadStringForAxis() calls it. */\n");
+    SDL_IOprintf(io, "    int x, y, w, h;  /* where it is on the sprite sheet. w and h are zero if the image is fully transparent. */\n");
+    SDL_IOprintf(io, "    int trim_x, trim_y;  /* where that rect goes in the size x size image. */\n");
+    SDL_IOprintf(io, "} ControllerImage_Sprite;\n\n");
+    SDL_IOprintf(io, "static const ControllerImage_Sprite controllerimage_sprites[] = {\n");
+    for (int i = 0; i < num_sheets; i++) {
+        const Sheet *sheet = &sheets[i];
+        for (int j = 0; j < sheet->num_names; j++) {
+            const SpriteName *name = &sheet->names[j];
+            const Sprite *sprite = name->sprite;
+            SDL_IOprintf(io, "    { \"%s\", %d, \"%s\", \"%s\", %d, %d, %d, %d, %d, %d },\n",
+                         sheet->device_type, sheet->size, sheet->image_fname, name->name,
+                         sprite->x, sprite->y, sprite->trim.w, sprite->trim.h, sprite->trim.x, sprite->trim.y);
+        }
+    }
+    SDL_IOprintf(io, "};\n\n");
+    SDL_IOprintf(io, "#endif\n");
+
+    return SDL_CloseIO(io);
+}
+
+// device types end up in filenames and metadata unescaped, so keep them boring. The art directories all are.
+static bool valid_device_type(const char *str)
+{
+    if (!*str) {
+        return false;
+    }
+    for (const char *ptr = str; *ptr; ptr++) {
+        const char ch = *ptr;
+        if (!SDL_isalnum(ch) && (ch != '_') && (ch != '-') && (ch != '.')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// splits a comma-separated list in place; returns the number of items, or -1 if out of memory.
+static int split_list(char *str, char ***_items)
+{
+    int count = 1;
+    for (const char *ptr = str; *ptr; ptr++) {
+        if (*ptr == ',') {
+            count++;
+        }
+    }
+
+    char **items = (char **) SDL_calloc(count, sizeof (char *));
+    if (!items) {
+        return -1;
+    }
+
+    count = 0;
+    char *saveptr = NULL;
+    for (char *item = SDL_strtok_r(str, ",", &saveptr); item; item = SDL_strtok_r(NULL, ",", &saveptr)) {
+        items[count++] = item;
+    }
+
+    *_items = items;
+    return count;
+}
+
+static int usage(const char *argv0)
+{
+    SDL_Log("USAGE: %s --devices type[,type...] --sizes N[,N...] [--output dir] [--json fname] [--header fname] [--padding N] [--jobs N] database.bin [overlay.bin...]", argv0);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    char *devices_list = NULL;
+    char *sizes_list = NULL;
+    const char *json_fname = NULL;
+    const char *header_fname = NULL;
+    const char **data_fnames = NULL;
+    int num_data_fnames = 0;
+    char **device_types = NULL;
+    int num_device_types = 0;
+    char **size_strs = NULL;
+    int num_sizes = 0;
+    int *sizes = NULL;
+    ControllerImage_Device **devices = NULL;
+    char *json_path = NULL;
+    int retval = 1;
+
+    data_fnames = (const char **) SDL_calloc(argc, sizeof (const char *));
+    if (!data_fnames) {
+        SDL_Log("Out of memory!");
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (*arg != '-') {
+            data_fnames[num_data_fnames++] = arg;
+            continue;
+        }
+
+        while (*arg == '-') { arg++; }
+        if (argv[i + 1] == NULL) {
+            SDL_free(data_fnames);
+            return usage(argv[0]);
+        } else if (SDL_strcmp(arg, "devices") == 0) {
+            devices_list = argv[++i];
+        } else if (SDL_strcmp(arg, "sizes") == 0) {
+            sizes_list = argv[++i];
+        } else if (SDL_strcmp(arg, "output") == 0) {
+            output_dir = argv[++i];
+        } else if (SDL_strcmp(arg, "json") == 0) {
+            json_fname = argv[++i];
+        } else if (SDL_strcmp(arg, "header") == 0) {
+            header_fname = argv[++i];
+        } else if (SDL_strcmp(arg, "padding") == 0) {
+            padding = (int) SDL_strtol(argv[++i], NULL, 10);
+            if (padding < 0) {
+                SDL_free(data_fnames);
+                return usage(argv[0]);
+            }
+        } else if (SDL_strcmp(arg, "jobs") == 0) {
+            num_threads = (int) SDL_strtol(argv[++i], NULL, 10);
+            if (num_threads <= 0) {
+                SDL_free(data_fnames);
+                return usage(argv[0]);
+            }
+        } else {
+            SDL_free(data_fnames);
+            return usage(argv[0]);
+        }
+    }
+
+    if (!devices_list || !sizes_list || !num_data_fnames) {
+        SDL_free(data_fnames);
+        return usage(argv[0]);
+    }
+
+    if (!SDL_Init(0)) {
+        SDL_Log("SDL_Init failed: %s", SDL_GetError());
+        SDL_free(data_fnames);
+        return 1;
+    }
+
+    if (num_threads <= 0) {
+        num_threads = SDL_max(1, SDL_GetNumLogicalCPUCores());
+    }
+
+    if (((num_device_types = split_list(devices_list, &device_types)) < 0) || ((num_sizes = split_list(sizes_list, &size_strs)) < 0)) {
+        SDL_Log("Out of memory!");
+        goto done;
+    } else if (!num_device_types || !num_sizes) {
+        retval = usage(argv[0]);
+        goto done;
+    }
+
+    for (int i = 0; i < num_device_types; i++) {
+        if (!valid_device_type(device_types[i])) {
+            SDL_Log("'%s' isn't a valid device type.", device_types[i]);
+            goto done;
+        }
+    }
+
+    sizes = (int *) SDL_calloc(num_sizes, sizeof (int));
+    if (!sizes) {
+        SDL_Log("Out of memory!");
+        goto done;
+    }
+
+    for (int i = 0; i < num_sizes; i++) {
+        char *endp = NULL;
+        sizes[i] = (int) SDL_strtol(size_strs[i], &endp, 10);
+        if ((*endp != '\0') || (sizes[i] <= 0) || (sizes[i] > 16384)) {
+            SDL_Log("'%s' isn't a valid size.", size_strs[i]);
+            goto done;
+        }
+    }
+
+    const Uint64 start = SDL_GetTicksNS();
+
+    if (!ControllerImage_Init()) {
+        SDL_Log("ControllerImage_Init failed: %s", SDL_GetError());
+        goto done;
+    }
+
+    // later files are overlays on earlier ones, just like loading them at runtime.
+    for (int i = 0; i < num_data_fnames; i++) {
+        if (!ControllerImage_AddDataFromFile(data_fnames[i])) {
+            SDL_Log("Couldn't load '%s': %s", data_fnames[i], SDL_GetError());
+            goto done;
+        }
+    }
+
+    batch = ControllerImage_CreateBatch(num_threads);
+    if (!batch) {
+        SDL_Log("ControllerImage_CreateBatch failed: %s", SDL_GetError());
+        goto done;
+    }
+
+    devices = (ControllerImage_Device **) SDL_calloc(num_device_types, sizeof (ControllerImage_Device *));
+    sheets = (Sheet *) SDL_calloc(num_device_types * num_sizes, sizeof (Sheet));
+    all_sprites = (Sprite **) SDL_calloc(num_device_types * num_sizes * MAX_SPRITES_PER_SHEET, sizeof (Sprite *));
+    if (!devices || !sheets || !all_sprites) {
+        SDL_Log("Out of memory!");
+        goto done;
+    }
+
+    // queue everything up front, then render it all in one flush; the SVG strings live until the devices are destroyed.
+    for (int i = 0; i < num_device_types; i++) {
+        devices[i] = ControllerImage_CreateGamepadDeviceByIdString(device_types[i]);
+        if (!devices[i]) {
+            SDL_Log("Couldn't create device '%s': %s", device_types[i], SDL_GetError());
+            goto done;
+        }
+
+        for (int j = 0; j < num_sizes; j++) {
+            Sheet *sheet = &sheets[num_sheets++];
+            sheet->device_type = device_types[i];
+            sheet->size = sizes[j];
+            if (SDL_asprintf(&sheet->image_fname, "%s-%d.png", device_types[i], sizes[j]) < 0) {
+                sheet->image_fname = NULL;
+                SDL_Log("Out of memory!");
+                goto done;
+            }
+
+            for (int k = 0; k < (int) SDL_GAMEPAD_BUTTON_COUNT; k++) {
+                const SDL_GamepadButton button = (SDL_GamepadButton) k;
+                const char *name = SDL_GetGamepadStringForButton(button);
+                const char *svg = name ? ControllerImage_GetSVGForButton(devices[i], button) : NULL;
+                if (svg && !add_sprite(sheet, devices[i], name, svg, false, k)) {
+                    goto done;
+                }
+            }
+
+            for (int k = 0; k < (int) SDL_GAMEPAD_AXIS_COUNT; k++) {
+                const SDL_GamepadAxis axis = (SDL_GamepadAxis) k;
+                const char *name = SDL_GetGamepadStringForAxis(axis);
+                const char *svg = name ? ControllerImage_GetSVGForAxis(devices[i], axis) : NULL;
+                if (svg && !add_sprite(sheet, devices[i], name, svg, true, k)) {
+                    goto done;
+                }
+            }
+
+            for (int k = 0; k < sheet->num_sprites; k++) {
+                all_sprites[num_all_sprites++] = &sheet->sprites[k];
+            }
+        }
+    }
+
+    if (!ControllerImage_FlushBatch(batch)) {
+        SDL_Log("ControllerImage_FlushBatch failed: %s", SDL_GetError());
+        goto done;
+    }
+
+    for (int i = 0; i < num_all_sprites; i++) {
+        all_sprites[i]->surface = ControllerImage_GetBatchSurface(batch, all_sprites[i]->request);
+        if (!all_sprites[i]->surface) {
+            SDL_Log("Couldn't render an image: %s", SDL_GetError());
+            goto done;
+        }
+    }
+
+    run_on_all_threads(trim_worker);
+
+    for (int i = 0; i < num_sheets; i++) {
+        pack_sheet(&sheets[i]);
+    }
+
+    if (!SDL_CreateDirectory(output_dir)) {
+        SDL_Log("Couldn't create '%s': %s", output_dir, SDL_GetError());
+        goto done;
+    }
+
+    run_on_all_threads(save_worker);
+    if (SDL_GetAtomicInt(&failures) > 0) {
+        goto done;
+    }
+
+    if (!json_fname && !header_fname) {
+        if (SDL_asprintf(&json_path, "%s/controllerimage-sprites.json", output_dir) < 0) {
+            json_path = NULL;
+            SDL_Log("Out of memory!");
+            goto done;
+        }
+        json_fname = json_path;
+    }
+
+    if (json_fname && !write_json(json_fname)) {
+        SDL_Log("Couldn't write '%s': %s", json_fname, SDL_GetError());
+        goto done;
+    } else if (header_fname && !write_header(header_fname)) {
+        SDL_Log("Couldn't write '%s': %s", header_fname, SDL_GetError());
+        goto done;
+    }
+
+    int num_images = 0;
+    for (int i = 0; i < num_sheets; i++) {
+        num_images += sheets[i].num_names;
+    }
+
+    SDL_Log("Exported %d images (%d unique) into %d sprite sheets in %.2f seconds, using %d threads.",
+            num_images, num_all_sprites, num_sheets, ((double) (SDL_GetTicksNS() - start)) / ((double) SDL_NS_PER_SECOND), num_threads);
+
+    retval = 0;
+
+done:
+    ControllerImage_DestroyBatch(batch);  // this frees the sprites' surfaces.
+    for (int i = 0; i < num_sheets; i++) {
+        SDL_free(sheets[i].image_fname);
+    }
+    for (int i = 0; devices && (i < num_device_types); i++) {
+        if (devices[i]) {
+            ControllerImage_DestroyDevice(devices[i]);
+        }
+    }
+    ControllerImage_Quit();
+    SDL_free(json_path);
+    SDL_free(all_sprites);
+    SDL_free(sheets);
+    SDL_free(devices);
+    SDL_free(sizes);
+    SDL_free(size_strs);
+    SDL_free(device_types);
+    SDL_free(data_fnames);
+    SDL_Quit();
+    return retval;
+}
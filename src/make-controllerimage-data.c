@@ -11,6 +11,15 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <math.h>
+
+// we use nanosvg to check that the SVG optimizer didn't change how things look.
+#define NANOSVG_IMPLEMENTATION
+#include "nanosvg.h"
+#define NANOSVGRAST_IMPLEMENTATION
+#include "nanosvgrast.h"
 
 #ifdef _WIN32
     #define WIN32_LEAN_AND_MEAN 1
@@ -93,9 +102,59 @@
         return retval;
     }
 
+    typedef HANDLE WorkerThread;
+    typedef CRITICAL_SECTION WorkerMutex;
+    typedef void (*WorkerFn)(void *arg);
+
+    typedef struct WorkerStart
+    {
+        WorkerFn fn;
+        void *arg;
+    } WorkerStart;
+
+    static DWORD WINAPI WorkerEntry(LPVOID arg)
+    {
+        WorkerStart *start = (WorkerStart *) arg;
+        start->fn(start->arg);
+        free(start);
+        return 0;
+    }
+
+    static int StartWorker(WorkerThread *thread, WorkerFn fn, void *arg)
+    {
+        WorkerStart *start = (WorkerStart *) xmalloc(sizeof (WorkerStart));
+        start->fn = fn;
+        start->arg = arg;
+        *thread = CreateThread(NULL, 0, WorkerEntry, start, 0, NULL);
+        if (*thread == NULL) {
+            free(start);
+            return 0;
+        }
+        return 1;
+    }
+
+    static void WaitWorker(WorkerThread thread)
+    {
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+    }
+
+    static void InitMutex(WorkerMutex *mutex) { InitializeCriticalSection(mutex); }
+    static void LockMutex(WorkerMutex *mutex) { EnterCriticalSection(mutex); }
+    static void UnlockMutex(WorkerMutex *mutex) { LeaveCriticalSection(mutex); }
+    static void DestroyMutex(WorkerMutex *mutex) { DeleteCriticalSection(mutex); }
+
+    static int GetCPUCount(void)
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return (int) info.dwNumberOfProcessors;
+    }
+
 #else
-    #include <sys/types.h>
     #include <dirent.h>
+    #include <pthread.h>
+    #include <unistd.h>
 
     typedef DIR DirHandle;
 
@@ -114,6 +173,54 @@
         struct dirent *dent = readdir(dirp);
         return dent ? dent->d_name : NULL;
     }
+
+    typedef pthread_t WorkerThread;
+    typedef pthread_mutex_t WorkerMutex;
+    typedef void (*WorkerFn)(void *arg);
+
+    typedef struct WorkerStart
+    {
+        WorkerFn fn;
+        void *arg;
+    } WorkerStart;
+
+    static void *xmalloc(size_t len);
+
+    static void *WorkerEntry(void *arg)
+    {
+        WorkerStart *start = (WorkerStart *) arg;
+        start->fn(start->arg);
+        free(start);
+        return NULL;
+    }
+
+    static int StartWorker(WorkerThread *thread, WorkerFn fn, void *arg)
+    {
+        WorkerStart *start = (WorkerStart *) xmalloc(sizeof (WorkerStart));
+        start->fn = fn;
+        start->arg = arg;
+        if (pthread_create(thread, NULL, WorkerEntry, start) != 0) {
+            free(start);
+            return 0;
+        }
+        return 1;
+    }
+
+    static void WaitWorker(WorkerThread thread)
+    {
+        pthread_join(thread, NULL);
+    }
+
+    static void InitMutex(WorkerMutex *mutex) { pthread_mutex_init(mutex, NULL); }
+    static void LockMutex(WorkerMutex *mutex) { pthread_mutex_lock(mutex); }
+    static void UnlockMutex(WorkerMutex *mutex) { pthread_mutex_unlock(mutex); }
+    static void DestroyMutex(WorkerMutex *mutex) { pthread_mutex_destroy(mutex); }
+
+    static int GetCPUCount(void)
+    {
+        const long retval = sysconf(_SC_NPROCESSORS_ONLN);
+        return (retval > 0) ? (int) retval : 1;
+    }
 #endif
 
 // this whole program is kinda slapdash atm.
@@ -139,11 +246,135 @@ typedef struct DeviceInfo
     Guid *guids;
 } DeviceInfo;
 
+// Per-image metadata, so apps can tell what an image costs without parsing
+//  or rendering it. Each item in the data file gets one IMAGEINFO_RECORD_SIZE
+//  record, big endian like everything else:
+//
+//  ui16 num_shapes, ui16 num_paths, ui32 num_points, 4 * ui32 bounds (the
+//   bits of floats: minx, miny, maxx, maxy), ui16 flags, ui32 raster_cost
+typedef struct ImageInfo
+{
+    int num_shapes;
+    int num_paths;
+    int num_points;
+    float bounds[4];
+    int flags;
+    unsigned int raster_cost;
+} ImageInfo;
+
+#define IMAGEINFO_FLAG_GRADIENTS (1 << 0)
+#define IMAGEINFO_FLAG_STROKES (1 << 1)
+#define IMAGEINFO_RECORD_SIZE 30
+#define IMAGEINFO_COST_SIZE 64.0f  // the raster cost is estimated for an image this many pixels wide.
+
+static unsigned char *pack_ui16(unsigned char *buf, unsigned int val)
+{
+    buf[0] = (unsigned char) ((val >> 8) & 0xFF);
+    buf[1] = (unsigned char) ((val >> 0) & 0xFF);
+    return buf + 2;
+}
+
+static unsigned char *pack_ui32(unsigned char *buf, unsigned int val)
+{
+    buf[0] = (unsigned char) ((val >> 24) & 0xFF);
+    buf[1] = (unsigned char) ((val >> 16) & 0xFF);
+    buf[2] = (unsigned char) ((val >> 8) & 0xFF);
+    buf[3] = (unsigned char) ((val >> 0) & 0xFF);
+    return buf + 4;
+}
+
+static void pack_image_info(const ImageInfo *info, unsigned char *buf)
+{
+    unsigned int bounds[4];
+    memcpy(bounds, info->bounds, sizeof (bounds));  // floats go in as their bits.
+
+    buf = pack_ui16(buf, (info->num_shapes > 0xFFFF) ? 0xFFFF : (unsigned int) info->num_shapes);
+    buf = pack_ui16(buf, (info->num_paths > 0xFFFF) ? 0xFFFF : (unsigned int) info->num_paths);
+    buf = pack_ui32(buf, (unsigned int) info->num_points);
+    for (int i = 0; i < 4; i++) {
+        buf = pack_ui32(buf, bounds[i]);
+    }
+    buf = pack_ui16(buf, (unsigned int) info->flags);
+    pack_ui32(buf, info->raster_cost);
+}
+
+static const unsigned char *unpack_ui32(const unsigned char *buf, unsigned int *_val)
+{
+    *_val = (((unsigned int) buf[0]) << 24) | (((unsigned int) buf[1]) << 16) | (((unsigned int) buf[2]) << 8) | ((unsigned int) buf[3]);
+    return buf + 4;
+}
+
+static void unpack_image_info(const unsigned char *buf, ImageInfo *info)
+{
+    unsigned int val = 0;
+    unsigned int bounds[4];
+    info->num_shapes = (int) ((((unsigned int) buf[0]) << 8) | ((unsigned int) buf[1]));
+    info->num_paths = (int) ((((unsigned int) buf[2]) << 8) | ((unsigned int) buf[3]));
+    buf = unpack_ui32(buf + 4, &val);
+    info->num_points = (int) val;
+    for (int i = 0; i < 4; i++) {
+        buf = unpack_ui32(buf, &bounds[i]);
+    }
+    memcpy(info->bounds, bounds, sizeof (bounds));
+    info->flags = (int) ((((unsigned int) buf[0]) << 8) | ((unsigned int) buf[1]));
+    unpack_ui32(buf + 2, &info->raster_cost);
+}
+
+// What we worked out about an SVG while loading it, on a worker thread (or
+//  what the incremental cache says we worked out last time), so it doesn't
+//  have to be parsed again on the main thread.
+typedef struct ImageMeta
+{
+    int known;  // 0 if nothing was worked out for this one; it gets parsed when it's needed.
+    ImageInfo info;
+    int has_geometry;  // 0 if nanosvg can't parse it.
+    unsigned long long geometry_hash;  // hash of what serialize_geometry() writes, for canonicalize_images().
+} ImageMeta;
+
+// Raw, not-yet-cached data for a device directory. Worker threads fill these
+//  in, and then they get merged into the string cache in directory order, so
+//  the output is the same no matter what order the threads finish in.
+typedef struct LoadedItem
+{
+    char *type;
+    char *image;
+    size_t original_len;  // these are only used when optimizing SVGs.
+    int optimized;  // 0 if not attempted, the level used if optimized, -1 if we kept the original.
+    int max_error;
+    double mean_error;
+    ImageMeta meta;
+} LoadedItem;
+
+typedef struct DeviceJob
+{
+    char *devid;
+    char *cachekey;
+    char *path;
+    char *inherits;  // contents of the "inherits" file, or NULL.
+    int inherits_index;  // number of items loaded before "inherits" was seen, so strings cache in the same order every time.
+    int num_items;
+    LoadedItem *items;
+    int num_guids;
+    Guid *guids;
+    unsigned long long signature;
+    int is_device;
+    int reused;
+} DeviceJob;
+
 static int num_strings = 0;
 static char **strings = NULL;
+static ImageMeta *string_meta = NULL;  // indexed like `strings`.
+static int *string_hashtable = NULL;  // indices into `strings`, -1 for empty slots.
+static int string_hashtable_size = 0;
 static int num_devices = 0;
 static DeviceInfo *devices = NULL;
 static int num_guids = 0;
+static int num_worker_threads = 0;
+static int incremental = 0;
+static int compress_strings = 0;
+static int write_c_source = 0;
+static int num_reused_devices = 0;
+static int num_canonicalized_images = 0;
 
 static void *xrealloc(void *ptr, size_t len)
 {
@@ -165,12 +396,70 @@ static void *xmalloc(size_t len)
     return ptr;
 }
 
-static int cache_string(const char *str)
+static void *xcalloc(size_t num, size_t len)
+{
+    void *ptr = calloc(num, len);
+    if (!ptr) {
+        fprintf(stderr, "Out of memory!\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+static char *xstrdup(const char *str)
+{
+    const size_t slen = strlen(str) + 1;
+    char *retval = (char *) xmalloc(slen);
+    memcpy(retval, str, slen);
+    return retval;
+}
+
+// FNV-1a; nothing fancy, we just need something fast and stable between runs.
+static unsigned long long hash_bytes(unsigned long long hash, const void *data, size_t len)
+{
+    const unsigned char *ptr = (const unsigned char *) data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned long long) ptr[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static const unsigned long long hash_seed = 14695981039346656037ULL;
+
+static void rehash_strings(void)
 {
+    free(string_hashtable);
+    string_hashtable_size = string_hashtable_size ? (string_hashtable_size * 2) : 1024;
+    string_hashtable = (int *) xmalloc(string_hashtable_size * sizeof (int));
+    memset(string_hashtable, 0xFF, string_hashtable_size * sizeof (int));  // -1 everywhere.
+
+    const int mask = string_hashtable_size - 1;
     for (int i = 0; i < num_strings; i++) {
-        if (strcmp(strings[i], str) == 0) {
-            return i;
+        int slot = (int) (hash_bytes(hash_seed, strings[i], strlen(strings[i])) & mask);
+        while (string_hashtable[slot] != -1) {
+            slot = (slot + 1) & mask;
+        }
+        string_hashtable[slot] = i;
+    }
+}
+
+// this takes ownership of `str`, which must be malloc'd. Returns the string's index.
+static int cache_string_take(char *str)
+{
+    if ((num_strings * 2) >= string_hashtable_size) {
+        rehash_strings();
+    }
+
+    const int mask = string_hashtable_size - 1;
+    int slot = (int) (hash_bytes(hash_seed, str, strlen(str)) & mask);
+    while (string_hashtable[slot] != -1) {
+        const int idx = string_hashtable[slot];
+        if (strcmp(strings[idx], str) == 0) {
+            free(str);
+            return idx;
         }
+        slot = (slot + 1) & mask;
     }
 
     // add a new string.
@@ -182,48 +471,67 @@ static int cache_string(const char *str)
 
     void *ptr = xrealloc(strings, (num_strings + 1) * sizeof (char *));
     strings = (char **) ptr;
-    strings[num_strings] = strdup(str);
-    if (!strings[num_strings]) {
-        fprintf(stderr, "Out of memory!\n");
-        exit(1);
-    }
+    strings[num_strings] = str;
+    string_hashtable[slot] = num_strings;
+
+    string_meta = (ImageMeta *) xrealloc(string_meta, (num_strings + 1) * sizeof (ImageMeta));
+    memset(&string_meta[num_strings], '\0', sizeof (ImageMeta));
 
     num_strings++;
 
     return num_strings - 1;
 }
 
-static char *load_text_file(const char *path)
+static int cache_string(const char *str)
+{
+    return cache_string_take(xstrdup(str));
+}
+
+// returns NULL if the file doesn't exist and `optional` is non-zero, otherwise fails on errors.
+static char *load_binary_file(const char *path, size_t *_buflen, int optional)
 {
     FILE *f = fopen(path, "rb");
     if (!f) {
+        if (optional && (errno == ENOENT)) {
+            return NULL;
+        }
         fprintf(stderr, "Failed to open '%s' for reading: %s\n", path, strerror(errno));
         exit(1);
     }
 
-    char *buf = NULL;
-    int buflen = 0;
+    // allocate once from the file size, instead of growing the buffer as we go.
+    long filelen = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        filelen = ftell(f);
+    }
 
-    while (1) {
-        const int chunksize = 32 * 1024;
-        void *ptr = xrealloc(buf, buflen + chunksize);
-        buf = (char *) ptr;
-        const int br = (int) fread(buf + buflen, 1, chunksize - 1, f);
-        buflen += br;
-        if (br < (chunksize - 1)) {
-            if (ferror(f)) {
-                fprintf(stderr, "Failed to read from '%s': %s\n", path, strerror(errno));
-                free(buf);
-                fclose(f);
-                exit(1);
-            }
-            break;
-        }
+    if ((filelen < 0) || (fseek(f, 0, SEEK_SET) != 0)) {
+        fprintf(stderr, "Failed to seek in '%s': %s\n", path, strerror(errno));
+        fclose(f);
+        exit(1);
+    }
+
+    char *buf = (char *) xmalloc(((size_t) filelen) + 1);
+    const size_t br = fread(buf, 1, (size_t) filelen, f);
+    if ((br != (size_t) filelen) && ferror(f)) {
+        fprintf(stderr, "Failed to read from '%s': %s\n", path, strerror(errno));
+        free(buf);
+        fclose(f);
+        exit(1);
     }
 
     fclose(f);
 
-    buf[buflen--] = '\0';  // make sure we're null-terminated.
+    buf[br] = '\0';  // make sure we're null-terminated.
+    *_buflen = br;
+    return buf;
+}
+
+static char *load_text_file(const char *path)
+{
+    size_t len = 0;
+    char *buf = load_binary_file(path, &len, 0);
+    int buflen = ((int) len) - 1;
 
     // trim ending whitespace/newlines...
     while (buflen >= 0) {
@@ -236,14 +544,6 @@ static char *load_text_file(const char *path)
     return buf;
 }
 
-static int cache_file_string(const char *path)
-{
-    char *buf = load_text_file(path);
-    const int retval = cache_string(buf);
-    free(buf);
-    return retval;
-}
-
 static char **break_string_into_lines(char *str)
 {
     int num_lines = 0;
@@ -295,7 +595,7 @@ static int convert_hex_char(char ch, int *bad)
     return 0;
 }
 
-static void parse_device_guids_file(DeviceInfo *device, const char *path)
+static void parse_device_guids_file(DeviceJob *job, const char *path)
 {
     char *buf = load_text_file(path);
     char **lines = break_string_into_lines(buf);
@@ -348,213 +648,4316 @@ static void parse_device_guids_file(DeviceInfo *device, const char *path)
             continue;
         }
 
-        device->guids = (Guid *) xrealloc(device->guids, (device->num_guids + 1) * sizeof (Guid));
-        Guid *pguid = &device->guids[device->num_guids++];
+        job->guids = (Guid *) xrealloc(job->guids, (job->num_guids + 1) * sizeof (Guid));
+        Guid *pguid = &job->guids[job->num_guids++];
         memcpy(pguid, &guid, sizeof (Guid));
-
-        num_guids++;
     }
 
     free(lines);
     free(buf);
 }
 
-static void process_gamepad_dir(const char *devid, const char *path)
+static char *make_path(const char *dir, const char *node)
 {
-    if (num_devices >= 0xFFFF) {  // currently stored in a Uint16 in the data file.
-        fprintf(stderr, "Too many unique devices! We need to alter the data file format!\n");
-        exit(1);
-    }
-
-    void *ptr = xrealloc(devices, (num_devices + 1) * sizeof (DeviceInfo));
-    devices = (DeviceInfo *) ptr;
-    DeviceInfo *device = &devices[num_devices];
-    num_devices++;
+    const size_t slen = strlen(dir) + strlen(node) + 2;
+    char *retval = (char *) xmalloc(slen);
+    snprintf(retval, slen, "%s/%s", dir, node);
+    return retval;
+}
 
+// read a directory's entries (minus "." and ".."), in the order the OS reports them.
+static char **list_dir(const char *path, int *_count)
+{
     DirHandle *dirp = OpenDir(path);
     if (!dirp) {
-        if (errno == ENOTDIR) {
-            return;  // not an error, might be readme.txt or something.
-        }
-        fprintf(stderr, "Couldn't opendir '%s': %s\n", path, strerror(errno));
-        exit(1);
+        return NULL;
     }
 
-    memset(device, '\0', sizeof (*device));
-    device->devid = cache_string(devid);
-
+    char **retval = (char **) xmalloc(sizeof (char *));  // never NULL on success, even for empty dirs.
+    int count = 0;
     const char *node;
     while ((node = ReadDir(dirp)) != NULL) {
         if (strcmp(node, ".") == 0) { continue; }
         if (strcmp(node, "..") == 0) { continue; }
-
-        char *ext = strrchr(node, '.');
-        const size_t slen = strlen(path) + strlen(node) + 2;
-        char *fullpath = (char *) xmalloc(slen);
-        snprintf(fullpath, slen, "%s/%s", path, node);
-
-        if (strcmp(node, "inherits") == 0) {
-            device->inherits = cache_file_string(fullpath);
-        } else if (strcmp(node, "guids") == 0) {
-            parse_device_guids_file(device, fullpath);
-        } else if (ext && (strcmp(ext, ".svg") == 0)) {
-            if (device->num_items >= 0xFFFF) {  // currently stored in a Uint16 in the data file.
-                fprintf(stderr, "Too many unique device items! We need to alter the data file format!\n");
-                exit(1);
-            }
-
-            *ext = '\0';
-            ptr = xrealloc(device->items, (device->num_items + 1) * sizeof (DeviceItem));
-            device->items = (DeviceItem *) ptr;
-            DeviceItem *item = &device->items[device->num_items++];
-            item->type = cache_string(node);
-            item->image = cache_file_string(fullpath);
-        }
-
-        free(fullpath);
+        retval = (char **) xrealloc(retval, (count + 1) * sizeof (char *));
+        retval[count++] = xstrdup(node);
     }
 
     CloseDir(dirp);
+
+    *_count = count;
+    return retval;
 }
 
-static void writeui16(FILE *f, int val)
+static void free_list(char **list, int count)
 {
-    if ((val < 0) || (val > 0xFFFF)) {
-        fprintf(stderr, "BUG: Expected Uint16 value, got %d instead!\n", val);
-        fclose(f);
-        exit(1);
+    for (int i = 0; i < count; i++) {
+        free(list[i]);
     }
-
-    const unsigned char ui8[2] = { (((unsigned int) val) >> 8) & 0xFF, (((unsigned int) val) >> 0) & 0xFF };
-    fwrite(ui8, 1, 2, f);
+    free(list);
 }
 
-static void process_devicetype_dir(const char *devicetype, const char *path)
+// SVG optimizer.
+//
+// This rewrites each SVG into something smaller that nanosvg will turn into
+//  the same image. nanosvg is the only thing that will ever read this data,
+//  so everything here is about what _nanosvg_ does with a file (ignoring
+//  unknown elements, how it inherits attributes, etc), not what a web browser
+//  would do with it.
+//
+// Levels:
+//  1: strip comments, metadata, editor junk, unused ids/defs/gradients, and
+//     attributes and style properties that don't change anything.
+//  2: also collapse groups and transforms, minify numbers and path data.
+//  3: also quantize coordinates to `optimize_precision` decimal places.
+//
+// Everything gets rasterized before and after, and if the difference is more
+//  than `optimize_max_error`, we keep the original file.
+
+#define OPTIMIZER_CHECK_SIZE 256
+
+static int optimize_level = 0;
+static int optimize_precision = 3;
+static int optimize_max_error = 16;
+
+typedef struct StrBuf
 {
-    size_t slen = strlen(path) + strlen(devicetype) + 2;
-    char *fulltypepath = (char *) xmalloc(slen);
-    snprintf(fulltypepath, slen, "%s/%s", path, devicetype);
+    char *data;
+    size_t len;
+    size_t alloc;
+} StrBuf;
 
-    DirHandle *dirp = OpenDir(fulltypepath);
-    if (!dirp) {
-        if (errno == ENOENT) {
-            free(fulltypepath);
-            return;  // not an error, doesn't exist.
+static void strbuf_append(StrBuf *buf, const char *str, size_t len)
+{
+    if ((buf->len + len + 1) > buf->alloc) {
+        while ((buf->len + len + 1) > buf->alloc) {
+            buf->alloc = buf->alloc ? (buf->alloc * 2) : 256;
         }
-        fprintf(stderr, "Couldn't opendir '%s': %s\n", fulltypepath, strerror(errno));
-        exit(1);
+        buf->data = (char *) xrealloc(buf->data, buf->alloc);
     }
-
-    const char *devid;
-    while ((devid = ReadDir(dirp)) != NULL) {
-        if (strcmp(devid, ".") == 0) { continue; }
-        if (strcmp(devid, "..") == 0) { continue; }
-        slen = strlen(fulltypepath) + strlen(devid) + 2;
-        char *fullpath = (char *) xmalloc(slen);
-        snprintf(fullpath, slen, "%s/%s", fulltypepath, devid);
-        process_gamepad_dir(devid, fullpath);
-        free(fullpath);
-    }
-    CloseDir(dirp);
-
-    free(fulltypepath);
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
 }
 
-static void process_theme_dir(const char *theme, const char *path)
+static void strbuf_appendstr(StrBuf *buf, const char *str)
 {
-    // add something, just to make sure the string index 0 isn't something that could be nullable.
-    // this could be more clever, but for an extra byte in the data file, it's good enough.
-    cache_string("");
-
-    process_devicetype_dir("gamepad", path);
-
-    size_t slen;
-
-    const char *binfile_basename = "controllerimage";
-    slen = strlen(binfile_basename) + strlen(theme) + 6;
-    char *binfile = (char *) xmalloc(slen);
-    snprintf(binfile, slen, "%s-%s.bin", binfile_basename, theme);
+    strbuf_append(buf, str, strlen(str));
+}
 
-    FILE *f = fopen(binfile, "wb");
-    if (!f) {
-        fprintf(stderr, "Failed to open '%s': %s\n", binfile, strerror(errno));
-        free(binfile);
-        exit(1);
-    }
+typedef struct SvgAttr
+{
+    char *name;
+    char *value;
+} SvgAttr;
 
-    static const char magic[8] = { 'C', 'T', 'I', 'M', 'G', '\r', '\n', '\0' };
+typedef struct SvgNode
+{
+    char *name;
+    int num_attrs;
+    SvgAttr *attrs;
+    int num_children;
+    struct SvgNode **children;
+} SvgNode;
 
-    fwrite(magic, 1, sizeof (magic), f);
-    writeui16(f, 2);  // version number
-    writeui16(f, num_strings);
-    for (int i = 0; i < num_strings; i++) {
-        fwrite(strings[i], 1, strlen(strings[i]) + 1, f);
-    }
-    writeui16(f, num_devices);
-    for (int i = 0; i < num_devices; i++) {
-        const DeviceInfo *device = &devices[i];
-        writeui16(f, device->devid);
-        writeui16(f, device->inherits);
-        writeui16(f, device->num_items);
-        writeui16(f, device->num_guids);
-        for (int j = 0; j < device->num_items; j++) {
-            const DeviceItem *item = &device->items[j];
-            writeui16(f, item->type);
-            writeui16(f, item->image);
+static void svg_free_node(SvgNode *node)
+{
+    if (node) {
+        for (int i = 0; i < node->num_attrs; i++) {
+            free(node->attrs[i].name);
+            free(node->attrs[i].value);
         }
-        for (int j = 0; j < device->num_guids; j++) {
-            const Guid *guid = &device->guids[j];
-            fwrite(guid->data, 1, sizeof (guid->data), f);
+        for (int i = 0; i < node->num_children; i++) {
+            svg_free_node(node->children[i]);
         }
+        free(node->attrs);
+        free(node->children);
+        free(node->name);
+        free(node);
     }
+}
 
-    if (fclose(f) == EOF) {
-        fprintf(stderr, "Failed to fclose '%s': %s\n", binfile, strerror(errno));
-        remove(binfile);
-        free(binfile);
-        exit(1);
-    }
-
-    printf("Filename: %s\n", binfile);
-    printf("Num devices: %d\n", num_devices);
-    printf("Num strings: %d\n", num_strings);
-    printf("Num GUIDs: %d\n", num_guids);
-    printf("\n");
-
-    free(binfile);
+static char *xstrndup(const char *str, size_t len)
+{
+    char *retval = (char *) xmalloc(len + 1);
+    memcpy(retval, str, len);
+    retval[len] = '\0';
+    return retval;
+}
 
-    for (int i = 0; i < num_strings; i++) {
-        free(strings[i]);
+static const char *svg_get_attr(const SvgNode *node, const char *name)
+{
+    for (int i = 0; i < node->num_attrs; i++) {
+        if (strcmp(node->attrs[i].name, name) == 0) {
+            return node->attrs[i].value;
+        }
     }
-    free(strings);
-    strings = NULL;
-    num_strings = 0;
-    num_guids = 0;
+    return NULL;
+}
 
-    for (int i = 0; i < num_devices; i++) {
-        free(devices[i].items);
-        free(devices[i].guids);
-    }
-    free(devices);
-    devices = NULL;
-    num_devices = 0;
+static void svg_insert_attr(SvgNode *node, int idx, const char *name, const char *value)
+{
+    node->attrs = (SvgAttr *) xrealloc(node->attrs, (node->num_attrs + 1) * sizeof (SvgAttr));
+    memmove(&node->attrs[idx + 1], &node->attrs[idx], (node->num_attrs - idx) * sizeof (SvgAttr));
+    node->attrs[idx].name = xstrdup(name);
+    node->attrs[idx].value = xstrdup(value);
+    node->num_attrs++;
 }
 
-static void usage_and_exit(const char *argv0)
+static void svg_remove_attr_at(SvgNode *node, int idx)
 {
-    fprintf(stderr, "USAGE: %s <path_to_art_directory>\n", argv0);
-    exit(1);
+    free(node->attrs[idx].name);
+    free(node->attrs[idx].value);
+    node->num_attrs--;
+    memmove(&node->attrs[idx], &node->attrs[idx + 1], (node->num_attrs - idx) * sizeof (SvgAttr));
 }
 
-int main(int argc, char **argv)
+static void svg_add_child(SvgNode *node, SvgNode *child)
 {
-    const char *basedir = NULL;
-    if (argc >= 2) {
-        basedir = argv[1];
+    node->children = (SvgNode **) xrealloc(node->children, (node->num_children + 1) * sizeof (SvgNode *));
+    node->children[node->num_children++] = child;
+}
+
+// removes child `idx` from `node`, replacing it with its own children. Frees the child.
+static void svg_unwrap_child(SvgNode *node, int idx)
+{
+    SvgNode *child = node->children[idx];
+    const int total = node->num_children - 1 + child->num_children;
+    SvgNode **children = (SvgNode **) xmalloc((total ? total : 1) * sizeof (SvgNode *));
+    memcpy(children, node->children, idx * sizeof (SvgNode *));
+    memcpy(children + idx, child->children, child->num_children * sizeof (SvgNode *));
+    memcpy(children + idx + child->num_children, node->children + idx + 1, (node->num_children - idx - 1) * sizeof (SvgNode *));
+    free(node->children);
+    node->children = children;
+    node->num_children = total;
+    child->num_children = 0;
+    svg_free_node(child);
+}
+
+static void svg_remove_child(SvgNode *node, int idx)
+{
+    svg_free_node(node->children[idx]);
+    node->num_children--;
+    memmove(&node->children[idx], &node->children[idx + 1], (node->num_children - idx) * sizeof (SvgNode *));
+}
+
+static int is_xml_space(char ch)
+{
+    return (ch == ' ') || (ch == '\t') || (ch == '\r') || (ch == '\n');
+}
+
+// A minimal XML parser. Text, comments, processing instructions and DOCTYPEs
+//  are thrown away, since nanosvg ignores all of them. Returns NULL if this
+//  doesn't look like well-formed XML.
+static SvgNode *svg_parse_xml(const char *str)
+{
+    SvgNode *root = NULL;
+    SvgNode *stack[128];
+    int depth = 0;
+
+    while (*str) {
+        if (*str != '<') {
+            str++;  // text content, nanosvg ignores it.
+            continue;
+        }
+
+        if (strncmp(str, "<!--", 4) == 0) {
+            str = strstr(str + 4, "-->");
+            if (!str) { goto failed; }
+            str += 3;
+            continue;
+        } else if (strncmp(str, "<![CDATA[", 9) == 0) {
+            str = strstr(str + 9, "]]>");
+            if (!str) { goto failed; }
+            str += 3;
+            continue;
+        } else if (strncmp(str, "<?", 2) == 0) {
+            str = strstr(str + 2, "?>");
+            if (!str) { goto failed; }
+            str += 2;
+            continue;
+        } else if (str[1] == '!') {  // DOCTYPE, etc.
+            int brackets = 0;
+            for (str += 2; *str; str++) {
+                if (*str == '[') {
+                    brackets++;
+                } else if (*str == ']') {
+                    brackets--;
+                } else if ((*str == '>') && (brackets <= 0)) {
+                    break;
+                }
+            }
+            if (!*str) { goto failed; }
+            str++;
+            continue;
+        } else if (str[1] == '/') {
+            const char *name = str + 2;
+            str = strchr(name, '>');
+            if (!str || (depth == 0)) { goto failed; }
+            size_t namelen = (size_t) (str - name);
+            while (namelen && is_xml_space(name[namelen - 1])) { namelen--; }
+            SvgNode *node = stack[--depth];
+            if ((strlen(node->name) != namelen) || (strncmp(node->name, name, namelen) != 0)) { goto failed; }
+            str++;
+            continue;
+        }
+
+        // start tag.
+        str++;
+        const char *name = str;
+        while (*str && !is_xml_space(*str) && (*str != '>') && (*str != '/')) { str++; }
+        if (!*str || (str == name)) { goto failed; }
+
+        SvgNode *node = (SvgNode *) xcalloc(1, sizeof (SvgNode));
+        node->name = xstrndup(name, (size_t) (str - name));
+        if (depth > 0) {
+            svg_add_child(stack[depth - 1], node);
+        } else if (!root) {
+            root = node;
+        } else {
+            svg_free_node(node);  // more than one root element?!
+            goto failed;
+        }
+
+        int closed = 0;
+        while (1) {
+            while (is_xml_space(*str)) { str++; }
+            if (*str == '>') {
+                str++;
+                break;
+            } else if ((str[0] == '/') && (str[1] == '>')) {
+                str += 2;
+                closed = 1;
+                break;
+            } else if (!*str) {
+                goto failed;
+            }
+
+            const char *attrname = str;
+            while (*str && !is_xml_space(*str) && (*str != '=') && (*str != '>') && (*str != '/')) { str++; }
+            const char *attrnameend = str;
+            while (is_xml_space(*str)) { str++; }
+            if ((*str != '=') || (attrnameend == attrname)) { goto failed; }
+            str++;
+            while (is_xml_space(*str)) { str++; }
+            const char quote = *str;
+            if ((quote != '"') && (quote != '\'')) { goto failed; }
+            const char *value = ++str;
+            str = strchr(str, quote);
+            if (!str) { goto failed; }
+
+            node->attrs = (SvgAttr *) xrealloc(node->attrs, (node->num_attrs + 1) * sizeof (SvgAttr));
+            node->attrs[node->num_attrs].name = xstrndup(attrname, (size_t) (attrnameend - attrname));
+            node->attrs[node->num_attrs].value = xstrndup(value, (size_t) (str - value));
+            node->num_attrs++;
+            str++;
+        }
+
+        if (!closed) {
+            if (depth >= (int) (sizeof (stack) / sizeof (stack[0]))) { goto failed; }
+            stack[depth++] = node;
+        }
+    }
+
+    if (depth == 0) {
+        return root;
+    }
+
+failed:
+    svg_free_node(root);
+    return NULL;
+}
+
+static void svg_write_node(StrBuf *buf, const SvgNode *node)
+{
+    strbuf_appendstr(buf, "<");
+    strbuf_appendstr(buf, node->name);
+    for (int i = 0; i < node->num_attrs; i++) {
+        const char *quote = strchr(node->attrs[i].value, '"') ? "'" : "\"";
+        strbuf_appendstr(buf, " ");
+        strbuf_appendstr(buf, node->attrs[i].name);
+        strbuf_appendstr(buf, "=");
+        strbuf_appendstr(buf, quote);
+        strbuf_appendstr(buf, node->attrs[i].value);
+        strbuf_appendstr(buf, quote);
+    }
+
+    // nanosvg only ends a tag name at whitespace, so "<g/>" would be an element named "g/".
+    const char *close = node->num_attrs ? "/>" : " />";
+    if (node->num_children == 0) {
+        strbuf_appendstr(buf, close);
+    } else {
+        strbuf_appendstr(buf, ">");
+        for (int i = 0; i < node->num_children; i++) {
+            svg_write_node(buf, node->children[i]);
+        }
+        strbuf_appendstr(buf, "</");
+        strbuf_appendstr(buf, node->name);
+        strbuf_appendstr(buf, ">");
+    }
+}
+
+
+// Numbers.
+
+static int parse_plain_number(const char *str, double *_val)
+{
+    // nanosvg uses its own atof, so use that to match it exactly, but make sure this is _only_ a number, no units.
+    const char *ptr = str;
+    if ((*ptr == '-') || (*ptr == '+')) { ptr++; }
+    int digits = 0;
+    while (nsvg__isdigit(*ptr)) { ptr++; digits++; }
+    if (*ptr == '.') {
+        ptr++;
+        while (nsvg__isdigit(*ptr)) { ptr++; digits++; }
+    }
+    if (!digits) {
+        return 0;
+    }
+    if ((*ptr == 'e') || (*ptr == 'E')) {
+        ptr++;
+        if ((*ptr == '-') || (*ptr == '+')) { ptr++; }
+        if (!nsvg__isdigit(*ptr)) { return 0; }
+        while (nsvg__isdigit(*ptr)) { ptr++; }
+    }
+    if (*ptr != '\0') {
+        return 0;
+    }
+    *_val = nsvg__atof(str);
+    return 1;
+}
+
+// drops leading zeroes ("0.5" -> ".5"), and the "+" and leading zeroes of exponents.
+static void tidy_number(char *str)
+{
+    char *e = strchr(str, 'e');
+    if (e) {
+        char *exp = e + 1;
+        char *src = exp;
+        const int negative = (*src == '-');
+        if ((*src == '-') || (*src == '+')) { src++; }
+        while ((*src == '0') && src[1]) { src++; }
+        if (negative) { *(exp++) = '-'; }
+        memmove(exp, src, strlen(src) + 1);
+    }
+
+    char *ptr = (*str == '-') ? str + 1 : str;
+    if ((ptr[0] == '0') && (ptr[1] == '.')) {
+        memmove(ptr, ptr + 1, strlen(ptr));
+    }
+
+    if (strcmp(str, "-0") == 0) {
+        strcpy(str, "0");
+    }
+}
+
+// Writes `val` to `buf` as briefly as possible. If `decimals` is >= 0, it's
+//  rounded to that many decimal places, otherwise this is the shortest string
+//  that nanosvg will parse back to the same float.
+static void format_number(char *buf, size_t buflen, double val, int decimals)
+{
+    if (decimals >= 0) {
+        snprintf(buf, buflen, "%.*f", decimals, val);
+        if (strchr(buf, '.')) {
+            char *ptr = buf + strlen(buf) - 1;
+            while (*ptr == '0') { *(ptr--) = '\0'; }
+            if (*ptr == '.') { *ptr = '\0'; }
+        }
+        tidy_number(buf);
+        return;
+    }
+
+    const float fval = (float) val;
+    char best[64] = { 0 };
+    char tmp[64];
+
+    for (int prec = 1; prec <= 9; prec++) {
+        snprintf(tmp, sizeof (tmp), "%.*g", prec, (double) fval);
+        tidy_number(tmp);
+        if ((float) nsvg__atof(tmp) == fval) {
+            strcpy(best, tmp);
+            break;
+        }
+    }
+
+    for (int prec = 0; prec <= 12; prec++) {
+        snprintf(tmp, sizeof (tmp), "%.*f", prec, (double) fval);
+        tidy_number(tmp);
+        if ((float) nsvg__atof(tmp) == fval) {
+            if (!best[0] || (strlen(tmp) < strlen(best))) {
+                strcpy(best, tmp);
+            }
+            break;
+        }
+    }
+
+    if (!best[0]) {  // shouldn't happen, but just in case.
+        snprintf(best, sizeof (best), "%.9g", (double) fval);
+    }
+
+    snprintf(buf, buflen, "%s", best);
+}
+
+// appends a number to a list of numbers, with a separator only if nanosvg needs one.
+static void append_number(StrBuf *buf, const char *num, int *prev_was_number, int *prev_has_dot)
+{
+    if (*prev_was_number) {
+        if ((num[0] == '-') || ((num[0] == '.') && *prev_has_dot)) {
+            // no separator needed.
+        } else {
+            strbuf_appendstr(buf, " ");
+        }
+    }
+    strbuf_appendstr(buf, num);
+    *prev_was_number = 1;
+    *prev_has_dot = (strchr(num, '.') != NULL) && (strchr(num, 'e') == NULL);
+}
+
+
+// Transforms, in nanosvg's layout: x' = x*t[0] + y*t[2] + t[4], y' = x*t[1] + y*t[3] + t[5]
+
+static void xform_identity(double *t)
+{
+    t[0] = 1.0; t[1] = 0.0; t[2] = 0.0; t[3] = 1.0; t[4] = 0.0; t[5] = 0.0;
+}
+
+static int xform_is_identity(const double *t)
+{
+    return (t[0] == 1.0) && (t[1] == 0.0) && (t[2] == 0.0) && (t[3] == 1.0) && (t[4] == 0.0) && (t[5] == 0.0);
+}
+
+static int xform_is_translation(const double *t)
+{
+    return (t[0] == 1.0) && (t[1] == 0.0) && (t[2] == 0.0) && (t[3] == 1.0);
+}
+
+// t = t * s, same as nsvg__xformMultiply.
+static void xform_multiply(double *t, const double *s)
+{
+    const double t0 = t[0] * s[0] + t[1] * s[2];
+    const double t2 = t[2] * s[0] + t[3] * s[2];
+    const double t4 = t[4] * s[0] + t[5] * s[2] + s[4];
+    t[1] = t[0] * s[1] + t[1] * s[3];
+    t[3] = t[2] * s[1] + t[3] * s[3];
+    t[5] = t[4] * s[1] + t[5] * s[3] + s[5];
+    t[0] = t0;
+    t[2] = t2;
+    t[4] = t4;
+}
+
+// t = s * t, same as nsvg__xformPremultiply.
+static void xform_premultiply(double *t, const double *s)
+{
+    double s2[6];
+    memcpy(s2, s, sizeof (s2));
+    xform_multiply(s2, t);
+    memcpy(t, s2, sizeof (s2));
+}
+
+static void xform_point(double *x, double *y, const double *t)
+{
+    const double px = *x;
+    const double py = *y;
+    *x = px * t[0] + py * t[2] + t[4];
+    *y = px * t[1] + py * t[3] + t[5];
+}
+
+// parses an SVG transform list the way nanosvg does (including its quirks), so the results match.
+static void parse_transform(double *xform, const char *str)
+{
+    xform_identity(xform);
+    while (*str) {
+        static const char *names[] = { "matrix", "translate", "scale", "rotate", "skewX", "skewY" };
+        int which = -1;
+        for (int i = 0; i < (int) (sizeof (names) / sizeof (names[0])); i++) {
+            if (strncmp(str, names[i], strlen(names[i])) == 0) {
+                which = i;
+                break;
+            }
+        }
+
+        if (which == -1) {
+            str++;
+            continue;
+        }
+
+        const char *ptr = str + strlen(names[which]);
+        while (*ptr && (*ptr != '(')) { ptr++; }
+        if (!*ptr) {
+            str++;
+            continue;
+        }
+        ptr++;
+
+        double args[6];
+        int nargs = 0;
+        while (*ptr && (*ptr != ')')) {
+            char item[64];
+            if ((*ptr == '-') || (*ptr == '+') || (*ptr == '.') || nsvg__isdigit(*ptr)) {
+                ptr = nsvg__parseNumber(ptr, item, 64);
+                if (nargs < 6) {
+                    args[nargs++] = nsvg__atof(item);
+                }
+            } else {
+                ptr++;
+            }
+        }
+        if (*ptr) { ptr++; }
+
+        double t[6];
+        xform_identity(t);
+        switch (which) {
+            case 0:
+                if (nargs == 6) { memcpy(t, args, sizeof (t)); }
+                break;
+            case 1:
+                t[4] = (nargs > 0) ? args[0] : 0.0;
+                t[5] = (nargs > 1) ? args[1] : 0.0;
+                break;
+            case 2:
+                t[0] = (nargs > 0) ? args[0] : 1.0;
+                t[3] = (nargs > 1) ? args[1] : t[0];
+                break;
+            case 3: {
+                // nanosvg uses floats for the trig, so we do too, to match it.
+                const float a = (float) (((nargs > 0) ? args[0] : 0.0) / 180.0 * NSVG_PI);
+                double m[6];
+                xform_identity(m);
+                if (nargs > 1) {
+                    m[4] = -args[1];
+                    m[5] = -args[2 < nargs ? 2 : 1];
+                    if (nargs < 3) { m[5] = 0.0; }
+                }
+                t[0] = cosf(a); t[1] = sinf(a); t[2] = -sinf(a); t[3] = cosf(a);
+                if (nargs > 1) {
+                    double r[6];
+                    memcpy(r, t, sizeof (r));
+                    memcpy(t, m, sizeof (t));
+                    xform_multiply(t, r);
+                    xform_identity(m);
+                    m[4] = args[1];
+                    m[5] = (nargs > 2) ? args[2] : 0.0;
+                    xform_multiply(t, m);
+                }
+                break;
+            }
+            case 4:
+                t[2] = tanf((float) (((nargs > 0) ? args[0] : 0.0) / 180.0 * NSVG_PI));
+                break;
+            case 5:
+                t[1] = tanf((float) (((nargs > 0) ? args[0] : 0.0) / 180.0 * NSVG_PI));
+                break;
+        }
+
+        xform_premultiply(xform, t);
+        str = ptr;
+    }
+}
+
+static char *format_transform(const double *t)
+{
+    char nums[6][64];
+    char buf[512];
+    for (int i = 0; i < 6; i++) {
+        format_number(nums[i], sizeof (nums[i]), t[i], -1);
+    }
+
+    if (xform_is_translation(t)) {
+        if (t[5] == 0.0) {
+            snprintf(buf, sizeof (buf), "translate(%s)", nums[4]);
+        } else {
+            snprintf(buf, sizeof (buf), "translate(%s %s)", nums[4], nums[5]);
+        }
+    } else if ((t[1] == 0.0) && (t[2] == 0.0) && (t[4] == 0.0) && (t[5] == 0.0)) {
+        if (t[0] == t[3]) {
+            snprintf(buf, sizeof (buf), "scale(%s)", nums[0]);
+        } else {
+            snprintf(buf, sizeof (buf), "scale(%s %s)", nums[0], nums[3]);
+        }
+    } else {
+        snprintf(buf, sizeof (buf), "matrix(%s %s %s %s %s %s)", nums[0], nums[1], nums[2], nums[3], nums[4], nums[5]);
+    }
+    return xstrdup(buf);
+}
+
+
+// Path data.
+
+typedef struct PathSeg
+{
+    char cmd;  // as written in the file, one of MmLlHhVvCcSsQqTtAaZz.
+    double args[7];
+    double x, y;  // absolute end point.
+    double ctrl[4];  // absolute control points (C: two, S/Q: one, in ctrl[0..1] and maybe ctrl[2..3])
+} PathSeg;
+
+static int path_args_per_command(char cmd)
+{
+    switch (cmd) {
+        case 'v': case 'V': case 'h': case 'H': return 1;
+        case 'm': case 'M': case 'l': case 'L': case 't': case 'T': return 2;
+        case 'q': case 'Q': case 's': case 'S': return 4;
+        case 'c': case 'C': return 6;
+        case 'a': case 'A': return 7;
+        case 'z': case 'Z': return 0;
+    }
+    return -1;
+}
+
+// Fill in the absolute coordinates of a segment, given the current point.
+static void path_resolve_segment(PathSeg *seg, double *cpx, double *cpy, double *startx, double *starty)
+{
+    const int rel = (seg->cmd >= 'a') && (seg->cmd <= 'z');
+    const double ox = rel ? *cpx : 0.0;
+    const double oy = rel ? *cpy : 0.0;
+    const double *a = seg->args;
+
+    switch (seg->cmd) {
+        case 'M': case 'm':
+            seg->x = ox + a[0]; seg->y = oy + a[1];
+            *startx = seg->x; *starty = seg->y;
+            break;
+        case 'L': case 'l': case 'T': case 't':
+            seg->x = ox + a[0]; seg->y = oy + a[1];
+            break;
+        case 'H': case 'h':
+            seg->x = ox + a[0]; seg->y = *cpy;
+            break;
+        case 'V': case 'v':
+            seg->x = *cpx; seg->y = oy + a[0];
+            break;
+        case 'C': case 'c':
+            seg->ctrl[0] = ox + a[0]; seg->ctrl[1] = oy + a[1];
+            seg->ctrl[2] = ox + a[2]; seg->ctrl[3] = oy + a[3];
+            seg->x = ox + a[4]; seg->y = oy + a[5];
+            break;
+        case 'S': case 's': case 'Q': case 'q':
+            seg->ctrl[0] = ox + a[0]; seg->ctrl[1] = oy + a[1];
+            seg->x = ox + a[2]; seg->y = oy + a[3];
+            break;
+        case 'A': case 'a':
+            seg->x = ox + a[5]; seg->y = oy + a[6];
+            break;
+        case 'Z': case 'z':
+            seg->x = *startx; seg->y = *starty;
+            break;
+    }
+
+    *cpx = seg->x;
+    *cpy = seg->y;
+}
+
+// Parses path data into segments, dropping anything nanosvg would ignore.
+static PathSeg *parse_path_data(const char *s, int *_num_segs)
+{
+    PathSeg *segs = NULL;
+    int num_segs = 0;
+    char cmd = '\0';
+    int rargs = 0;
+    int nargs = 0;
+    int init_point = 0;
+    double args[10];
+    double val = 0.0;
+    char item[64];
+
+    while (*s) {
+        item[0] = '\0';
+        if (((cmd == 'A') || (cmd == 'a')) && ((nargs == 3) || (nargs == 4))) {
+            s = nsvg__getNextPathItemWhenArcFlag(s, item);
+        }
+        if (*item) {
+            val = item[0] - '0';  // an arc flag.
+        } else {
+            s = nsvg__getNextPathItem(s, item, &val);
+        }
+        if (!*item) {
+            break;
+        }
+
+        if ((cmd != '\0') && nsvg__isCoordinate(item)) {
+            if (nargs < 10) {
+                args[nargs++] = val;
+            }
+            if (nargs >= rargs) {
+                if ((rargs > 0) && (nargs == rargs)) {
+                    segs = (PathSeg *) xrealloc(segs, (num_segs + 1) * sizeof (PathSeg));
+                    PathSeg *seg = &segs[num_segs++];
+                    memset(seg, '\0', sizeof (*seg));
+                    seg->cmd = cmd;
+                    memcpy(seg->args, args, rargs * sizeof (double));
+                }
+                if ((cmd == 'M') || (cmd == 'm')) {
+                    cmd = (cmd == 'm') ? 'l' : 'L';
+                    rargs = path_args_per_command(cmd);
+                    init_point = 1;
+                }
+                nargs = 0;
+            }
+        } else {
+            cmd = item[0];
+            if ((cmd == 'M') || (cmd == 'm')) {
+                nargs = 0;
+            } else if (!init_point) {
+                cmd = '\0';  // nanosvg ignores everything until the first moveto.
+            }
+
+            if ((cmd == 'Z') || (cmd == 'z')) {
+                segs = (PathSeg *) xrealloc(segs, (num_segs + 1) * sizeof (PathSeg));
+                PathSeg *seg = &segs[num_segs++];
+                memset(seg, '\0', sizeof (*seg));
+                seg->cmd = 'Z';
+                nargs = 0;
+            }
+
+            rargs = path_args_per_command(cmd);
+            if (rargs == -1) {
+                cmd = '\0';
+                rargs = 0;
+            }
+        }
+    }
+
+    double cpx = 0.0, cpy = 0.0, startx = 0.0, starty = 0.0;
+    for (int i = 0; i < num_segs; i++) {
+        path_resolve_segment(&segs[i], &cpx, &cpy, &startx, &starty);
+    }
+
+    *_num_segs = num_segs;
+    return segs;
+}
+
+typedef struct PathWriter
+{
+    StrBuf buf;
+    char prev_cmd;
+    int prev_was_number;
+    int prev_has_dot;
+    int prev_was_flag;
+} PathWriter;
+
+// nanosvg (and SVG) repeat the last command if there's no new one; a moveto repeats as a lineto.
+static int path_command_is_implied(const PathWriter *w, char cmd)
+{
+    if ((cmd == 'M') || (cmd == 'm') || (cmd == 'Z') || (cmd == 'z')) {
+        return 0;
+    }
+    return (cmd == w->prev_cmd) || ((cmd == 'L') && (w->prev_cmd == 'M')) || ((cmd == 'l') && (w->prev_cmd == 'm'));
+}
+
+static void path_write_command(PathWriter *w, char cmd)
+{
+    if (!path_command_is_implied(w, cmd)) {
+        char str[2] = { cmd, '\0' };
+        strbuf_appendstr(&w->buf, str);
+        w->prev_was_number = 0;
+        w->prev_was_flag = 0;
+    }
+    w->prev_cmd = cmd;
+}
+
+static void path_write_number(PathWriter *w, const char *num)
+{
+    if (w->prev_was_flag) {
+        w->prev_was_number = 0;  // the flag is one char, nanosvg knows where it ends.
+        w->prev_was_flag = 0;
+    }
+    append_number(&w->buf, num, &w->prev_was_number, &w->prev_has_dot);
+}
+
+static void path_write_flag(PathWriter *w, double val)
+{
+    if (w->prev_was_number && !w->prev_was_flag) {
+        strbuf_appendstr(&w->buf, " ");
+    }
+    strbuf_appendstr(&w->buf, (val != 0.0) ? "1" : "0");
+    w->prev_was_number = 1;
+    w->prev_was_flag = 1;
+}
+
+// writes the numbers for a command, with the arc flags handled properly.
+static void path_write_args(PathWriter *w, char cmd, char nums[7][64], int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (((cmd == 'A') || (cmd == 'a')) && ((i == 3) || (i == 4))) {
+            path_write_flag(w, nsvg__atof(nums[i]));
+        } else {
+            path_write_number(w, nums[i]);
+        }
+    }
+}
+
+// Writes path data exactly as parsed (same commands, same numbers), just without wasted bytes.
+static char *write_path_data_lossless(const PathSeg *segs, int num_segs)
+{
+    PathWriter w;
+    memset(&w, '\0', sizeof (w));
+    strbuf_appendstr(&w.buf, "");
+
+    for (int i = 0; i < num_segs; i++) {
+        const PathSeg *seg = &segs[i];
+        const int count = path_args_per_command(seg->cmd);
+        char nums[7][64];
+        for (int j = 0; j < count; j++) {
+            format_number(nums[j], sizeof (nums[j]), seg->args[j], -1);
+        }
+        path_write_command(&w, seg->cmd);
+        path_write_args(&w, seg->cmd, nums, count);
+    }
+
+    return w.buf.data;
+}
+
+// Writes path data from absolute coordinates, picking relative or absolute
+//  commands for each segment, whichever is shorter. If `decimals` >= 0,
+//  coordinates are rounded, and relative coordinates are computed from the
+//  rounded values, so the rounding error doesn't add up along the path.
+static char *write_path_data_optimized(const PathSeg *segs, int num_segs, int decimals)
+{
+    PathWriter w;
+    memset(&w, '\0', sizeof (w));
+    strbuf_appendstr(&w.buf, "");
+
+    double scale = 1.0;
+    for (int i = 0; i < decimals; i++) {
+        scale *= 10.0;
+    }
+
+    #define QUANTIZE(v) ((decimals >= 0) ? (floor(((v) * scale) + 0.5) / scale) : (double) (float) (v))
+
+    double ex = 0.0, ey = 0.0;  // the current point, as nanosvg will see it.
+    double esx = 0.0, esy = 0.0;
+
+    for (int i = 0; i < num_segs; i++) {
+        const PathSeg *seg = &segs[i];
+        const char upper = (char) toupper(seg->cmd);
+        double absv[7];
+        double relv[7];
+        int count = 0;
+        char cmd = upper;
+
+        if (upper == 'Z') {
+            path_write_command(&w, 'z');
+            ex = esx;
+            ey = esy;
+            continue;
+        }
+
+        const double qx = QUANTIZE(seg->x);
+        const double qy = QUANTIZE(seg->y);
+
+        switch (upper) {
+            case 'M': case 'L': case 'H': case 'V':
+                if (upper != 'M') {
+                    if (qy == ey) {
+                        cmd = 'H';
+                    } else if (qx == ex) {
+                        cmd = 'V';
+                    } else {
+                        cmd = 'L';
+                    }
+                }
+                if (cmd == 'H') {
+                    absv[0] = qx; relv[0] = qx - ex; count = 1;
+                } else if (cmd == 'V') {
+                    absv[0] = qy; relv[0] = qy - ey; count = 1;
+                } else {
+                    absv[0] = qx; absv[1] = qy; relv[0] = qx - ex; relv[1] = qy - ey; count = 2;
+                }
+                break;
+
+            case 'T':
+                absv[0] = qx; absv[1] = qy; relv[0] = qx - ex; relv[1] = qy - ey; count = 2;
+                break;
+
+            case 'C':
+                for (int j = 0; j < 4; j += 2) {
+                    absv[j] = QUANTIZE(seg->ctrl[j]);
+                    absv[j + 1] = QUANTIZE(seg->ctrl[j + 1]);
+                    relv[j] = absv[j] - ex;
+                    relv[j + 1] = absv[j + 1] - ey;
+                }
+                absv[4] = qx; absv[5] = qy; relv[4] = qx - ex; relv[5] = qy - ey; count = 6;
+                break;
+
+            case 'S': case 'Q':
+                absv[0] = QUANTIZE(seg->ctrl[0]);
+                absv[1] = QUANTIZE(seg->ctrl[1]);
+                relv[0] = absv[0] - ex;
+                relv[1] = absv[1] - ey;
+                absv[2] = qx; absv[3] = qy; relv[2] = qx - ex; relv[3] = qy - ey; count = 4;
+                break;
+
+            case 'A':
+                for (int j = 0; j < 3; j++) {
+                    absv[j] = relv[j] = QUANTIZE(seg->args[j]);
+                }
+                absv[3] = relv[3] = seg->args[3];
+                absv[4] = relv[4] = seg->args[4];
+                absv[5] = qx; absv[6] = qy; relv[5] = qx - ex; relv[6] = qy - ey; count = 7;
+                break;
+        }
+
+        char absnums[7][64];
+        char relnums[7][64];
+        size_t abslen = 0, rellen = 0;
+        for (int j = 0; j < count; j++) {
+            format_number(absnums[j], sizeof (absnums[j]), absv[j], decimals);
+            format_number(relnums[j], sizeof (relnums[j]), relv[j], decimals);
+            abslen += strlen(absnums[j]);
+            rellen += strlen(relnums[j]);
+        }
+
+        abslen += path_command_is_implied(&w, cmd) ? 0 : 1;
+        rellen += path_command_is_implied(&w, (char) tolower(cmd)) ? 0 : 1;
+
+        // without rounding, relative coords would pick up float error, so only use them when rounding.
+        const int use_rel = (decimals >= 0) && (rellen < abslen);
+        const char outcmd = use_rel ? (char) tolower(cmd) : cmd;
+        path_write_command(&w, outcmd);
+        path_write_args(&w, outcmd, use_rel ? relnums : absnums, count);
+
+        // track where nanosvg will think we are, based on what we actually wrote.
+        if (use_rel) {
+            if (cmd == 'H') {
+                ex += nsvg__atof(relnums[0]);
+            } else if (cmd == 'V') {
+                ey += nsvg__atof(relnums[0]);
+            } else {
+                ex += nsvg__atof(relnums[count - 2]);
+                ey += nsvg__atof(relnums[count - 1]);
+            }
+            ex = QUANTIZE(ex);  // clean up float noise.
+            ey = QUANTIZE(ey);
+        } else {
+            if (cmd == 'H') {
+                ex = nsvg__atof(absnums[0]);
+            } else if (cmd == 'V') {
+                ey = nsvg__atof(absnums[0]);
+            } else {
+                ex = nsvg__atof(absnums[count - 2]);
+                ey = nsvg__atof(absnums[count - 1]);
+            }
+        }
+
+        if (cmd == 'M') {
+            esx = ex;
+            esy = ey;
+        }
+    }
+
+    #undef QUANTIZE
+
+    return w.buf.data;
+}
+
+static int path_has_arcs(const PathSeg *segs, int num_segs)
+{
+    for (int i = 0; i < num_segs; i++) {
+        if ((segs[i].cmd == 'A') || (segs[i].cmd == 'a')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Applies a transform to already-resolved absolute coordinates.
+static void path_transform(PathSeg *segs, int num_segs, const double *t)
+{
+    for (int i = 0; i < num_segs; i++) {
+        PathSeg *seg = &segs[i];
+        xform_point(&seg->x, &seg->y, t);
+        xform_point(&seg->ctrl[0], &seg->ctrl[1], t);
+        xform_point(&seg->ctrl[2], &seg->ctrl[3], t);  // (arcs only get here for translations, so radii and rotation don't change.)
+    }
+}
+
+
+// Presentation attributes.
+//  nanosvg treats these all the same whether they're attributes or in a
+//  style="" attribute, and a later one just replaces an earlier one, and a
+//  child just copies its parent's values before applying its own.
+
+enum
+{
+    PROP_DISPLAY,
+    PROP_FILL,
+    PROP_OPACITY,
+    PROP_FILL_OPACITY,
+    PROP_STROKE,
+    PROP_STROKE_WIDTH,
+    PROP_STROKE_DASHARRAY,
+    PROP_STROKE_DASHOFFSET,
+    PROP_STROKE_OPACITY,
+    PROP_STROKE_LINECAP,
+    PROP_STROKE_LINEJOIN,
+    PROP_STROKE_MITERLIMIT,
+    PROP_FILL_RULE,
+    PROP_FONT_SIZE,
+    NUM_PROPS
+};
+
+static const char *prop_names[NUM_PROPS] = {
+    "display", "fill", "opacity", "fill-opacity", "stroke", "stroke-width",
+    "stroke-dasharray", "stroke-dashoffset", "stroke-opacity", "stroke-linecap",
+    "stroke-linejoin", "stroke-miterlimit", "fill-rule", "font-size"
+};
+
+// nanosvg's initial values.
+static const char *prop_defaults[NUM_PROPS] = {
+    "inline", "#000", "1", "1", "none", "1", "none", "0", "1", "butt", "miter", "4", "nonzero", NULL
+};
+
+static int find_prop(const char *name)
+{
+    for (int i = 0; i < NUM_PROPS; i++) {
+        if (strcmp(prop_names[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// things nanosvg's attribute parser knows about that aren't presentation attributes.
+static int is_nanosvg_attr(const char *name)
+{
+    return (strcmp(name, "transform") == 0) || (strcmp(name, "style") == 0) || (strcmp(name, "id") == 0) ||
+           (strcmp(name, "stop-color") == 0) || (strcmp(name, "stop-opacity") == 0) || (strcmp(name, "offset") == 0);
+}
+
+static int is_shape_element(const char *name)
+{
+    return (strcmp(name, "path") == 0) || (strcmp(name, "rect") == 0) || (strcmp(name, "circle") == 0) ||
+           (strcmp(name, "ellipse") == 0) || (strcmp(name, "line") == 0) || (strcmp(name, "polyline") == 0) ||
+           (strcmp(name, "polygon") == 0);
+}
+
+static int is_gradient_element(const char *name)
+{
+    return (strcmp(name, "linearGradient") == 0) || (strcmp(name, "radialGradient") == 0);
+}
+
+static int is_known_element(const char *name)
+{
+    return is_shape_element(name) || is_gradient_element(name) || (strcmp(name, "g") == 0) ||
+           (strcmp(name, "svg") == 0) || (strcmp(name, "defs") == 0) || (strcmp(name, "stop") == 0);
+}
+
+// the geometry attributes nanosvg reads for each shape.
+static int is_geometry_attr(const char *element, const char *name)
+{
+    if (strcmp(element, "path") == 0) {
+        return (strcmp(name, "d") == 0);
+    } else if (strcmp(element, "rect") == 0) {
+        return (strcmp(name, "x") == 0) || (strcmp(name, "y") == 0) || (strcmp(name, "width") == 0) ||
+               (strcmp(name, "height") == 0) || (strcmp(name, "rx") == 0) || (strcmp(name, "ry") == 0);
+    } else if (strcmp(element, "circle") == 0) {
+        return (strcmp(name, "cx") == 0) || (strcmp(name, "cy") == 0) || (strcmp(name, "r") == 0);
+    } else if (strcmp(element, "ellipse") == 0) {
+        return (strcmp(name, "cx") == 0) || (strcmp(name, "cy") == 0) || (strcmp(name, "rx") == 0) || (strcmp(name, "ry") == 0);
+    } else if (strcmp(element, "line") == 0) {
+        return (strcmp(name, "x1") == 0) || (strcmp(name, "y1") == 0) || (strcmp(name, "x2") == 0) || (strcmp(name, "y2") == 0);
+    } else if ((strcmp(element, "polyline") == 0) || (strcmp(element, "polygon") == 0)) {
+        return (strcmp(name, "points") == 0);
+    }
+    return 0;
+}
+
+// A g or shape element, broken down into what nanosvg will actually use from it.
+typedef struct SvgStyle
+{
+    char *props[NUM_PROPS];  // NULL if not set on this element.
+    double xform[6];
+    char *xform_source;  // the original transform="" value, if there was exactly one.
+    int num_xforms;
+    int num_geometry;
+    SvgAttr geometry[8];
+    int ok;  // zero if this element has something we don't want to touch.
+} SvgStyle;
+
+static void free_style(SvgStyle *style)
+{
+    for (int i = 0; i < NUM_PROPS; i++) {
+        free(style->props[i]);
+    }
+    for (int i = 0; i < style->num_geometry; i++) {
+        free(style->geometry[i].name);
+        free(style->geometry[i].value);
+    }
+    free(style->xform_source);
+}
+
+static void set_style_prop(SvgStyle *style, const char *name, const char *value)
+{
+    const int prop = find_prop(name);
+    if (prop == PROP_DISPLAY) {
+        // nanosvg only pays attention to "none", and once set, a child can't undo it.
+        if (strcmp(value, "none") == 0) {
+            free(style->props[prop]);
+            style->props[prop] = xstrdup("none");
+        }
+    } else if (prop >= 0) {
+        free(style->props[prop]);
+        style->props[prop] = xstrdup(value);
+    } else if (strcmp(name, "transform") == 0) {
+        double t[6];
+        parse_transform(t, value);
+        xform_premultiply(style->xform, t);
+        free(style->xform_source);
+        style->xform_source = xstrdup(value);
+        style->num_xforms++;
+    }
+    // anything else nanosvg ignores (or is meaningless on this element), so drop it.
+}
+
+static void parse_inline_style(SvgStyle *style, const char *str)
+{
+    // same parsing rules as nsvg__parseStyle/nsvg__parseNameValue.
+    while (*str) {
+        while (*str && nsvg__isspace(*str)) { str++; }
+        const char *start = str;
+        while (*str && (*str != ';')) { str++; }
+        const char *end = str;
+        while ((end > start) && ((end[-1] == ';') || nsvg__isspace(end[-1]))) { end--; }
+
+        const char *colon = start;
+        while ((colon < end) && (*colon != ':')) { colon++; }
+        const char *nameend = colon;
+        while ((nameend > start) && nsvg__isspace(nameend[-1])) { nameend--; }
+        const char *val = colon;
+        while ((val < end) && ((*val == ':') || nsvg__isspace(*val))) { val++; }
+
+        if (nameend > start) {
+            char *name = xstrndup(start, (size_t) (nameend - start));
+            char *value = xstrndup(val, (size_t) (end - val));
+            set_style_prop(style, name, value);
+            free(name);
+            free(value);
+        }
+
+        if (*str) { str++; }
+    }
+}
+
+static void build_style(const SvgNode *node, SvgStyle *style)
+{
+    memset(style, '\0', sizeof (*style));
+    xform_identity(style->xform);
+    style->ok = 1;
+
+    for (int i = 0; i < node->num_attrs; i++) {
+        const SvgAttr *attr = &node->attrs[i];
+        if (strcmp(attr->name, "style") == 0) {
+            parse_inline_style(style, attr->value);
+        } else if ((find_prop(attr->name) >= 0) || is_nanosvg_attr(attr->name)) {
+            set_style_prop(style, attr->name, attr->value);
+        } else if (is_geometry_attr(node->name, attr->name)) {
+            if (style->num_geometry >= (int) (sizeof (style->geometry) / sizeof (style->geometry[0]))) {
+                style->ok = 0;  // duplicate attributes or something weird.
+            } else {
+                style->geometry[style->num_geometry].name = xstrdup(attr->name);
+                style->geometry[style->num_geometry].value = xstrdup(attr->value);
+                style->num_geometry++;
+            }
+        }
+        // anything else is ignored by nanosvg.
+    }
+
+    // font-size changes what "em" units mean in the order attributes are parsed. Don't touch it.
+    if (style->props[PROP_FONT_SIZE]) {
+        style->ok = 0;
+    }
+}
+
+static int parse_hex_color(const char *str, unsigned int *_rgb)
+{
+    unsigned int rgb = 0;
+    if (str[0] != '#') {
+        return 0;
+    }
+    const size_t len = strlen(str + 1);
+    for (size_t i = 1; i <= len; i++) {
+        if (!isxdigit((unsigned char) str[i])) {
+            return 0;
+        }
+    }
+    if (len == 6) {
+        rgb = (unsigned int) strtoul(str + 1, NULL, 16);
+    } else if (len == 3) {
+        const unsigned int short_rgb = (unsigned int) strtoul(str + 1, NULL, 16);
+        const unsigned int r = (short_rgb >> 8) & 0xF, g = (short_rgb >> 4) & 0xF, b = short_rgb & 0xF;
+        rgb = (r * 17) << 16 | (g * 17) << 8 | (b * 17);
+    } else {
+        return 0;
+    }
+    *_rgb = rgb;
+    return 1;
+}
+
+static int prop_values_equal(int prop, const char *a, const char *b)
+{
+    if (!a || !b) {
+        return 0;
+    } else if (strcmp(a, b) == 0) {
+        return 1;
+    } else if ((prop == PROP_FILL) || (prop == PROP_STROKE)) {
+        unsigned int rgba, rgbb;
+        return parse_hex_color(a, &rgba) && parse_hex_color(b, &rgbb) && (rgba == rgbb);
+    } else {
+        double da, db;
+        return parse_plain_number(a, &da) && parse_plain_number(b, &db) && ((float) da == (float) db);
+    }
+}
+
+static char *minify_prop_value(int prop, const char *value)
+{
+    static const struct { const char *name; const char *hex; } colors[] = {
+        { "black", "#000" }, { "white", "#fff" }, { "red", "red" }, { "yellow", "#ff0" }, { "fuchsia", "#f0f" },
+        { "magenta", "#f0f" }, { "cyan", "#0ff" }, { "aqua", "#0ff" }, { "blue", "#00f" }, { "lime", "#0f0" }
+    };
+    unsigned int rgb;
+    double num;
+    char buf[64];
+
+    if ((prop == PROP_FILL) || (prop == PROP_STROKE)) {
+        for (size_t i = 0; i < (sizeof (colors) / sizeof (colors[0])); i++) {
+            if (strcmp(value, colors[i].name) == 0) {
+                return xstrdup(colors[i].hex);
+            }
+        }
+        if (parse_hex_color(value, &rgb)) {
+            const unsigned int r = (rgb >> 16) & 0xFF, g = (rgb >> 8) & 0xFF, b = rgb & 0xFF;
+            if (((r >> 4) == (r & 0xF)) && ((g >> 4) == (g & 0xF)) && ((b >> 4) == (b & 0xF))) {
+                snprintf(buf, sizeof (buf), "#%x%x%x", r & 0xF, g & 0xF, b & 0xF);
+            } else {
+                snprintf(buf, sizeof (buf), "#%06x", rgb);
+            }
+            return xstrdup(buf);
+        }
+    } else if ((prop != PROP_STROKE_DASHARRAY) && parse_plain_number(value, &num)) {
+        format_number(buf, sizeof (buf), num, -1);
+        return xstrdup(buf);
+    }
+
+    return xstrdup(value);
+}
+
+// Rebuilds an element's attributes from its style.
+static void apply_style(SvgNode *node, const SvgStyle *style)
+{
+    for (int i = 0; i < node->num_attrs; i++) {
+        free(node->attrs[i].name);
+        free(node->attrs[i].value);
+    }
+    node->num_attrs = 0;
+
+    int num_props = 0;
+    for (int i = 0; i < NUM_PROPS; i++) {
+        if (style->props[i]) {
+            num_props++;
+        }
+    }
+
+    // attributes cost 4 extra bytes each (space, '=', quotes), style="" costs 9 plus 2 each (':', ';').
+    if ((num_props * 4) > (num_props * 2 + 8)) {
+        StrBuf buf;
+        memset(&buf, '\0', sizeof (buf));
+        for (int i = 0; i < NUM_PROPS; i++) {
+            if (style->props[i]) {
+                if (buf.len) { strbuf_appendstr(&buf, ";"); }
+                strbuf_appendstr(&buf, prop_names[i]);
+                strbuf_appendstr(&buf, ":");
+                strbuf_appendstr(&buf, style->props[i]);
+            }
+        }
+        svg_insert_attr(node, node->num_attrs, "style", buf.data);
+        free(buf.data);
+    } else {
+        for (int i = 0; i < NUM_PROPS; i++) {
+            if (style->props[i]) {
+                svg_insert_attr(node, node->num_attrs, prop_names[i], style->props[i]);
+            }
+        }
+    }
+
+    if (!xform_is_identity(style->xform)) {
+        char *str = format_transform(style->xform);
+        if (style->xform_source && (style->num_xforms == 1) && (strlen(style->xform_source) < strlen(str))) {
+            double t[6];
+            parse_transform(t, style->xform_source);
+            if (memcmp(t, style->xform, sizeof (t)) == 0) {  // still the original transform? Use it if it's shorter, like "rotate(90)".
+                free(str);
+                str = xstrdup(style->xform_source);
+            }
+        }
+        svg_insert_attr(node, node->num_attrs, "transform", str);
+        free(str);
+    }
+
+    for (int i = 0; i < style->num_geometry; i++) {
+        svg_insert_attr(node, node->num_attrs, style->geometry[i].name, style->geometry[i].value);
+    }
+}
+
+
+// Optimization passes.
+
+typedef struct IdList
+{
+    int count;
+    char **ids;
+} IdList;
+
+static int idlist_contains(const IdList *list, const char *id)
+{
+    for (int i = 0; i < list->count; i++) {
+        if (strcmp(list->ids[i], id) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void idlist_add(IdList *list, const char *id, size_t len)
+{
+    char *str = xstrndup(id, len);
+    if (idlist_contains(list, str)) {
+        free(str);
+    } else {
+        list->ids = (char **) xrealloc(list->ids, (list->count + 1) * sizeof (char *));
+        list->ids[list->count++] = str;
+    }
+}
+
+static void idlist_free(IdList *list)
+{
+    for (int i = 0; i < list->count; i++) {
+        free(list->ids[i]);
+    }
+    free(list->ids);
+}
+
+static void collect_refs_in_string(IdList *list, const char *str)
+{
+    while ((str = strstr(str, "url(")) != NULL) {
+        str += 4;
+        while (*str && (*str != '#') && (*str != ')')) { str++; }
+        if (*str == '#') {
+            const char *start = ++str;
+            while (*str && (*str != ')') && !is_xml_space(*str)) { str++; }
+            idlist_add(list, start, (size_t) (str - start));
+        }
+    }
+}
+
+static void collect_refs(const SvgNode *node, IdList *list, int skip_gradients)
+{
+    if (skip_gradients && is_gradient_element(node->name)) {
+        return;
+    }
+
+    for (int i = 0; i < node->num_attrs; i++) {
+        const SvgAttr *attr = &node->attrs[i];
+        if ((strcmp(attr->name, "xlink:href") == 0) || (strcmp(attr->name, "href") == 0)) {
+            if (attr->value[0] == '#') {
+                idlist_add(list, attr->value + 1, strlen(attr->value + 1));
+            }
+        } else {
+            collect_refs_in_string(list, attr->value);
+        }
+    }
+
+    for (int i = 0; i < node->num_children; i++) {
+        collect_refs(node->children[i], list, skip_gradients);
+    }
+}
+
+static void find_gradients(SvgNode *node, SvgNode ***_list, int *_count)
+{
+    if (is_gradient_element(node->name)) {
+        *_list = (SvgNode **) xrealloc(*_list, (*_count + 1) * sizeof (SvgNode *));
+        (*_list)[(*_count)++] = node;
+    }
+    for (int i = 0; i < node->num_children; i++) {
+        find_gradients(node->children[i], _list, _count);
+    }
+}
+
+// figures out which ids are actually used, including gradients referenced by used gradients.
+static void find_used_ids(SvgNode *root, IdList *used)
+{
+    SvgNode **gradients = NULL;
+    int num_gradients = 0;
+
+    collect_refs(root, used, 1);
+    find_gradients(root, &gradients, &num_gradients);
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 0; i < num_gradients; i++) {
+            const char *id = svg_get_attr(gradients[i], "id");
+            if (id && idlist_contains(used, id)) {
+                const int before = used->count;
+                collect_refs(gradients[i], used, 0);
+                if (used->count != before) {
+                    changed = 1;
+                }
+                // don't check this one again.
+                memmove(&gradients[i], &gradients[i + 1], (num_gradients - i - 1) * sizeof (SvgNode *));
+                num_gradients--;
+                i--;
+            }
+        }
+    }
+
+    free(gradients);
+}
+
+static int contains_known_element(const SvgNode *node)
+{
+    for (int i = 0; i < node->num_children; i++) {
+        if (is_known_element(node->children[i]->name) || contains_known_element(node->children[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int contains_element(const SvgNode *node, const char *name)
+{
+    for (int i = 0; i < node->num_children; i++) {
+        if ((strcmp(node->children[i]->name, name) == 0) || contains_element(node->children[i], name)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Level 1: remove elements and attributes that nanosvg ignores, and unused gradients/ids.
+static void strip_node(SvgNode *node, const IdList *used, int in_defs)
+{
+    for (int i = 0; i < node->num_attrs; i++) {
+        const SvgAttr *attr = &node->attrs[i];
+        int keep = 1;
+        if (strcmp(attr->name, "id") == 0) {
+            keep = idlist_contains(used, attr->value);
+        } else if (strcmp(attr->name, "xmlns") == 0) {
+            keep = 1;
+        } else if (strncmp(attr->name, "xmlns:", 6) == 0) {
+            keep = (strcmp(attr->name, "xmlns:xlink") == 0);  // we clean this up later if no xlink:href is left.
+        } else if (strcmp(attr->name, "xlink:href") == 0) {
+            keep = 1;
+        } else if (strchr(attr->name, ':') != NULL) {
+            keep = 0;  // inkscape:, sodipodi:, xml:space, etc.
+        } else if ((strcmp(attr->name, "version") == 0) || (strcmp(attr->name, "class") == 0)) {
+            keep = 0;
+        }
+
+        if (!keep) {
+            svg_remove_attr_at(node, i);
+            i--;
+        }
+    }
+
+    for (int i = 0; i < node->num_children; i++) {
+        SvgNode *child = node->children[i];
+        const int child_in_defs = in_defs || (strcmp(child->name, "defs") == 0);
+        if (in_defs && !is_gradient_element(child->name) && (strcmp(child->name, "stop") != 0)) {
+            // nanosvg skips everything but gradients inside <defs>.
+            if (contains_element(child, "linearGradient") || contains_element(child, "radialGradient")) {
+                strip_node(child, used, child_in_defs);
+                svg_unwrap_child(node, i);
+            } else {
+                svg_remove_child(node, i);
+            }
+            i--;
+        } else if (!is_known_element(child->name)) {
+            // nanosvg ignores unknown elements, but not their children.
+            if (contains_known_element(child)) {
+                strip_node(child, used, child_in_defs);
+                svg_unwrap_child(node, i);
+            } else {
+                svg_remove_child(node, i);
+            }
+            i--;
+        } else if (is_gradient_element(child->name)) {
+            const char *id = svg_get_attr(child, "id");
+            if (!id || !idlist_contains(used, id)) {
+                svg_remove_child(node, i);
+                i--;
+            } else {
+                strip_node(child, used, child_in_defs);
+            }
+        } else {
+            strip_node(child, used, child_in_defs);
+            if ((child->num_children == 0) && ((strcmp(child->name, "defs") == 0) || (strcmp(child->name, "g") == 0))) {
+                svg_remove_child(node, i);  // empty group or defs, does nothing.
+                i--;
+            } else if ((child->num_attrs == 0) && (strcmp(child->name, "g") == 0)) {
+                svg_unwrap_child(node, i);  // group with no attributes, does nothing.
+                i--;
+            }
+        }
+    }
+}
+
+// Drop properties that match what would be inherited anyhow, or that don't matter.
+static void simplify_style(const SvgNode *node, SvgStyle *style, char **inherited, int level)
+{
+    for (int i = 0; i < NUM_PROPS; i++) {
+        if (!style->props[i]) {
+            continue;
+        }
+
+        if (level >= 2) {
+            char *minified = minify_prop_value(i, style->props[i]);
+            free(style->props[i]);
+            style->props[i] = minified;
+        }
+
+        if (prop_values_equal(i, style->props[i], inherited[i]) || ((i == PROP_DISPLAY) && (strcmp(style->props[i], "none") != 0))) {
+            free(style->props[i]);
+            style->props[i] = NULL;
+        }
+    }
+
+    if (is_shape_element(node->name)) {
+        const char *stroke = style->props[PROP_STROKE] ? style->props[PROP_STROKE] : inherited[PROP_STROKE];
+        const char *fill = style->props[PROP_FILL] ? style->props[PROP_FILL] : inherited[PROP_FILL];
+        if (stroke && (strcmp(stroke, "none") == 0)) {
+            static const int stroke_props[] = { PROP_STROKE_WIDTH, PROP_STROKE_DASHARRAY, PROP_STROKE_DASHOFFSET, PROP_STROKE_OPACITY, PROP_STROKE_LINECAP, PROP_STROKE_LINEJOIN, PROP_STROKE_MITERLIMIT };
+            for (size_t i = 0; i < (sizeof (stroke_props) / sizeof (stroke_props[0])); i++) {
+                free(style->props[stroke_props[i]]);
+                style->props[stroke_props[i]] = NULL;
+            }
+        }
+        if (fill && (strcmp(fill, "none") == 0)) {
+            free(style->props[PROP_FILL_OPACITY]);
+            free(style->props[PROP_FILL_RULE]);
+            style->props[PROP_FILL_OPACITY] = NULL;
+            style->props[PROP_FILL_RULE] = NULL;
+        }
+    }
+}
+
+static int is_plain_number_list(const char *str)
+{
+    for (; *str; str++) {
+        if (!nsvg__isdigit(*str) && !is_xml_space(*str) && (strchr(".,-+eE", *str) == NULL)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static char *minify_number_list(const char *str, int decimals)
+{
+    StrBuf buf;
+    memset(&buf, '\0', sizeof (buf));
+    strbuf_appendstr(&buf, "");
+    int prev_was_number = 0, prev_has_dot = 0;
+    char item[64];
+    char num[64];
+    double val = 0.0;
+    while (*str) {
+        str = nsvg__getNextPathItem(str, item, &val);
+        if (!*item) {
+            break;
+        }
+        format_number(num, sizeof (num), val, decimals);
+        append_number(&buf, num, &prev_was_number, &prev_has_dot);
+    }
+    return buf.data;
+}
+
+// Level 2+: numbers, path data and transforms. Returns non-zero if `style->xform` was folded into the geometry.
+static int optimize_geometry(const SvgNode *node, SvgStyle *style, char **inherited, int level)
+{
+    const int decimals = (level >= 3) ? optimize_precision : -1;
+    int baked = 0;
+
+    // we can fold a transform into path data if nanosvg would get the same results.
+    int can_bake = !xform_is_identity(style->xform) && (strcmp(node->name, "path") == 0);
+    if (can_bake) {
+        const char *stroke = style->props[PROP_STROKE] ? style->props[PROP_STROKE] : inherited[PROP_STROKE];
+        const char *fill = style->props[PROP_FILL] ? style->props[PROP_FILL] : inherited[PROP_FILL];
+        if (strstr(stroke, "url(") || strstr(fill, "url(")) {
+            can_bake = 0;  // gradients are positioned by the shape's transform.
+        } else if ((strcmp(stroke, "none") != 0) && !xform_is_translation(style->xform)) {
+            can_bake = 0;  // nanosvg scales stroke width by the transform.
+        }
+    }
+
+    for (int i = 0; i < style->num_geometry; i++) {
+        SvgAttr *attr = &style->geometry[i];
+        char *newval = NULL;
+        double num;
+        if (strcmp(attr->name, "d") == 0) {
+            int num_segs = 0;
+            PathSeg *segs = parse_path_data(attr->value, &num_segs);
+            newval = (decimals >= 0) ? write_path_data_optimized(segs, num_segs, decimals) : write_path_data_lossless(segs, num_segs);
+            if (can_bake && (xform_is_translation(style->xform) || !path_has_arcs(segs, num_segs))) {
+                path_transform(segs, num_segs, style->xform);
+                char *bakedval = write_path_data_optimized(segs, num_segs, decimals);
+                char *xformstr = format_transform(style->xform);
+                // only keep the baked version if it's smaller than the path plus the transform="" attribute.
+                if (strlen(bakedval) < (strlen(newval) + strlen(xformstr) + 13)) {
+                    free(newval);
+                    newval = bakedval;
+                    baked = 1;
+                } else {
+                    free(bakedval);
+                }
+                free(xformstr);
+            }
+            free(segs);
+        } else if (strcmp(attr->name, "points") == 0) {
+            if (is_plain_number_list(attr->value)) {
+                newval = minify_number_list(attr->value, decimals);
+            }
+        } else if (parse_plain_number(attr->value, &num)) {
+            char buf[64];
+            format_number(buf, sizeof (buf), num, decimals);
+            newval = xstrdup(buf);
+        }
+
+        if (newval) {
+            free(attr->value);
+            attr->value = newval;
+        }
+    }
+
+    if (baked) {
+        xform_identity(style->xform);
+    }
+
+    return baked;
+}
+
+// Level 2+: push group transforms down into children, and get rid of groups that don't need to exist.
+static int can_push_into_children(const SvgNode *node)
+{
+    if (node->num_children == 0) {
+        return 0;
+    }
+    for (int i = 0; i < node->num_children; i++) {
+        const char *name = node->children[i]->name;
+        if ((strcmp(name, "g") != 0) && !is_shape_element(name)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void optimize_node(SvgNode *node, char **inherited, int level);
+
+static SvgNode *svg_clone_node(const SvgNode *node)
+{
+    SvgNode *retval = (SvgNode *) xcalloc(1, sizeof (SvgNode));
+    retval->name = xstrdup(node->name);
+    for (int i = 0; i < node->num_attrs; i++) {
+        svg_insert_attr(retval, i, node->attrs[i].name, node->attrs[i].value);
+    }
+    for (int i = 0; i < node->num_children; i++) {
+        svg_add_child(retval, svg_clone_node(node->children[i]));
+    }
+    return retval;
+}
+
+static size_t svg_node_size(const SvgNode *node)
+{
+    StrBuf buf;
+    memset(&buf, '\0', sizeof (buf));
+    svg_write_node(&buf, node);
+    free(buf.data);
+    return buf.len;
+}
+
+static void optimize_group_or_shape(SvgNode *node, int idx, char **inherited, int level)
+{
+    SvgNode *child = node->children[idx];
+    char *computed[NUM_PROPS];
+    SvgStyle style;
+
+    build_style(child, &style);
+    if (!style.ok) {
+        free_style(&style);
+        return;  // leave this whole subtree alone.
+    }
+
+    simplify_style(child, &style, inherited, level);
+
+    if (strcmp(child->name, "g") != 0) {
+        if (level >= 2) {
+            optimize_geometry(child, &style, inherited, level);
+        }
+        apply_style(child, &style);
+        free_style(&style);
+        return;
+    }
+
+    for (int i = 0; i < NUM_PROPS; i++) {
+        computed[i] = style.props[i] ? style.props[i] : inherited[i];
+    }
+
+    // Try pushing the group's transform down to its children, where it might
+    //  get folded into path data. nanosvg applies the parent's transform
+    //  first, so putting it first in each child's attributes is the same
+    //  thing. This isn't always a win, so we keep whichever is smaller.
+    SvgNode *pushed = NULL;
+    if ((level >= 2) && !xform_is_identity(style.xform) && can_push_into_children(child)) {
+        double xform[6];
+        char *xformstr = format_transform(style.xform);
+        pushed = svg_clone_node(child);
+        for (int i = 0; i < pushed->num_children; i++) {
+            svg_insert_attr(pushed->children[i], 0, "transform", xformstr);
+        }
+        free(xformstr);
+        memcpy(xform, style.xform, sizeof (xform));
+        xform_identity(style.xform);
+        apply_style(pushed, &style);
+        optimize_node(pushed, computed, level);
+        memcpy(style.xform, xform, sizeof (xform));
+    }
+
+    apply_style(child, &style);
+    optimize_node(child, computed, level);
+
+    if (pushed) {
+        if (svg_node_size(pushed) < svg_node_size(child)) {
+            node->children[idx] = pushed;
+            svg_free_node(child);
+            child = pushed;
+        } else {
+            svg_free_node(pushed);
+        }
+    }
+
+    free_style(&style);
+
+    if (level >= 2) {
+        if (child->num_attrs == 0) {
+            svg_unwrap_child(node, idx);  // group doesn't do anything anymore.
+        } else if ((child->num_children == 1) && can_push_into_children(child)) {
+            // a group with one child can just give its attributes to the child. nanosvg would apply them in this order anyhow.
+            SvgNode *gc = child->children[0];
+            SvgAttr *attrs = (SvgAttr *) xmalloc((child->num_attrs + gc->num_attrs) * sizeof (SvgAttr));
+            memcpy(attrs, child->attrs, child->num_attrs * sizeof (SvgAttr));
+            memcpy(attrs + child->num_attrs, gc->attrs, gc->num_attrs * sizeof (SvgAttr));
+            free(gc->attrs);
+            gc->attrs = attrs;
+            gc->num_attrs += child->num_attrs;
+            child->num_attrs = 0;
+
+            build_style(gc, &style);
+            if (style.ok) {
+                apply_style(gc, &style);  // collapse it back down to one style and transform.
+            }
+            free_style(&style);
+
+            svg_unwrap_child(node, idx);
+        }
+    }
+}
+
+static void optimize_node(SvgNode *node, char **inherited, int level)
+{
+    for (int i = 0; i < node->num_children; i++) {
+        SvgNode *child = node->children[i];
+        if ((strcmp(child->name, "g") == 0) || is_shape_element(child->name)) {
+            const int before = node->num_children;
+            optimize_group_or_shape(node, i, inherited, level);
+            i += node->num_children - before;  // if a group was unwrapped, skip its (already optimized) children.
+        }
+    }
+}
+
+// Things that make nanosvg's state machine do weird stuff that we'd rather not try to reproduce.
+static int svg_is_safe_to_optimize(const SvgNode *node, int depth, int in_defs)
+{
+    for (int i = 0; i < node->num_children; i++) {
+        const SvgNode *child = node->children[i];
+        if (strcmp(child->name, "svg") == 0) {
+            return 0;  // nested <svg> changes the parent's attributes.
+        } else if (strcmp(child->name, "defs") == 0) {
+            if (in_defs) {
+                return 0;  // nested <defs> ends the outer one early.
+            } else if ((depth > 0) && contains_element(child, "g")) {
+                return 0;  // a </g> in <defs> pops the enclosing group's attributes.
+            }
+        }
+        if (!svg_is_safe_to_optimize(child, depth + 1, in_defs || (strcmp(child->name, "defs") == 0))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int uses_xlink(const SvgNode *node)
+{
+    if (svg_get_attr(node, "xlink:href")) {
+        return 1;
+    }
+    for (int i = 0; i < node->num_children; i++) {
+        if (uses_xlink(node->children[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Returns an optimized copy of `svg`, or NULL if we couldn't do anything with it.
+static char *optimize_svg(const char *svg, int level)
+{
+    SvgNode *root = svg_parse_xml(svg);
+    if (!root) {
+        return NULL;
+    } else if ((strcmp(root->name, "svg") != 0) || !svg_is_safe_to_optimize(root, 0, 0)) {
+        svg_free_node(root);
+        return NULL;
+    }
+
+    IdList used;
+    memset(&used, '\0', sizeof (used));
+    find_used_ids(root, &used);
+    strip_node(root, &used, 0);
+    idlist_free(&used);
+
+    // the root element's presentation attributes apply to everything, but we leave the root itself alone.
+    SvgStyle rootstyle;
+    char *inherited[NUM_PROPS];
+    build_style(root, &rootstyle);
+    for (int i = 0; i < NUM_PROPS; i++) {
+        inherited[i] = rootstyle.props[i] ? rootstyle.props[i] : (char *) prop_defaults[i];
+    }
+    if (rootstyle.ok && xform_is_identity(rootstyle.xform)) {
+        optimize_node(root, inherited, level);
+    }
+    free_style(&rootstyle);
+
+    if (!uses_xlink(root)) {
+        for (int i = 0; i < root->num_attrs; i++) {
+            if (strcmp(root->attrs[i].name, "xmlns:xlink") == 0) {
+                svg_remove_attr_at(root, i);
+                break;
+            }
+        }
+    }
+
+    StrBuf buf;
+    memset(&buf, '\0', sizeof (buf));
+    svg_write_node(&buf, root);
+    svg_free_node(root);
+    return buf.data;
+}
+
+static unsigned char *rasterize_for_comparison(const char *svg, int size, float *_width)
+{
+    NSVGimage *image = nsvgParseConst(svg, strlen(svg), "px", 96.0f);
+    if (!image) {
+        return NULL;
+    } else if (image->width <= 0.0f) {
+        nsvgDelete(image);
+        return NULL;
+    }
+
+    NSVGrasterizer *rasterizer = nsvgCreateRasterizer();
+    if (!rasterizer) {
+        fprintf(stderr, "Out of memory!\n");
+        exit(1);
+    }
+
+    // same scaling that ControllerImage uses.
+    unsigned char *pixels = (unsigned char *) xcalloc(size * size, 4);
+    nsvgRasterize(rasterizer, image, 0.0f, 0.0f, (float) size / image->width, pixels, size, size, size * 4);
+    nsvgDeleteRasterizer(rasterizer);
+    *_width = image->width;
+    nsvgDelete(image);
+    return pixels;
+}
+
+// Compare how nanosvg renders two SVGs at `size` pixels. Returns the biggest difference in any pixel's channel.
+static int compare_rendering(const char *svg1, const char *svg2, int size, double *_mean_error)
+{
+    int max_error = 255;
+    float width1 = 0.0f, width2 = 0.0f;
+    unsigned char *pixels1 = rasterize_for_comparison(svg1, size, &width1);
+    unsigned char *pixels2 = pixels1 ? rasterize_for_comparison(svg2, size, &width2) : NULL;
+
+    *_mean_error = 255.0;
+
+    if (pixels2 && (width1 == width2)) {
+        const int total = size * size * 4;
+        double sum = 0.0;
+        max_error = 0;
+        for (int i = 0; i < total; i++) {
+            const int diff = abs(((int) pixels1[i]) - ((int) pixels2[i]));
+            sum += (double) diff;
+            if (diff > max_error) {
+                max_error = diff;
+            }
+        }
+        *_mean_error = sum / (double) total;
+    }
+
+    free(pixels1);
+    free(pixels2);
+    return max_error;
+}
+
+// Optimizes an item's image in place, if it works out. If the requested
+//  level changes the rendering too much, we try lower levels before giving up.
+//  This runs on a worker thread!
+static void optimize_item_uncached(LoadedItem *item)
+{
+    item->original_len = strlen(item->image);
+    item->optimized = -1;
+    item->max_error = 0;
+    item->mean_error = 0.0;
+
+    for (int level = optimize_level; level > 0; level--) {
+        char *optimized = optimize_svg(item->image, level);
+        if (!optimized) {
+            return;  // not something we can parse, so no level will work.
+        }
+
+        double mean_error = 0.0;
+        const int max_error = compare_rendering(item->image, optimized, OPTIMIZER_CHECK_SIZE, &mean_error);
+        if ((level == optimize_level) || (max_error <= optimize_max_error)) {
+            item->max_error = max_error;  // report the best level's error if nothing works out.
+            item->mean_error = mean_error;
+        }
+
+        if ((max_error <= optimize_max_error) && (strlen(optimized) < item->original_len)) {
+            free(item->image);
+            item->image = optimized;
+            item->optimized = level;
+            return;
+        }
+
+        free(optimized);
+    }
+}
+
+// Lots of device directories have identical SVGs (the ps3/ps4/ps5 face
+//  buttons, the xbox family...), so optimizer results are cached by content,
+//  and each distinct SVG is only optimized and rendered once, across themes
+//  too. The worker threads share this.
+typedef struct OptimizedSvg
+{
+    unsigned long long hash;
+    char *original;
+    char *optimized;  // NULL if we kept the original.
+    int level;  // what goes in LoadedItem::optimized.
+    int max_error;
+    double mean_error;
+    struct OptimizedSvg *next;
+} OptimizedSvg;
+
+#define OPTIMIZE_CACHE_BUCKETS 1024
+static OptimizedSvg *optimize_cache[OPTIMIZE_CACHE_BUCKETS];
+static WorkerMutex optimize_cache_mutex;
+static int num_optimize_cache_hits = 0;
+
+static void optimize_item(LoadedItem *item)
+{
+    const unsigned long long hash = hash_bytes(hash_seed, item->image, strlen(item->image));
+    OptimizedSvg **bucket = &optimize_cache[hash % OPTIMIZE_CACHE_BUCKETS];
+
+    LockMutex(&optimize_cache_mutex);
+    for (const OptimizedSvg *cached = *bucket; cached != NULL; cached = cached->next) {
+        if ((cached->hash == hash) && (strcmp(cached->original, item->image) == 0)) {
+            item->original_len = strlen(cached->original);
+            item->optimized = cached->level;
+            item->max_error = cached->max_error;
+            item->mean_error = cached->mean_error;
+            if (cached->optimized) {
+                free(item->image);
+                item->image = xstrdup(cached->optimized);
+            }
+            num_optimize_cache_hits++;
+            UnlockMutex(&optimize_cache_mutex);
+            return;
+        }
+    }
+    UnlockMutex(&optimize_cache_mutex);
+
+    // if another thread is working on the same SVG right now, we both do it; that's okay, it's rare.
+    OptimizedSvg *cached = (OptimizedSvg *) xcalloc(1, sizeof (OptimizedSvg));
+    cached->hash = hash;
+    cached->original = xstrdup(item->image);
+    optimize_item_uncached(item);
+    cached->optimized = (item->optimized > 0) ? xstrdup(item->image) : NULL;
+    cached->level = item->optimized;
+    cached->max_error = item->max_error;
+    cached->mean_error = item->mean_error;
+
+    LockMutex(&optimize_cache_mutex);
+    cached->next = *bucket;
+    *bucket = cached;
+    UnlockMutex(&optimize_cache_mutex);
+}
+
+
+// Cache of previously-built devices for incremental builds.
+//  Each device directory is fingerprinted by the names and contents of its
+//  files; if that matches, we reuse the cached device instead of parsing or
+//  optimizing anything again.
+static const char cache_magic[8] = { 'C', 'T', 'I', 'C', 'A', 'C', 'H', '\0' };
+static const int cache_version = 4;
+
+typedef struct CachedDevice
+{
+    const char *key;
+    unsigned long long signature;
+    const char *inherits;  // NULL if none.
+    int inherits_index;
+    int num_items;
+    const char **items;  // type, image, type, image...
+    int *item_stats;  // original_len, optimized, max_error, mean_error * 1000000, for each item.
+    ImageMeta *item_meta;
+    int num_guids;
+    const unsigned char *guids;
+} CachedDevice;
+
+// Whether two SVGs rendered the same the last time canonicalize_images()
+//  asked, so it doesn't have to rasterize them again. The cache file keeps
+//  the ones the last build asked about.
+typedef struct RenderVerdict
+{
+    unsigned long long svg1;  // hashes of the two SVGs' text, smallest first.
+    unsigned long long svg2;
+    int identical;
+} RenderVerdict;
+
+static char *device_cache_buf = NULL;
+static CachedDevice *cached_devices = NULL;
+static int num_cached_devices = 0;
+static RenderVerdict *cached_verdicts = NULL;
+static int num_cached_verdicts = 0;
+static RenderVerdict *checked_verdicts = NULL;  // the ones this build asked about.
+static int num_checked_verdicts = 0;
+
+// This hashes what's in the files, not their timestamps: an edit that keeps the size and puts the
+//  modification time back (or lands in the same second) would fool those.
+static unsigned long long signature_for_device_dir(const char *path, char **nodes, int num_nodes)
+{
+    // changing the optimizer settings changes the output, so they're part of the signature.
+    const int settings[3] = { optimize_level, optimize_precision, optimize_max_error };
+    unsigned long long signature = hash_bytes(hash_seed, settings, sizeof (settings));
+    for (int i = 0; i < num_nodes; i++) {
+        char *fullpath = make_path(path, nodes[i]);
+        struct stat statbuf;
+        if (stat(fullpath, &statbuf) == -1) {
+            fprintf(stderr, "Couldn't stat '%s': %s\n", fullpath, strerror(errno));
+            exit(1);
+        }
+        signature = hash_bytes(signature, nodes[i], strlen(nodes[i]) + 1);
+        if ((statbuf.st_mode & S_IFMT) == S_IFREG) {
+            size_t buflen = 0;
+            char *buf = load_binary_file(fullpath, &buflen, 0);
+            const unsigned long long size = (unsigned long long) buflen;
+            signature = hash_bytes(signature, &size, sizeof (size));
+            signature = hash_bytes(signature, buf, buflen);
+            free(buf);
+        }
+        free(fullpath);
+    }
+    return signature;
+}
+
+static const unsigned char *cache_read_str(const unsigned char *ptr, const unsigned char *end, const char **_str)
+{
+    const unsigned char *str = ptr;
+    while ((ptr < end) && *ptr) {
+        ptr++;
+    }
+    if (ptr >= end) {
+        return NULL;
+    }
+    *_str = (const char *) str;
+    return ptr + 1;
+}
+
+static const unsigned char *cache_read_ui32(const unsigned char *ptr, const unsigned char *end, int *_val)
+{
+    if ((end - ptr) < 4) {
+        return NULL;
+    }
+    *_val = (int) ((((unsigned int) ptr[0]) << 24) | (((unsigned int) ptr[1]) << 16) | (((unsigned int) ptr[2]) << 8) | ((unsigned int) ptr[3]));
+    return ptr + 4;
+}
+
+static const unsigned char *cache_read_ui64(const unsigned char *ptr, const unsigned char *end, unsigned long long *_val)
+{
+    int hi = 0, lo = 0;
+    if (((ptr = cache_read_ui32(ptr, end, &hi)) == NULL) || ((ptr = cache_read_ui32(ptr, end, &lo)) == NULL)) {
+        return NULL;
+    }
+    *_val = (((unsigned long long) (unsigned int) hi) << 32) | ((unsigned long long) (unsigned int) lo);
+    return ptr;
+}
+
+static void free_device_cache(void)
+{
+    for (int i = 0; i < num_cached_devices; i++) {
+        free((void *) cached_devices[i].items);
+        free(cached_devices[i].item_stats);
+        free(cached_devices[i].item_meta);
+    }
+    free(cached_devices);
+    free(device_cache_buf);
+    free(cached_verdicts);
+    free(checked_verdicts);
+    cached_devices = NULL;
+    device_cache_buf = NULL;
+    num_cached_devices = 0;
+    cached_verdicts = checked_verdicts = NULL;
+    num_cached_verdicts = num_checked_verdicts = 0;
+}
+
+static void load_device_cache(const char *cachefile)
+{
+    size_t buflen = 0;
+    device_cache_buf = load_binary_file(cachefile, &buflen, 1);
+    if (!device_cache_buf) {
+        return;  // no cache yet, that's okay, we'll build everything.
+    }
+
+    const unsigned char *ptr = (const unsigned char *) device_cache_buf;
+    const unsigned char *end = ptr + buflen;
+    int version = 0;
+    int count = 0;
+
+    if ((buflen < sizeof (cache_magic)) || (memcmp(ptr, cache_magic, sizeof (cache_magic)) != 0)) {
+        goto bogus;
+    }
+    ptr += sizeof (cache_magic);
+
+    if ((ptr = cache_read_ui32(ptr, end, &version)) == NULL) {
+        goto bogus;
+    } else if (version != cache_version) {
+        goto bogus;
+    } else if ((ptr = cache_read_ui32(ptr, end, &count)) == NULL) {
+        goto bogus;
+    }
+
+    cached_devices = (CachedDevice *) xcalloc(count ? count : 1, sizeof (CachedDevice));
+    for (int i = 0; i < count; i++) {
+        CachedDevice *cached = &cached_devices[i];
+        int has_inherits = 0;
+        num_cached_devices++;
+        if ((ptr = cache_read_str(ptr, end, &cached->key)) == NULL) { goto bogus; }
+        if ((ptr = cache_read_ui64(ptr, end, &cached->signature)) == NULL) { goto bogus; }
+        if ((ptr = cache_read_ui32(ptr, end, &has_inherits)) == NULL) { goto bogus; }
+        if (has_inherits && ((ptr = cache_read_str(ptr, end, &cached->inherits)) == NULL)) { goto bogus; }
+        if ((ptr = cache_read_ui32(ptr, end, &cached->inherits_index)) == NULL) { goto bogus; }
+        if ((ptr = cache_read_ui32(ptr, end, &cached->num_items)) == NULL) { goto bogus; }
+        if ((cached->num_items < 0) || (cached->num_items > 0xFFFF)) { goto bogus; }
+        cached->items = (const char **) xcalloc((cached->num_items * 2) + 1, sizeof (char *));
+        cached->item_stats = (int *) xcalloc((cached->num_items * 4) + 1, sizeof (int));
+        cached->item_meta = (ImageMeta *) xcalloc(cached->num_items + 1, sizeof (ImageMeta));
+        for (int j = 0; j < cached->num_items; j++) {
+            if ((ptr = cache_read_str(ptr, end, &cached->items[j * 2])) == NULL) { goto bogus; }
+            if ((ptr = cache_read_str(ptr, end, &cached->items[(j * 2) + 1])) == NULL) { goto bogus; }
+            for (int k = 0; k < 4; k++) {
+                if ((ptr = cache_read_ui32(ptr, end, &cached->item_stats[(j * 4) + k])) == NULL) { goto bogus; }
+            }
+            ImageMeta *meta = &cached->item_meta[j];
+            if ((end - ptr) < IMAGEINFO_RECORD_SIZE) { goto bogus; }
+            unpack_image_info(ptr, &meta->info);
+            ptr += IMAGEINFO_RECORD_SIZE;
+            if ((ptr = cache_read_ui32(ptr, end, &meta->has_geometry)) == NULL) { goto bogus; }
+            if ((ptr = cache_read_ui64(ptr, end, &meta->geometry_hash)) == NULL) { goto bogus; }
+            meta->known = 1;
+        }
+        if ((ptr = cache_read_ui32(ptr, end, &cached->num_guids)) == NULL) { goto bogus; }
+        if ((cached->num_guids < 0) || ((end - ptr) < (cached->num_guids * 16))) { goto bogus; }
+        cached->guids = ptr;
+        ptr += cached->num_guids * 16;
+    }
+
+    if ((ptr = cache_read_ui32(ptr, end, &count)) == NULL) {
+        goto bogus;
+    } else if ((count < 0) || ((end - ptr) < (count * 20))) {
+        goto bogus;
+    }
+
+    cached_verdicts = (RenderVerdict *) xcalloc(count ? count : 1, sizeof (RenderVerdict));
+    for (int i = 0; i < count; i++) {
+        RenderVerdict *verdict = &cached_verdicts[num_cached_verdicts++];
+        if ((ptr = cache_read_ui64(ptr, end, &verdict->svg1)) == NULL) { goto bogus; }
+        if ((ptr = cache_read_ui64(ptr, end, &verdict->svg2)) == NULL) { goto bogus; }
+        if ((ptr = cache_read_ui32(ptr, end, &verdict->identical)) == NULL) { goto bogus; }
+    }
+
+    return;
+
+bogus:
+    fprintf(stderr, "WARNING: Ignoring unusable cache file '%s'\n", cachefile);
+    free_device_cache();
+}
+
+static void cache_write_ui32(FILE *f, unsigned int val)
+{
+    const unsigned char ui8[4] = { (val >> 24) & 0xFF, (val >> 16) & 0xFF, (val >> 8) & 0xFF, (val >> 0) & 0xFF };
+    fwrite(ui8, 1, 4, f);
+}
+
+static void cache_write_ui64(FILE *f, unsigned long long val)
+{
+    cache_write_ui32(f, (unsigned int) (val >> 32));
+    cache_write_ui32(f, (unsigned int) (val & 0xFFFFFFFF));
+}
+
+static void save_device_cache(const char *cachefile, const DeviceJob *jobs, int num_jobs)
+{
+    FILE *f = fopen(cachefile, "wb");
+    if (!f) {
+        fprintf(stderr, "WARNING: Failed to open '%s' for writing: %s\n", cachefile, strerror(errno));
+        return;
+    }
+
+    int total = 0;
+    for (int i = 0; i < num_jobs; i++) {
+        total += jobs[i].is_device ? 1 : 0;
+    }
+
+    fwrite(cache_magic, 1, sizeof (cache_magic), f);
+    cache_write_ui32(f, (unsigned int) cache_version);
+    cache_write_ui32(f, (unsigned int) total);
+    for (int i = 0; i < num_jobs; i++) {
+        const DeviceJob *job = &jobs[i];
+        if (!job->is_device) {
+            continue;
+        }
+        fwrite(job->cachekey, 1, strlen(job->cachekey) + 1, f);
+        cache_write_ui64(f, job->signature);
+        cache_write_ui32(f, job->inherits ? 1 : 0);
+        if (job->inherits) {
+            fwrite(job->inherits, 1, strlen(job->inherits) + 1, f);
+        }
+        cache_write_ui32(f, (unsigned int) job->inherits_index);
+        cache_write_ui32(f, (unsigned int) job->num_items);
+        for (int j = 0; j < job->num_items; j++) {
+            fwrite(job->items[j].type, 1, strlen(job->items[j].type) + 1, f);
+            fwrite(job->items[j].image, 1, strlen(job->items[j].image) + 1, f);
+            cache_write_ui32(f, (unsigned int) job->items[j].original_len);
+            cache_write_ui32(f, (unsigned int) job->items[j].optimized);
+            cache_write_ui32(f, (unsigned int) job->items[j].max_error);
+            cache_write_ui32(f, (unsigned int) (job->items[j].mean_error * 1000000.0));
+            unsigned char record[IMAGEINFO_RECORD_SIZE];
+            pack_image_info(&job->items[j].meta.info, record);
+            fwrite(record, 1, sizeof (record), f);
+            cache_write_ui32(f, (unsigned int) job->items[j].meta.has_geometry);
+            cache_write_ui64(f, job->items[j].meta.geometry_hash);
+        }
+        cache_write_ui32(f, (unsigned int) job->num_guids);
+        for (int j = 0; j < job->num_guids; j++) {
+            fwrite(job->guids[j].data, 1, sizeof (job->guids[j].data), f);
+        }
+    }
+
+    cache_write_ui32(f, (unsigned int) num_checked_verdicts);
+    for (int i = 0; i < num_checked_verdicts; i++) {
+        cache_write_ui64(f, checked_verdicts[i].svg1);
+        cache_write_ui64(f, checked_verdicts[i].svg2);
+        cache_write_ui32(f, (unsigned int) checked_verdicts[i].identical);
+    }
+
+    if (fclose(f) == EOF) {
+        fprintf(stderr, "WARNING: Failed to fclose '%s': %s\n", cachefile, strerror(errno));
+        remove(cachefile);
+    }
+}
+
+static const CachedDevice *find_cached_device(const char *key, unsigned long long signature)
+{
+    for (int i = 0; i < num_cached_devices; i++) {
+        const CachedDevice *cached = &cached_devices[i];
+        if ((cached->signature == signature) && (strcmp(cached->key, key) == 0)) {
+            return cached;
+        }
+    }
+    return NULL;
+}
+
+static void reuse_cached_device(DeviceJob *job, const CachedDevice *cached)
+{
+    job->inherits = cached->inherits ? xstrdup(cached->inherits) : NULL;
+    job->inherits_index = cached->inherits_index;
+    job->num_items = cached->num_items;
+    job->items = (LoadedItem *) xcalloc(cached->num_items ? cached->num_items : 1, sizeof (LoadedItem));
+    for (int i = 0; i < cached->num_items; i++) {
+        job->items[i].type = xstrdup(cached->items[i * 2]);
+        job->items[i].image = xstrdup(cached->items[(i * 2) + 1]);
+        job->items[i].original_len = (size_t) cached->item_stats[(i * 4) + 0];
+        job->items[i].optimized = cached->item_stats[(i * 4) + 1];
+        job->items[i].max_error = cached->item_stats[(i * 4) + 2];
+        job->items[i].mean_error = ((double) cached->item_stats[(i * 4) + 3]) / 1000000.0;
+        job->items[i].meta = cached->item_meta[i];
+    }
+    job->num_guids = cached->num_guids;
+    if (cached->num_guids) {
+        job->guids = (Guid *) xmalloc(cached->num_guids * sizeof (Guid));
+        memcpy(job->guids, cached->guids, cached->num_guids * sizeof (Guid));
+    }
+    job->reused = 1;
+}
+
+static void compute_image_info(const char *svg, ImageInfo *info);
+static int hash_geometry(const char *svg, unsigned long long *_hash);
+
+// This runs on a worker thread! It only touches `job`, and the read-only device cache.
+static void load_gamepad_dir(DeviceJob *job)
+{
+    int num_nodes = 0;
+    char **nodes = list_dir(job->path, &num_nodes);
+    if (!nodes) {
+        if (errno == ENOTDIR) {
+            return;  // not an error, might be readme.txt or something.
+        }
+        fprintf(stderr, "Couldn't opendir '%s': %s\n", job->path, strerror(errno));
+        exit(1);
+    }
+
+    job->is_device = 1;
+
+    if (incremental) {
+        job->signature = signature_for_device_dir(job->path, nodes, num_nodes);
+        const CachedDevice *cached = find_cached_device(job->cachekey, job->signature);
+        if (cached) {
+            reuse_cached_device(job, cached);
+            free_list(nodes, num_nodes);
+            return;
+        }
+    }
+
+    for (int i = 0; i < num_nodes; i++) {
+        char *node = nodes[i];
+        char *ext = strrchr(node, '.');
+        char *fullpath = make_path(job->path, node);
+
+        if (strcmp(node, "inherits") == 0) {
+            free(job->inherits);
+            job->inherits = load_text_file(fullpath);
+            job->inherits_index = job->num_items;
+        } else if (strcmp(node, "guids") == 0) {
+            parse_device_guids_file(job, fullpath);
+        } else if (ext && (strcmp(ext, ".svg") == 0)) {
+            if (job->num_items >= 0xFFFF) {  // currently stored in a Uint16 in the data file.
+                fprintf(stderr, "Too many unique device items! We need to alter the data file format!\n");
+                exit(1);
+            }
+
+            *ext = '\0';
+            job->items = (LoadedItem *) xrealloc(job->items, (job->num_items + 1) * sizeof (LoadedItem));
+            LoadedItem *item = &job->items[job->num_items++];
+            memset(item, '\0', sizeof (*item));
+            item->type = xstrdup(node);
+            item->image = load_text_file(fullpath);
+            if (optimize_level > 0) {
+                optimize_item(item);
+            }
+
+            // parse it here, while we're on a worker thread, instead of when writing the data file.
+            compute_image_info(item->image, &item->meta.info);
+            item->meta.has_geometry = hash_geometry(item->image, &item->meta.geometry_hash);
+            item->meta.known = 1;
+        }
+
+        free(fullpath);
+    }
+
+    free_list(nodes, num_nodes);
+}
+
+typedef struct WorkQueue
+{
+    WorkerMutex mutex;
+    DeviceJob *jobs;
+    int num_jobs;
+    int next_job;
+} WorkQueue;
+
+static void device_worker(void *arg)
+{
+    WorkQueue *queue = (WorkQueue *) arg;
+    while (1) {
+        LockMutex(&queue->mutex);
+        const int idx = queue->next_job++;
+        UnlockMutex(&queue->mutex);
+        if (idx >= queue->num_jobs) {
+            break;
+        }
+        load_gamepad_dir(&queue->jobs[idx]);
+    }
+}
+
+static void run_device_jobs(DeviceJob *jobs, int num_jobs)
+{
+    WorkQueue queue;
+    memset(&queue, '\0', sizeof (queue));
+    InitMutex(&queue.mutex);
+    queue.jobs = jobs;
+    queue.num_jobs = num_jobs;
+
+    int num_threads = (num_worker_threads < num_jobs) ? num_worker_threads : num_jobs;
+    WorkerThread *threads = (WorkerThread *) xcalloc(num_threads ? num_threads : 1, sizeof (WorkerThread));
+    int started = 0;
+    for (int i = 0; i < num_threads; i++) {
+        if (!StartWorker(&threads[started], device_worker, &queue)) {
+            break;  // oh well, whatever threads we got (possibly none) will do.
+        }
+        started++;
+    }
+
+    device_worker(&queue);  // this thread does work, too.
+
+    for (int i = 0; i < started; i++) {
+        WaitWorker(threads[i]);
+    }
+
+    free(threads);
+    DestroyMutex(&queue.mutex);
+}
+
+static size_t total_original_svg_bytes = 0;
+static size_t total_optimized_svg_bytes = 0;
+
+static void report_optimized_item(const DeviceJob *job, const LoadedItem *item)
+{
+    const size_t newlen = strlen(item->image);
+    const double pct = item->original_len ? (100.0 - ((((double) newlen) / ((double) item->original_len)) * 100.0)) : 0.0;
+
+    total_original_svg_bytes += item->original_len;
+    total_optimized_svg_bytes += newlen;
+
+    if (item->optimized > 0) {
+        printf("  %s/%s.svg: %d -> %d bytes (%.1f%% smaller), level %d, max error %d, mean error %.4f\n", job->cachekey, item->type, (int) item->original_len, (int) newlen, pct, item->optimized, item->max_error, item->mean_error);
+    } else if (item->max_error > optimize_max_error) {
+        printf("  %s/%s.svg: kept original, max error %d is over the limit of %d\n", job->cachekey, item->type, item->max_error, optimize_max_error);
+    } else {
+        printf("  %s/%s.svg: kept original, couldn't make it smaller\n", job->cachekey, item->type);
+    }
+}
+
+// Move a loaded device into the global string cache and device list. This runs on the main thread, in directory order.
+static void add_loaded_device(DeviceJob *job)
+{
+    if (num_devices >= 0xFFFF) {  // currently stored in a Uint16 in the data file.
+        fprintf(stderr, "Too many unique devices! We need to alter the data file format!\n");
+        exit(1);
+    }
+
+    void *ptr = xrealloc(devices, (num_devices + 1) * sizeof (DeviceInfo));
+    devices = (DeviceInfo *) ptr;
+    DeviceInfo *device = &devices[num_devices];
+    num_devices++;
+
+    memset(device, '\0', sizeof (*device));
+    device->devid = cache_string(job->devid);
+
+    if (job->num_items) {
+        device->items = (DeviceItem *) xmalloc(job->num_items * sizeof (DeviceItem));
+    }
+
+    for (int i = 0; i <= job->num_items; i++) {
+        if (job->inherits && (i == job->inherits_index)) {
+            device->inherits = cache_string(job->inherits);
+        }
+        if (i < job->num_items) {
+            DeviceItem *item = &device->items[device->num_items++];
+            item->type = cache_string(job->items[i].type);
+            item->image = cache_string(job->items[i].image);
+            string_meta[item->image] = job->items[i].meta;
+            if (optimize_level > 0) {
+                report_optimized_item(job, &job->items[i]);
+            }
+        }
+    }
+
+    if (job->num_guids) {
+        device->num_guids = job->num_guids;
+        device->guids = (Guid *) xmalloc(job->num_guids * sizeof (Guid));
+        memcpy(device->guids, job->guids, job->num_guids * sizeof (Guid));
+        num_guids += job->num_guids;
+    }
+
+    if (job->reused) {
+        num_reused_devices++;
+    }
+}
+
+static void free_device_jobs(DeviceJob *jobs, int num_jobs)
+{
+    for (int i = 0; i < num_jobs; i++) {
+        DeviceJob *job = &jobs[i];
+        for (int j = 0; j < job->num_items; j++) {
+            free(job->items[j].type);
+            free(job->items[j].image);
+        }
+        free(job->items);
+        free(job->guids);
+        free(job->inherits);
+        free(job->path);
+        free(job->cachekey);
+        free(job->devid);
+    }
+    free(jobs);
+}
+
+// The string table is most of the data file (it's all the SVGs), so it can
+//  optionally be compressed as a single LZ4 block (just the block format, no
+//  frame header). The library only needs a tiny decoder for this, and we
+//  have all the time in the world here, so this searches hash chains for the
+//  longest match instead of doing what LZ4's fast mode does.
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5   // the last 5 bytes are always literals.
+#define LZ4_MFLIMIT 12       // the last match must start at least 12 bytes before the end.
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 16
+#define LZ4_MAX_CHAIN 256
+
+static unsigned int lz4_hash(const unsigned char *ptr)
+{
+    const unsigned int val = ((unsigned int) ptr[0]) | (((unsigned int) ptr[1]) << 8) | (((unsigned int) ptr[2]) << 16) | (((unsigned int) ptr[3]) << 24);
+    return (val * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static unsigned char *lz4_write_length(unsigned char *op, size_t len)
+{
+    while (len >= 255) {
+        *(op++) = 255;
+        len -= 255;
+    }
+    *(op++) = (unsigned char) len;
+    return op;
+}
+
+static unsigned char *lz4_write_sequence(unsigned char *op, const unsigned char *literals, size_t num_literals, size_t offset, size_t matchlen)
+{
+    unsigned char *token = op++;
+    *token = (unsigned char) (((num_literals >= 15) ? 15 : num_literals) << 4);
+    if (num_literals >= 15) {
+        op = lz4_write_length(op, num_literals - 15);
+    }
+    memcpy(op, literals, num_literals);
+    op += num_literals;
+
+    if (matchlen > 0) {  // zero means this is the last sequence, which is only literals.
+        const size_t len = matchlen - LZ4_MINMATCH;
+        *token |= (unsigned char) ((len >= 15) ? 15 : len);
+        *(op++) = (unsigned char) (offset & 0xFF);
+        *(op++) = (unsigned char) ((offset >> 8) & 0xFF);
+        if (len >= 15) {
+            op = lz4_write_length(op, len - 15);
+        }
+    }
+    return op;
+}
+
+static void lz4_insert(const unsigned char *src, size_t pos, int *head, int *chain)
+{
+    const unsigned int hash = lz4_hash(src + pos);
+    chain[pos] = head[hash];
+    head[hash] = (int) pos;
+}
+
+static size_t lz4_find_match(const unsigned char *src, size_t pos, size_t matchlimit, const int *head, const int *chain, size_t *_offset)
+{
+    size_t bestlen = 0;
+    int tries = LZ4_MAX_CHAIN;
+    for (int candidate = head[lz4_hash(src + pos)]; (candidate >= 0) && (tries > 0); candidate = chain[candidate], tries--) {
+        const size_t offset = pos - (size_t) candidate;
+        if (offset > LZ4_MAX_OFFSET) {
+            break;  // chains only get further away from here.
+        }
+        size_t len = 0;
+        while (((pos + len) < matchlimit) && (src[candidate + len] == src[pos + len])) {
+            len++;
+        }
+        if (len > bestlen) {
+            bestlen = len;
+            *_offset = offset;
+        }
+    }
+    return (bestlen >= LZ4_MINMATCH) ? bestlen : 0;
+}
+
+static unsigned char *lz4_compress_block(const unsigned char *src, size_t srclen, size_t *_dstlen)
+{
+    unsigned char *dst = (unsigned char *) xmalloc(srclen + (srclen / 255) + 16);
+    int *head = (int *) xmalloc(sizeof (int) * (1 << LZ4_HASH_BITS));
+    int *chain = (int *) xmalloc(sizeof (int) * (srclen ? srclen : 1));
+    unsigned char *op = dst;
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    for (int i = 0; i < (1 << LZ4_HASH_BITS); i++) {
+        head[i] = -1;
+    }
+
+    if (srclen > LZ4_MFLIMIT) {
+        const size_t matchlimit = srclen - LZ4_LASTLITERALS;
+        const size_t lastmatchstart = srclen - LZ4_MFLIMIT;
+        while (pos < lastmatchstart) {
+            size_t offset = 0;
+            size_t len = lz4_find_match(src, pos, matchlimit, head, chain, &offset);
+            if (len == 0) {
+                lz4_insert(src, pos++, head, chain);
+                continue;
+            }
+
+            // one step of lazy matching: if the next byte starts a longer match, emit this one as a literal instead.
+            lz4_insert(src, pos, head, chain);
+            if ((pos + 1) < lastmatchstart) {
+                size_t nextoffset = 0;
+                const size_t nextlen = lz4_find_match(src, pos + 1, matchlimit, head, chain, &nextoffset);
+                if (nextlen > (len + 1)) {
+                    pos++;
+                    len = nextlen;
+                    offset = nextoffset;
+                    lz4_insert(src, pos, head, chain);
+                }
+            }
+
+            op = lz4_write_sequence(op, src + anchor, pos - anchor, offset, len);
+            for (size_t i = pos + 1; i < (pos + len); i++) {
+                if (i < lastmatchstart) {
+                    lz4_insert(src, i, head, chain);
+                }
+            }
+            pos += len;
+            anchor = pos;
+        }
+    }
+
+    op = lz4_write_sequence(op, src + anchor, srclen - anchor, 0, 0);
+
+    free(chain);
+    free(head);
+
+    *_dstlen = (size_t) (op - dst);
+    return dst;
+}
+
+static void writeui16(FILE *f, int val)
+{
+    if ((val < 0) || (val > 0xFFFF)) {
+        fprintf(stderr, "BUG: Expected Uint16 value, got %d instead!\n", val);
+        fclose(f);
+        exit(1);
+    }
+
+    const unsigned char ui8[2] = { (((unsigned int) val) >> 8) & 0xFF, (((unsigned int) val) >> 0) & 0xFF };
+    fwrite(ui8, 1, 2, f);
+}
+
+static void writeui32(FILE *f, size_t val)
+{
+    if (val > 0xFFFFFFFF) {
+        fprintf(stderr, "BUG: Expected Uint32 value, got %llu instead!\n", (unsigned long long) val);
+        fclose(f);
+        exit(1);
+    }
+
+    const unsigned char ui8[4] = { (val >> 24) & 0xFF, (val >> 16) & 0xFF, (val >> 8) & 0xFF, (val >> 0) & 0xFF };
+    fwrite(ui8, 1, 4, f);
+}
+
+// the returned jobs have been loaded, but not added to the database yet.
+static DeviceJob *process_devicetype_dir(const char *devicetype, const char *path, int *_num_jobs)
+{
+    char *fulltypepath = make_path(path, devicetype);
+    int num_nodes = 0;
+    char **nodes = list_dir(fulltypepath, &num_nodes);
+
+    *_num_jobs = 0;
+
+    if (!nodes) {
+        if (errno == ENOENT) {
+            free(fulltypepath);
+            return NULL;  // not an error, doesn't exist.
+        }
+        fprintf(stderr, "Couldn't opendir '%s': %s\n", fulltypepath, strerror(errno));
+        exit(1);
+    }
+
+    DeviceJob *jobs = (DeviceJob *) xcalloc(num_nodes ? num_nodes : 1, sizeof (DeviceJob));
+    for (int i = 0; i < num_nodes; i++) {
+        DeviceJob *job = &jobs[i];
+        job->devid = nodes[i];  // job owns this string now.
+        job->path = make_path(fulltypepath, nodes[i]);
+        job->cachekey = make_path(devicetype, nodes[i]);
+    }
+    free(nodes);  // just the array, the strings belong to the jobs now.
+
+    run_device_jobs(jobs, num_nodes);
+
+    for (int i = 0; i < num_nodes; i++) {
+        if (jobs[i].is_device) {
+            add_loaded_device(&jobs[i]);
+        }
+    }
+
+    free(fulltypepath);
+
+    *_num_jobs = num_nodes;
+    return jobs;
+}
+
+#define SECTION_IMAGE_INFO 1
+
+// A whole data file's worth of strings and devices, either built from an art
+//  directory or loaded from a .bin file. Device fields index into `strings`.
+typedef struct Database
+{
+    int num_strings;
+    char **strings;
+    int num_devices;
+    DeviceInfo *devices;
+    ImageMeta *image_meta;  // indexed like `strings`, or NULL if loaded from a data file.
+    ImageInfo *image_infos;  // indexed like `strings`, filled in by compute_image_infos() right before writing.
+} Database;
+
+// moves the strings and devices we've been building up into `db`, and resets everything for the next one.
+static void take_database(Database *db)
+{
+    db->num_strings = num_strings;
+    db->strings = strings;
+    db->num_devices = num_devices;
+    db->devices = devices;
+    db->image_meta = string_meta;
+    db->image_infos = NULL;
+
+    strings = NULL;
+    string_meta = NULL;
+    num_strings = 0;
+    free(string_hashtable);
+    string_hashtable = NULL;
+    string_hashtable_size = 0;
+    devices = NULL;
+    num_devices = 0;
+    num_guids = 0;
+}
+
+static void free_database(Database *db)
+{
+    for (int i = 0; i < db->num_strings; i++) {
+        free(db->strings[i]);
+    }
+    free(db->strings);
+
+    for (int i = 0; i < db->num_devices; i++) {
+        free(db->devices[i].items);
+        free(db->devices[i].guids);
+    }
+    free(db->devices);
+    free(db->image_meta);
+    free(db->image_infos);
+
+    memset(db, '\0', sizeof (*db));
+}
+
+static int count_database_guids(const Database *db)
+{
+    int retval = 0;
+    for (int i = 0; i < db->num_devices; i++) {
+        retval += db->devices[i].num_guids;
+    }
+    return retval;
+}
+
+// returns how many items use an image, and how many distinct images they use.
+//  Identical SVGs share a string, so this is what deduplication saved us.
+static int count_database_images(const Database *db, int *_unique)
+{
+    char *seen = (char *) xcalloc(db->num_strings ? db->num_strings : 1, 1);
+    int retval = 0;
+    int unique = 0;
+    for (int i = 0; i < db->num_devices; i++) {
+        const DeviceInfo *device = &db->devices[i];
+        for (int j = 0; j < device->num_items; j++) {
+            const int image = device->items[j].image;
+            if (!seen[image]) {
+                seen[image] = 1;
+                unique++;
+            }
+            retval++;
+        }
+    }
+    free(seen);
+    *_unique = unique;
+    return retval;
+}
+
+// Coordinates that differ by less than this (in SVG units) count as the same
+//  point when comparing geometry; the same drawing written with relative vs
+//  absolute commands, or quadratic vs cubic curves, doesn't parse to exactly
+//  the same floats. Anything this finds still has to pass a rendering check.
+#define CANONICAL_QUANTUM (1.0f / 256.0f)
+
+// The most any pixel's channel may change when we collapse two images, at
+//  any of these sizes. Small sizes catch differences that antialiasing hides
+//  at big ones.
+#define CANONICAL_MAX_ERROR 1
+static const int canonical_check_sizes[] = { 16, 24, 32, 48, 64, 128, 256 };
+
+typedef struct CanonicalSegment
+{
+    int is_line;
+    float pts[6];  // control points and end point for curves, just the end point for lines.
+} CanonicalSegment;
+
+static int is_straight_segment(const float *p0, const float *seg)
+{
+    const float dx = seg[4] - p0[0];
+    const float dy = seg[5] - p0[1];
+    const float len = sqrtf((dx * dx) + (dy * dy));
+    for (int i = 0; i < 4; i += 2) {
+        const float cx = seg[i] - p0[0];
+        const float cy = seg[i+1] - p0[1];
+        if (len < CANONICAL_QUANTUM) {  // zero-length segment, straight if the control points don't go anywhere either.
+            if ((fabsf(cx) >= CANONICAL_QUANTUM) || (fabsf(cy) >= CANONICAL_QUANTUM)) {
+                return 0;
+            }
+            continue;
+        }
+        const float t = ((cx * dx) + (cy * dy)) / (len * len);
+        if ((t < 0.0f) || (t > 1.0f) || ((fabsf((cx * dy) - (cy * dx)) / len) >= CANONICAL_QUANTUM)) {
+            return 0;  // control point is off the line, or past its ends.
+        }
+    }
+    return 1;
+}
+
+static int same_point(const float *a, const float *b)
+{
+    return (fabsf(a[0] - b[0]) < CANONICAL_QUANTUM) && (fabsf(a[1] - b[1]) < CANONICAL_QUANTUM);
+}
+
+static void serialize_coord(StrBuf *buf, float val)
+{
+    const long quantized = lrintf(val / CANONICAL_QUANTUM);
+    strbuf_append(buf, (const char *) &quantized, sizeof (quantized));
+}
+
+// Straight cubics become lines, zero-length lines go away, and runs of lines
+//  in the same direction become one line. A fill always closes its paths, so
+//  if there's no stroke, a last line back to the start doesn't change anything.
+static void serialize_path(StrBuf *buf, const NSVGpath *path, int stroked)
+{
+    const int num_segments = (path->npts - 1) / 3;
+    CanonicalSegment *segments = (CanonicalSegment *) xcalloc(num_segments ? num_segments : 1, sizeof (CanonicalSegment));
+    int num_emitted = 0;
+
+    const float *start = path->pts;
+    const float *cur = start;
+    const float *line_start = NULL;  // where the last emitted line began.
+    for (int i = 0; i < num_segments; i++) {
+        const float *seg = &path->pts[2 + (i * 6)];
+        const float *end = &seg[4];
+        if (!is_straight_segment(cur, seg)) {
+            CanonicalSegment *out = &segments[num_emitted++];
+            out->is_line = 0;
+            memcpy(out->pts, seg, sizeof (out->pts));
+            line_start = NULL;
+        } else if (same_point(cur, end)) {
+            // zero-length, drop it.
+        } else if (line_start && is_straight_segment(line_start, (const float []) { cur[0], cur[1], cur[0], cur[1], end[0], end[1] })) {
+            segments[num_emitted - 1].pts[0] = end[0];  // keeps going the same way, so extend the last line.
+            segments[num_emitted - 1].pts[1] = end[1];
+        } else {
+            CanonicalSegment *out = &segments[num_emitted++];
+            out->is_line = 1;
+            out->pts[0] = end[0];
+            out->pts[1] = end[1];
+            line_start = cur;
+        }
+        cur = end;
+    }
+
+    if (!stroked && (num_emitted > 0) && segments[num_emitted - 1].is_line && same_point(segments[num_emitted - 1].pts, start)) {
+        num_emitted--;
+    }
+
+    strbuf_append(buf, "P", 1);
+    if (stroked) {
+        strbuf_append(buf, &path->closed, sizeof (path->closed));
+    }
+    serialize_coord(buf, start[0]);
+    serialize_coord(buf, start[1]);
+    for (int i = 0; i < num_emitted; i++) {
+        const CanonicalSegment *seg = &segments[i];
+        const int count = seg->is_line ? 2 : 6;
+        strbuf_append(buf, seg->is_line ? "L" : "C", 1);
+        for (int j = 0; j < count; j++) {
+            serialize_coord(buf, seg->pts[j]);
+        }
+    }
+
+    free(segments);
+}
+
+static int renders_identically(const char *svg1, const char *svg2)
+{
+    for (int i = 0; i < (int) (sizeof (canonical_check_sizes) / sizeof (canonical_check_sizes[0])); i++) {
+        double mean_error = 0.0;
+        if (compare_rendering(svg1, svg2, canonical_check_sizes[i], &mean_error) > CANONICAL_MAX_ERROR) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// renders_identically(), but it asks the incremental cache first, and
+//  remembers the answer for the next one.
+static int renders_identically_cached(const char *svg1, const char *svg2)
+{
+    unsigned long long hash1 = hash_bytes(hash_seed, svg1, strlen(svg1));
+    unsigned long long hash2 = hash_bytes(hash_seed, svg2, strlen(svg2));
+    if (hash1 > hash2) {
+        const unsigned long long tmp = hash1;
+        hash1 = hash2;
+        hash2 = tmp;
+    }
+
+    for (int i = 0; i < num_checked_verdicts; i++) {
+        if ((checked_verdicts[i].svg1 == hash1) && (checked_verdicts[i].svg2 == hash2)) {
+            return checked_verdicts[i].identical;
+        }
+    }
+
+    int identical = -1;
+    for (int i = 0; i < num_cached_verdicts; i++) {
+        if ((cached_verdicts[i].svg1 == hash1) && (cached_verdicts[i].svg2 == hash2)) {
+            identical = cached_verdicts[i].identical;
+            break;
+        }
+    }
+
+    if (identical == -1) {
+        identical = renders_identically(svg1, svg2);
+    }
+
+    checked_verdicts = (RenderVerdict *) xrealloc(checked_verdicts, (num_checked_verdicts + 1) * sizeof (RenderVerdict));
+    checked_verdicts[num_checked_verdicts].svg1 = hash1;
+    checked_verdicts[num_checked_verdicts].svg2 = hash2;
+    checked_verdicts[num_checked_verdicts].identical = identical;
+    num_checked_verdicts++;
+    return identical;
+}
+
+static int compare_strbufs(const void *_a, const void *_b)
+{
+    const StrBuf *a = (const StrBuf *) _a;
+    const StrBuf *b = (const StrBuf *) _b;
+    if (a->len != b->len) {
+        return (a->len < b->len) ? -1 : 1;
+    }
+    return memcmp(a->data, b->data, a->len);
+}
+
+static void serialize_paint(StrBuf *buf, const NSVGpaint *paint)
+{
+    strbuf_append(buf, (const char *) &paint->type, sizeof (paint->type));
+    if (paint->type == NSVG_PAINT_COLOR) {
+        strbuf_append(buf, (const char *) &paint->color, sizeof (paint->color));
+    } else if ((paint->type == NSVG_PAINT_LINEAR_GRADIENT) || (paint->type == NSVG_PAINT_RADIAL_GRADIENT)) {
+        const NSVGgradient *grad = paint->gradient;
+        strbuf_append(buf, (const char *) grad->xform, sizeof (grad->xform));
+        strbuf_append(buf, &grad->spread, sizeof (grad->spread));
+        strbuf_append(buf, (const char *) &grad->fx, sizeof (grad->fx));
+        strbuf_append(buf, (const char *) &grad->fy, sizeof (grad->fy));
+        strbuf_append(buf, (const char *) &grad->nstops, sizeof (grad->nstops));
+        strbuf_append(buf, (const char *) grad->stops, grad->nstops * sizeof (NSVGgradientStop));
+    }
+}
+
+// Writes out everything about a parsed image that changes how it renders,
+//  and nothing else (ids, whitespace, attribute order, how numbers and path
+//  commands were written, invisible shapes...), so SVGs that nanosvg will
+//  draw the same way come out byte-for-byte identical. Returns 0 if it
+//  doesn't parse.
+static int serialize_geometry(const char *svg, StrBuf *buf)
+{
+    NSVGimage *image = nsvgParseConst(svg, strlen(svg), "px", 96.0f);
+    if (!image) {
+        return 0;
+    }
+
+    strbuf_append(buf, (const char *) &image->width, sizeof (image->width));
+    strbuf_append(buf, (const char *) &image->height, sizeof (image->height));
+
+    for (const NSVGshape *shape = image->shapes; shape != NULL; shape = shape->next) {
+        if (!(shape->flags & NSVG_FLAGS_VISIBLE)) {
+            continue;  // the rasterizer skips these.
+        }
+
+        strbuf_append(buf, "S", 1);
+        strbuf_append(buf, (const char *) &shape->opacity, sizeof (shape->opacity));
+        strbuf_append(buf, &shape->fillRule, sizeof (shape->fillRule));
+        serialize_paint(buf, &shape->fill);
+        serialize_paint(buf, &shape->stroke);
+        if (shape->stroke.type != NSVG_PAINT_NONE) {
+            strbuf_append(buf, (const char *) &shape->strokeWidth, sizeof (shape->strokeWidth));
+            strbuf_append(buf, (const char *) &shape->strokeDashOffset, sizeof (shape->strokeDashOffset));
+            strbuf_append(buf, &shape->strokeDashCount, sizeof (shape->strokeDashCount));
+            strbuf_append(buf, (const char *) shape->strokeDashArray, shape->strokeDashCount * sizeof (float));
+            strbuf_append(buf, &shape->strokeLineJoin, sizeof (shape->strokeLineJoin));
+            strbuf_append(buf, &shape->strokeLineCap, sizeof (shape->strokeLineCap));
+            strbuf_append(buf, (const char *) &shape->miterLimit, sizeof (shape->miterLimit));
+        }
+
+        // the rasterizer collects the edges of all of a shape's paths before
+        //  it draws anything, so their order doesn't matter; sort them.
+        int num_paths = 0;
+        for (const NSVGpath *path = shape->paths; path != NULL; path = path->next) {
+            num_paths++;
+        }
+
+        StrBuf *paths = (StrBuf *) xcalloc(num_paths ? num_paths : 1, sizeof (StrBuf));
+        int i = 0;
+        for (const NSVGpath *path = shape->paths; path != NULL; path = path->next) {
+            serialize_path(&paths[i++], path, shape->stroke.type != NSVG_PAINT_NONE);
+        }
+
+        qsort(paths, num_paths, sizeof (StrBuf), compare_strbufs);
+        for (i = 0; i < num_paths; i++) {
+            strbuf_append(buf, paths[i].data, paths[i].len);
+            free(paths[i].data);
+        }
+        free(paths);
+    }
+
+    nsvgDelete(image);
+    return 1;
+}
+
+// This runs on a worker thread, while loading art, so incremental builds can
+//  cache it. Returns 0 if it doesn't parse.
+static int hash_geometry(const char *svg, unsigned long long *_hash)
+{
+    StrBuf buf;
+    memset(&buf, '\0', sizeof (buf));
+    const int retval = serialize_geometry(svg, &buf);
+    *_hash = retval ? hash_bytes(hash_seed, buf.data, buf.len) : 0;
+    free(buf.data);
+    return retval;
+}
+
+// Images that render identically collapse to one string (the shortest SVG of
+//  the bunch), so the data file only carries it once and the library only
+//  parses it once. Matching geometry hashes only nominate a pair; they also
+//  have to render the same before we believe it. Then the strings nothing
+//  uses anymore get dropped.
+static void canonicalize_images(Database *db)
+{
+    const int total = db->num_strings ? db->num_strings : 1;
+    int *remap = (int *) xmalloc(total * sizeof (int));
+    char *is_image = (char *) xcalloc(total, 1);
+    unsigned long long *hashes = (unsigned long long *) xcalloc(total, sizeof (unsigned long long));
+    int *images = (int *) xmalloc(total * sizeof (int));
+    int num_images = 0;
+
+    for (int i = 0; i < db->num_strings; i++) {
+        remap[i] = i;
+    }
+
+    for (int i = 0; i < db->num_devices; i++) {
+        const DeviceInfo *device = &db->devices[i];
+        for (int j = 0; j < device->num_items; j++) {
+            const int image = device->items[j].image;
+            if (!is_image[image]) {
+                const ImageMeta *meta = &db->image_meta[image];
+                is_image[image] = 1;
+                if (meta->known ? meta->has_geometry : hash_geometry(db->strings[image], &hashes[image])) {
+                    if (meta->known) {
+                        hashes[image] = meta->geometry_hash;
+                    }
+                    images[num_images++] = image;
+                }
+            }
+        }
+    }
+
+    // there are only a few hundred images per theme, so just compare each against the ones before it.
+    for (int i = 0; i < num_images; i++) {
+        const int image = images[i];
+        for (int j = 0; j < i; j++) {
+            const int other = images[j];
+            if ((remap[other] == other) && (hashes[other] == hashes[image]) && renders_identically_cached(db->strings[other], db->strings[image])) {
+                if (strlen(db->strings[image]) < strlen(db->strings[other])) {
+                    for (int k = 0; k < i; k++) {  // this one's smaller, so it takes over the group.
+                        if (remap[images[k]] == other) {
+                            remap[images[k]] = image;
+                        }
+                    }
+                } else {
+                    remap[image] = other;
+                }
+                num_canonicalized_images++;
+                break;
+            }
+        }
+    }
+
+    free(hashes);
+    free(images);
+    free(is_image);
+
+    // drop strings nothing refers to anymore, keeping the rest in order (and index 0 where it is).
+    int *used = (int *) xcalloc(total, sizeof (int));
+    used[0] = 1;
+    for (int i = 0; i < db->num_devices; i++) {
+        DeviceInfo *device = &db->devices[i];
+        used[device->devid] = used[device->inherits] = 1;
+        for (int j = 0; j < device->num_items; j++) {
+            device->items[j].image = remap[device->items[j].image];
+            used[device->items[j].type] = used[device->items[j].image] = 1;
+        }
+    }
+
+    int num_kept = 0;
+    for (int i = 0; i < db->num_strings; i++) {
+        if (used[i]) {
+            remap[i] = num_kept;
+            db->image_meta[num_kept] = db->image_meta[i];
+            db->strings[num_kept++] = db->strings[i];
+        } else {
+            free(db->strings[i]);
+        }
+    }
+    db->num_strings = num_kept;
+
+    for (int i = 0; i < db->num_devices; i++) {
+        DeviceInfo *device = &db->devices[i];
+        device->devid = remap[device->devid];
+        device->inherits = remap[device->inherits];
+        for (int j = 0; j < device->num_items; j++) {
+            device->items[j].type = remap[device->items[j].type];
+            device->items[j].image = remap[device->items[j].image];
+        }
+    }
+
+    free(used);
+    free(remap);
+}
+
+// `cachefile` can be NULL to skip the incremental cache.
+static void build_theme_database(const char *path, const char *cachefile, Database *db)
+{
+    // add something, just to make sure the string index 0 isn't something that could be nullable.
+    // this could be more clever, but for an extra byte in the data file, it's good enough.
+    cache_string("");
+
+    if (cachefile) {
+        load_device_cache(cachefile);
+    }
+
+    int num_jobs = 0;
+    DeviceJob *jobs = process_devicetype_dir("gamepad", path, &num_jobs);
+
+    take_database(db);
+    canonicalize_images(db);
+
+    // this goes after canonicalize_images(), so the cache gets the render checks it did, too.
+    if (cachefile) {
+        save_device_cache(cachefile, jobs, num_jobs);
+    }
+    free_device_cache();
+
+    free_device_jobs(jobs, num_jobs);
+}
+
+static void compute_image_info(const char *svg, ImageInfo *info)
+{
+    memset(info, '\0', sizeof (*info));
+
+    NSVGimage *image = nsvgParseConst(svg, strlen(svg), "px", 96.0f);
+    if (!image) {
+        return;  // the library won't be able to parse it either, so it costs nothing.
+    }
+
+    const float scale = (image->width > 0.0f) ? (IMAGEINFO_COST_SIZE / image->width) : 0.0f;
+    double cost = 0.0;
+
+    for (NSVGshape *shape = image->shapes; shape != NULL; shape = shape->next) {
+        const int fill = (shape->fill.type != NSVG_PAINT_NONE);
+        const int stroke = (shape->stroke.type != NSVG_PAINT_NONE) && (shape->strokeWidth > 0.0f);
+        if (!(shape->flags & NSVG_FLAGS_VISIBLE) || (!fill && !stroke)) {
+            continue;  // nothing gets drawn for this one.
+        }
+
+        int segments = 0;
+        for (NSVGpath *path = shape->paths; path != NULL; path = path->next) {
+            info->num_paths++;
+            info->num_points += path->npts;
+            segments += (path->npts - 1) / 3;
+        }
+
+        // nanosvg's bounds only cover the geometry, so a stroke reaches half its width past them. Miter joins
+        //  and square caps can poke out a little further than that, but this is close enough for layout.
+        const float halfstroke = stroke ? (shape->strokeWidth * 0.5f) : 0.0f;
+        const float drawn[4] = {
+            shape->bounds[0] - halfstroke, shape->bounds[1] - halfstroke,
+            shape->bounds[2] + halfstroke, shape->bounds[3] + halfstroke
+        };
+
+        if (info->num_shapes++ == 0) {
+            memcpy(info->bounds, drawn, sizeof (info->bounds));
+        } else {
+            info->bounds[0] = fminf(info->bounds[0], drawn[0]);
+            info->bounds[1] = fminf(info->bounds[1], drawn[1]);
+            info->bounds[2] = fmaxf(info->bounds[2], drawn[2]);
+            info->bounds[3] = fmaxf(info->bounds[3], drawn[3]);
+        }
+
+        // nanosvg's time goes to flattening and sorting edges (strokes make about twice as many) and to filling
+        //  pixels (gradients cost more per pixel). These weights came from timing the standard art at 64 pixels,
+        //  but it's only meant to rank images against each other, not to predict actual time.
+        const double w = (shape->bounds[2] - shape->bounds[0]) * scale;
+        const double h = (shape->bounds[3] - shape->bounds[1]) * scale;
+        if (fill) {
+            const int gradient = (shape->fill.type != NSVG_PAINT_COLOR);
+            info->flags |= gradient ? IMAGEINFO_FLAG_GRADIENTS : 0;
+            cost += segments + ((w * h * (gradient ? 2.0 : 1.0)) / 400.0);
+        }
+        if (stroke) {
+            const int gradient = (shape->stroke.type != NSVG_PAINT_COLOR);
+            const double sw = shape->strokeWidth * scale;
+            info->flags |= IMAGEINFO_FLAG_STROKES | (gradient ? IMAGEINFO_FLAG_GRADIENTS : 0);
+            cost += (segments * 2) + (((w + sw) * (h + sw) * (gradient ? 2.0 : 1.0)) / 400.0);
+        }
+    }
+
+    info->raster_cost = (cost > 4000000000.0) ? 4000000000u : (unsigned int) ceil(cost);
+    nsvgDelete(image);
+}
+
+// only the strings that devices use as images get filled in. Anything the
+//  worker threads (or the incremental cache) already worked out isn't parsed again.
+static void compute_image_infos(Database *db)
+{
+    free(db->image_infos);
+    db->image_infos = (ImageInfo *) xcalloc(db->num_strings ? db->num_strings : 1, sizeof (ImageInfo));
+    char *done = (char *) xcalloc(db->num_strings ? db->num_strings : 1, 1);
+    for (int i = 0; i < db->num_devices; i++) {
+        const DeviceInfo *device = &db->devices[i];
+        for (int j = 0; j < device->num_items; j++) {
+            const int image = device->items[j].image;
+            if (done[image]) {
+                continue;
+            } else if (db->image_meta && db->image_meta[image].known) {
+                db->image_infos[image] = db->image_meta[image].info;
+            } else {
+                compute_image_info(db->strings[image], &db->image_infos[image]);
+            }
+            done[image] = 1;
+        }
+    }
+    free(done);
+}
+
+// returns the size of the file written. If compressing, the string table's uncompressed and compressed sizes go in the last two arguments.
+static size_t write_data_file(const char *binfile, const Database *db, size_t *_string_table_len, size_t *_compressed_len)
+{
+    FILE *f = fopen(binfile, "wb");
+    if (!f) {
+        fprintf(stderr, "Failed to open '%s': %s\n", binfile, strerror(errno));
+        exit(1);
+    }
+
+    static const char magic[8] = { 'C', 'T', 'I', 'M', 'G', '\r', '\n', '\0' };
+
+    size_t string_table_len = 0;
+    for (int i = 0; i < db->num_strings; i++) {
+        string_table_len += strlen(db->strings[i]) + 1;
+    }
+
+    size_t compressed_len = 0;
+    unsigned char *compressed = NULL;
+    if (compress_strings) {
+        unsigned char *string_table = (unsigned char *) xmalloc(string_table_len ? string_table_len : 1);
+        unsigned char *dst = string_table;
+        for (int i = 0; i < db->num_strings; i++) {
+            const size_t len = strlen(db->strings[i]) + 1;
+            memcpy(dst, db->strings[i], len);
+            dst += len;
+        }
+        compressed = lz4_compress_block(string_table, string_table_len, &compressed_len);
+        free(string_table);
+    }
+
+    fwrite(magic, 1, sizeof (magic), f);
+    writeui16(f, compress_strings ? 3 : 2);  // version number (only bump it if we need version 3 features, so older libraries can still use it.)
+    writeui16(f, db->num_strings);
+    if (compress_strings) {
+        writeui16(f, 1);  // compression type (0: none, 1: LZ4 block)
+        writeui32(f, string_table_len);
+        writeui32(f, compressed_len);
+        fwrite(compressed, 1, compressed_len, f);
+        free(compressed);
+    } else {
+        for (int i = 0; i < db->num_strings; i++) {
+            fwrite(db->strings[i], 1, strlen(db->strings[i]) + 1, f);
+        }
+    }
+    writeui16(f, db->num_devices);
+    for (int i = 0; i < db->num_devices; i++) {
+        const DeviceInfo *device = &db->devices[i];
+        writeui16(f, device->devid);
+        writeui16(f, device->inherits);
+        writeui16(f, device->num_items);
+        writeui16(f, device->num_guids);
+        for (int j = 0; j < device->num_items; j++) {
+            const DeviceItem *item = &device->items[j];
+            writeui16(f, item->type);
+            writeui16(f, item->image);
+        }
+        for (int j = 0; j < device->num_guids; j++) {
+            const Guid *guid = &device->guids[j];
+            fwrite(guid->data, 1, sizeof (guid->data), f);
+        }
+    }
+
+    // Optional sections follow the devices: ui16 type, ui32 length, then that
+    //  many bytes. Older libraries stop reading after the devices, so adding
+    //  these doesn't need a version bump, and libraries skip types they don't
+    //  know. Image info is one record per item, in the order the devices
+    //  above list them.
+    if (db->image_infos) {
+        size_t total_items = 0;
+        for (int i = 0; i < db->num_devices; i++) {
+            total_items += db->devices[i].num_items;
+        }
+        writeui16(f, SECTION_IMAGE_INFO);
+        writeui32(f, total_items * IMAGEINFO_RECORD_SIZE);
+        for (int i = 0; i < db->num_devices; i++) {
+            const DeviceInfo *device = &db->devices[i];
+            for (int j = 0; j < device->num_items; j++) {
+                unsigned char record[IMAGEINFO_RECORD_SIZE];
+                pack_image_info(&db->image_infos[device->items[j].image], record);
+                fwrite(record, 1, sizeof (record), f);
+            }
+        }
+    }
+
+    const long filelen = ftell(f);
+
+    if (fclose(f) == EOF) {
+        fprintf(stderr, "Failed to fclose '%s': %s\n", binfile, strerror(errno));
+        remove(binfile);
+        exit(1);
+    }
+
+    if (_string_table_len) {
+        *_string_table_len = string_table_len;
+    }
+    if (_compressed_len) {
+        *_compressed_len = compressed_len;
+    }
+
+    return (filelen > 0) ? (size_t) filelen : 0;
+}
+
+static void static_append_ui16(StrBuf *buf, int val)
+{
+    const char ui8[2] = { (char) ((((unsigned int) val) >> 8) & 0xFF), (char) ((((unsigned int) val) >> 0) & 0xFF) };
+    strbuf_append(buf, ui8, 2);
+}
+
+static void static_append_ui32(StrBuf *buf, size_t val)
+{
+    const char ui8[4] = { (char) ((val >> 24) & 0xFF), (char) ((val >> 16) & 0xFF), (char) ((val >> 8) & 0xFF), (char) ((val >> 0) & 0xFF) };
+    strbuf_append(buf, ui8, 4);
+}
+
+// The static layout, for ControllerImage_AddStaticData(): the library uses
+//  it right where it sits in the app's binary, so devices refer to strings by
+//  their byte offset instead of an index that would have to be resolved by
+//  scanning the strings. Everything is big endian, like the .bin files.
+//
+//  magic[8], ui16 version, ui16 num_devices, ui32 offset of the strings
+//  then per device: ui32 devid, ui32 inherits (0 for none), ui16 num_items,
+//   ui16 num_guids, num_items * (ui32 type, ui32 image, image info record),
+//   num_guids * 16 bytes
+//  then every string, null-terminated, once each.
+//
+//  Version 1 didn't have the image info records.
+static void build_static_data(const Database *db, StrBuf *buf)
+{
+    static const char static_magic[8] = { 'C', 'T', 'I', 'M', 'G', 'S', 'T', '\0' };
+
+    size_t strings_offset = 16;
+    for (int i = 0; i < db->num_devices; i++) {
+        strings_offset += 12 + (db->devices[i].num_items * (8 + IMAGEINFO_RECORD_SIZE)) + (db->devices[i].num_guids * 16);
+    }
+
+    size_t *offsets = (size_t *) xcalloc(db->num_strings + 1, sizeof (size_t));
+    size_t offset = strings_offset;
+    for (int i = 0; i < db->num_strings; i++) {
+        offsets[i] = offset;
+        offset += strlen(db->strings[i]) + 1;
+    }
+
+    if ((offset > 0xFFFFFFFF) || (db->num_devices > 0xFFFF)) {
+        fprintf(stderr, "Database is too big for the static data format!\n");
+        exit(1);
+    }
+
+    strbuf_append(buf, static_magic, sizeof (static_magic));
+    static_append_ui16(buf, 2);  // version number.
+    static_append_ui16(buf, db->num_devices);
+    static_append_ui32(buf, strings_offset);
+    for (int i = 0; i < db->num_devices; i++) {
+        const DeviceInfo *device = &db->devices[i];
+        static_append_ui32(buf, offsets[device->devid]);
+        static_append_ui32(buf, device->inherits ? offsets[device->inherits] : 0);
+        static_append_ui16(buf, device->num_items);
+        static_append_ui16(buf, device->num_guids);
+        for (int j = 0; j < device->num_items; j++) {
+            static_append_ui32(buf, offsets[device->items[j].type]);
+            static_append_ui32(buf, offsets[device->items[j].image]);
+            unsigned char record[IMAGEINFO_RECORD_SIZE];
+            pack_image_info(&db->image_infos[device->items[j].image], record);
+            strbuf_append(buf, (const char *) record, sizeof (record));
+        }
+        for (int j = 0; j < device->num_guids; j++) {
+            strbuf_append(buf, (const char *) device->guids[j].data, sizeof (device->guids[j].data));
+        }
+    }
+
+    if (buf->len != strings_offset) {
+        fprintf(stderr, "BUG: static data index is %d bytes, expected %d!\n", (int) buf->len, (int) strings_offset);
+        exit(1);
+    }
+
+    for (int i = 0; i < db->num_strings; i++) {
+        strbuf_append(buf, db->strings[i], strlen(db->strings[i]) + 1);
+    }
+
+    free(offsets);
+}
+
+// writes the static layout as a C source file that defines `symbol` and `symbol`_len. Returns the size of the data.
+static size_t write_c_source_file(const char *cfile, const char *symbol, const Database *db)
+{
+    StrBuf buf;
+    memset(&buf, '\0', sizeof (buf));
+    build_static_data(db, &buf);
+
+    FILE *f = fopen(cfile, "w");
+    if (!f) {
+        fprintf(stderr, "Failed to open '%s': %s\n", cfile, strerror(errno));
+        exit(1);
+    }
+
+    fprintf(f, "/* This file was generated by make-controllerimage-data --c-source; don't edit it.\n");
+    fprintf(f, " * Compile it into your program and register it at startup with:\n");
+    fprintf(f, " *\n");
+    fprintf(f, " *   extern const unsigned char %s[];\n", symbol);
+    fprintf(f, " *   extern const size_t %s_len;\n", symbol);
+    fprintf(f, " *   ControllerImage_AddStaticData(%s, %s_len);\n", symbol, symbol);
+    fprintf(f, " */\n\n");
+    fprintf(f, "#include <stddef.h>\n\n");
+    fprintf(f, "const size_t %s_len = %d;\n\n", symbol, (int) buf.len);
+    fprintf(f, "const unsigned char %s[%d] = {\n", symbol, (int) buf.len);
+    for (size_t i = 0; i < buf.len; i++) {
+        fprintf(f, "%s0x%02x,%s", ((i % 16) == 0) ? "    " : "", (unsigned int) (unsigned char) buf.data[i], (((i % 16) == 15) || (i == (buf.len - 1))) ? "\n" : " ");
+    }
+    fprintf(f, "};\n\n");
+
+    if (fclose(f) == EOF) {
+        fprintf(stderr, "Failed to fclose '%s': %s\n", cfile, strerror(errno));
+        remove(cfile);
+        exit(1);
+    }
+
+    const size_t retval = buf.len;
+    free(buf.data);
+    return retval;
+}
+
+static void process_theme_dir(const char *theme, const char *path)
+{
+    size_t slen;
+
+    const char *binfile_basename = "controllerimage";
+
+    char *cachefile = NULL;
+    if (incremental) {
+        slen = strlen(binfile_basename) + strlen(theme) + 8;
+        cachefile = (char *) xmalloc(slen);
+        snprintf(cachefile, slen, "%s-%s.cache", binfile_basename, theme);
+    }
+
+    Database db;
+    build_theme_database(path, cachefile, &db);
+    free(cachefile);
+
+    compute_image_infos(&db);
+
+    slen = strlen(binfile_basename) + strlen(theme) + 6;
+    char *binfile = (char *) xmalloc(slen);
+    snprintf(binfile, slen, "%s-%s.bin", binfile_basename, theme);
+
+    size_t string_table_len = 0;
+    size_t compressed_len = 0;
+    write_data_file(binfile, &db, &string_table_len, &compressed_len);
+
+    printf("Filename: %s\n", binfile);
+
+    if (write_c_source) {
+        slen = strlen(binfile_basename) + strlen(theme) + 6;
+        char *cfile = (char *) xmalloc(slen);
+        snprintf(cfile, slen, "%s-%s.c", binfile_basename, theme);
+
+        // the symbol is the file name, minus the extension, with anything that can't be in a C identifier replaced.
+        char *symbol = xstrdup(cfile);
+        symbol[slen - 5] = '\0';
+        for (char *ptr = symbol; *ptr; ptr++) {
+            if (!(((*ptr >= 'a') && (*ptr <= 'z')) || ((*ptr >= 'A') && (*ptr <= 'Z')) || ((*ptr >= '0') && (*ptr <= '9')))) {
+                *ptr = '_';
+            }
+        }
+
+        const size_t staticlen = write_c_source_file(cfile, symbol, &db);
+        printf("C source: %s (%s, %d bytes)\n", cfile, symbol, (int) staticlen);
+        free(symbol);
+        free(cfile);
+    }
+
+    int unique_images = 0;
+    const int num_images = count_database_images(&db, &unique_images);
+    const double dedup_pct = num_images ? (100.0 - ((((double) unique_images) / ((double) num_images)) * 100.0)) : 0.0;
+
+    printf("Num devices: %d\n", db.num_devices);
+    printf("Num strings: %d\n", db.num_strings);
+    printf("Num GUIDs: %d\n", count_database_guids(&db));
+    printf("Num images: %d (%d unique, %.1f%% deduplicated)\n", num_images, unique_images, dedup_pct);
+    printf("Collapsed SVGs that render identically: %d\n", num_canonicalized_images);
+    if (compress_strings) {
+        printf("Compressed strings: %d -> %d bytes\n", (int) string_table_len, (int) compressed_len);
+    }
+    if (incremental) {
+        printf("Reused from cache: %d\n", num_reused_devices);
+    }
+    if (optimize_level > 0) {
+        const double pct = total_original_svg_bytes ? (100.0 - ((((double) total_optimized_svg_bytes) / ((double) total_original_svg_bytes)) * 100.0)) : 0.0;
+        printf("Optimized SVGs: %d -> %d bytes (%.1f%% smaller)\n", (int) total_original_svg_bytes, (int) total_optimized_svg_bytes, pct);
+        printf("Reused optimizer results: %d (identical SVGs)\n", num_optimize_cache_hits);
+    }
+    printf("\n");
+
+    free(binfile);
+    free_database(&db);
+
+    num_reused_devices = 0;
+    num_canonicalized_images = 0;
+    num_optimize_cache_hits = 0;
+    total_original_svg_bytes = 0;
+    total_optimized_svg_bytes = 0;
+}
+
+
+// Overlays! The library lets you load more data files on top of earlier
+//  ones, and a device in a later file replaces the whole device from an
+//  earlier one, GUIDs included. So a patch only needs to ship the devices
+//  that changed, plus enough GUIDs to fix up the GUID mappings.
+//  --diff builds that overlay from two versions of a theme, and --verify
+//  checks that loading the base and then the overlay matches the new data,
+//  by doing what ControllerImage_AddData() does in a simulation here.
+//
+//  There's no way to remove a device or GUID with an overlay, so if the new
+//  data is missing something the old data had, you have to ship a full file.
+
+static int lz4_read_length(const unsigned char **_src, const unsigned char *srcend, size_t *_len)
+{
+    unsigned char b;
+    do {
+        if (*_src >= srcend) {
+            return 0;
+        }
+        b = *((*_src)++);
+        *_len += b;
+    } while (b == 255);
+    return 1;
+}
+
+// this is the same as DecompressBlock() in the library.
+static unsigned char *lz4_decompress_block(const unsigned char *src, size_t srclen, size_t dstlen)
+{
+    const unsigned char *srcend = src + srclen;
+    unsigned char *dst = (unsigned char *) xmalloc(dstlen ? dstlen : 1);
+    unsigned char *op = dst;
+    unsigned char *dstend = dst + dstlen;
+
+    while (src < srcend) {
+        const unsigned char token = *(src++);
+
+        size_t len = (size_t) (token >> 4);
+        if ((len == 15) && !lz4_read_length(&src, srcend, &len)) {
+            break;
+        } else if ((len > (size_t) (srcend - src)) || (len > (size_t) (dstend - op))) {
+            break;
+        }
+
+        memcpy(op, src, len);
+        op += len;
+        src += len;
+
+        if (src == srcend) {
+            if (op == dstend) {
+                return dst;  // the last sequence is only literals.
+            }
+            break;
+        } else if ((srcend - src) < 2) {
+            break;
+        }
+
+        const size_t offset = ((size_t) src[0]) | (((size_t) src[1]) << 8);
+        src += 2;
+        len = (size_t) (token & 0xF);
+        if ((len == 15) && !lz4_read_length(&src, srcend, &len)) {
+            break;
+        }
+        len += LZ4_MINMATCH;
+        if ((offset == 0) || (offset > (size_t) (op - dst)) || (len > (size_t) (dstend - op))) {
+            break;
+        }
+
+        const unsigned char *match = op - offset;
+        for (size_t i = 0; i < len; i++) {
+            *(op++) = *(match++);
+        }
+    }
+
+    free(dst);
+    return NULL;
+}
+
+static int readui16(const unsigned char **_ptr, const unsigned char *end, int *_val)
+{
+    const unsigned char *ptr = *_ptr;
+    if ((end - ptr) < 2) {
+        return 0;
+    }
+    *_val = (((int) ptr[0]) << 8) | ((int) ptr[1]);
+    *_ptr = ptr + 2;
+    return 1;
+}
+
+static int readui32(const unsigned char **_ptr, const unsigned char *end, size_t *_val)
+{
+    const unsigned char *ptr = *_ptr;
+    if ((end - ptr) < 4) {
+        return 0;
+    }
+    *_val = (((size_t) ptr[0]) << 24) | (((size_t) ptr[1]) << 16) | (((size_t) ptr[2]) << 8) | ((size_t) ptr[3]);
+    *_ptr = ptr + 4;
+    return 1;
+}
+
+static void load_data_file(const char *binfile, Database *db)
+{
+    static const char magic[8] = { 'C', 'T', 'I', 'M', 'G', '\r', '\n', '\0' };
+    size_t buflen = 0;
+    char *buf = load_binary_file(binfile, &buflen, 0);
+    const unsigned char *ptr = (const unsigned char *) buf;
+    const unsigned char *end = ptr + buflen;
+    unsigned char *decompressed = NULL;
+    int version = 0;
+    int count = 0;
+
+    memset(db, '\0', sizeof (*db));
+
+    if ((buflen < sizeof (magic)) || (memcmp(buf, magic, sizeof (magic)) != 0)) {
+        goto bogus;
+    }
+    ptr += sizeof (magic);
+
+    if (!readui16(&ptr, end, &version) || (version < 1) || (version > 3)) {
+        fprintf(stderr, "'%s' is an unsupported data version\n", binfile);
+        exit(1);
+    } else if (!readui16(&ptr, end, &count)) {
+        goto bogus;
+    }
+
+    db->num_strings = count;
+    db->strings = (char **) xcalloc(count ? count : 1, sizeof (char *));
+
+    const unsigned char *strptr = ptr;
+    const unsigned char *strend = end;
+    if (version >= 3) {
+        int compression = 0;
+        if (!readui16(&ptr, end, &compression)) {
+            goto bogus;
+        } else if (compression == 1) {
+            size_t uncompressed_len = 0;
+            size_t compressed_len = 0;
+            if (!readui32(&ptr, end, &uncompressed_len) || !readui32(&ptr, end, &compressed_len) || (compressed_len > (size_t) (end - ptr))) {
+                goto bogus;
+            } else if ((decompressed = lz4_decompress_block(ptr, compressed_len, uncompressed_len)) == NULL) {
+                goto bogus;
+            }
+            ptr += compressed_len;
+            strptr = decompressed;
+            strend = decompressed + uncompressed_len;
+        } else if (compression != 0) {
+            fprintf(stderr, "'%s' uses an unsupported compression type\n", binfile);
+            exit(1);
+        } else {
+            strptr = ptr;
+        }
+    }
+
+    for (int i = 0; i < db->num_strings; i++) {
+        const unsigned char *str = strptr;
+        while ((strptr < strend) && *strptr) {
+            strptr++;
+        }
+        if (strptr >= strend) {
+            goto bogus;
+        }
+        db->strings[i] = xstrdup((const char *) str);
+        strptr++;
+    }
+
+    if (decompressed) {
+        free(decompressed);
+        decompressed = NULL;
+    } else {
+        ptr = strptr;
+    }
+
+    if (!readui16(&ptr, end, &count)) {
+        goto bogus;
+    }
+
+    db->devices = (DeviceInfo *) xcalloc(count ? count : 1, sizeof (DeviceInfo));
+    for (int i = 0; i < count; i++) {
+        DeviceInfo *device = &db->devices[db->num_devices++];
+        if (!readui16(&ptr, end, &device->devid) || !readui16(&ptr, end, &device->inherits) || !readui16(&ptr, end, &device->num_items)) {
+            goto bogus;
+        } else if ((version >= 2) && !readui16(&ptr, end, &device->num_guids)) {
+            goto bogus;
+        } else if ((device->devid >= db->num_strings) || (device->inherits >= db->num_strings)) {
+            goto bogus;
+        }
+
+        device->items = (DeviceItem *) xcalloc(device->num_items ? device->num_items : 1, sizeof (DeviceItem));
+        for (int j = 0; j < device->num_items; j++) {
+            DeviceItem *item = &device->items[j];
+            if (!readui16(&ptr, end, &item->type) || !readui16(&ptr, end, &item->image)) {
+                goto bogus;
+            } else if ((item->type >= db->num_strings) || (item->image >= db->num_strings)) {
+                goto bogus;
+            }
+        }
+
+        device->guids = (Guid *) xcalloc(device->num_guids ? device->num_guids : 1, sizeof (Guid));
+        for (int j = 0; j < device->num_guids; j++) {
+            if ((size_t) (end - ptr) < sizeof (device->guids[j].data)) {
+                goto bogus;
+            }
+            memcpy(device->guids[j].data, ptr, sizeof (device->guids[j].data));
+            ptr += sizeof (device->guids[j].data);
+        }
+    }
+
+    free(buf);
+    return;
+
+bogus:
+    fprintf(stderr, "'%s' is not a valid data file\n", binfile);
+    exit(1);
+}
+
+// `path` can be a .bin file or a theme directory (like "art/standard").
+static void load_database(const char *path, Database *db)
+{
+    struct stat statbuf;
+    if (stat(path, &statbuf) == -1) {
+        fprintf(stderr, "Couldn't stat '%s': %s\n", path, strerror(errno));
+        exit(1);
+    } else if ((statbuf.st_mode & S_IFMT) == S_IFDIR) {
+        build_theme_database(path, NULL, db);
+    } else {
+        load_data_file(path, db);
+    }
+}
+
+// What the library ends up with after loading some data files: devices by
+//  name, and GUIDs mapped to device names.
+typedef struct SimulatedDevice
+{
+    const char *devid;
+    const Database *db;
+    const DeviceInfo *info;
+} SimulatedDevice;
+
+typedef struct SimulatedGuid
+{
+    Guid key;
+    const char *devid;
+} SimulatedGuid;
+
+typedef struct SimulatedLibrary
+{
+    int num_devices;
+    SimulatedDevice *devices;
+    int num_guids;
+    SimulatedGuid *guids;
+} SimulatedLibrary;
+
+// the library maps each GUID, and then a GUID with everything but the USB VID/PID zeroed out.
+static void guid_keys(const Guid *guid, Guid keys[2])
+{
+    keys[0] = *guid;
+    memset(&keys[1], '\0', sizeof (keys[1]));
+    keys[1].data[4] = guid->data[4];  // VID
+    keys[1].data[5] = guid->data[5];
+    keys[1].data[8] = guid->data[8];  // PID
+    keys[1].data[9] = guid->data[9];
+}
+
+static SimulatedDevice *find_simulated_device(const SimulatedLibrary *lib, const char *devid)
+{
+    for (int i = 0; i < lib->num_devices; i++) {
+        if (strcmp(lib->devices[i].devid, devid) == 0) {
+            return &lib->devices[i];
+        }
+    }
+    return NULL;
+}
+
+static SimulatedGuid *find_simulated_guid(const SimulatedLibrary *lib, const Guid *key)
+{
+    for (int i = 0; i < lib->num_guids; i++) {
+        if (memcmp(lib->guids[i].key.data, key->data, sizeof (key->data)) == 0) {
+            return &lib->guids[i];
+        }
+    }
+    return NULL;
+}
+
+static void simulate_add_data(SimulatedLibrary *lib, const Database *db)
+{
+    for (int i = 0; i < db->num_devices; i++) {
+        const DeviceInfo *info = &db->devices[i];
+        const char *devid = db->strings[info->devid];
+        SimulatedDevice *device = find_simulated_device(lib, devid);
+        if (!device) {
+            lib->devices = (SimulatedDevice *) xrealloc(lib->devices, (lib->num_devices + 1) * sizeof (SimulatedDevice));
+            device = &lib->devices[lib->num_devices++];
+            device->devid = devid;
+        }
+        device->db = db;
+        device->info = info;
+
+        for (int j = 0; j < info->num_guids; j++) {
+            Guid keys[2];
+            guid_keys(&info->guids[j], keys);
+            for (int k = 0; k < 2; k++) {
+                SimulatedGuid *guid = find_simulated_guid(lib, &keys[k]);
+                if (!guid) {
+                    lib->guids = (SimulatedGuid *) xrealloc(lib->guids, (lib->num_guids + 1) * sizeof (SimulatedGuid));
+                    guid = &lib->guids[lib->num_guids++];
+                    guid->key = keys[k];
+                }
+                guid->devid = devid;
+            }
+        }
+    }
+}
+
+static void free_simulated_library(SimulatedLibrary *lib)
+{
+    free(lib->devices);
+    free(lib->guids);
+    memset(lib, '\0', sizeof (*lib));
+}
+
+static int same_simulated_device(const SimulatedDevice *a, const SimulatedDevice *b)
+{
+    const char *a_inherits = a->info->inherits ? a->db->strings[a->info->inherits] : NULL;
+    const char *b_inherits = b->info->inherits ? b->db->strings[b->info->inherits] : NULL;
+    if ((a_inherits == NULL) != (b_inherits == NULL)) {
+        return 0;
+    } else if (a_inherits && (strcmp(a_inherits, b_inherits) != 0)) {
+        return 0;
+    } else if (a->info->num_items != b->info->num_items) {
+        return 0;
+    }
+
+    for (int i = 0; i < a->info->num_items; i++) {
+        const DeviceItem *a_item = &a->info->items[i];
+        const DeviceItem *b_item = &b->info->items[i];
+        if (strcmp(a->db->strings[a_item->type], b->db->strings[b_item->type]) != 0) {
+            return 0;
+        } else if (strcmp(a->db->strings[a_item->image], b->db->strings[b_item->image]) != 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static void print_guid(FILE *io, const Guid *guid)
+{
+    for (int i = 0; i < (int) sizeof (guid->data); i++) {
+        fprintf(io, "%02x", (unsigned int) guid->data[i]);
+    }
+}
+
+// returns the number of differences found, and reports each of them (with `prefix` in front of them) if `prefix` isn't NULL.
+static int compare_simulated_libraries(const SimulatedLibrary *got, const SimulatedLibrary *expected, const char *prefix)
+{
+    int differences = 0;
+
+    for (int i = 0; i < expected->num_devices; i++) {
+        const SimulatedDevice *want = &expected->devices[i];
+        const SimulatedDevice *have = find_simulated_device(got, want->devid);
+        if (!have || !same_simulated_device(have, want)) {
+            if (prefix) {
+                fprintf(stderr, "%sdevice '%s' is %s\n", prefix, want->devid, have ? "different" : "missing");
+            }
+            differences++;
+        }
+    }
+
+    for (int i = 0; i < got->num_devices; i++) {
+        if (!find_simulated_device(expected, got->devices[i].devid)) {
+            if (prefix) {
+                fprintf(stderr, "%sdevice '%s' shouldn't be there\n", prefix, got->devices[i].devid);
+            }
+            differences++;
+        }
+    }
+
+    for (int i = 0; i < expected->num_guids; i++) {
+        const SimulatedGuid *want = &expected->guids[i];
+        const SimulatedGuid *have = find_simulated_guid(got, &want->key);
+        if (!have || (strcmp(have->devid, want->devid) != 0)) {
+            if (prefix) {
+                fprintf(stderr, "%sGUID ", prefix);
+                print_guid(stderr, &want->key);
+                fprintf(stderr, " should map to '%s', not '%s'\n", want->devid, have ? have->devid : "(nothing)");
+            }
+            differences++;
+        }
+    }
+
+    for (int i = 0; i < got->num_guids; i++) {
+        if (!find_simulated_guid(expected, &got->guids[i].key)) {
+            if (prefix) {
+                fprintf(stderr, "%sGUID ", prefix);
+                print_guid(stderr, &got->guids[i].key);
+                fprintf(stderr, " shouldn't map to anything\n");
+            }
+            differences++;
+        }
+    }
+
+    return differences;
+}
+
+// One GUID in one device of the new database. Each one sets two GUID mappings when loaded (see guid_keys()).
+typedef struct GuidListing
+{
+    int device;
+    int guid;
+    Guid keys[2];
+    int last_listing[2];  // index of the last listing in the new database that sets the same key.
+    int included;
+} GuidListing;
+
+static void include_guid_listing(GuidListing *listings, int idx)
+{
+    if (!listings[idx].included) {
+        listings[idx].included = 1;
+        // anything else that sets the same key has to be followed by the final word on that key, or we'd leave it wrong.
+        include_guid_listing(listings, listings[idx].last_listing[0]);
+        include_guid_listing(listings, listings[idx].last_listing[1]);
+    }
+}
+
+static void make_overlay(const char *oldpath, const char *newpath, const char *overlayfile)
+{
+    Database olddb, newdb, overlaydb;
+    SimulatedLibrary oldlib, newlib;
+
+    memset(&oldlib, '\0', sizeof (oldlib));
+    memset(&newlib, '\0', sizeof (newlib));
+
+    load_database(oldpath, &olddb);
+    load_database(newpath, &newdb);
+    simulate_add_data(&oldlib, &olddb);
+    simulate_add_data(&newlib, &newdb);
+
+    int removed = 0;
+    for (int i = 0; i < oldlib.num_devices; i++) {
+        if (!find_simulated_device(&newlib, oldlib.devices[i].devid)) {
+            fprintf(stderr, "Device '%s' was removed; overlays can't remove things, ship a full data file instead.\n", oldlib.devices[i].devid);
+            removed++;
+        }
+    }
+    for (int i = 0; i < oldlib.num_guids; i++) {
+        if (!find_simulated_guid(&newlib, &oldlib.guids[i].key)) {
+            fprintf(stderr, "GUID ");
+            print_guid(stderr, &oldlib.guids[i].key);
+            fprintf(stderr, " was removed; overlays can't remove things, ship a full data file instead.\n");
+            removed++;
+        }
+    }
+    if (removed) {
+        exit(1);
+    }
+
+    // list every GUID in the new database, in the order the library would see them.
+    int num_listings = 0;
+    GuidListing *listings = (GuidListing *) xcalloc(count_database_guids(&newdb) + 1, sizeof (GuidListing));
+    for (int i = 0; i < newdb.num_devices; i++) {
+        for (int j = 0; j < newdb.devices[i].num_guids; j++) {
+            GuidListing *listing = &listings[num_listings++];
+            listing->device = i;
+            listing->guid = j;
+            guid_keys(&newdb.devices[i].guids[j], listing->keys);
+        }
+    }
+
+    for (int i = 0; i < num_listings; i++) {
+        for (int k = 0; k < 2; k++) {
+            listings[i].last_listing[k] = i;
+            for (int j = num_listings - 1; j > i; j--) {
+                if ((memcmp(listings[j].keys[0].data, listings[i].keys[k].data, sizeof (Guid)) == 0) || (memcmp(listings[j].keys[1].data, listings[i].keys[k].data, sizeof (Guid)) == 0)) {
+                    listings[i].last_listing[k] = j;
+                    break;
+                }
+            }
+        }
+    }
+
+    // any GUID mapping that changed needs the listing that set it last in the new database.
+    for (int i = 0; i < num_listings; i++) {
+        for (int k = 0; k < 2; k++) {
+            const SimulatedGuid *oldguid = find_simulated_guid(&oldlib, &listings[i].keys[k]);
+            const SimulatedGuid *newguid = find_simulated_guid(&newlib, &listings[i].keys[k]);
+            if (!oldguid || (strcmp(oldguid->devid, newguid->devid) != 0)) {
+                include_guid_listing(listings, listings[i].last_listing[k]);
+            }
+        }
+    }
+
+    // pick the devices to ship: anything new or changed, and anything that carries a GUID we need.
+    int *include_device = (int *) xcalloc(newdb.num_devices + 1, sizeof (int));
+    for (int i = 0; i < newlib.num_devices; i++) {
+        const SimulatedDevice *newdev = &newlib.devices[i];
+        const SimulatedDevice *olddev = find_simulated_device(&oldlib, newdev->devid);
+        if (!olddev || !same_simulated_device(olddev, newdev)) {
+            include_device[(int) (newdev->info - newdb.devices)] = 1;
+        }
+    }
+    for (int i = 0; i < num_listings; i++) {
+        if (listings[i].included) {
+            include_device[listings[i].device] = 1;
+        }
+    }
+
+    // if a device name shows up more than once, whatever we ship has to end with the version the library would keep.
+    for (int i = 0; i < newdb.num_devices; i++) {
+        if (include_device[i]) {
+            const SimulatedDevice *newdev = find_simulated_device(&newlib, newdb.strings[newdb.devices[i].devid]);
+            include_device[(int) (newdev->info - newdb.devices)] = 1;
+        }
+    }
+
+    cache_string("");  // same as build_theme_database(), keep index 0 unused.
+
+    int num_shipped_guids = 0;
+    int listing = 0;
+    for (int i = 0; i < newdb.num_devices; i++) {
+        const DeviceInfo *newdev = &newdb.devices[i];
+        if (!include_device[i]) {
+            listing += newdev->num_guids;
+            continue;
+        }
+
+        devices = (DeviceInfo *) xrealloc(devices, (num_devices + 1) * sizeof (DeviceInfo));
+        DeviceInfo *device = &devices[num_devices++];
+        memset(device, '\0', sizeof (*device));
+        device->devid = cache_string(newdb.strings[newdev->devid]);
+        device->inherits = newdev->inherits ? cache_string(newdb.strings[newdev->inherits]) : 0;
+        device->items = (DeviceItem *) xmalloc((newdev->num_items + 1) * sizeof (DeviceItem));
+        device->guids = (Guid *) xmalloc((newdev->num_guids + 1) * sizeof (Guid));
+        for (int j = 0; j < newdev->num_items; j++) {
+            DeviceItem *item = &device->items[device->num_items++];
+            item->type = cache_string(newdb.strings[newdev->items[j].type]);
+            item->image = cache_string(newdb.strings[newdev->items[j].image]);
+        }
+        for (int j = 0; j < newdev->num_guids; j++, listing++) {
+            if (listings[listing].included) {
+                device->guids[device->num_guids++] = newdev->guids[j];
+                num_shipped_guids++;
+            }
+        }
+    }
+
+    free(include_device);
+    free(listings);
+
+    take_database(&overlaydb);
+
+    // make sure this actually works before we write it out.
+    SimulatedLibrary patchedlib;
+    memset(&patchedlib, '\0', sizeof (patchedlib));
+    simulate_add_data(&patchedlib, &olddb);
+    simulate_add_data(&patchedlib, &overlaydb);
+    if (compare_simulated_libraries(&patchedlib, &newlib, "BUG: overlay is wrong: ") != 0) {
+        exit(1);
+    }
+    free_simulated_library(&patchedlib);
+
+    compute_image_infos(&overlaydb);
+    const size_t overlaylen = write_data_file(overlayfile, &overlaydb, NULL, NULL);
+
+    printf("Filename: %s\n", overlayfile);
+    printf("Num devices: %d (of %d)\n", overlaydb.num_devices, newdb.num_devices);
+    printf("Num strings: %d (of %d)\n", overlaydb.num_strings, newdb.num_strings);
+    printf("Num GUIDs: %d (of %d)\n", num_shipped_guids, count_database_guids(&newdb));
+    printf("Size: %d bytes\n", (int) overlaylen);
+    printf("\n");
+
+    free_simulated_library(&oldlib);
+    free_simulated_library(&newlib);
+    free_database(&overlaydb);
+    free_database(&newdb);
+    free_database(&olddb);
+}
+
+static int verify_overlay(const char *basepath, const char *overlaypath, const char *newpath)
+{
+    Database basedb, overlaydb, newdb;
+    SimulatedLibrary patchedlib, newlib;
+
+    memset(&patchedlib, '\0', sizeof (patchedlib));
+    memset(&newlib, '\0', sizeof (newlib));
+
+    load_database(basepath, &basedb);
+    load_database(overlaypath, &overlaydb);
+    load_database(newpath, &newdb);
+
+    simulate_add_data(&patchedlib, &basedb);
+    simulate_add_data(&patchedlib, &overlaydb);
+    simulate_add_data(&newlib, &newdb);
+
+    const int differences = compare_simulated_libraries(&patchedlib, &newlib, "  ");
+    if (differences) {
+        fprintf(stderr, "FAILED: '%s' + '%s' != '%s' (%d differences)\n", basepath, overlaypath, newpath, differences);
     } else {
+        printf("OK: '%s' + '%s' == '%s'\n", basepath, overlaypath, newpath);
+    }
+
+    free_simulated_library(&patchedlib);
+    free_simulated_library(&newlib);
+    free_database(&newdb);
+    free_database(&overlaydb);
+    free_database(&basedb);
+
+    return differences ? 1 : 0;
+}
+
+static void usage_and_exit(const char *argv0)
+{
+    fprintf(stderr, "USAGE: %s [options] <path_to_art_directory>\n", argv0);
+    fprintf(stderr, "       %s [options] --diff <old> <new> <overlay.bin>\n", argv0);
+    fprintf(stderr, "       %s [options] --verify <base> <overlay.bin> <new>\n", argv0);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  --diff             Write an overlay with just what changed between two versions of a theme.\n");
+    fprintf(stderr, "  --verify           Check that loading the base and then the overlay gets the new data.\n");
+    fprintf(stderr, "                     (<old>, <new> and <base> can be .bin files or theme directories, like 'art/standard'.)\n");
+    fprintf(stderr, "  --jobs N           Use N threads to load art (default: number of CPUs).\n");
+    fprintf(stderr, "  --incremental      Reuse unchanged device directories from the last build.\n");
+    fprintf(stderr, "  --compress         Compress the string table (writes data version 3).\n");
+    fprintf(stderr, "  --c-source         Also write each theme as a .c file for ControllerImage_AddStaticData().\n");
+    fprintf(stderr, "  --optimize LEVEL   Shrink SVGs (0: off (default), 1: strip junk, 2: minify, 3: quantize).\n");
+    fprintf(stderr, "  --precision N      Decimal places to keep for --optimize 3 (default: %d).\n", optimize_precision);
+    fprintf(stderr, "  --max-error N      Keep the original SVG if any pixel changes more than this (default: %d).\n", optimize_max_error);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *basedir = NULL;
+    const char *diffargs[3] = { NULL, NULL, NULL };
+    const char *verifyargs[3] = { NULL, NULL, NULL };
+
+    num_worker_threads = -1;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--jobs") == 0) {
+            if ((i + 1) >= argc) {
+                usage_and_exit(argv[0]);
+            }
+            num_worker_threads = atoi(argv[++i]);
+            if (num_worker_threads < 1) {
+                usage_and_exit(argv[0]);
+            }
+        } else if (strcmp(arg, "--incremental") == 0) {
+            incremental = 1;
+        } else if (((strcmp(arg, "--diff") == 0) || (strcmp(arg, "--verify") == 0)) && ((i + 3) < argc)) {
+            const char **args = (arg[2] == 'd') ? diffargs : verifyargs;
+            args[0] = argv[++i];
+            args[1] = argv[++i];
+            args[2] = argv[++i];
+        } else if (strcmp(arg, "--compress") == 0) {
+            compress_strings = 1;
+        } else if (strcmp(arg, "--c-source") == 0) {
+            write_c_source = 1;
+        } else if ((strcmp(arg, "--optimize") == 0) && ((i + 1) < argc)) {
+            optimize_level = atoi(argv[++i]);
+            if ((optimize_level < 0) || (optimize_level > 3)) {
+                usage_and_exit(argv[0]);
+            }
+        } else if ((strcmp(arg, "--precision") == 0) && ((i + 1) < argc)) {
+            optimize_precision = atoi(argv[++i]);
+            if ((optimize_precision < 0) || (optimize_precision > 8)) {
+                usage_and_exit(argv[0]);
+            }
+        } else if ((strcmp(arg, "--max-error") == 0) && ((i + 1) < argc)) {
+            optimize_max_error = atoi(argv[++i]);
+            if ((optimize_max_error < 0) || (optimize_max_error > 255)) {
+                usage_and_exit(argv[0]);
+            }
+        } else if ((*arg == '-') || (basedir != NULL)) {
+            usage_and_exit(argv[0]);
+        } else {
+            basedir = arg;
+        }
+    }
+
+    const int num_modes = (basedir ? 1 : 0) + (diffargs[0] ? 1 : 0) + (verifyargs[0] ? 1 : 0);
+    if (num_modes != 1) {
         usage_and_exit(argv[0]);
     }
 
+    if (num_worker_threads < 0) {
+        num_worker_threads = GetCPUCount();
+    }
+    num_worker_threads--;  // the main thread does work too.
+
+    InitMutex(&optimize_cache_mutex);
+
+    if (diffargs[0]) {
+        make_overlay(diffargs[0], diffargs[1], diffargs[2]);
+        return 0;
+    } else if (verifyargs[0]) {
+        return verify_overlay(verifyargs[0], verifyargs[1], verifyargs[2]);
+    }
+
     DirHandle *dirp = OpenDir(basedir);
     if (!dirp) {
         fprintf(stderr, "Couldn't opendir '%s': %s\n", basedir, strerror(errno));
@@ -575,4 +4978,3 @@ int main(int argc, char **argv)
 
     return 0;
 }
-
@@ -29,6 +29,10 @@
 #ifndef NANOSVG_H
 #define NANOSVG_H
 
+#ifndef NANOSVG_SKIP_STDC_HEADERS  // ControllerImage
+#include <stddef.h>
+#endif  // ControllerImage
+
 #ifndef NANOSVG_CPLUSPLUS
 #ifdef __cplusplus
 extern "C" {
@@ -164,6 +168,7 @@ typedef struct NSVGimage
 	float width;				// Width of the image.
 	float height;				// Height of the image.
 	NSVGshape* shapes;			// Linked list of shapes in the image.
+	struct NSVGarenaPage* arena;	// ControllerImage: the image and everything in it live here.
 } NSVGimage;
 
 
@@ -176,6 +181,10 @@ NSVGimage* nsvgParseFromFile(const char* filename, const char* units, float dpi)
 // Important note: changes the string.
 NSVGimage* nsvgParse(char* input, const char* units, float dpi);
 
+// ControllerImage: Parses SVG file from `length` bytes of memory, which don't
+// have to be null terminated. Unlike nsvgParse(), this doesn't change the input.
+NSVGimage* nsvgParseConst(const char* input, size_t length, const char* units, float dpi);
+
 // Duplicates a path.
 NSVGpath* nsvgDuplicatePath(NSVGpath* p);
 
@@ -361,6 +370,73 @@ int nsvg__parseXML(char* input,
 	return 1;
 }
 
+// ControllerImage: copy [s,e) into the scratch buffer and null terminate it, so it can be split up there.
+static char* nsvg__stageXML(const char* s, const char* e, char* local, size_t localSize, char** scratch, size_t* scratchSize)
+{
+	size_t len = (size_t)(e - s);
+	char* buf = local;
+	if (len >= localSize) {
+		if (len >= *scratchSize) {
+			size_t newSize = *scratchSize ? *scratchSize * 2 : localSize * 4;
+			while (newSize <= len) newSize *= 2;
+			buf = (char*)realloc(*scratch, newSize);
+			if (buf == NULL) return NULL;
+			*scratch = buf;
+			*scratchSize = newSize;
+		}
+		buf = *scratch;
+	}
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	return buf;
+}
+
+// ControllerImage: like nsvg__parseXML(), but `input` is const and `length` bytes long (or until a null
+// char, if that comes first). Tags are split up in a small scratch buffer instead of in the input.
+static int nsvg__parseXMLConst(const char* input, size_t length,
+							   void (*startelCb)(void* ud, const char* el, const char** attr),
+							   void (*endelCb)(void* ud, const char* el),
+							   void (*contentCb)(void* ud, const char* s),
+							   void* ud)
+{
+	char local[512];
+	char* scratch = NULL;
+	size_t scratchSize = 0;
+	const char* s = input;
+	const char* end = input + length;
+	const char* mark = s;
+	char* buf;
+	int state = NSVG_XML_CONTENT;
+	int ok = 1;
+	while (s < end && *s) {
+		if (*s == '<' && state == NSVG_XML_CONTENT) {
+			// Start of a tag; skip copying content that's only white space.
+			if (contentCb) {
+				while (mark < s && nsvg__isspace(*mark)) mark++;
+				if (mark < s) {
+					buf = nsvg__stageXML(mark, s, local, sizeof(local), &scratch, &scratchSize);
+					if (buf == NULL) { ok = 0; break; }
+					nsvg__parseContent(buf, contentCb, ud);
+				}
+			}
+			mark = ++s;
+			state = NSVG_XML_TAG;
+		} else if (*s == '>' && state == NSVG_XML_TAG) {
+			// Start of a content or new tag.
+			buf = nsvg__stageXML(mark, s, local, sizeof(local), &scratch, &scratchSize);
+			if (buf == NULL) { ok = 0; break; }
+			nsvg__parseElement(buf, startelCb, endelCb, ud);
+			mark = ++s;
+			state = NSVG_XML_CONTENT;
+		} else {
+			s++;
+		}
+	}
+
+	free(scratch);
+	return ok;
+}
+
 
 /* Simple SVG parser. */
 
@@ -619,16 +695,62 @@ static void nsvg__curveBounds(float* bounds, float* curve)
 	}
 }
 
+// ControllerImage: an image, and all its shapes, paths, points and gradients, come from one arena,
+// so parsing makes a few allocations instead of a few per shape, and deleting an image is just as quick.
+#define NSVG_ARENA_PAGE_SIZE 4096
+#define NSVG_ARENA_MAX_PAGE_SIZE 65536
+
+typedef struct NSVGarenaPage {
+	struct NSVGarenaPage* next;
+	size_t size;
+	size_t used;
+} NSVGarenaPage;
+
+static void* nsvg__arenaAlloc(NSVGarenaPage** arena, size_t size)
+{
+	const size_t headerlen = (sizeof(NSVGarenaPage) + 15) & ~((size_t)15);
+	NSVGarenaPage* page = *arena;
+	unsigned char* ptr;
+
+	size = (size + 15) & ~((size_t)15);
+	if (page == NULL || page->size - page->used < size) {
+		size_t pageSize = page ? page->size * 2 : NSVG_ARENA_PAGE_SIZE;
+		if (pageSize > NSVG_ARENA_MAX_PAGE_SIZE) pageSize = NSVG_ARENA_MAX_PAGE_SIZE;
+		if (pageSize < size) pageSize = size;
+		page = (NSVGarenaPage*)malloc(headerlen + pageSize);
+		if (page == NULL) return NULL;
+		page->next = *arena;
+		page->size = pageSize;
+		page->used = 0;
+		*arena = page;
+	}
+
+	ptr = ((unsigned char*)page) + headerlen + page->used;
+	page->used += size;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+static void nsvg__arenaFree(NSVGarenaPage* page)
+{
+	while (page != NULL) {
+		NSVGarenaPage* next = page->next;
+		free(page);
+		page = next;
+	}
+}
+
 static NSVGparser* nsvg__createParser(void)
 {
 	NSVGparser* p;
+	NSVGarenaPage* arena = NULL;
 	p = (NSVGparser*)malloc(sizeof(NSVGparser));
 	if (p == NULL) goto error;
 	memset(p, 0, sizeof(NSVGparser));
 
-	p->image = (NSVGimage*)malloc(sizeof(NSVGimage));
+	p->image = (NSVGimage*)nsvg__arenaAlloc(&arena, sizeof(NSVGimage));
 	if (p->image == NULL) goto error;
-	memset(p->image, 0, sizeof(NSVGimage));
+	p->image->arena = arena;
 
 	// Init style
 	nsvg__xformIdentity(p->attr[0].xform);
@@ -650,30 +772,10 @@ static NSVGparser* nsvg__createParser(void)
 	return p;
 
 error:
-	if (p) {
-		if (p->image) free(p->image);
-		free(p);
-	}
+	if (p) free(p);
 	return NULL;
 }
 
-static void nsvg__deletePaths(NSVGpath* path)
-{
-	while (path) {
-		NSVGpath *next = path->next;
-		if (path->pts != NULL)
-			free(path->pts);
-		free(path);
-		path = next;
-	}
-}
-
-static void nsvg__deletePaint(NSVGpaint* paint)
-{
-	if (paint->type == NSVG_PAINT_LINEAR_GRADIENT || paint->type == NSVG_PAINT_RADIAL_GRADIENT)
-		free(paint->gradient);
-}
-
 static void nsvg__deleteGradientData(NSVGgradientData* grad)
 {
 	NSVGgradientData* next;
@@ -688,7 +790,7 @@ static void nsvg__deleteGradientData(NSVGgradientData* grad)
 static void nsvg__deleteParser(NSVGparser* p)
 {
 	if (p != NULL) {
-		nsvg__deletePaths(p->plist);
+		// ControllerImage: any paths left in p->plist are in the image's arena.
 		nsvg__deleteGradientData(p->gradients);
 		nsvgDelete(p->image);
 		free(p->pts);
@@ -854,7 +956,7 @@ static NSVGgradient* nsvg__createGradient(NSVGparser* p, const char* id, const f
 	}
 	if (stops == NULL) return NULL;
 
-	grad = (NSVGgradient*)malloc(sizeof(NSVGgradient) + sizeof(NSVGgradientStop)*(nstops-1));
+	grad = (NSVGgradient*)nsvg__arenaAlloc(&p->image->arena, sizeof(NSVGgradient) + sizeof(NSVGgradientStop)*(nstops-1));
 	if (grad == NULL) return NULL;
 
 	// The shape width and height.
@@ -958,9 +1060,8 @@ static void nsvg__addShape(NSVGparser* p)
 	if (p->plist == NULL)
 		return;
 
-	shape = (NSVGshape*)malloc(sizeof(NSVGshape));
-	if (shape == NULL) goto error;
-	memset(shape, 0, sizeof(NSVGshape));
+	shape = (NSVGshape*)nsvg__arenaAlloc(&p->image->arena, sizeof(NSVGshape));
+	if (shape == NULL) return;
 
 	memcpy(shape->id, attr->id, sizeof shape->id);
 	memcpy(shape->fillGradient, attr->fillGradient, sizeof shape->fillGradient);
@@ -1024,11 +1125,6 @@ static void nsvg__addShape(NSVGparser* p)
 	else
 		p->shapesTail->next = shape;
 	p->shapesTail = shape;
-
-	return;
-
-error:
-	if (shape) free(shape);
 }
 
 static void nsvg__addPath(NSVGparser* p, char closed)
@@ -1049,12 +1145,11 @@ static void nsvg__addPath(NSVGparser* p, char closed)
 	if ((p->npts % 3) != 1)
 		return;
 
-	path = (NSVGpath*)malloc(sizeof(NSVGpath));
-	if (path == NULL) goto error;
-	memset(path, 0, sizeof(NSVGpath));
+	// ControllerImage: the points come right after the path, in the same arena allocation.
+	path = (NSVGpath*)nsvg__arenaAlloc(&p->image->arena, sizeof(NSVGpath) + p->npts*2*sizeof(float));
+	if (path == NULL) return;
 
-	path->pts = (float*)malloc(p->npts*2*sizeof(float));
-	if (path->pts == NULL) goto error;
+	path->pts = (float*)(path + 1);
 	path->closed = closed;
 	path->npts = p->npts;
 
@@ -1081,14 +1176,6 @@ static void nsvg__addPath(NSVGparser* p, char closed)
 
 	path->next = p->plist;
 	p->plist = path;
-
-	return;
-
-error:
-	if (path != NULL) {
-		if (path->pts != NULL) free(path->pts);
-		free(path);
-	}
 }
 
 // We roll our own string to float because the std library one uses locale and messes things up.
@@ -1194,6 +1281,65 @@ static const char* nsvg__parseNumber(const char* s, char* it, const int size)
 	return s;
 }
 
+// ControllerImage: exact powers of ten, for fractions of up to 18 digits.
+static const double nsvg__pow10[19] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+	1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18
+};
+
+// ControllerImage: nsvg__parseNumber() then nsvg__atof(), in one pass and without the copy, for the
+// common case of plain decimal numbers. The result is the same, bit for bit: it does the same math,
+// and anything with an exponent, or with too many digits for that math to be exact, takes the old path.
+static const char* nsvg__parseNumberValue(const char* s, double* val)
+{
+	const char* start = s;
+	long long intPart = 0, fracPart = 0;
+	int intDigits = 0, fracDigits = 0;
+	double res, sign = 1.0;
+
+	if (*s == '+') {
+		s++;
+	} else if (*s == '-') {
+		sign = -1.0;
+		s++;
+	}
+	// past 18 digits, only count them: those numbers take the old path below, and more would overflow.
+	while (nsvg__isdigit(*s)) {
+		if (intDigits < 18)
+			intPart = intPart*10 + (*s - '0');
+		s++;
+		intDigits++;
+	}
+	if (*s == '.') {
+		s++;
+		while (nsvg__isdigit(*s)) {
+			if (fracDigits < 18)
+				fracPart = fracPart*10 + (*s - '0');
+			s++;
+			fracDigits++;
+		}
+	}
+
+	if (((*s == 'e' || *s == 'E') && (s[1] != 'm' && s[1] != 'x')) || intDigits > 18 || fracDigits > 18 || (s - start) >= 64) {
+		char it[64];
+		s = nsvg__parseNumber(start, it, 64);
+		*val = nsvg__atof(it);
+		return s;
+	}
+
+	// A valid number should have integer or fractional part.
+	if (intDigits == 0 && fracDigits == 0) {
+		*val = 0.0;
+		return s;
+	}
+
+	res = (double)intPart;
+	if (fracDigits > 0)
+		res += (double)fracPart / nsvg__pow10[fracDigits];
+	*val = res * sign;
+	return s;
+}
+
 static const char* nsvg__getNextPathItemWhenArcFlag(const char* s, char* it)
 {
 	it[0] = '\0';
@@ -1207,14 +1353,21 @@ static const char* nsvg__getNextPathItemWhenArcFlag(const char* s, char* it)
 	return s;
 }
 
-static const char* nsvg__getNextPathItem(const char* s, char* it)
+// ControllerImage: numbers are parsed right here into *val (0 for commands), instead of copied into `it`
+// to be parsed later. `it` only gets the first two chars of a number, which is enough for nsvg__isCoordinate().
+static const char* nsvg__getNextPathItem(const char* s, char* it, double* val)
 {
 	it[0] = '\0';
+	*val = 0.0;
 	// Skip white spaces and commas
 	while (*s && (nsvg__isspace(*s) || *s == ',')) s++;
 	if (!*s) return s;
 	if (*s == '-' || *s == '+' || *s == '.' || nsvg__isdigit(*s)) {
-		s = nsvg__parseNumber(s, it, 64);
+		const char* start = s;
+		s = nsvg__parseNumberValue(s, val);
+		it[0] = start[0];
+		it[1] = (s - start > 1) ? start[1] : '\0';
+		it[2] = '\0';
 	} else {
 		// Parse command
 		it[0] = *s++;
@@ -1448,14 +1601,51 @@ NSVGNamedColor nsvg__colors[] = {
 #endif
 };
 
+// ControllerImage: nsvg__colors as an open-addressed hash table, so a name costs a hash and a probe or
+// two instead of a walk through the whole list. Each slot holds an index into nsvg__colors plus one, or
+// zero if it's empty; names that collide take the next free slot. The seed was picked so no name needs
+// more than three probes. This covers the NANOSVG_ALL_COLOR_KEYWORDS names too (lookups skip indices
+// past the end when those aren't compiled in), so it has to be regenerated if nsvg__colors changes.
+#define NSVG__COLOR_HASH_SEED 0x811cdaa8u
+
+static const unsigned char nsvg__colorSlots[256] = {
+	  0,  39, 120,   0,   0,  55,  65, 114,   0,   0,   0,   0,   0, 127,  59,  89,
+	105,   0,  75,   0,   0, 118,   0,  52, 131,   0,  95,  61,   3, 129,   0,   0,
+	  0,  56,   0,   0,   0,   0,  70,   0,   0,  78,  64,  35,  50, 108,  96,  90,
+	 76,  46, 111,  72,   6, 116, 125,   0,   0, 137,   0,  10,  77,  16,  33,  80,
+	 97,   0,   0,   0,   0,  34, 139,  85,   0, 144,  30,   8,  92, 124,   0,   0,
+	  0,   0,  84, 112, 121,  91,  66,  69,  83, 109,  43,  32, 138,   0, 126,   0,
+	  0,   0,   0,  57,   9, 115,  24,  25, 140,   0,   0,   0,   0, 128,  49,   0,
+	  5,  47, 123,   0, 113,  62,   0,   0,  73,   0,  82,  86,  31,  15,  67, 133,
+	 21, 146,  22,  98,  81, 106,  28,  42,   0,   0,   0,  26, 104,   0,   0,   0,
+	 51,   0,   0,   0,   0,  14,   0,   0,   0,  11,   0,   0,  63, 130,   0,   0,
+	  0,   0,  13,   0,   0,  99, 103, 145,  23,   4,  37,  44,   0,  45,  29,  54,
+	  1,   0,  17,  93,   0, 135,   0,   0,   0,  27,   0,   0,   0,   0,   0,   0,
+	102,   0,  36,  48,  79,   0, 134, 101,   0, 132, 117,   0,   2,  68,  19,   7,
+	 41,  94,  74,   0,   0,   0,   0,  18, 110, 142, 143, 136,   0,   0,  88,  87,
+	147,   0, 122,   0,   0, 119,  58,  53, 141,  38,   0,   0,   0,   0,  12,  20,
+	  0,   0,  60,   0,   0,   0,   0, 100,   0,   0,   0,   0,   0, 107,  40,  71,
+};
+
+static unsigned int nsvg__hashColorName(const char* str)
+{
+	unsigned int h = NSVG__COLOR_HASH_SEED;	// FNV-1a
+	while (*str)
+		h = (h ^ (unsigned char)*str++) * 16777619u;
+	return (h ^ (h >> 16)) & 255;
+}
+
 static unsigned int nsvg__parseColorName(const char* str)
 {
-	int i, ncolors = sizeof(nsvg__colors) / sizeof(NSVGNamedColor);
+	int ncolors = sizeof(nsvg__colors) / sizeof(NSVGNamedColor);
+	unsigned int slot = nsvg__hashColorName(str);
 
-	for (i = 0; i < ncolors; i++) {
-		if (strcmp(nsvg__colors[i].name, str) == 0) {
+	while (nsvg__colorSlots[slot] != 0) {
+		int i = nsvg__colorSlots[slot] - 1;
+		if (i < ncolors && strcmp(nsvg__colors[i].name, str) == 0) {
 			return nsvg__colors[i].color;
 		}
+		slot = (slot + 1) & 255;
 	}
 
 	return NSVG_RGB(128, 128, 128);
@@ -1523,9 +1713,9 @@ static int nsvg__isCoordinate(const char* s)
 static NSVGcoordinate nsvg__parseCoordinateRaw(const char* str)
 {
 	NSVGcoordinate coord = {0, NSVG_UNITS_USER};
-	char buf[64];
-	coord.units = nsvg__parseUnits(nsvg__parseNumber(str, buf, 64));
-	coord.value = nsvg__atof(buf);
+	double val;
+	coord.units = nsvg__parseUnits(nsvg__parseNumberValue(str, &val));
+	coord.value = (float)val;
 	return coord;
 }
 
@@ -1545,7 +1735,7 @@ static int nsvg__parseTransformArgs(const char* str, float* args, int maxNa, int
 {
 	const char* end;
 	const char* ptr;
-	char it[64];
+	double val;
 
 	*na = 0;
 	ptr = str;
@@ -1560,8 +1750,8 @@ static int nsvg__parseTransformArgs(const char* str, float* args, int maxNa, int
 	while (ptr < end) {
 		if (*ptr == '-' || *ptr == '+' || *ptr == '.' || nsvg__isdigit(*ptr)) {
 			if (*na >= maxNa) return 0;
-			ptr = nsvg__parseNumber(ptr, it, 64);
-			args[(*na)++] = (float)nsvg__atof(it);
+			ptr = nsvg__parseNumberValue(ptr, &val);
+			args[(*na)++] = (float)val;
 		} else {
 			++ptr;
 		}
@@ -1781,75 +1971,172 @@ static int nsvg__parseStrokeDashArray(NSVGparser* p, const char* str, float* str
 
 static void nsvg__parseStyle(NSVGparser* p, const char* str);
 
+// ControllerImage: attribute and element names are matched by length first, so each one is compared
+// against a candidate or two instead of going down a chain of strcmp() calls.
+enum NSVGattrName {
+	NSVG_ATTR_UNKNOWN = 0,
+	NSVG_ATTR_STYLE,
+	NSVG_ATTR_DISPLAY,
+	NSVG_ATTR_FILL,
+	NSVG_ATTR_OPACITY,
+	NSVG_ATTR_FILL_OPACITY,
+	NSVG_ATTR_STROKE,
+	NSVG_ATTR_STROKE_WIDTH,
+	NSVG_ATTR_STROKE_DASHARRAY,
+	NSVG_ATTR_STROKE_DASHOFFSET,
+	NSVG_ATTR_STROKE_OPACITY,
+	NSVG_ATTR_STROKE_LINECAP,
+	NSVG_ATTR_STROKE_LINEJOIN,
+	NSVG_ATTR_STROKE_MITERLIMIT,
+	NSVG_ATTR_FILL_RULE,
+	NSVG_ATTR_FONT_SIZE,
+	NSVG_ATTR_TRANSFORM,
+	NSVG_ATTR_STOP_COLOR,
+	NSVG_ATTR_STOP_OPACITY,
+	NSVG_ATTR_OFFSET,
+	NSVG_ATTR_ID
+};
+
+static int nsvg__attrName(const char* name)
+{
+	switch (strlen(name)) {
+		case 2:
+			if (memcmp(name, "id", 2) == 0) return NSVG_ATTR_ID;
+			break;
+		case 4:
+			if (memcmp(name, "fill", 4) == 0) return NSVG_ATTR_FILL;
+			break;
+		case 5:
+			if (memcmp(name, "style", 5) == 0) return NSVG_ATTR_STYLE;
+			break;
+		case 6:
+			if (memcmp(name, "stroke", 6) == 0) return NSVG_ATTR_STROKE;
+			if (memcmp(name, "offset", 6) == 0) return NSVG_ATTR_OFFSET;
+			break;
+		case 7:
+			if (memcmp(name, "display", 7) == 0) return NSVG_ATTR_DISPLAY;
+			if (memcmp(name, "opacity", 7) == 0) return NSVG_ATTR_OPACITY;
+			break;
+		case 9:
+			if (memcmp(name, "fill-rule", 9) == 0) return NSVG_ATTR_FILL_RULE;
+			if (memcmp(name, "font-size", 9) == 0) return NSVG_ATTR_FONT_SIZE;
+			if (memcmp(name, "transform", 9) == 0) return NSVG_ATTR_TRANSFORM;
+			break;
+		case 10:
+			if (memcmp(name, "stop-color", 10) == 0) return NSVG_ATTR_STOP_COLOR;
+			break;
+		case 12:
+			if (memcmp(name, "fill-opacity", 12) == 0) return NSVG_ATTR_FILL_OPACITY;
+			if (memcmp(name, "stroke-width", 12) == 0) return NSVG_ATTR_STROKE_WIDTH;
+			if (memcmp(name, "stop-opacity", 12) == 0) return NSVG_ATTR_STOP_OPACITY;
+			break;
+		case 14:
+			if (memcmp(name, "stroke-opacity", 14) == 0) return NSVG_ATTR_STROKE_OPACITY;
+			if (memcmp(name, "stroke-linecap", 14) == 0) return NSVG_ATTR_STROKE_LINECAP;
+			break;
+		case 15:
+			if (memcmp(name, "stroke-linejoin", 15) == 0) return NSVG_ATTR_STROKE_LINEJOIN;
+			break;
+		case 16:
+			if (memcmp(name, "stroke-dasharray", 16) == 0) return NSVG_ATTR_STROKE_DASHARRAY;
+			break;
+		case 17:
+			if (memcmp(name, "stroke-dashoffset", 17) == 0) return NSVG_ATTR_STROKE_DASHOFFSET;
+			if (memcmp(name, "stroke-miterlimit", 17) == 0) return NSVG_ATTR_STROKE_MITERLIMIT;
+			break;
+	}
+	return NSVG_ATTR_UNKNOWN;
+}
+
 static int nsvg__parseAttr(NSVGparser* p, const char* name, const char* value)
 {
 	float xform[6];
 	NSVGattrib* attr = nsvg__getAttr(p);
 	if (!attr) return 0;
 
-	if (strcmp(name, "style") == 0) {
-		nsvg__parseStyle(p, value);
-	} else if (strcmp(name, "display") == 0) {
-		if (strcmp(value, "none") == 0)
-			attr->visible = 0;
-		// Don't reset ->visible on display:inline, one display:none hides the whole subtree
-
-	} else if (strcmp(name, "fill") == 0) {
-		if (strcmp(value, "none") == 0) {
-			attr->hasFill = 0;
-		} else if (strncmp(value, "url(", 4) == 0) {
-			attr->hasFill = 2;
-			nsvg__parseUrl(attr->fillGradient, value);
-		} else {
-			attr->hasFill = 1;
-			attr->fillColor = nsvg__parseColor(value);
-		}
-	} else if (strcmp(name, "opacity") == 0) {
-		attr->opacity = nsvg__parseOpacity(value);
-	} else if (strcmp(name, "fill-opacity") == 0) {
-		attr->fillOpacity = nsvg__parseOpacity(value);
-	} else if (strcmp(name, "stroke") == 0) {
-		if (strcmp(value, "none") == 0) {
-			attr->hasStroke = 0;
-		} else if (strncmp(value, "url(", 4) == 0) {
-			attr->hasStroke = 2;
-			nsvg__parseUrl(attr->strokeGradient, value);
-		} else {
-			attr->hasStroke = 1;
-			attr->strokeColor = nsvg__parseColor(value);
-		}
-	} else if (strcmp(name, "stroke-width") == 0) {
-		attr->strokeWidth = nsvg__parseCoordinate(p, value, 0.0f, nsvg__actualLength(p));
-	} else if (strcmp(name, "stroke-dasharray") == 0) {
-		attr->strokeDashCount = nsvg__parseStrokeDashArray(p, value, attr->strokeDashArray);
-	} else if (strcmp(name, "stroke-dashoffset") == 0) {
-		attr->strokeDashOffset = nsvg__parseCoordinate(p, value, 0.0f, nsvg__actualLength(p));
-	} else if (strcmp(name, "stroke-opacity") == 0) {
-		attr->strokeOpacity = nsvg__parseOpacity(value);
-	} else if (strcmp(name, "stroke-linecap") == 0) {
-		attr->strokeLineCap = nsvg__parseLineCap(value);
-	} else if (strcmp(name, "stroke-linejoin") == 0) {
-		attr->strokeLineJoin = nsvg__parseLineJoin(value);
-	} else if (strcmp(name, "stroke-miterlimit") == 0) {
-		attr->miterLimit = nsvg__parseMiterLimit(value);
-	} else if (strcmp(name, "fill-rule") == 0) {
-		attr->fillRule = nsvg__parseFillRule(value);
-	} else if (strcmp(name, "font-size") == 0) {
-		attr->fontSize = nsvg__parseCoordinate(p, value, 0.0f, nsvg__actualLength(p));
-	} else if (strcmp(name, "transform") == 0) {
-		nsvg__parseTransform(xform, value);
-		nsvg__xformPremultiply(attr->xform, xform);
-	} else if (strcmp(name, "stop-color") == 0) {
-		attr->stopColor = nsvg__parseColor(value);
-	} else if (strcmp(name, "stop-opacity") == 0) {
-		attr->stopOpacity = nsvg__parseOpacity(value);
-	} else if (strcmp(name, "offset") == 0) {
-		attr->stopOffset = nsvg__parseCoordinate(p, value, 0.0f, 1.0f);
-	} else if (strcmp(name, "id") == 0) {
-		strncpy(attr->id, value, 63);
-		attr->id[63] = '\0';
-	} else {
-		return 0;
+	switch (nsvg__attrName(name)) {
+		case NSVG_ATTR_STYLE:
+			nsvg__parseStyle(p, value);
+			break;
+		case NSVG_ATTR_DISPLAY:
+			if (strcmp(value, "none") == 0)
+				attr->visible = 0;
+			// Don't reset ->visible on display:inline, one display:none hides the whole subtree
+			break;
+		case NSVG_ATTR_FILL:
+			if (strcmp(value, "none") == 0) {
+				attr->hasFill = 0;
+			} else if (strncmp(value, "url(", 4) == 0) {
+				attr->hasFill = 2;
+				nsvg__parseUrl(attr->fillGradient, value);
+			} else {
+				attr->hasFill = 1;
+				attr->fillColor = nsvg__parseColor(value);
+			}
+			break;
+		case NSVG_ATTR_OPACITY:
+			attr->opacity = nsvg__parseOpacity(value);
+			break;
+		case NSVG_ATTR_FILL_OPACITY:
+			attr->fillOpacity = nsvg__parseOpacity(value);
+			break;
+		case NSVG_ATTR_STROKE:
+			if (strcmp(value, "none") == 0) {
+				attr->hasStroke = 0;
+			} else if (strncmp(value, "url(", 4) == 0) {
+				attr->hasStroke = 2;
+				nsvg__parseUrl(attr->strokeGradient, value);
+			} else {
+				attr->hasStroke = 1;
+				attr->strokeColor = nsvg__parseColor(value);
+			}
+			break;
+		case NSVG_ATTR_STROKE_WIDTH:
+			attr->strokeWidth = nsvg__parseCoordinate(p, value, 0.0f, nsvg__actualLength(p));
+			break;
+		case NSVG_ATTR_STROKE_DASHARRAY:
+			attr->strokeDashCount = nsvg__parseStrokeDashArray(p, value, attr->strokeDashArray);
+			break;
+		case NSVG_ATTR_STROKE_DASHOFFSET:
+			attr->strokeDashOffset = nsvg__parseCoordinate(p, value, 0.0f, nsvg__actualLength(p));
+			break;
+		case NSVG_ATTR_STROKE_OPACITY:
+			attr->strokeOpacity = nsvg__parseOpacity(value);
+			break;
+		case NSVG_ATTR_STROKE_LINECAP:
+			attr->strokeLineCap = nsvg__parseLineCap(value);
+			break;
+		case NSVG_ATTR_STROKE_LINEJOIN:
+			attr->strokeLineJoin = nsvg__parseLineJoin(value);
+			break;
+		case NSVG_ATTR_STROKE_MITERLIMIT:
+			attr->miterLimit = nsvg__parseMiterLimit(value);
+			break;
+		case NSVG_ATTR_FILL_RULE:
+			attr->fillRule = nsvg__parseFillRule(value);
+			break;
+		case NSVG_ATTR_FONT_SIZE:
+			attr->fontSize = nsvg__parseCoordinate(p, value, 0.0f, nsvg__actualLength(p));
+			break;
+		case NSVG_ATTR_TRANSFORM:
+			nsvg__parseTransform(xform, value);
+			nsvg__xformPremultiply(attr->xform, xform);
+			break;
+		case NSVG_ATTR_STOP_COLOR:
+			attr->stopColor = nsvg__parseColor(value);
+			break;
+		case NSVG_ATTR_STOP_OPACITY:
+			attr->stopOpacity = nsvg__parseOpacity(value);
+			break;
+		case NSVG_ATTR_OFFSET:
+			attr->stopOffset = nsvg__parseCoordinate(p, value, 0.0f, 1.0f);
+			break;
+		case NSVG_ATTR_ID:
+			strncpy(attr->id, value, 63);
+			attr->id[63] = '\0';
+			break;
+		default:
+			return 0;
 	}
 	return 1;
 }
@@ -2270,6 +2557,7 @@ static void nsvg__parsePath(NSVGparser* p, const char** attr)
 	char closedFlag;
 	int i;
 	char item[64];
+	double val;
 
 	for (i = 0; attr[i]; i += 2) {
 		if (strcmp(attr[i], "d") == 0) {
@@ -2295,12 +2583,14 @@ static void nsvg__parsePath(NSVGparser* p, const char** attr)
 			item[0] = '\0';
 			if ((cmd == 'A' || cmd == 'a') && (nargs == 3 || nargs == 4))
 				s = nsvg__getNextPathItemWhenArcFlag(s, item);
-			if (!*item)
-				s = nsvg__getNextPathItem(s, item);
+			if (*item)
+				val = item[0] - '0';  // an arc flag.
+			else
+				s = nsvg__getNextPathItem(s, item, &val);
 			if (!*item) break;
 			if (cmd != '\0' && nsvg__isCoordinate(item)) {
 				if (nargs < 10)
-					args[nargs++] = (float)nsvg__atof(item);
+					args[nargs++] = (float)val;
 				if (nargs >= rargs) {
 					switch (cmd) {
 						case 'm':
@@ -2557,6 +2847,7 @@ static void nsvg__parsePoly(NSVGparser* p, const char** attr, int closeFlag)
 	float args[2];
 	int nargs, npts = 0;
 	char item[64];
+	double val;
 
 	nsvg__resetPath(p);
 
@@ -2566,8 +2857,8 @@ static void nsvg__parsePoly(NSVGparser* p, const char** attr, int closeFlag)
 				s = attr[i + 1];
 				nargs = 0;
 				while (*s) {
-					s = nsvg__getNextPathItem(s, item);
-					args[nargs++] = (float)nsvg__atof(item);
+					s = nsvg__getNextPathItem(s, item, &val);
+					args[nargs++] = (float)val;
 					if (nargs >= 2) {
 						if (npts == 0)
 							nsvg__moveTo(p, args[0], args[1]);
@@ -2597,21 +2888,21 @@ static void nsvg__parseSVG(NSVGparser* p, const char** attr)
 				p->image->height = nsvg__parseCoordinate(p, attr[i + 1], 0.0f, 0.0f);
 			} else if (strcmp(attr[i], "viewBox") == 0) {
 				const char *s = attr[i + 1];
-				char buf[64];
-				s = nsvg__parseNumber(s, buf, 64);
-				p->viewMinx = nsvg__atof(buf);
+				double val;
+				s = nsvg__parseNumberValue(s, &val);
+				p->viewMinx = (float)val;
 				while (*s && (nsvg__isspace(*s) || *s == '%' || *s == ',')) s++;
 				if (!*s) return;
-				s = nsvg__parseNumber(s, buf, 64);
-				p->viewMiny = nsvg__atof(buf);
+				s = nsvg__parseNumberValue(s, &val);
+				p->viewMiny = (float)val;
 				while (*s && (nsvg__isspace(*s) || *s == '%' || *s == ',')) s++;
 				if (!*s) return;
-				s = nsvg__parseNumber(s, buf, 64);
-				p->viewWidth = nsvg__atof(buf);
+				s = nsvg__parseNumberValue(s, &val);
+				p->viewWidth = (float)val;
 				while (*s && (nsvg__isspace(*s) || *s == '%' || *s == ',')) s++;
 				if (!*s) return;
-				s = nsvg__parseNumber(s, buf, 64);
-				p->viewHeight = nsvg__atof(buf);
+				s = nsvg__parseNumberValue(s, &val);
+				p->viewHeight = (float)val;
 			} else if (strcmp(attr[i], "preserveAspectRatio") == 0) {
 				if (strstr(attr[i + 1], "none") != 0) {
 					// No uniform scaling
@@ -2753,65 +3044,131 @@ static void nsvg__parseGradientStop(NSVGparser* p, const char** attr)
 	stop->offset = curAttr->stopOffset;
 }
 
+enum NSVGelementName {
+	NSVG_ELEMENT_UNKNOWN = 0,
+	NSVG_ELEMENT_G,
+	NSVG_ELEMENT_PATH,
+	NSVG_ELEMENT_RECT,
+	NSVG_ELEMENT_CIRCLE,
+	NSVG_ELEMENT_ELLIPSE,
+	NSVG_ELEMENT_LINE,
+	NSVG_ELEMENT_POLYLINE,
+	NSVG_ELEMENT_POLYGON,
+	NSVG_ELEMENT_LINEAR_GRADIENT,
+	NSVG_ELEMENT_RADIAL_GRADIENT,
+	NSVG_ELEMENT_STOP,
+	NSVG_ELEMENT_DEFS,
+	NSVG_ELEMENT_SVG
+};
+
+static int nsvg__elementName(const char* name)
+{
+	switch (strlen(name)) {
+		case 1:
+			if (name[0] == 'g') return NSVG_ELEMENT_G;
+			break;
+		case 3:
+			if (memcmp(name, "svg", 3) == 0) return NSVG_ELEMENT_SVG;
+			break;
+		case 4:
+			if (memcmp(name, "path", 4) == 0) return NSVG_ELEMENT_PATH;
+			if (memcmp(name, "rect", 4) == 0) return NSVG_ELEMENT_RECT;
+			if (memcmp(name, "line", 4) == 0) return NSVG_ELEMENT_LINE;
+			if (memcmp(name, "stop", 4) == 0) return NSVG_ELEMENT_STOP;
+			if (memcmp(name, "defs", 4) == 0) return NSVG_ELEMENT_DEFS;
+			break;
+		case 6:
+			if (memcmp(name, "circle", 6) == 0) return NSVG_ELEMENT_CIRCLE;
+			break;
+		case 7:
+			if (memcmp(name, "ellipse", 7) == 0) return NSVG_ELEMENT_ELLIPSE;
+			if (memcmp(name, "polygon", 7) == 0) return NSVG_ELEMENT_POLYGON;
+			break;
+		case 8:
+			if (memcmp(name, "polyline", 8) == 0) return NSVG_ELEMENT_POLYLINE;
+			break;
+		case 14:
+			if (memcmp(name, "linearGradient", 14) == 0) return NSVG_ELEMENT_LINEAR_GRADIENT;
+			if (memcmp(name, "radialGradient", 14) == 0) return NSVG_ELEMENT_RADIAL_GRADIENT;
+			break;
+	}
+	return NSVG_ELEMENT_UNKNOWN;
+}
+
 static void nsvg__startElement(void* ud, const char* el, const char** attr)
 {
 	NSVGparser* p = (NSVGparser*)ud;
+	int element = nsvg__elementName(el);
 
 	if (p->defsFlag) {
 		// Skip everything but gradients in defs
-		if (strcmp(el, "linearGradient") == 0) {
+		if (element == NSVG_ELEMENT_LINEAR_GRADIENT) {
 			nsvg__parseGradient(p, attr, NSVG_PAINT_LINEAR_GRADIENT);
-		} else if (strcmp(el, "radialGradient") == 0) {
+		} else if (element == NSVG_ELEMENT_RADIAL_GRADIENT) {
 			nsvg__parseGradient(p, attr, NSVG_PAINT_RADIAL_GRADIENT);
-		} else if (strcmp(el, "stop") == 0) {
+		} else if (element == NSVG_ELEMENT_STOP) {
 			nsvg__parseGradientStop(p, attr);
 		}
 		return;
 	}
 
-	if (strcmp(el, "g") == 0) {
-		nsvg__pushAttr(p);
-		nsvg__parseAttribs(p, attr);
-	} else if (strcmp(el, "path") == 0) {
-		if (p->pathFlag)	// Do not allow nested paths.
-			return;
-		nsvg__pushAttr(p);
-		nsvg__parsePath(p, attr);
-		nsvg__popAttr(p);
-	} else if (strcmp(el, "rect") == 0) {
-		nsvg__pushAttr(p);
-		nsvg__parseRect(p, attr);
-		nsvg__popAttr(p);
-	} else if (strcmp(el, "circle") == 0) {
-		nsvg__pushAttr(p);
-		nsvg__parseCircle(p, attr);
-		nsvg__popAttr(p);
-	} else if (strcmp(el, "ellipse") == 0) {
-		nsvg__pushAttr(p);
-		nsvg__parseEllipse(p, attr);
-		nsvg__popAttr(p);
-	} else if (strcmp(el, "line") == 0)  {
-		nsvg__pushAttr(p);
-		nsvg__parseLine(p, attr);
-		nsvg__popAttr(p);
-	} else if (strcmp(el, "polyline") == 0)  {
-		nsvg__pushAttr(p);
-		nsvg__parsePoly(p, attr, 0);
-		nsvg__popAttr(p);
-	} else if (strcmp(el, "polygon") == 0)  {
-		nsvg__pushAttr(p);
-		nsvg__parsePoly(p, attr, 1);
-		nsvg__popAttr(p);
-	} else  if (strcmp(el, "linearGradient") == 0) {
-		nsvg__parseGradient(p, attr, NSVG_PAINT_LINEAR_GRADIENT);
-	} else if (strcmp(el, "radialGradient") == 0) {
-		nsvg__parseGradient(p, attr, NSVG_PAINT_RADIAL_GRADIENT);
-	} else if (strcmp(el, "stop") == 0) {
-		nsvg__parseGradientStop(p, attr);
-	} else if (strcmp(el, "defs") == 0) {
-		p->defsFlag = 1;
-	} else if (strcmp(el, "svg") == 0) {
-		nsvg__parseSVG(p, attr);
+	switch (element) {
+		case NSVG_ELEMENT_G:
+			nsvg__pushAttr(p);
+			nsvg__parseAttribs(p, attr);
+			break;
+		case NSVG_ELEMENT_PATH:
+			if (p->pathFlag)	// Do not allow nested paths.
+				return;
+			nsvg__pushAttr(p);
+			nsvg__parsePath(p, attr);
+			nsvg__popAttr(p);
+			break;
+		case NSVG_ELEMENT_RECT:
+			nsvg__pushAttr(p);
+			nsvg__parseRect(p, attr);
+			nsvg__popAttr(p);
+			break;
+		case NSVG_ELEMENT_CIRCLE:
+			nsvg__pushAttr(p);
+			nsvg__parseCircle(p, attr);
+			nsvg__popAttr(p);
+			break;
+		case NSVG_ELEMENT_ELLIPSE:
+			nsvg__pushAttr(p);
+			nsvg__parseEllipse(p, attr);
+			nsvg__popAttr(p);
+			break;
+		case NSVG_ELEMENT_LINE:
+			nsvg__pushAttr(p);
+			nsvg__parseLine(p, attr);
+			nsvg__popAttr(p);
+			break;
+		case NSVG_ELEMENT_POLYLINE:
+			nsvg__pushAttr(p);
+			nsvg__parsePoly(p, attr, 0);
+			nsvg__popAttr(p);
+			break;
+		case NSVG_ELEMENT_POLYGON:
+			nsvg__pushAttr(p);
+			nsvg__parsePoly(p, attr, 1);
+			nsvg__popAttr(p);
+			break;
+		case NSVG_ELEMENT_LINEAR_GRADIENT:
+			nsvg__parseGradient(p, attr, NSVG_PAINT_LINEAR_GRADIENT);
+			break;
+		case NSVG_ELEMENT_RADIAL_GRADIENT:
+			nsvg__parseGradient(p, attr, NSVG_PAINT_RADIAL_GRADIENT);
+			break;
+		case NSVG_ELEMENT_STOP:
+			nsvg__parseGradientStop(p, attr);
+			break;
+		case NSVG_ELEMENT_DEFS:
+			p->defsFlag = 1;
+			break;
+		case NSVG_ELEMENT_SVG:
+			nsvg__parseSVG(p, attr);
+			break;
 	}
 }
 
@@ -2819,12 +3176,16 @@ static void nsvg__endElement(void* ud, const char* el)
 {
 	NSVGparser* p = (NSVGparser*)ud;
 
-	if (strcmp(el, "g") == 0) {
-		nsvg__popAttr(p);
-	} else if (strcmp(el, "path") == 0) {
-		p->pathFlag = 0;
-	} else if (strcmp(el, "defs") == 0) {
-		p->defsFlag = 0;
+	switch (nsvg__elementName(el)) {
+		case NSVG_ELEMENT_G:
+			nsvg__popAttr(p);
+			break;
+		case NSVG_ELEMENT_PATH:
+			p->pathFlag = 0;
+			break;
+		case NSVG_ELEMENT_DEFS:
+			p->defsFlag = 0;
+			break;
 	}
 }
 
@@ -2996,10 +3357,28 @@ static void nsvg__createGradients(NSVGparser* p)
 	}
 }
 
+// ControllerImage: the end of nsvgParse(), shared with nsvgParseConst().
+static NSVGimage* nsvg__finishParse(NSVGparser* p, const char* units)
+{
+	NSVGimage* ret = 0;
+
+	// Create gradients after all definitions have been parsed
+	nsvg__createGradients(p);
+
+	// Scale to viewBox
+	nsvg__scaleToViewbox(p, units);
+
+	ret = p->image;
+	p->image = NULL;
+
+	nsvg__deleteParser(p);
+
+	return ret;
+}
+
 NSVGimage* nsvgParse(char* input, const char* units, float dpi)
 {
 	NSVGparser* p;
-	NSVGimage* ret = 0;
 
 	p = nsvg__createParser();
 	if (p == NULL) {
@@ -3009,18 +3388,25 @@ NSVGimage* nsvgParse(char* input, const char* units, float dpi)
 
 	nsvg__parseXML(input, nsvg__startElement, nsvg__endElement, nsvg__content, p);
 
-	// Create gradients after all definitions have been parsed
-	nsvg__createGradients(p);
+	return nsvg__finishParse(p, units);
+}
 
-	// Scale to viewBox
-	nsvg__scaleToViewbox(p, units);
+NSVGimage* nsvgParseConst(const char* input, size_t length, const char* units, float dpi)
+{
+	NSVGparser* p;
 
-	ret = p->image;
-	p->image = NULL;
+	p = nsvg__createParser();
+	if (p == NULL) {
+		return NULL;
+	}
+	p->dpi = dpi;
 
-	nsvg__deleteParser(p);
+	if (!nsvg__parseXMLConst(input, length, nsvg__startElement, nsvg__endElement, nsvg__content, p)) {
+		nsvg__deleteParser(p);
+		return NULL;
+	}
 
-	return ret;
+	return nsvg__finishParse(p, units);
 }
 
 #ifndef NANOSVG_SKIP_STDIO  // ControllerImage
@@ -3086,18 +3472,9 @@ error:
 
 void nsvgDelete(NSVGimage* image)
 {
-	NSVGshape *snext, *shape;
+	// ControllerImage: the image lives in its own arena, with everything else.
 	if (image == NULL) return;
-	shape = image->shapes;
-	while (shape != NULL) {
-		snext = shape->next;
-		nsvg__deletePaths(shape->paths);
-		nsvg__deletePaint(&shape->fill);
-		nsvg__deletePaint(&shape->stroke);
-		free(shape);
-		shape = snext;
-	}
-	free(image);
+	nsvg__arenaFree(image->arena);
 }
 
 #endif // NANOSVG_IMPLEMENTATION
@@ -64,9 +64,49 @@ void nsvgRasterize(NSVGrasterizer* r,
 				   NSVGimage* image, float tx, float ty, float scale,
 				   unsigned char* dst, int w, int h, int stride);
 
+// ControllerImage: Same as nsvgRasterize, but with separate horizontal and vertical scales.
+//   sx,sy - image scale along each axis
+void nsvgRasterizeXY(NSVGrasterizer* r,
+				   NSVGimage* image, float tx, float ty, float sx, float sy,
+				   unsigned char* dst, int w, int h, int stride);
+
 // Deletes rasterizer context.
 void nsvgDeleteRasterizer(NSVGrasterizer*);
 
+// ControllerImage: A packed 16 or 32-bit pixel format to write instead of RGBA
+// bytes. Each pixel is written as one native-endian value; channels with zero
+// bits are dropped. Conversion happens in the same pass that unpremultiplies
+// alpha, so it doesn't touch the output an extra time.
+typedef struct NSVGpixelFormat {
+	int bytesPerPixel;		// 2 or 4.
+	unsigned char rbits, gbits, bbits, abits;	// 8 or less.
+	unsigned char rshift, gshift, bshift, ashift;
+	int useColorKey;		// if abits is zero, mostly transparent pixels become colorKey.
+	unsigned int colorKey;
+} NSVGpixelFormat;
+
+// ControllerImage: Sets the pixel format later rasterization writes, or NULL for RGBA bytes (the default).
+void nsvgSetPixelFormat(NSVGrasterizer* r, const NSVGpixelFormat* format);
+
+// ControllerImage: Flattens and sorts the edges of every shape in an image at
+// a given offset and scale, so repeated rasterization at that scale can skip
+// straight to filling scanlines. The cache is a single allocation.
+//   r - pointer to rasterizer context (used as scratch space)
+//   image - pointer to image whose edges are cached
+//   tx,ty - image offset (applied after scaling)
+//   sx,sy - image scale along each axis
+typedef struct NSVGedgeCache NSVGedgeCache;
+NSVGedgeCache* nsvgCreateEdgeCache(NSVGrasterizer* r, NSVGimage* image, float tx, float ty, float sx, float sy);
+
+// ControllerImage: Same as nsvgRasterizeXY, but uses edges from nsvgCreateEdgeCache.
+// The image must be the same one (or a reparse of the same SVG) the cache was made from.
+void nsvgRasterizeEdgeCache(NSVGrasterizer* r,
+				   NSVGimage* image, NSVGedgeCache* cache,
+				   unsigned char* dst, int w, int h, int stride);
+
+// ControllerImage: Deletes an edge cache.
+void nsvgDeleteEdgeCache(NSVGedgeCache* cache);
+
 
 #ifndef NANOSVGRAST_CPLUSPLUS
 #ifdef __cplusplus
@@ -82,6 +122,12 @@ void nsvgDeleteRasterizer(NSVGrasterizer*);
 #include <string.h>
 #endif  // ControllerImage
 
+// ControllerImage: use SSE2 for gradients where it's always available, unless told not to.
+#if !defined(NSVG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define NSVG__SSE2 1
+#include <emmintrin.h>
+#endif
+
 #define NSVG__SUBSAMPLES	5
 #define NSVG__FIXSHIFT		10
 #define NSVG__FIX			(1 << NSVG__FIXSHIFT)
@@ -150,6 +196,15 @@ struct NSVGrasterizer
 
 	unsigned char* bitmap;
 	int width, height, stride;
+
+	// ControllerImage: with a 16-bit pixel format, we rasterize RGBA into `converted`, then convert into `output`.
+	// 32-bit formats are rasterized straight into the output and converted in place.
+	int hasFormat;
+	NSVGpixelFormat format;
+	unsigned char* converted;
+	size_t cconverted;
+	unsigned char* output;
+	int outputStride;
 };
 
 NSVGrasterizer* nsvgCreateRasterizer(void)
@@ -168,6 +223,17 @@ error:
 	return NULL;
 }
 
+void nsvgSetPixelFormat(NSVGrasterizer* r, const NSVGpixelFormat* format)
+{
+	if (format != NULL) {
+		r->hasFormat = 1;
+		memcpy(&r->format, format, sizeof(NSVGpixelFormat));
+	} else {
+		r->hasFormat = 0;
+		memset(&r->format, 0, sizeof(NSVGpixelFormat));
+	}
+}
+
 void nsvgDeleteRasterizer(NSVGrasterizer* r)
 {
 	NSVGmemPage* p;
@@ -185,6 +251,7 @@ void nsvgDeleteRasterizer(NSVGrasterizer* r)
 	if (r->points) free(r->points);
 	if (r->points2) free(r->points2);
 	if (r->scanline) free(r->scanline);
+	if (r->converted) free(r->converted);
 
 	free(r);
 }
@@ -373,7 +440,7 @@ static void nsvg__flattenCubicBez(NSVGrasterizer* r,
 	nsvg__flattenCubicBez(r, x1234,y1234, x234,y234, x34,y34, x4,y4, level+1, type);
 }
 
-static void nsvg__flattenShape(NSVGrasterizer* r, NSVGshape* shape, float scale)
+static void nsvg__flattenShape(NSVGrasterizer* r, NSVGshape* shape, float sx, float sy)
 {
 	int i, j;
 	NSVGpath* path;
@@ -381,13 +448,13 @@ static void nsvg__flattenShape(NSVGrasterizer* r, NSVGshape* shape, float scale)
 	for (path = shape->paths; path != NULL; path = path->next) {
 		r->npoints = 0;
 		// Flatten path
-		nsvg__addPathPoint(r, path->pts[0]*scale, path->pts[1]*scale, 0);
+		nsvg__addPathPoint(r, path->pts[0]*sx, path->pts[1]*sy, 0);
 		for (i = 0; i < path->npts-1; i += 3) {
 			float* p = &path->pts[i*2];
-			nsvg__flattenCubicBez(r, p[0]*scale,p[1]*scale, p[2]*scale,p[3]*scale, p[4]*scale,p[5]*scale, p[6]*scale,p[7]*scale, 0, 0);
+			nsvg__flattenCubicBez(r, p[0]*sx,p[1]*sy, p[2]*sx,p[3]*sy, p[4]*sx,p[5]*sy, p[6]*sx,p[7]*sy, 0, 0);
 		}
 		// Close path
-		nsvg__addPathPoint(r, path->pts[0]*scale, path->pts[1]*scale, 0);
+		nsvg__addPathPoint(r, path->pts[0]*sx, path->pts[1]*sy, 0);
 		// Build edges
 		for (i = 0, j = r->npoints-1; i < r->npoints; j = i++)
 			nsvg__addEdge(r, r->points[j].x, r->points[j].y, r->points[i].x, r->points[i].y);
@@ -737,7 +804,7 @@ static void nsvg__prepareStroke(NSVGrasterizer* r, float miterLimit, int lineJoi
 	}
 }
 
-static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float scale)
+static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float sx, float sy)
 {
 	int i, j, closed;
 	NSVGpath* path;
@@ -745,15 +812,16 @@ static void nsvg__flattenShapeStroke(NSVGrasterizer* r, NSVGshape* shape, float
 	float miterLimit = shape->miterLimit;
 	int lineJoin = shape->strokeLineJoin;
 	int lineCap = shape->strokeLineCap;
+	float scale = sx > sy ? sx : sy;  // ControllerImage: non-uniform scaling.
 	float lineWidth = shape->strokeWidth * scale;
 
 	for (path = shape->paths; path != NULL; path = path->next) {
 		// Flatten path
 		r->npoints = 0;
-		nsvg__addPathPoint(r, path->pts[0]*scale, path->pts[1]*scale, NSVG_PT_CORNER);
+		nsvg__addPathPoint(r, path->pts[0]*sx, path->pts[1]*sy, NSVG_PT_CORNER);
 		for (i = 0; i < path->npts-1; i += 3) {
 			float* p = &path->pts[i*2];
-			nsvg__flattenCubicBez(r, p[0]*scale,p[1]*scale, p[2]*scale,p[3]*scale, p[4]*scale,p[5]*scale, p[6]*scale,p[7]*scale, 0, NSVG_PT_CORNER);
+			nsvg__flattenCubicBez(r, p[0]*sx,p[1]*sy, p[2]*sx,p[3]*sy, p[4]*sx,p[5]*sy, p[6]*sx,p[7]*sy, 0, NSVG_PT_CORNER);
 		}
 		if (r->npoints < 2)
 			continue;
@@ -989,143 +1057,255 @@ static inline int nsvg__div255(int x)
     return ((x+1) * 257) >> 16;
 }
 
+// ControllerImage: blend one color over a run of pixels.
+static void nsvg__blendColorRun(unsigned char* dst, const unsigned char* cover, int count, unsigned int c)
+{
+	int i, cr, cg, cb, ca;
+	cr = c & 0xff;
+	cg = (c >> 8) & 0xff;
+	cb = (c >> 16) & 0xff;
+	ca = (c >> 24) & 0xff;
+
+	for (i = 0; i < count; i++) {
+		int r,g,b;
+		int a = nsvg__div255((int)cover[0] * ca);
+		int ia = 255 - a;
+		// Premultiply
+		r = nsvg__div255(cr * a);
+		g = nsvg__div255(cg * a);
+		b = nsvg__div255(cb * a);
+
+		// Blend over
+		r += nsvg__div255(ia * (int)dst[0]);
+		g += nsvg__div255(ia * (int)dst[1]);
+		b += nsvg__div255(ia * (int)dst[2]);
+		a += nsvg__div255(ia * (int)dst[3]);
+
+		dst[0] = (unsigned char)r;
+		dst[1] = (unsigned char)g;
+		dst[2] = (unsigned char)b;
+		dst[3] = (unsigned char)a;
+
+		cover++;
+		dst += 4;
+	}
+}
+
+// ControllerImage: blend a run of gradient colors, already looked up as indices into `colors`.
+static void nsvg__blendIndexedRun(unsigned char* dst, const unsigned char* cover, int count, const unsigned int* colors, const unsigned char* index)
+{
+	int i, cr, cg, cb, ca;
+	unsigned int c;
+
+	for (i = 0; i < count; i++) {
+		int r,g,b,a,ia;
+		c = colors[index[i]];
+		cr = (c) & 0xff;
+		cg = (c >> 8) & 0xff;
+		cb = (c >> 16) & 0xff;
+		ca = (c >> 24) & 0xff;
+
+		a = nsvg__div255((int)cover[0] * ca);
+		ia = 255 - a;
+
+		// Premultiply
+		r = nsvg__div255(cr * a);
+		g = nsvg__div255(cg * a);
+		b = nsvg__div255(cb * a);
+
+		// Blend over
+		r += nsvg__div255(ia * (int)dst[0]);
+		g += nsvg__div255(ia * (int)dst[1]);
+		b += nsvg__div255(ia * (int)dst[2]);
+		a += nsvg__div255(ia * (int)dst[3]);
+
+		dst[0] = (unsigned char)r;
+		dst[1] = (unsigned char)g;
+		dst[2] = (unsigned char)b;
+		dst[3] = (unsigned char)a;
+
+		cover++;
+		dst += 4;
+	}
+}
+
+// ControllerImage: gradient lookups are done in chunks this big, so the color index math can be done in bulk.
+#define NSVG__GRADIENT_CHUNK	64
+
+// ControllerImage: linear gradient color indices. This does the same float math, in the same order, as the
+// old per-pixel loop did (fx accumulates dx one pixel at a time), so the output doesn't change.
+static void nsvg__linearIndices(unsigned char* index, int count, float* fx, float dx, float t1, float fyt, float t5)
+{
+	float f = *fx;
+	int i;
+	for (i = 0; i < count; i++) {
+		float gy = f*t1 + fyt + t5;
+		index[i] = (unsigned char)(int)nsvg__clampf(gy*255.0f, 0, 255.0f);
+		f += dx;
+	}
+	*fx = f;
+}
+
+// ControllerImage: radial gradient color indices. This is where the sqrt goes, so do four at a time if we can.
+// Like nsvg__linearIndices, this matches the old per-pixel float math exactly.
+static void nsvg__radialIndices(unsigned char* index, int count, float* fx, float dx, const float* t, float fytx, float fyty)
+{
+	float f = *fx;
+	int i = 0;
+#ifdef NSVG__SSE2
+	const __m128 vt0 = _mm_set1_ps(t[0]), vt1 = _mm_set1_ps(t[1]);
+	const __m128 vt4 = _mm_set1_ps(t[4]), vt5 = _mm_set1_ps(t[5]);
+	const __m128 vfytx = _mm_set1_ps(fytx), vfyty = _mm_set1_ps(fyty);
+	const __m128 vzero = _mm_setzero_ps(), v255 = _mm_set1_ps(255.0f);
+	for (; i+4 <= count; i += 4) {
+		float f0 = f, f1 = f0 + dx, f2 = f1 + dx, f3 = f2 + dx;
+		__m128 vf = _mm_setr_ps(f0, f1, f2, f3);
+		__m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vf, vt0), vfytx), vt4);
+		__m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vf, vt1), vfyty), vt5);
+		__m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+		__m128i v = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(d, v255), vzero), v255));
+		v = _mm_packs_epi32(v, v);
+		v = _mm_packus_epi16(v, v);
+		{
+			int packed = _mm_cvtsi128_si32(v);
+			memcpy(&index[i], &packed, 4);
+		}
+		f = f3 + dx;
+	}
+#endif
+	for (; i < count; i++) {
+		float gx = f*t[0] + fytx + t[4];
+		float gy = f*t[1] + fyty + t[5];
+		float gd = sqrtf(gx*gx + gy*gy);
+		index[i] = (unsigned char)(int)nsvg__clampf(gd*255.0f, 0, 255.0f);
+		f += dx;
+	}
+	*fx = f;
+}
+
+// ControllerImage: clamp a (possibly huge) pixel position into [lo,hi] before turning it into an int.
+static int nsvg__clampPixel(double v, int lo, int hi)
+{
+	return v < (double)lo ? lo : (v > (double)hi ? hi : (int)v);
+}
+
 static void nsvg__scanlineSolid(unsigned char* dst, int count, unsigned char* cover, int x, int y,
-								float tx, float ty, float scale, NSVGcachedPaint* cache)
+								float tx, float ty, float sx, float sy, NSVGcachedPaint* cache)
 {
 
 	if (cache->type == NSVG_PAINT_COLOR) {
-		int i, cr, cg, cb, ca;
-		cr = cache->colors[0] & 0xff;
-		cg = (cache->colors[0] >> 8) & 0xff;
-		cb = (cache->colors[0] >> 16) & 0xff;
-		ca = (cache->colors[0] >> 24) & 0xff;
-
-		for (i = 0; i < count; i++) {
-			int r,g,b;
-			int a = nsvg__div255((int)cover[0] * ca);
-			int ia = 255 - a;
-			// Premultiply
-			r = nsvg__div255(cr * a);
-			g = nsvg__div255(cg * a);
-			b = nsvg__div255(cb * a);
-
-			// Blend over
-			r += nsvg__div255(ia * (int)dst[0]);
-			g += nsvg__div255(ia * (int)dst[1]);
-			b += nsvg__div255(ia * (int)dst[2]);
-			a += nsvg__div255(ia * (int)dst[3]);
-
-			dst[0] = (unsigned char)r;
-			dst[1] = (unsigned char)g;
-			dst[2] = (unsigned char)b;
-			dst[3] = (unsigned char)a;
-
-			cover++;
-			dst += 4;
-		}
+		nsvg__blendColorRun(dst, cover, count, cache->colors[0]);
 	} else if (cache->type == NSVG_PAINT_LINEAR_GRADIENT) {
 		// TODO: spread modes.
-		// TODO: plenty of opportunities to optimize.
-		float fx, fy, dx, gy;
+		// ControllerImage: the gradient is a straight ramp across the run, so the pixels before it reaches
+		// one end of the color table and after it reaches the other are all one color, and only the rest
+		// need a lookup.
+		float fx, fy, dx, fyt, g, dg;
 		float* t = cache->xform;
-		int i, cr, cg, cb, ca;
-		unsigned int c;
-
-		fx = ((float)x - tx) / scale;
-		fy = ((float)y - ty) / scale;
-		dx = 1.0f / scale;
-
-		for (i = 0; i < count; i++) {
-			int r,g,b,a,ia;
-			gy = fx*t[1] + fy*t[3] + t[5];
-			c = cache->colors[(int)nsvg__clampf(gy*255.0f, 0, 255.0f)];
-			cr = (c) & 0xff;
-			cg = (c >> 8) & 0xff;
-			cb = (c >> 16) & 0xff;
-			ca = (c >> 24) & 0xff;
-
-			a = nsvg__div255((int)cover[0] * ca);
-			ia = 255 - a;
-
-			// Premultiply
-			r = nsvg__div255(cr * a);
-			g = nsvg__div255(cg * a);
-			b = nsvg__div255(cb * a);
-
-			// Blend over
-			r += nsvg__div255(ia * (int)dst[0]);
-			g += nsvg__div255(ia * (int)dst[1]);
-			b += nsvg__div255(ia * (int)dst[2]);
-			a += nsvg__div255(ia * (int)dst[3]);
-
-			dst[0] = (unsigned char)r;
-			dst[1] = (unsigned char)g;
-			dst[2] = (unsigned char)b;
-			dst[3] = (unsigned char)a;
-
-			cover++;
-			dst += 4;
-			fx += dx;
+		unsigned char index[NSVG__GRADIENT_CHUNK];
+		int lo, hi, i, n;
+
+		fx = ((float)x - tx) / sx;
+		fy = ((float)y - ty) / sy;
+		dx = 1.0f / sx;
+		fyt = fy*t[3];
+
+		if (t[1] == 0.0f) {  // doesn't change along the run.
+			nsvg__blendColorRun(dst, cover, count, cache->colors[(int)nsvg__clampf((fyt + t[5])*255.0f, 0, 255.0f)]);
+			return;
+		}
+
+		// [lo,hi) is where it might not be clamped, with a couple pixels of slop on each side, so
+		// float error in where the ends land can't change which pixels get clamped.
+		g = (fx*t[1] + fyt + t[5]) * 255.0f;
+		dg = (t[1] / sx) * 255.0f;
+		{
+			double i0 = (0.0 - (double)g) / (double)dg;
+			double i1 = (255.0 - (double)g) / (double)dg;
+			if (i0 > i1) { double tmp = i0; i0 = i1; i1 = tmp; }
+			lo = nsvg__clampPixel(i0 - 2.0, 0, count);
+			hi = nsvg__clampPixel(i1 + 3.0, lo, count);
+		}
+
+		if (lo > 0) {
+			nsvg__blendColorRun(dst, cover, lo, cache->colors[dg > 0 ? 0 : 255]);
+			for (i = 0; i < lo; i++)
+				fx += dx;  // step it the same way the lookups do, so they land in the same place.
+		}
+
+		for (i = lo; i < hi; i += n) {
+			n = hi - i < NSVG__GRADIENT_CHUNK ? hi - i : NSVG__GRADIENT_CHUNK;
+			nsvg__linearIndices(index, n, &fx, dx, t[1], fyt, t[5]);
+			nsvg__blendIndexedRun(&dst[i*4], &cover[i], n, cache->colors, index);
 		}
+
+		if (hi < count)
+			nsvg__blendColorRun(&dst[hi*4], &cover[hi], count - hi, cache->colors[dg > 0 ? 255 : 0]);
 	} else if (cache->type == NSVG_PAINT_RADIAL_GRADIENT) {
 		// TODO: spread modes.
-		// TODO: plenty of opportunities to optimize.
 		// TODO: focus (fx,fy)
-		float fx, fy, dx, gx, gy, gd;
+		// ControllerImage: the run is a straight line through gradient space, so it's only inside the
+		// unit circle (where it isn't clamped to the last color) between the two places it crosses it.
+		float fx, fy, dx, fytx, fyty, gx, gy, dgx, dgy;
 		float* t = cache->xform;
-		int i, cr, cg, cb, ca;
-		unsigned int c;
-
-		fx = ((float)x - tx) / scale;
-		fy = ((float)y - ty) / scale;
-		dx = 1.0f / scale;
-
-		for (i = 0; i < count; i++) {
-			int r,g,b,a,ia;
-			gx = fx*t[0] + fy*t[2] + t[4];
-			gy = fx*t[1] + fy*t[3] + t[5];
-			gd = sqrtf(gx*gx + gy*gy);
-			c = cache->colors[(int)nsvg__clampf(gd*255.0f, 0, 255.0f)];
-			cr = (c) & 0xff;
-			cg = (c >> 8) & 0xff;
-			cb = (c >> 16) & 0xff;
-			ca = (c >> 24) & 0xff;
-
-			a = nsvg__div255((int)cover[0] * ca);
-			ia = 255 - a;
-
-			// Premultiply
-			r = nsvg__div255(cr * a);
-			g = nsvg__div255(cg * a);
-			b = nsvg__div255(cb * a);
-
-			// Blend over
-			r += nsvg__div255(ia * (int)dst[0]);
-			g += nsvg__div255(ia * (int)dst[1]);
-			b += nsvg__div255(ia * (int)dst[2]);
-			a += nsvg__div255(ia * (int)dst[3]);
-
-			dst[0] = (unsigned char)r;
-			dst[1] = (unsigned char)g;
-			dst[2] = (unsigned char)b;
-			dst[3] = (unsigned char)a;
-
-			cover++;
-			dst += 4;
-			fx += dx;
+		unsigned char index[NSVG__GRADIENT_CHUNK];
+		int lo = count, hi = count, i, n;
+
+		fx = ((float)x - tx) / sx;
+		fy = ((float)y - ty) / sy;
+		dx = 1.0f / sx;
+		fytx = fy*t[2];
+		fyty = fy*t[3];
+		gx = fx*t[0] + fytx + t[4];
+		gy = fx*t[1] + fyty + t[5];
+		dgx = t[0] / sx;
+		dgy = t[1] / sx;
+
+		{
+			// solve |(gx,gy) + i*(dgx,dgy)|^2 = 1 for i.
+			double a = (double)dgx*dgx + (double)dgy*dgy;
+			double b = 2.0 * ((double)gx*dgx + (double)gy*dgy);
+			double c = (double)gx*gx + (double)gy*gy - 1.0;
+			if (a < 1e-12) {
+				lo = 0;  // doesn't move; let the lookup below sort it out.
+				hi = count;
+			} else {
+				double disc = b*b - 4.0*a*c;
+				if (disc > 0.0) {
+					double sq = sqrt(disc);
+					lo = nsvg__clampPixel((-b - sq) / (2.0*a) - 2.0, 0, count);
+					hi = nsvg__clampPixel((-b + sq) / (2.0*a) + 3.0, lo, count);
+				}
+			}
+		}
+
+		if (lo > 0) {
+			nsvg__blendColorRun(dst, cover, lo, cache->colors[255]);
+			for (i = 0; i < lo; i++)
+				fx += dx;
 		}
+
+		for (i = lo; i < hi; i += n) {
+			n = hi - i < NSVG__GRADIENT_CHUNK ? hi - i : NSVG__GRADIENT_CHUNK;
+			nsvg__radialIndices(index, n, &fx, dx, t, fytx, fyty);
+			nsvg__blendIndexedRun(&dst[i*4], &cover[i], n, cache->colors, index);
+		}
+
+		if (hi < count)
+			nsvg__blendColorRun(&dst[hi*4], &cover[hi], count - hi, cache->colors[255]);
 	}
 }
 
-static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r, float tx, float ty, float scale, NSVGcachedPaint* cache, char fillRule)
+static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r, float tx, float ty, float sx, float sy, NSVGcachedPaint* cache, char fillRule)
 {
 	NSVGactiveEdge *active = NULL;
+	unsigned char* row = r->bitmap;  // ControllerImage: stepped, not y * stride, so big images don't overflow an int.
 	int y, s;
 	int e = 0;
 	int maxWeight = (255 / NSVG__SUBSAMPLES);  // weight per vertical scanline
 	int xmin, xmax;
 
-	for (y = 0; y < r->height; y++) {
+	for (y = 0; y < r->height; y++, row += r->stride) {
 		memset(r->scanline, 0, r->width);
 		xmin = r->width;
 		xmax = 0;
@@ -1199,69 +1379,206 @@ static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r, float tx, float ty, fl
 		if (xmin < 0) xmin = 0;
 		if (xmax > r->width-1) xmax = r->width-1;
 		if (xmin <= xmax) {
-			nsvg__scanlineSolid(&r->bitmap[y * r->stride] + xmin*4, xmax-xmin+1, &r->scanline[xmin], xmin, y, tx,ty, scale, cache);
+			nsvg__scanlineSolid(row + xmin*4, xmax-xmin+1, &r->scanline[xmin], xmin, y, tx,ty, sx, sy, cache);
+		}
+	}
+
+}
+
+// ControllerImage: (r * nsvg__unpremultiplyTable[a]) >> 16 is exactly r*255/a for every r and a, without dividing.
+static const unsigned int nsvg__unpremultiplyTable[256] = {
+	0u, 16711680u, 8355840u, 5570560u, 4177920u, 3342336u, 2785280u, 2387383u,
+	2088960u, 1856854u, 1671168u, 1519244u, 1392640u, 1285514u, 1193692u, 1114112u,
+	1044480u, 983040u, 928427u, 879563u, 835584u, 795795u, 759622u, 726595u,
+	696320u, 668468u, 642757u, 618952u, 596846u, 576265u, 557056u, 539087u,
+	522240u, 506415u, 491520u, 477477u, 464214u, 451668u, 439782u, 428505u,
+	417792u, 407602u, 397898u, 388644u, 379811u, 371371u, 363298u, 355568u,
+	348160u, 341055u, 334234u, 327680u, 321379u, 315315u, 309476u, 303849u,
+	298423u, 293188u, 288133u, 283249u, 278528u, 273962u, 269544u, 265265u,
+	261120u, 257103u, 253208u, 249429u, 245760u, 242199u, 238739u, 235376u,
+	232107u, 228928u, 225834u, 222823u, 219891u, 217035u, 214253u, 211541u,
+	208896u, 206318u, 203801u, 201346u, 198949u, 196608u, 194322u, 192089u,
+	189906u, 187772u, 185686u, 183645u, 181649u, 179696u, 177784u, 175913u,
+	174080u, 172286u, 170528u, 168805u, 167117u, 165463u, 163840u, 162250u,
+	160690u, 159159u, 157658u, 156184u, 154738u, 153319u, 151925u, 150556u,
+	149212u, 147891u, 146594u, 145319u, 144067u, 142835u, 141625u, 140435u,
+	139264u, 138114u, 136981u, 135868u, 134772u, 133694u, 132633u, 131589u,
+	130560u, 129548u, 128552u, 127571u, 126604u, 125652u, 124715u, 123791u,
+	122880u, 121984u, 121100u, 120228u, 119370u, 118523u, 117688u, 116865u,
+	116054u, 115253u, 114464u, 113685u, 112917u, 112159u, 111412u, 110674u,
+	109946u, 109227u, 108518u, 107818u, 107127u, 106444u, 105771u, 105105u,
+	104448u, 103800u, 103159u, 102526u, 101901u, 101283u, 100673u, 100070u,
+	99475u, 98886u, 98304u, 97730u, 97161u, 96600u, 96045u, 95496u,
+	94953u, 94417u, 93886u, 93362u, 92843u, 92330u, 91823u, 91321u,
+	90825u, 90334u, 89848u, 89368u, 88892u, 88422u, 87957u, 87496u,
+	87040u, 86590u, 86143u, 85701u, 85264u, 84831u, 84403u, 83979u,
+	83559u, 83143u, 82732u, 82324u, 81920u, 81521u, 81125u, 80733u,
+	80345u, 79961u, 79580u, 79203u, 78829u, 78459u, 78092u, 77729u,
+	77369u, 77013u, 76660u, 76310u, 75963u, 75619u, 75278u, 74941u,
+	74606u, 74275u, 73946u, 73620u, 73297u, 72977u, 72660u, 72345u,
+	72034u, 71724u, 71418u, 71114u, 70813u, 70514u, 70218u, 69924u,
+	69632u, 69344u, 69057u, 68773u, 68491u, 68211u, 67934u, 67659u,
+	67386u, 67116u, 66847u, 66581u, 66317u, 66055u, 65795u, 65536u,
+};
+
+static void nsvg__unpremultiplyPixels(unsigned char* row, int count)
+{
+	int x;
+	for (x = 0; x < count; x++) {
+		unsigned int a = row[3];
+		if (a != 0 && a != 255) {	// ControllerImage: these don't change.
+			unsigned int m = nsvg__unpremultiplyTable[a];
+			row[0] = (unsigned char)((row[0] * m) >> 16);
+			row[1] = (unsigned char)((row[1] * m) >> 16);
+			row[2] = (unsigned char)((row[2] * m) >> 16);
 		}
+		row += 4;
 	}
+}
 
+static void nsvg__unpremultiplyRow(unsigned char* row, int w)
+{
+	int x = 0;
+#ifdef NSVG__SSE2
+	// ControllerImage: most of an image is fully opaque or fully transparent, so skip those four pixels at a time.
+	const __m128i amask = _mm_set1_epi32((int)0xFF000000);
+	const __m128i zero = _mm_setzero_si128();
+	for (; x+4 <= w; x += 4) {
+		__m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)&row[x*4]), amask);
+		__m128i same = _mm_or_si128(_mm_cmpeq_epi32(a, amask), _mm_cmpeq_epi32(a, zero));
+		if (_mm_movemask_epi8(same) != 0xFFFF)
+			nsvg__unpremultiplyPixels(&row[x*4], 4);
+	}
+#endif
+	nsvg__unpremultiplyPixels(&row[x*4], w - x);
 }
 
-static void nsvg__unpremultiplyAlpha(unsigned char* image, int w, int h, int stride)
+// ControllerImage: this only reads neighbors with nonzero alpha, which defringing doesn't change,
+// so it works on one row at a time, as long as the rows around it are unpremultiplied already.
+static void nsvg__defringePixels(unsigned char* image, int x, int xend, int y, int w, int h, int stride)
 {
-	int x,y;
-
-	// Unpremultiply
-	for (y = 0; y < h; y++) {
-		unsigned char *row = &image[y*stride];
-		for (x = 0; x < w; x++) {
-			int r = row[0], g = row[1], b = row[2], a = row[3];
-			if (a != 0) {
-				row[0] = (unsigned char)(r*255/a);
-				row[1] = (unsigned char)(g*255/a);
-				row[2] = (unsigned char)(b*255/a);
+	unsigned char* row = &image[x*4];
+	for (; x < xend; x++) {
+		int r = 0, g = 0, b = 0, a = row[3], n = 0;
+		if (a == 0) {
+			if (x-1 > 0 && row[-1] != 0) {
+				r += row[-4];
+				g += row[-3];
+				b += row[-2];
+				n++;
+			}
+			if (x+1 < w && row[7] != 0) {
+				r += row[4];
+				g += row[5];
+				b += row[6];
+				n++;
+			}
+			if (y-1 > 0 && row[-stride+3] != 0) {
+				r += row[-stride];
+				g += row[-stride+1];
+				b += row[-stride+2];
+				n++;
+			}
+			if (y+1 < h && row[stride+3] != 0) {
+				r += row[stride];
+				g += row[stride+1];
+				b += row[stride+2];
+				n++;
+			}
+			if (n > 0) {
+				row[0] = (unsigned char)(r/n);
+				row[1] = (unsigned char)(g/n);
+				row[2] = (unsigned char)(b/n);
 			}
-			row += 4;
 		}
+		row += 4;
 	}
+}
 
-	// Defringe
-	for (y = 0; y < h; y++) {
-		unsigned char *row = &image[y*stride];
-		for (x = 0; x < w; x++) {
-			int r = 0, g = 0, b = 0, a = row[3], n = 0;
-			if (a == 0) {
-				if (x-1 > 0 && row[-1] != 0) {
-					r += row[-4];
-					g += row[-3];
-					b += row[-2];
-					n++;
-				}
-				if (x+1 < w && row[7] != 0) {
-					r += row[4];
-					g += row[5];
-					b += row[6];
-					n++;
-				}
-				if (y-1 > 0 && row[-stride+3] != 0) {
-					r += row[-stride];
-					g += row[-stride+1];
-					b += row[-stride+2];
-					n++;
-				}
-				if (y+1 < h && row[stride+3] != 0) {
-					r += row[stride];
-					g += row[stride+1];
-					b += row[stride+2];
-					n++;
-				}
-				if (n > 0) {
-					row[0] = (unsigned char)(r/n);
-					row[1] = (unsigned char)(g/n);
-					row[2] = (unsigned char)(b/n);
-				}
+static void nsvg__defringeRow(unsigned char* row, int y, int w, int h, int stride)
+{
+	int x = 0;
+#ifdef NSVG__SSE2
+	// ControllerImage: skip four pixels at a time if none of them are transparent, or if they and everything
+	// around them are. Only for pixels that have neighbors on all sides, so we don't read past the image.
+	if (y >= 1 && y+1 < h && w > 5) {
+		const __m128i amask = _mm_set1_epi32((int)0xFF000000);
+		const __m128i zero = _mm_setzero_si128();
+		nsvg__defringePixels(row, 0, 1, y, w, h, stride);
+		for (x = 1; x+4 < w; x += 4) {
+			const unsigned char* p = &row[x*4];
+			__m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)p), amask);
+			int transparent = _mm_movemask_epi8(_mm_cmpeq_epi32(a, zero));
+			if (transparent == 0) {
+				continue;
+			} else if (transparent == 0xFFFF && p[-1] == 0 && p[19] == 0) {
+				__m128i above = _mm_and_si128(_mm_loadu_si128((const __m128i*)(p - stride)), amask);
+				__m128i below = _mm_and_si128(_mm_loadu_si128((const __m128i*)(p + stride)), amask);
+				if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_or_si128(above, below), zero)) == 0xFFFF)
+					continue;
 			}
-			row += 4;
+			nsvg__defringePixels(row, x, x+4, y, w, h, stride);
+		}
+	}
+#endif
+	nsvg__defringePixels(row, x, w, y, w, h, stride);
+}
+
+// ControllerImage: pack a finished RGBA row into the requested pixel format.
+static void nsvg__convertRow(const NSVGpixelFormat* fmt, const unsigned char* src, unsigned char* dst, int w)
+{
+	int x;
+	for (x = 0; x < w; x++) {
+		unsigned int r = src[0], g = src[1], b = src[2], a = src[3];
+		unsigned int pixel = ((r >> (8 - fmt->rbits)) << fmt->rshift) |
+							 ((g >> (8 - fmt->gbits)) << fmt->gshift) |
+							 ((b >> (8 - fmt->bbits)) << fmt->bshift);
+		if (fmt->abits != 0) {
+			pixel |= (a >> (8 - fmt->abits)) << fmt->ashift;
+		} else if (fmt->useColorKey) {
+			if (a < 128) {
+				pixel = fmt->colorKey;
+			} else if (pixel == fmt->colorKey) {
+				pixel ^= 1u << fmt->bshift;  // don't let opaque pixels turn transparent by accident.
+			}
+		}
+
+		if (fmt->bytesPerPixel == 4) {
+			memcpy(dst, &pixel, 4);
+		} else {
+			unsigned short pixel16 = (unsigned short)pixel;
+			memcpy(dst, &pixel16, 2);
+		}
+		src += 4;
+		dst += fmt->bytesPerPixel;
+	}
+}
+
+// ControllerImage: unpremultiply and defringe in one pass, one row behind, since defringing a row needs
+// the row after it unpremultiplied already. If `dst` isn't NULL, each finished row is converted into it.
+// `dst` can be `image` itself, for 32-bit formats; then each row is converted one row later still, since
+// defringing the next row reads it as RGBA.
+static void nsvg__unpremultiplyAlpha(NSVGrasterizer* r, unsigned char* image, int w, int h, int stride,
+									 unsigned char* dst, int dstStride)
+{
+	int y;
+	int lag = (dst == image) ? 1 : 0;
+
+	if (h > 0)
+		nsvg__unpremultiplyRow(image, w);
+
+	for (y = 0; y < h; y++, image += stride) {
+		if (y+1 < h)
+			nsvg__unpremultiplyRow(image + stride, w);
+		nsvg__defringeRow(image, y, w, h, stride);
+		if (dst != NULL && y >= lag) {
+			nsvg__convertRow(&r->format, image - lag*stride, dst, w);
+			dst += dstStride;
 		}
 	}
+
+	if (dst != NULL && lag && h > 0)
+		nsvg__convertRow(&r->format, image - stride, dst, w);
 }
 
 
@@ -1367,15 +1684,74 @@ static void dumpEdges(NSVGrasterizer* r, const char* name)
 }
 */
 
-void nsvgRasterize(NSVGrasterizer* r,
-				   NSVGimage* image, float tx, float ty, float scale,
-				   unsigned char* dst, int w, int h, int stride)
+// ControllerImage: flatten, translate and sort one shape's fill or stroke edges into r->edges.
+static void nsvg__prepareEdges(NSVGrasterizer* r, NSVGshape* shape, float tx, float ty, float sx, float sy, int stroke)
 {
-	NSVGshape *shape = NULL;
 	NSVGedge *e = NULL;
-	NSVGcachedPaint cache;
 	int i;
 
+	nsvg__resetPool(r);
+	r->freelist = NULL;
+	r->nedges = 0;
+
+	if (stroke)
+		nsvg__flattenShapeStroke(r, shape, sx, sy);
+	else
+		nsvg__flattenShape(r, shape, sx, sy);
+
+//	dumpEdges(r, "edge.svg");
+
+	// Scale and translate edges
+	for (i = 0; i < r->nedges; i++) {
+		e = &r->edges[i];
+		e->x0 = tx + e->x0;
+		e->y0 = (ty + e->y0) * NSVG__SUBSAMPLES;
+		e->x1 = tx + e->x1;
+		e->y1 = (ty + e->y1) * NSVG__SUBSAMPLES;
+	}
+
+	// Rasterize edges
+	if (r->nedges != 0)
+		qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
+}
+
+// ControllerImage: each visible shape draws its fill pass, then its stroke pass.
+static int nsvg__hasFillPass(NSVGshape* shape)
+{
+	return (shape->flags & NSVG_FLAGS_VISIBLE) && shape->fill.type != NSVG_PAINT_NONE;
+}
+
+static int nsvg__hasStrokePass(NSVGshape* shape, float sx, float sy)
+{
+	float scale = sx > sy ? sx : sy;
+	return (shape->flags & NSVG_FLAGS_VISIBLE) && shape->stroke.type != NSVG_PAINT_NONE && (shape->strokeWidth * scale) > 0.01f;
+}
+
+static int nsvg__beginRasterize(NSVGrasterizer* r, unsigned char* dst, int w, int h, int stride)
+{
+	int i;
+
+	// ControllerImage: rasterize into scratch space if the output has smaller pixels than RGBA; 32-bit
+	// formats have room to rasterize in place, and get converted as they're unpremultiplied.
+	// Big images overflow an int here, so do the size in size_t, and fail if even that overflows (or if
+	// the scratch stride, w*4, won't fit in an int).
+	if (r->hasFormat && r->format.bytesPerPixel != 4) {
+		size_t size;
+		if (w <= 0 || h <= 0) return 0;
+		if ((size_t)w > ((size_t)0x7fffffff / 4) || (size_t)h > ((size_t)-1 / 4) / (size_t)w) return 0;
+		size = (size_t)w * (size_t)h * 4;
+		if (size > r->cconverted) {
+			unsigned char* converted = (unsigned char*)realloc(r->converted, size);
+			if (converted == NULL) return 0;
+			r->converted = converted;
+			r->cconverted = size;
+		}
+		r->output = dst;
+		r->outputStride = stride;
+		dst = r->converted;
+		stride = w*4;
+	}
+
 	r->bitmap = dst;
 	r->width = w;
 	r->height = h;
@@ -1384,76 +1760,181 @@ void nsvgRasterize(NSVGrasterizer* r,
 	if (w > r->cscanline) {
 		r->cscanline = w;
 		r->scanline = (unsigned char*)realloc(r->scanline, w);
-		if (r->scanline == NULL) return;
+		if (r->scanline == NULL) return 0;
 	}
 
-	for (i = 0; i < h; i++)
-		memset(&dst[i*stride], 0, w*4);
+	// ControllerImage: step a row pointer instead of multiplying, so big images don't overflow an int.
+	for (i = 0; i < h; i++, dst += stride)
+		memset(dst, 0, w*4);
 
-	for (shape = image->shapes; shape != NULL; shape = shape->next) {
-		if (!(shape->flags & NSVG_FLAGS_VISIBLE))
-			continue;
+	return 1;
+}
 
-		if (shape->fill.type != NSVG_PAINT_NONE) {
-			nsvg__resetPool(r);
-			r->freelist = NULL;
-			r->nedges = 0;
+static void nsvg__endRasterize(NSVGrasterizer* r, unsigned char* dst, int w, int h, int stride)
+{
+	if (r->hasFormat)
+		nsvg__unpremultiplyAlpha(r, r->bitmap, w, h, r->stride, dst, stride);  // r->bitmap is dst for 32-bit formats.
+	else
+		nsvg__unpremultiplyAlpha(r, dst, w, h, stride, NULL, 0);
 
-			nsvg__flattenShape(r, shape, scale);
+	r->output = NULL;
+	r->outputStride = 0;
+	r->bitmap = NULL;
+	r->width = 0;
+	r->height = 0;
+	r->stride = 0;
+}
 
-			// Scale and translate edges
-			for (i = 0; i < r->nedges; i++) {
-				e = &r->edges[i];
-				e->x0 = tx + e->x0;
-				e->y0 = (ty + e->y0) * NSVG__SUBSAMPLES;
-				e->x1 = tx + e->x1;
-				e->y1 = (ty + e->y1) * NSVG__SUBSAMPLES;
-			}
+void nsvgRasterize(NSVGrasterizer* r,
+				   NSVGimage* image, float tx, float ty, float scale,
+				   unsigned char* dst, int w, int h, int stride)
+{
+	nsvgRasterizeXY(r, image, tx, ty, scale, scale, dst, w, h, stride);
+}
 
-			// Rasterize edges
-			if (r->nedges != 0)
-				qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
+void nsvgRasterizeXY(NSVGrasterizer* r,
+				   NSVGimage* image, float tx, float ty, float sx, float sy,
+				   unsigned char* dst, int w, int h, int stride)
+{
+	NSVGshape *shape = NULL;
+	NSVGcachedPaint cache;
+
+	if (!nsvg__beginRasterize(r, dst, w, h, stride)) return;
+
+	for (shape = image->shapes; shape != NULL; shape = shape->next) {
+		if (nsvg__hasFillPass(shape)) {
+			nsvg__prepareEdges(r, shape, tx, ty, sx, sy, 0);
 
 			// now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
 			nsvg__initPaint(&cache, &shape->fill, shape->opacity);
 
-			nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, shape->fillRule);
+			nsvg__rasterizeSortedEdges(r, tx,ty,sx,sy, &cache, shape->fillRule);
 		}
-		if (shape->stroke.type != NSVG_PAINT_NONE && (shape->strokeWidth * scale) > 0.01f) {
-			nsvg__resetPool(r);
-			r->freelist = NULL;
-			r->nedges = 0;
-
-			nsvg__flattenShapeStroke(r, shape, scale);
-
-//			dumpEdges(r, "edge.svg");
-
-			// Scale and translate edges
-			for (i = 0; i < r->nedges; i++) {
-				e = &r->edges[i];
-				e->x0 = tx + e->x0;
-				e->y0 = (ty + e->y0) * NSVG__SUBSAMPLES;
-				e->x1 = tx + e->x1;
-				e->y1 = (ty + e->y1) * NSVG__SUBSAMPLES;
-			}
-
-			// Rasterize edges
-			if (r->nedges != 0)
-				qsort(r->edges, r->nedges, sizeof(NSVGedge), nsvg__cmpEdge);
+		if (nsvg__hasStrokePass(shape, sx, sy)) {
+			nsvg__prepareEdges(r, shape, tx, ty, sx, sy, 1);
 
 			// now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
 			nsvg__initPaint(&cache, &shape->stroke, shape->opacity);
 
-			nsvg__rasterizeSortedEdges(r, tx,ty,scale, &cache, NSVG_FILLRULE_NONZERO);
+			nsvg__rasterizeSortedEdges(r, tx,ty,sx,sy, &cache, NSVG_FILLRULE_NONZERO);
 		}
 	}
 
-	nsvg__unpremultiplyAlpha(dst, w, h, stride);
+	nsvg__endRasterize(r, dst, w, h, stride);
+}
 
-	r->bitmap = NULL;
-	r->width = 0;
-	r->height = 0;
-	r->stride = 0;
+// ControllerImage: edge caches.
+struct NSVGedgeCache
+{
+	float tx, ty, sx, sy;
+	int npasses;
+	int* passEdges;		// number of edges in each pass, in drawing order.
+	NSVGedge* edges;	// all passes' edges, back to back.
+	int nedges;
+};
+
+NSVGedgeCache* nsvgCreateEdgeCache(NSVGrasterizer* r, NSVGimage* image, float tx, float ty, float sx, float sy)
+{
+	NSVGshape *shape = NULL;
+	NSVGedgeCache* cache = NULL;
+	unsigned char* grown = NULL;
+	size_t headerlen = (sizeof(NSVGedgeCache) + 15) & ~((size_t)15);
+	size_t edgesofs = 0;
+	int npasses = 0, cedges = 0, pass = 0, stroke;
+
+	// counting passes doesn't flatten anything, and it puts the pass list ahead of the edges, so the edges
+	//  can grow at the end of the one allocation as each pass is flattened.
+	for (shape = image->shapes; shape != NULL; shape = shape->next) {
+		for (stroke = 0; stroke < 2; stroke++) {
+			if (stroke ? nsvg__hasStrokePass(shape, sx, sy) : nsvg__hasFillPass(shape))
+				npasses++;
+		}
+	}
+	edgesofs = (headerlen + sizeof(int)*npasses + 15) & ~((size_t)15);
+
+	cache = (NSVGedgeCache*)malloc(edgesofs);
+	if (cache == NULL) return NULL;
+	memset(cache, 0, sizeof(NSVGedgeCache));
+
+	for (shape = image->shapes; shape != NULL; shape = shape->next) {
+		for (stroke = 0; stroke < 2; stroke++) {
+			if (stroke ? nsvg__hasStrokePass(shape, sx, sy) : nsvg__hasFillPass(shape)) {
+				nsvg__prepareEdges(r, shape, tx, ty, sx, sy, stroke);
+				if (cache->nedges + r->nedges > cedges) {
+					cedges = cedges > 0 ? cedges * 2 : 64;
+					if (cedges < cache->nedges + r->nedges) cedges = cache->nedges + r->nedges;
+					grown = (unsigned char*)realloc(cache, edgesofs + sizeof(NSVGedge)*cedges);
+					if (grown == NULL) {
+						free(cache);
+						return NULL;
+					}
+					cache = (NSVGedgeCache*)grown;
+				}
+				cache->edges = (NSVGedge*)(((unsigned char*)cache) + edgesofs);
+				if (r->nedges != 0)
+					memcpy(&cache->edges[cache->nedges], r->edges, sizeof(NSVGedge)*r->nedges);
+				cache->nedges += r->nedges;
+				((int*)(((unsigned char*)cache) + headerlen))[pass++] = r->nedges;
+			}
+		}
+	}
+
+	// give back what doubling overshot; shrinking can't fail in practice, but keep the bigger block if it does.
+	if (cedges > cache->nedges) {
+		grown = (unsigned char*)realloc(cache, edgesofs + sizeof(NSVGedge)*cache->nedges);
+		if (grown != NULL) cache = (NSVGedgeCache*)grown;
+	}
+
+	cache->tx = tx;
+	cache->ty = ty;
+	cache->sx = sx;
+	cache->sy = sy;
+	cache->npasses = pass;
+	cache->passEdges = (int*)(((unsigned char*)cache) + headerlen);
+	cache->edges = (NSVGedge*)(((unsigned char*)cache) + edgesofs);
+
+	return cache;
+}
+
+void nsvgRasterizeEdgeCache(NSVGrasterizer* r,
+				   NSVGimage* image, NSVGedgeCache* cache,
+				   unsigned char* dst, int w, int h, int stride)
+{
+	NSVGshape *shape = NULL;
+	NSVGcachedPaint paint;
+	NSVGedge* edges = r->edges;
+	int nedges = r->nedges;
+	int pass = 0, offset = 0, stroke;
+	float tx = cache->tx, ty = cache->ty, sx = cache->sx, sy = cache->sy;
+
+	if (!nsvg__beginRasterize(r, dst, w, h, stride)) return;
+
+	// point the rasterizer at the cached edges for each pass instead of flattening again.
+	for (shape = image->shapes; shape != NULL; shape = shape->next) {
+		for (stroke = 0; stroke < 2; stroke++) {
+			if (stroke ? nsvg__hasStrokePass(shape, sx, sy) : nsvg__hasFillPass(shape)) {
+				if (pass >= cache->npasses) break;  // not the image this cache was made from!
+				nsvg__resetPool(r);
+				r->freelist = NULL;
+				r->edges = &cache->edges[offset];
+				r->nedges = cache->passEdges[pass];
+				offset += cache->passEdges[pass++];
+
+				nsvg__initPaint(&paint, stroke ? &shape->stroke : &shape->fill, shape->opacity);
+				nsvg__rasterizeSortedEdges(r, tx,ty,sx,sy, &paint, stroke ? NSVG_FILLRULE_NONZERO : shape->fillRule);
+			}
+		}
+	}
+
+	r->edges = edges;
+	r->nedges = nedges;
+
+	nsvg__endRasterize(r, dst, w, h, stride);
+}
+
+void nsvgDeleteEdgeCache(NSVGedgeCache* cache)
+{
+	if (cache) free(cache);
 }
 
 #endif // NANOSVGRAST_IMPLEMENTATION
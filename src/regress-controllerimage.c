@@ -0,0 +1,798 @@
+/*
+ * ControllerImage; A simple way to obtain game controller images.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ *
+ *  This file written by Ryan C. Gordon.
+ */
+
+// This renders every image for every device type at a list of sizes, without
+//  a window or renderer, and compares the pixels against a golden file, so
+//  changes to the rasterizer (or the parser, or the data tool) can't quietly
+//  change the output. It times every image too, and can compare those times
+//  to an earlier run, so you can see what an optimization did per glyph.
+//
+// The golden file has a hash of each image's pixels and a tiny thumbnail
+//  (the average color of each cell in a 4x4 grid). If the hash matches, the
+//  image is identical. If it doesn't, the image still passes if no thumbnail
+//  cell moved more than --tolerance, since a different compiler or CPU can
+//  round a few edge pixels differently without anything actually being wrong.
+//
+// Run it from a directory with the .bin files in it (what
+//  make-controllerimage-data produces), and point it at the art directory so
+//  it knows what device types to try.
+//
+// It also rasterizes the gradient-heavy test art in test/art/gradients, since
+//  the shipping art barely uses gradients. Those show up in the golden file
+//  as a device type called "gradients", one glyph per SVG.
+
+#include <stdio.h>
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h>
+#include "controllerimage.h"
+
+// we call into the library's copy of nanosvg directly for the gradient test art.
+#define NANOSVG_SKIP_STDC_HEADERS 1
+#define NANOSVG_SKIP_STDIO 1
+#include "nanosvg.h"
+#include "nanosvgrast.h"
+
+#define THUMBNAIL_GRID 4
+#define THUMBNAIL_BYTES (THUMBNAIL_GRID * THUMBNAIL_GRID * 4)
+
+typedef struct Result
+{
+    char device_type[64];
+    char glyph[32];  // what SDL_GetGamepadStringForButton() or SDL_GetGamepadStringForAxis() calls it.
+    int size;
+    Uint64 hash;
+    Uint8 thumbnail[THUMBNAIL_BYTES];
+    Uint64 *samples;  // nanoseconds per sample, for this run's results only.
+    Uint64 median_ns;
+    bool seen;  // for golden/baseline entries: did this run produce it, too?
+} Result;
+
+static char **device_types = NULL;
+static int num_device_types = 0;
+static int iterations = 5;
+static int tolerance = 4;
+static double threshold = 10.0;
+static Result *results = NULL;
+static int num_results = 0;
+static char **gradient_files = NULL;
+static int num_gradient_files = 0;
+
+static SDL_EnumerationResult SDLCALL collect_device_type(void *userdata, const char *dirname, const char *fname)
+{
+    for (int i = 0; i < num_device_types; i++) {
+        if (SDL_strcmp(device_types[i], fname) == 0) {
+            return SDL_ENUM_CONTINUE;  // already have it from another theme.
+        }
+    }
+
+    void *ptr = SDL_realloc(device_types, (num_device_types + 1) * sizeof (char *));
+    if (!ptr) {
+        return SDL_ENUM_FAILURE;
+    }
+    device_types = (char **) ptr;
+    device_types[num_device_types] = SDL_strdup(fname);
+    if (!device_types[num_device_types]) {
+        return SDL_ENUM_FAILURE;
+    }
+    num_device_types++;
+    return SDL_ENUM_CONTINUE;
+}
+
+static SDL_EnumerationResult SDLCALL collect_theme(void *userdata, const char *dirname, const char *fname)
+{
+    char *path = NULL;
+    if (SDL_asprintf(&path, "%s%s/gamepad", dirname, fname) < 0) {
+        return SDL_ENUM_FAILURE;
+    }
+
+    SDL_PathInfo info;
+    if (SDL_GetPathInfo(path, &info) && (info.type == SDL_PATHTYPE_DIRECTORY)) {
+        SDL_EnumerateDirectory(path, collect_device_type, NULL);
+    }
+    SDL_free(path);
+    return SDL_ENUM_CONTINUE;
+}
+
+static int SDLCALL compare_strings(const void *a, const void *b)
+{
+    return SDL_strcmp(*(const char **) a, *(const char **) b);
+}
+
+static int SDLCALL compare_results(const void *a, const void *b)
+{
+    const Result *resulta = (const Result *) a;
+    const Result *resultb = (const Result *) b;
+    int cmp = SDL_strcmp(resulta->device_type, resultb->device_type);
+    if (cmp == 0) {
+        cmp = (resulta->size < resultb->size) ? -1 : (resulta->size > resultb->size) ? 1 : 0;
+    }
+    if (cmp == 0) {
+        cmp = SDL_strcmp(resulta->glyph, resultb->glyph);
+    }
+    return cmp;
+}
+
+static int SDLCALL compare_ns(const void *a, const void *b)
+{
+    const Uint64 nsa = *(const Uint64 *) a;
+    const Uint64 nsb = *(const Uint64 *) b;
+    return (nsa < nsb) ? -1 : (nsa > nsb) ? 1 : 0;
+}
+
+static Uint64 hash_pixels(const SDL_Surface *surface)
+{
+    Uint64 hash = 0xcbf29ce484222325ull;  // FNV-1a
+    for (int y = 0; y < surface->h; y++) {
+        const Uint8 *row = ((const Uint8 *) surface->pixels) + (y * surface->pitch);
+        for (int i = 0; i < (surface->w * 4); i++) {
+            hash = (hash ^ row[i]) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+// the average of each RGBA channel in each cell of a THUMBNAIL_GRID x THUMBNAIL_GRID grid.
+static void make_thumbnail(const SDL_Surface *surface, Uint8 *thumbnail)
+{
+    for (int celly = 0; celly < THUMBNAIL_GRID; celly++) {
+        const int y0 = (celly * surface->h) / THUMBNAIL_GRID;
+        const int y1 = ((celly + 1) * surface->h) / THUMBNAIL_GRID;
+        for (int cellx = 0; cellx < THUMBNAIL_GRID; cellx++) {
+            const int x0 = (cellx * surface->w) / THUMBNAIL_GRID;
+            const int x1 = ((cellx + 1) * surface->w) / THUMBNAIL_GRID;
+            Uint64 sums[4] = { 0, 0, 0, 0 };
+            for (int y = y0; y < y1; y++) {
+                const Uint8 *pixel = ((const Uint8 *) surface->pixels) + (y * surface->pitch) + (x0 * 4);
+                for (int x = x0; x < x1; x++, pixel += 4) {
+                    sums[0] += pixel[0];
+                    sums[1] += pixel[1];
+                    sums[2] += pixel[2];
+                    sums[3] += pixel[3];
+                }
+            }
+            const Uint64 count = (Uint64) (y1 - y0) * (Uint64) (x1 - x0);
+            Uint8 *cell = &thumbnail[((celly * THUMBNAIL_GRID) + cellx) * 4];
+            for (int i = 0; i < 4; i++) {
+                cell[i] = count ? (Uint8) ((sums[i] + (count / 2)) / count) : 0;
+            }
+        }
+    }
+}
+
+static Result *add_result(const char *device_type, const char *glyph, int size)
+{
+    void *ptr = SDL_realloc(results, (num_results + 1) * sizeof (Result));
+    if (!ptr) {
+        return NULL;
+    }
+    results = (Result *) ptr;
+
+    Result *result = &results[num_results];
+    SDL_zerop(result);
+    SDL_strlcpy(result->device_type, device_type, sizeof (result->device_type));
+    SDL_strlcpy(result->glyph, glyph, sizeof (result->glyph));
+    result->size = size;
+    result->samples = (Uint64 *) SDL_calloc(iterations, sizeof (Uint64));
+    if (!result->samples) {
+        return NULL;
+    }
+    num_results++;
+    return result;
+}
+
+static Result *find_result(Result *list, int count, const char *device_type, const char *glyph, int size)
+{
+    Result key;
+    SDL_zero(key);
+    SDL_strlcpy(key.device_type, device_type, sizeof (key.device_type));
+    SDL_strlcpy(key.glyph, glyph, sizeof (key.glyph));
+    key.size = size;
+    return (Result *) SDL_bsearch(&key, list, count, sizeof (Result), compare_results);
+}
+
+// `iteration` is which sample this is. The first one sets the result's hash and thumbnail, and every later one has
+//  to match it exactly, since those come from the library's caches instead of starting over.
+static bool record_sample(ControllerImage_Device *device, const char *device_type, int size, bool is_axis, int which, int iteration, int *_index)
+{
+    const char *glyph = is_axis ? SDL_GetGamepadStringForAxis((SDL_GamepadAxis) which) : SDL_GetGamepadStringForButton((SDL_GamepadButton) which);
+    const bool has_art = is_axis ? ControllerImage_DeviceHasArtworkForAxis(device, (SDL_GamepadAxis) which) : ControllerImage_DeviceHasArtworkForButton(device, (SDL_GamepadButton) which);
+    if (!glyph || !has_art) {
+        return true;  // nothing to test here.
+    }
+
+    Result *result = NULL;
+    if (iteration == 0) {
+        result = add_result(device_type, glyph, size);
+        if (!result) {
+            SDL_Log("Out of memory!");
+            return false;
+        }
+    } else {
+        result = &results[*_index];
+    }
+    (*_index)++;
+
+    const Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Surface *surface = is_axis ? ControllerImage_CreateSurfaceForAxis(device, (SDL_GamepadAxis) which, size) : ControllerImage_CreateSurfaceForButton(device, (SDL_GamepadButton) which, size);
+    const Uint64 now = SDL_GetPerformanceCounter();
+    if (!surface) {
+        SDL_Log("Couldn't render '%s' for '%s' at %d pixels: %s", glyph, device_type, size, SDL_GetError());
+        return false;
+    }
+
+    result->samples[iteration] = ((now - start) * SDL_NS_PER_SECOND) / SDL_GetPerformanceFrequency();
+
+    const Uint64 hash = hash_pixels(surface);
+    bool okay = true;
+    if (iteration == 0) {
+        result->hash = hash;
+        make_thumbnail(surface, result->thumbnail);
+    } else if (hash != result->hash) {
+        SDL_Log("'%s' for '%s' at %d pixels changed between iterations (%016" SDL_PRIx64 " on the first, %016" SDL_PRIx64 " on #%d)",
+                glyph, device_type, size, result->hash, hash, iteration + 1);
+        okay = false;
+    }
+
+    SDL_DestroySurface(surface);
+    return okay;
+}
+
+static SDL_EnumerationResult SDLCALL collect_gradient_file(void *userdata, const char *dirname, const char *fname)
+{
+    const size_t fnamelen = SDL_strlen(fname);
+    if ((fnamelen < 4) || (SDL_strcasecmp(fname + (fnamelen - 4), ".svg") != 0)) {
+        return SDL_ENUM_CONTINUE;
+    }
+
+    void *ptr = SDL_realloc(gradient_files, (num_gradient_files + 1) * sizeof (char *));
+    if (!ptr) {
+        return SDL_ENUM_FAILURE;
+    }
+    gradient_files = (char **) ptr;
+    gradient_files[num_gradient_files] = SDL_strdup(fname);
+    if (!gradient_files[num_gradient_files]) {
+        return SDL_ENUM_FAILURE;
+    }
+    num_gradient_files++;
+    return SDL_ENUM_CONTINUE;
+}
+
+static bool render_gradient_file(NSVGrasterizer *rasterizer, const char *dir, const char *fname, const int *sizes, int num_sizes)
+{
+    char *path = NULL;
+    if (SDL_asprintf(&path, "%s/%s", dir, fname) < 0) {
+        SDL_Log("Out of memory!");
+        return false;
+    }
+
+    size_t svglen = 0;
+    char *svg = (char *) SDL_LoadFile(path, &svglen);
+    if (!svg) {
+        SDL_Log("Couldn't load '%s': %s", path, SDL_GetError());
+        SDL_free(path);
+        return false;
+    }
+
+    NSVGimage *image = nsvgParseConst(svg, svglen, "px", 96.0f);
+    if (!image || (image->width <= 0.0f)) {
+        SDL_Log("Couldn't parse '%s'", path);
+        nsvgDelete(image);
+        SDL_free(svg);
+        SDL_free(path);
+        return false;
+    }
+
+    char glyph[32];  // the file name without the ".svg"
+    SDL_strlcpy(glyph, fname, SDL_min(sizeof (glyph), SDL_strlen(fname) - 3));
+
+    bool okay = true;
+    for (int i = 0; okay && (i < num_sizes); i++) {
+        const int size = sizes[i];
+        Result *result = add_result("gradients", glyph, size);
+        SDL_Surface *surface = result ? SDL_CreateSurface(size, size, SDL_PIXELFORMAT_RGBA32) : NULL;
+        if (!surface) {
+            SDL_Log("Out of memory!");
+            okay = false;
+            break;
+        }
+
+        for (int iteration = 0; okay && (iteration < iterations); iteration++) {
+            const Uint64 start = SDL_GetPerformanceCounter();
+            nsvgRasterize(rasterizer, image, 0.0f, 0.0f, ((float) size) / image->width, (unsigned char *) surface->pixels, size, size, surface->pitch);
+            const Uint64 now = SDL_GetPerformanceCounter();
+            result->samples[iteration] = ((now - start) * SDL_NS_PER_SECOND) / SDL_GetPerformanceFrequency();
+
+            const Uint64 hash = hash_pixels(surface);
+            if (iteration == 0) {
+                result->hash = hash;
+                make_thumbnail(surface, result->thumbnail);
+            } else if (hash != result->hash) {
+                SDL_Log("'%s' at %d pixels changed between iterations", fname, size);
+                okay = false;
+            }
+        }
+        SDL_DestroySurface(surface);
+    }
+
+    nsvgDelete(image);
+    SDL_free(svg);
+    SDL_free(path);
+    return okay;
+}
+
+static bool render_gradients(const char *dir, const int *sizes, int num_sizes)
+{
+    char *path = NULL;
+    if (SDL_asprintf(&path, "%s/", dir) < 0) {
+        SDL_Log("Out of memory!");
+        return false;
+    }
+    SDL_EnumerateDirectory(path, collect_gradient_file, NULL);
+    SDL_free(path);
+
+    if (num_gradient_files == 0) {
+        // not fatal; if the golden file has them, they'll show up as missing.
+        SDL_Log("Didn't find any gradient test art in '%s'; use --gradients to point at it.", dir);
+        return true;
+    }
+
+    SDL_qsort(gradient_files, num_gradient_files, sizeof (char *), compare_strings);
+
+    NSVGrasterizer *rasterizer = nsvgCreateRasterizer();
+    if (!rasterizer) {
+        SDL_Log("Out of memory!");
+        return false;
+    }
+
+    bool okay = true;
+    for (int i = 0; okay && (i < num_gradient_files); i++) {
+        okay = render_gradient_file(rasterizer, dir, gradient_files[i], sizes, num_sizes);
+    }
+
+    nsvgDeleteRasterizer(rasterizer);
+    return okay;
+}
+
+// this does the gradient test art too, since it sorts and finishes off every result at the end.
+static bool render_everything(const char *gradientdir, const int *sizes, int num_sizes)
+{
+    if (!render_gradients(gradientdir, sizes, num_sizes)) {
+        return false;
+    }
+
+    for (int i = 0; i < num_device_types; i++) {
+        const char *device_type = device_types[i];
+
+        // one device for every size and pass, the way an app would use it: the first pass parses and renders from
+        //  scratch, and the later ones go through the library's caches, which have to give the same pixels.
+        ControllerImage_Device *device = ControllerImage_CreateGamepadDeviceByIdString(device_type);
+        if (!device) {  // nothing in the loaded data for this one, probably.
+            SDL_Log("Skipping '%s': %s", device_type, SDL_GetError());
+            continue;
+        }
+
+        bool okay = true;
+        for (int j = 0; okay && (j < num_sizes); j++) {
+            const int first = num_results;
+            for (int iteration = 0; okay && (iteration < iterations); iteration++) {
+                int index = first;
+                for (int k = 0; okay && (k < (int) SDL_GAMEPAD_BUTTON_COUNT); k++) {
+                    okay = record_sample(device, device_type, sizes[j], false, k, iteration, &index);
+                }
+                for (int k = 0; okay && (k < (int) SDL_GAMEPAD_AXIS_COUNT); k++) {
+                    okay = record_sample(device, device_type, sizes[j], true, k, iteration, &index);
+                }
+            }
+        }
+
+        ControllerImage_DestroyDevice(device);
+        if (!okay) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < num_results; i++) {
+        Result *result = &results[i];
+        SDL_qsort(result->samples, iterations, sizeof (Uint64), compare_ns);
+        result->median_ns = result->samples[iterations / 2];
+    }
+
+    SDL_qsort(results, num_results, sizeof (Result), compare_results);
+    return true;
+}
+
+// reads a golden file (hashes and thumbnails) or a timings file (medians), sorted for find_result().
+static Result *load_results(const char *fname, bool timings, int *_count)
+{
+    size_t len = 0;
+    char *data = (char *) SDL_LoadFile(fname, &len);
+    if (!data) {
+        return NULL;
+    }
+
+    Result *list = NULL;
+    int count = 0;
+    int lineno = 0;
+    char *saveptr = NULL;
+    for (char *line = SDL_strtok_r(data, "\r\n", &saveptr); line; line = SDL_strtok_r(NULL, "\r\n", &saveptr)) {
+        lineno++;
+        if ((*line == '#') || (*line == '\0')) {
+            continue;
+        }
+
+        Result result;
+        char number[32];
+        char thumbnail[(THUMBNAIL_BYTES * 2) + 1];
+        SDL_zero(result);
+        SDL_zero(thumbnail);
+        const int fields = SDL_sscanf(line, "%63s %31s %d %31s %128s", result.device_type, result.glyph, &result.size, number, thumbnail);
+        if ((fields != (timings ? 4 : 5)) || (!timings && (SDL_strlen(thumbnail) != (THUMBNAIL_BYTES * 2)))) {
+            SDL_SetError("%s:%d: Malformed line", fname, lineno);
+            SDL_free(list);
+            SDL_free(data);
+            return NULL;
+        }
+
+        if (timings) {
+            result.median_ns = (Uint64) SDL_strtoull(number, NULL, 10);
+        } else {
+            result.hash = (Uint64) SDL_strtoull(number, NULL, 16);
+            for (int i = 0; i < THUMBNAIL_BYTES; i++) {
+                const char hex[3] = { thumbnail[i * 2], thumbnail[(i * 2) + 1], '\0' };
+                result.thumbnail[i] = (Uint8) SDL_strtoul(hex, NULL, 16);
+            }
+        }
+
+        void *ptr = SDL_realloc(list, (count + 1) * sizeof (Result));
+        if (!ptr) {
+            SDL_free(list);
+            SDL_free(data);
+            return NULL;
+        }
+        list = (Result *) ptr;
+        SDL_copyp(&list[count++], &result);
+    }
+
+    SDL_free(data);
+    SDL_qsort(list, count, sizeof (Result), compare_results);
+    *_count = count;
+    return list;
+}
+
+static bool write_golden(const char *fname)
+{
+    SDL_IOStream *io = SDL_IOFromFile(fname, "w");
+    if (!io) {
+        return false;
+    }
+
+    SDL_IOprintf(io, "# regress-controllerimage golden file: device_type glyph size hash thumbnail\n");
+    for (int i = 0; i < num_results; i++) {
+        const Result *result = &results[i];
+        SDL_IOprintf(io, "%s %s %d %016" SDL_PRIx64 " ", result->device_type, result->glyph, result->size, result->hash);
+        for (int j = 0; j < THUMBNAIL_BYTES; j++) {
+            SDL_IOprintf(io, "%02x", (unsigned int) result->thumbnail[j]);
+        }
+        SDL_IOprintf(io, "\n");
+    }
+
+    return SDL_CloseIO(io);
+}
+
+static bool write_timings(const char *fname)
+{
+    SDL_IOStream *io = SDL_IOFromFile(fname, "w");
+    if (!io) {
+        return false;
+    }
+
+    SDL_IOprintf(io, "# regress-controllerimage timings: device_type glyph size median_ns\n");
+    for (int i = 0; i < num_results; i++) {
+        const Result *result = &results[i];
+        SDL_IOprintf(io, "%s %s %d %" SDL_PRIu64 "\n", result->device_type, result->glyph, result->size, result->median_ns);
+    }
+
+    return SDL_CloseIO(io);
+}
+
+// returns the number of failures.
+static int compare_golden(Result *golden, int num_golden)
+{
+    int identical = 0;
+    int close_enough = 0;
+    int failed = 0;
+    int missing = 0;
+    int added = 0;
+
+    for (int i = 0; i < num_results; i++) {
+        const Result *result = &results[i];
+        Result *expected = find_result(golden, num_golden, result->device_type, result->glyph, result->size);
+        if (!expected) {
+            printf("NEW      %s %s %d\n", result->device_type, result->glyph, result->size);
+            added++;
+            continue;
+        }
+
+        expected->seen = true;
+        if (expected->hash == result->hash) {
+            identical++;
+            continue;
+        }
+
+        int worst = 0;
+        for (int j = 0; j < THUMBNAIL_BYTES; j++) {
+            worst = SDL_max(worst, SDL_abs(((int) expected->thumbnail[j]) - ((int) result->thumbnail[j])));
+        }
+
+        if (worst <= tolerance) {
+            printf("CLOSE    %s %s %d (off by %d)\n", result->device_type, result->glyph, result->size, worst);
+            close_enough++;
+        } else {
+            printf("FAILED   %s %s %d (off by %d)\n", result->device_type, result->glyph, result->size, worst);
+            failed++;
+        }
+    }
+
+    for (int i = 0; i < num_golden; i++) {
+        const Result *expected = &golden[i];
+        if (!expected->seen) {
+            printf("MISSING  %s %s %d\n", expected->device_type, expected->glyph, expected->size);
+            missing++;
+        }
+    }
+
+    printf("\n%d identical, %d within tolerance %d, %d failed, %d missing, %d not in the golden file.\n",
+           identical, close_enough, tolerance, failed, missing, added);
+
+    return failed + missing;
+}
+
+typedef struct Delta
+{
+    const Result *result;
+    Uint64 baseline_ns;
+    double percent;
+} Delta;
+
+static int SDLCALL compare_deltas(const void *a, const void *b)
+{
+    // biggest change first, faster or slower.
+    const double deltaa = SDL_fabs(((const Delta *) a)->percent);
+    const double deltab = SDL_fabs(((const Delta *) b)->percent);
+    return (deltaa > deltab) ? -1 : (deltaa < deltab) ? 1 : 0;
+}
+
+static void compare_timings(Result *baseline, int num_baseline)
+{
+    Delta *deltas = (Delta *) SDL_calloc(num_results ? num_results : 1, sizeof (Delta));
+    if (!deltas) {
+        SDL_Log("Out of memory!");
+        return;
+    }
+
+    Uint64 total_now = 0;
+    Uint64 total_then = 0;
+    int num_deltas = 0;
+    for (int i = 0; i < num_results; i++) {
+        const Result *result = &results[i];
+        const Result *then = find_result(baseline, num_baseline, result->device_type, result->glyph, result->size);
+        if (then && then->median_ns) {
+            total_now += result->median_ns;
+            total_then += then->median_ns;
+            const double percent = ((((double) result->median_ns) - ((double) then->median_ns)) * 100.0) / ((double) then->median_ns);
+            if (SDL_fabs(percent) >= threshold) {
+                deltas[num_deltas].percent = percent;
+                deltas[num_deltas].result = result;
+                deltas[num_deltas].baseline_ns = then->median_ns;
+                num_deltas++;
+            }
+        }
+    }
+
+    SDL_qsort(deltas, num_deltas, sizeof (Delta), compare_deltas);
+
+    printf("\n%-20s %-14s %5s %12s %12s %8s\n", "device", "glyph", "size", "baseline", "now", "change");
+    for (int i = 0; i < num_deltas; i++) {
+        const Delta *delta = &deltas[i];
+        printf("%-20s %-14s %5d %10.1fus %10.1fus %+7.1f%%\n", delta->result->device_type, delta->result->glyph, delta->result->size,
+               ((double) delta->baseline_ns) / 1000.0, ((double) delta->result->median_ns) / 1000.0, delta->percent);
+    }
+
+    if (total_then) {
+        printf("\n%d glyphs changed by %.0f%% or more. All glyphs together: %.2fms then, %.2fms now (%+.1f%%).\n",
+               num_deltas, threshold, ((double) total_then) / 1000000.0, ((double) total_now) / 1000000.0,
+               ((((double) total_now) - ((double) total_then)) * 100.0) / ((double) total_then));
+    } else {
+        printf("\nNothing in the baseline matches this run.\n");
+    }
+
+    SDL_free(deltas);
+}
+
+static int usage(const char *argv0)
+{
+    SDL_Log("USAGE: %s [--art dir] [--gradients dir] [--sizes N[,N...]] [--iterations N] [--golden fname] [--tolerance N] [--write-golden fname] [--timings fname] [--baseline fname] [--threshold percent] [database.bin...]", argv0);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *artdir = "art";
+    const char *gradientdir = "test/art/gradients";
+    const char *golden_fname = NULL;
+    const char *write_golden_fname = NULL;
+    const char *timings_fname = NULL;
+    const char *baseline_fname = NULL;
+    const char **data_fnames = NULL;
+    int num_data_fnames = 0;
+    int sizes[32];
+    int num_sizes = 0;
+    Result *golden = NULL;
+    int num_golden = 0;
+    Result *baseline = NULL;
+    int num_baseline = 0;
+    int retval = 1;
+
+    data_fnames = (const char **) SDL_calloc(argc + 1, sizeof (const char *));
+    if (!data_fnames) {
+        SDL_Log("Out of memory!");
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (*arg != '-') {
+            data_fnames[num_data_fnames++] = arg;
+            continue;
+        }
+
+        while (*arg == '-') { arg++; }
+        if (argv[i + 1] == NULL) {
+            SDL_free(data_fnames);
+            return usage(argv[0]);
+        } else if (SDL_strcmp(arg, "art") == 0) {
+            artdir = argv[++i];
+        } else if (SDL_strcmp(arg, "gradients") == 0) {
+            gradientdir = argv[++i];
+        } else if (SDL_strcmp(arg, "sizes") == 0) {
+            const char *ptr = argv[++i];
+            num_sizes = 0;
+            while (*ptr) {
+                char *endp = NULL;
+                const long size = SDL_strtol(ptr, &endp, 10);
+                if ((endp == ptr) || (size <= 0) || (size > 16384) || ((*endp != ',') && (*endp != '\0')) || (num_sizes >= (int) SDL_arraysize(sizes))) {
+                    SDL_free(data_fnames);
+                    return usage(argv[0]);
+                }
+                sizes[num_sizes++] = (int) size;
+                ptr = (*endp == ',') ? (endp + 1) : endp;
+            }
+        } else if (SDL_strcmp(arg, "iterations") == 0) {
+            iterations = (int) SDL_strtol(argv[++i], NULL, 10);
+            if (iterations <= 0) {
+                SDL_free(data_fnames);
+                return usage(argv[0]);
+            }
+        } else if (SDL_strcmp(arg, "golden") == 0) {
+            golden_fname = argv[++i];
+        } else if (SDL_strcmp(arg, "tolerance") == 0) {
+            tolerance = (int) SDL_strtol(argv[++i], NULL, 10);
+        } else if (SDL_strcmp(arg, "write-golden") == 0) {
+            write_golden_fname = argv[++i];
+        } else if (SDL_strcmp(arg, "timings") == 0) {
+            timings_fname = argv[++i];
+        } else if (SDL_strcmp(arg, "baseline") == 0) {
+            baseline_fname = argv[++i];
+        } else if (SDL_strcmp(arg, "threshold") == 0) {
+            threshold = SDL_strtod(argv[++i], NULL);
+        } else {
+            SDL_free(data_fnames);
+            return usage(argv[0]);
+        }
+    }
+
+    if (num_sizes == 0) {  // the golden file in test/golden was made with these.
+        sizes[num_sizes++] = 32;
+        sizes[num_sizes++] = 128;
+    }
+
+    if (num_data_fnames == 0) {
+        data_fnames[num_data_fnames++] = "controllerimage-standard.bin";
+    }
+
+    if (!SDL_Init(0)) {
+        SDL_Log("SDL_Init failed: %s", SDL_GetError());
+        SDL_free(data_fnames);
+        return 1;
+    }
+
+    char *artpath = NULL;
+    if (SDL_asprintf(&artpath, "%s/", artdir) < 0) {
+        goto done;
+    }
+    SDL_EnumerateDirectory(artpath, collect_theme, NULL);
+    SDL_free(artpath);
+
+    if (num_device_types == 0) {
+        SDL_Log("Didn't find any device types in '%s'; use --art to point at the art directory.", artdir);
+        goto done;
+    }
+
+    SDL_qsort(device_types, num_device_types, sizeof (char *), compare_strings);
+
+    // load these before doing any work, so a typo doesn't cost a whole run.
+    if (golden_fname && ((golden = load_results(golden_fname, false, &num_golden)) == NULL)) {
+        SDL_Log("Couldn't load '%s': %s", golden_fname, SDL_GetError());
+        goto done;
+    } else if (baseline_fname && ((baseline = load_results(baseline_fname, true, &num_baseline)) == NULL)) {
+        SDL_Log("Couldn't load '%s': %s", baseline_fname, SDL_GetError());
+        goto done;
+    }
+
+    if (!ControllerImage_Init()) {
+        SDL_Log("ControllerImage_Init failed: %s", SDL_GetError());
+        goto done;
+    }
+
+    // later files are overlays on earlier ones, just like loading them at runtime.
+    for (int i = 0; i < num_data_fnames; i++) {
+        if (!ControllerImage_AddDataFromFile(data_fnames[i])) {
+            SDL_Log("Couldn't load '%s': %s", data_fnames[i], SDL_GetError());
+            goto done;
+        }
+    }
+
+    if (!render_everything(gradientdir, sizes, num_sizes)) {
+        goto done;
+    }
+
+    Uint64 total_ns = 0;
+    for (int i = 0; i < num_results; i++) {
+        total_ns += results[i].median_ns;
+    }
+    printf("Rendered %d images (%d device types, %d sizes), %d iterations each; %.2fms per pass.\n",
+           num_results, num_device_types, num_sizes, iterations, ((double) total_ns) / 1000000.0);
+
+    if (write_golden_fname && !write_golden(write_golden_fname)) {
+        SDL_Log("Couldn't write '%s': %s", write_golden_fname, SDL_GetError());
+        goto done;
+    } else if (timings_fname && !write_timings(timings_fname)) {
+        SDL_Log("Couldn't write '%s': %s", timings_fname, SDL_GetError());
+        goto done;
+    }
+
+    if (baseline) {
+        compare_timings(baseline, num_baseline);
+    }
+
+    retval = 0;
+    if (golden && (compare_golden(golden, num_golden) > 0)) {
+        retval = 1;
+    }
+
+done:
+    ControllerImage_Quit();
+    for (int i = 0; i < num_results; i++) {
+        SDL_free(results[i].samples);
+    }
+    SDL_free(results);
+    for (int i = 0; i < num_device_types; i++) {
+        SDL_free(device_types[i]);
+    }
+    SDL_free(device_types);
+    for (int i = 0; i < num_gradient_files; i++) {
+        SDL_free(gradient_files[i]);
+    }
+    SDL_free(gradient_files);
+    SDL_free(golden);
+    SDL_free(baseline);
+    SDL_free(data_fnames);
+    SDL_Quit();
+    return retval;
+}
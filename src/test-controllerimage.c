@@ -267,9 +267,7 @@ static void update_gamepad_textures(SDL_PropertiesID gamepad_props, const int ne
         } else if (i == SDL_GAMEPAD_BUTTON_TOUCHPAD) {
             thissize *= 3;
         }
-        SDL_Surface *surf = ControllerImage_CreateSurfaceForButton(imgdev, i, thissize);
-        SDL_Texture *tex = surf ? SDL_CreateTextureFromSurface(renderer, surf) : NULL;
-        SDL_DestroySurface(surf);
+        SDL_Texture *tex = ControllerImage_CreateTextureForButton(renderer, imgdev, i, thissize);
         SDL_snprintf(propname, sizeof (propname), PROP_TEXBUTTON_FMT, (int) i);
         SDL_SetPointerPropertyWithCleanup(gamepad_props, propname, tex, cleanup_texture, NULL);
     }
@@ -279,9 +277,7 @@ static void update_gamepad_textures(SDL_PropertiesID gamepad_props, const int ne
         if ((i != SDL_GAMEPAD_AXIS_LEFT_TRIGGER) && (i != SDL_GAMEPAD_AXIS_RIGHT_TRIGGER)) {
             thissize *= 2;
         }
-        SDL_Surface *surf = ControllerImage_CreateSurfaceForAxis(imgdev, i, thissize);
-        SDL_Texture *tex = surf ? SDL_CreateTextureFromSurface(renderer, surf) : NULL;
-        SDL_DestroySurface(surf);
+        SDL_Texture *tex = ControllerImage_CreateTextureForAxis(renderer, imgdev, i, thissize);
         SDL_snprintf(propname, sizeof (propname), PROP_TEXAXIS_FMT, (int) i);
         SDL_SetPointerPropertyWithCleanup(gamepad_props, propname, tex, cleanup_texture, NULL);
     }